@@ -4,10 +4,37 @@
 #include "stdafx.h"
 #include "optionparser.h"
 #include <iostream>
+#include <csignal>
 #include "ellipseParameters.h"
 #include "ellipseUtils.h"
 #include "testcases.h"
 #include "leastSquareEllipseFit.h"
+#include "constrainedLeastSquareEllipseFit.h"
+#include "concentricEllipseFit.h"
+#include "ellipseMixtureFit.h"
+#include "ellipseGeometry.h"
+#include "ellipseOverlap.h"
+#include "textPointReader.h"
+#include "pointFileReader.h"
+#include "npyFile.h"
+#include "binaryPointFile.h"
+#include "compressedPointFile.h"
+#include "pointArchive.h"
+#include "directoryListing.h"
+#include "resultWriter.h"
+#include "rasterRenderer.h"
+#include "outOfCoreFit.h"
+#include "workStealingThreadPool.h"
+#include "batchFitPipeline.h"
+#include "boundedQueue.h"
+#include "streamFitService.h"
+#include "fitServer.h"
+#include "sharedRingFit.h"
+#include "ellipseFitApi.h"
+#include "momentSummary.h"
+#include "resultCache.h"
+#include "directoryWatcher.h"
+#include "batchJournal.h"
 #include "writeSVG.h"
 
 using namespace EllipseUtils;
@@ -66,7 +93,7 @@ static std::string GenerateFilenameForSvg(const char* szFilename, int i)
 	return oss.str();
 }
 
-static bool TestEllipseFrom5Points(const char* szFilename)
+static bool TestEllipseFrom5Points(const char* szFilename, ResultWriter* results)
 {
 	bool allOk = true;
 	for (int i = 0; ; ++i)
@@ -83,6 +110,10 @@ static bool TestEllipseFrom5Points(const char* szFilename)
 		bool isOk = IsResultOk(pTestData, ellParams);
 
 		printf("x0=%lf y0=%lf a=%lf b=%lf angle=%lf <- %s\n", ellParams.x0, ellParams.y0, ellParams.a, ellParams.b, radToDegree(ellParams.theta), isOk ? "OK" : "FAIL");
+		if (results != nullptr)
+		{
+			results->Write(FitResult{ (uint64_t)i, nullptr, 5, ellParams });
+		}
 
 		if (!isOk)
 		{
@@ -116,7 +147,7 @@ static bool TestEllipseFrom5Points(const char* szFilename)
 }
 
 
-static bool TestLeastSquareFit()
+static bool TestLeastSquareFit(ResultWriter* results)
 {
 	bool allOk = true;
 
@@ -134,6 +165,10 @@ static bool TestLeastSquareFit()
 
 		bool isOk = IsResultOk(testParams, ellParams);
 		printf("x0=%lf y0=%lf a=%lf b=%lf angle=%lf <- %s\n", ellParams.x0, ellParams.y0, ellParams.a, ellParams.b, radToDegree(ellParams.theta), isOk ? "OK" : "FAIL");
+		if (results != nullptr)
+		{
+			results->Write(FitResult{ (uint64_t)i, nullptr, (uint64_t)testParams->count, ellParams });
+		}
 
 		if (!isOk)
 		{
@@ -144,150 +179,4041 @@ static bool TestLeastSquareFit()
 	return allOk;
 }
 
-static void LoadFile(const char* szFilename, std::vector<double>& xPoints, std::vector<double>& yPoints)
+/// <summary>	Writes the points and the ellipse to an SVG file. </summary>
+template <typename PointAccessor>
+static void WriteFitSvg(const PointAccessor& accessor, const EllipseParameters<double>& ellParams, const char* svgOutputFilename, const SvgOptions& svgOptions = SvgOptions())
 {
-	std::ifstream read;
-	read.open(szFilename);
-	if (!read.is_open())
+	// the view box contains the ellipse and all points
+	double minX, minY, maxX, maxY;
+	EllipseGeometry<double>::BoundingBox(ellParams, minX, minY, maxX, maxY);
+	for (size_t i = 0; i < accessor.GetLength(); ++i)
 	{
-		throw std::exception("Couldn't open file.");
+		minX = (std::min)(minX, accessor.GetX(i)); maxX = (std::max)(maxX, accessor.GetX(i));
+		minY = (std::min)(minY, accessor.GetY(i)); maxY = (std::max)(maxY, accessor.GetY(i));
 	}
 
-	std::string line;
-	while (std::getline(read, line))
+	int x = (int)floor(minX);
+	int y = (int)floor(minY);
+	int w = (int)ceil(maxX) - x;
+	int h = (int)ceil(maxY) - y;
+
+	size_t count = 0;
+	write_svg_points_and_ellipse(
+		svgOutputFilename,
+		x, y, w, h,
+		[&](double& x, double& y)->bool
 	{
-		double x, y;
-		if (sscanf_s(line.c_str(), "%lf %lf", &x, &y) == 2)
+		if (count < accessor.GetLength())
 		{
-			xPoints.push_back(x);
-			yPoints.push_back(y);
+			x = accessor.GetX(count);
+			y = accessor.GetY(count);
+			++count;
+			return true;
 		}
+		return false;
+	},
+		ellParams.x0, ellParams.y0, ellParams.a, ellParams.b, ellParams.theta, svgOptions);
+}
+
+template <typename PointAccessor>
+static EllipseParameters<double> LeastSquareFitAndWriteSvg(const PointAccessor& accessor, const char* svgOutputFilename, const SvgOptions& svgOptions = SvgOptions())
+{
+	auto result = LeastSquareEllipseFitter<double>::Fit(accessor);
+	EllipseParameters<double> ellParams = EllipseParameters<double>::FromAlgebraicParameters(result);
+	if (svgOutputFilename != nullptr)
+	{
+		WriteFitSvg(accessor, ellParams, svgOutputFilename, svgOptions);
 	}
 
-	read.close();
+	return ellParams;
 }
 
-static void LeastSquareFileFromFile(const char* szFilename, const char* svgOutputFilename)
+/// <summary>	Renders the points and the ellipse into an image with imageSize pixels along the longer side, written as
+/// 			PGM if the filename ends with ".pgm", otherwise as PPM. </summary>
+template <typename PointAccessor>
+static void RenderFitImage(const PointAccessor& accessor, const EllipseParameters<double>& ellParams, const char* szImageFilename, int imageSize)
 {
-	std::vector<double> xPoints; std::vector<double> yPoints;
-	LoadFile(szFilename, xPoints, yPoints);
+	double minX, minY, maxX, maxY;
+	EllipseGeometry<double>::BoundingBox(ellParams, minX, minY, maxX, maxY);
+	for (size_t i = 0; i < accessor.GetLength(); ++i)
+	{
+		minX = (std::min)(minX, accessor.GetX(i)); maxX = (std::max)(maxX, accessor.GetX(i));
+		minY = (std::min)(minY, accessor.GetY(i)); maxY = (std::max)(maxY, accessor.GetY(i));
+	}
 
-	LeastSquareEllipseFitter<double>::PointAccessorFromTwoVectors accessor(xPoints, yPoints);
-	auto result = LeastSquareEllipseFitter<double>::Fit(accessor);
-	EllipseParameters<double> ellParams = EllipseParameters<double>::FromAlgebraicParameters(result);
+	const double aspect = (maxY - minY) / (std::max)(maxX - minX, 1e-9);
+	const int width = aspect <= 1 ? imageSize : (std::max)((int)(imageSize / aspect), 16);
+	const int height = aspect <= 1 ? (std::max)((int)(imageSize * aspect), 16) : imageSize;
+	const size_t length = strlen(szImageFilename);
+	const bool isGray = length >= 4 && _stricmp(szImageFilename + length - 4, ".pgm") == 0;
 
-	int x = ellParams.x0 - (std::max)(ellParams.a, ellParams.b);
-	int y = ellParams.y0 - (std::max)(ellParams.a, ellParams.b);
-	int w, h;
-	w = h = 2 * (std::max)(ellParams.a, ellParams.b);
+	RasterImage image(width, height, isGray ? 1 : 3);
+	double viewX, viewY, scale;
+	RasterRenderer::FitView(minX, minY, maxX, maxY, width, height, 8, viewX, viewY, scale);
+	RasterRenderer(image, viewX, viewY, scale).Render(accessor, &ellParams, 1);
+	image.WritePnm(szImageFilename);
+}
 
-	int count = 0;
-	write_svg_points_and_ellipse(
-		svgOutputFilename,
-		x, y, w, h,
-		[&](double& x, double& y)->bool
+static void LeastSquareFileFromFile(const char* szFilename, const PointFileOptions& pointFileOptions, const char* svgOutputFilename, const SvgOptions& svgOptions, const char* szImageFilename, int imageSize, ResultWriter* results)
+{
+	PointFileReader::Visit<double>(szFilename, [&](const auto& accessor)
 	{
-		if (count < xPoints.size())
+		EllipseParameters<double> ellParams = LeastSquareFitAndWriteSvg(accessor, svgOutputFilename, svgOptions);
+		if (szImageFilename != nullptr)
 		{
-			x = xPoints[count];
-			y = yPoints[count];
-			++count;
-			return true;
+			RenderFitImage(accessor, ellParams, szImageFilename, imageSize);
 		}
-		return false;
-	},
-		ellParams.x0, ellParams.y0, ellParams.a, ellParams.b, ellParams.theta);
+
+		if (results != nullptr)
+		{
+			results->Write(FitResult{ 0, szFilename, accessor.GetLength(), ellParams });
+		}
+	}, pointFileOptions);
 }
 
-static const char* _5POINTTESTOPTION = "5pointtest";
-static const char* LEASTSQUAREELLIPSETESTOPTION = "leastsquarefittest";
-static const char* LEASTSQUAREELLIPSEOPTION = "leastsquarefit";
+static void ConvertToBinaryPointFile(const char* szFilename, const PointFileOptions& pointFileOptions, const char* szOutputFilename, PointDataType dataType)
+{
+	std::vector<double> xPoints; std::vector<double> yPoints;
+	PointFileReader::Read(szFilename, xPoints, yPoints, pointFileOptions);
+	BinaryPointFile::Write(szOutputFilename, dataType, xPoints.data(), yPoints.data(), xPoints.size());
+	printf("%u points written to %s\n", (unsigned int)xPoints.size(), szOutputFilename);
+}
 
-static option::ArgStatus CommandArgRequired(const option::Option& option, bool msg)
+static void ConvertToCompressedPointFile(const char* szFilename, const PointFileOptions& pointFileOptions, const char* szOutputFilename, double quantum)
 {
-	if (option.arg != 0)
+	std::vector<double> xPoints; std::vector<double> yPoints;
+	PointFileReader::Read(szFilename, xPoints, yPoints, pointFileOptions);
+	CompressedPointFile::Write(szOutputFilename, xPoints.data(), yPoints.data(), xPoints.size(), quantum);
+	printf("%u points written to %s\n", (unsigned int)xPoints.size(), szOutputFilename);
+}
+
+static void PackPointArchive(const char* szDirectory, const char* szArchiveFilename, PointDataType dataType)
+{
+	std::vector<std::string> files = DirectoryListing::GetFiles(szDirectory);
+	PointArchiveWriter writer(szArchiveFilename);
+	size_t pointCount = 0, fileCount = 0;
+	for (const std::string& filename : files)
 	{
-		if (strcmp(option.arg, _5POINTTESTOPTION) == 0 ||
-			strcmp(option.arg, LEASTSQUAREELLIPSETESTOPTION) == 0 ||
-			strcmp(option.arg, LEASTSQUAREELLIPSEOPTION) == 0)
+		std::vector<double> xPoints; std::vector<double> yPoints;
+		PointFileReader::Read(filename.c_str(), xPoints, yPoints);
+
+		// skip files without points (like scripts in the same directory)
+		if (xPoints.empty())
 		{
-			return option::ARG_OK;
+			continue;
 		}
+
+		writer.Add(DirectoryListing::GetFileName(filename), dataType, xPoints.data(), yPoints.data(), xPoints.size());
+		pointCount += xPoints.size();
+		++fileCount;
 	}
 
-	return option::ARG_ILLEGAL;
+	writer.Finish();
+	printf("%u files with %u points packed into %s\n", (unsigned int)fileCount, (unsigned int)pointCount, szArchiveFilename);
 }
 
-static option::ArgStatus FilenameArgRequired(const option::Option& option, bool msg)
+static void UnpackPointArchive(const char* szArchiveFilename, const char* szDirectory)
 {
-	if (option.arg != 0)
+	PointArchive archive(szArchiveFilename);
+	DirectoryListing::CreateDirectoryIfMissing(szDirectory);
+	PointArchive::SequentialReader reader(archive);
+	while (reader.Next())
 	{
-		return option::ARG_OK;
+		// only the file name, an archive must not write outside of the directory
+		std::string filename = DirectoryListing::Combine(szDirectory, DirectoryListing::GetFileName(archive.GetName(reader.GetIndex())));
+		FILE* fp;
+		if (fopen_s(&fp, filename.c_str(), "w") != 0)
+		{
+			throw std::runtime_error("Couldn't create file.");
+		}
+
+		reader.Visit<double>([&](const auto& accessor)
+		{
+			for (size_t i = 0; i < accessor.GetLength(); ++i)
+			{
+				fprintf(fp, "%.17g %.17g\n", accessor.GetX(i), accessor.GetY(i));
+			}
+		});
+		fclose(fp);
 	}
 
-	return option::ARG_ILLEGAL;
+	printf("%u entries unpacked into %s\n", (unsigned int)archive.GetEntryCount(), szDirectory);
 }
 
-enum  optionIndex { UNKNOWN, HELP, COMMAND, SVGOUTPUT, POINTSINPUTFILE };
-const option::Descriptor usage[] =
+/// <summary>	Fits all entries of the archive, the results are printed or - if results is given - written there. </summary>
+static void LeastSquareFitArchive(const char* szArchiveFilename, ResultWriter* results)
 {
-	{ UNKNOWN, 0,"" , ""    ,option::Arg::None, "USAGE: example [options]\n\n"
-	"Options:" },
-	{ HELP,    0,"" , "help",option::Arg::None, "  --help  \tPrint usage and exit." },
-	{ COMMAND,    0,"c", "command",CommandArgRequired, "  --command, -c  \tspecifies command." },
-	{ SVGOUTPUT,  0,"s" ,  "svg"   ,FilenameArgRequired, "  --svg, -s  \tspecifies filename for SVG-output." },
-	{ POINTSINPUTFILE,  0,"p" ,  "points"   ,FilenameArgRequired, "  --points, -p  \tspecifies filename with list of points" },
-	{ 0,0,0,0,0,0 }
+	PointArchive archive(szArchiveFilename);
+	PointArchive::SequentialReader reader(archive);
+	while (reader.Next())
+	{
+		EllipseParameters<double> ellParams = EllipseParameters<double>::Invalid();
+		const size_t index = reader.GetIndex();
+		reader.Visit<double>([&](const auto& accessor) { ellParams = EllipseParameters<double>::FromAlgebraicParameters(LeastSquareEllipseFitter<double>::Fit(accessor)); });
+		if (results != nullptr)
+		{
+			results->Write(FitResult{ index, archive.GetName(index).c_str(), archive.GetEntry(index).count, ellParams });
+		}
+		else
+		{
+			printf("%s: x0=%lf y0=%lf a=%lf b=%lf angle=%lf\n", archive.GetName(index).c_str(), ellParams.x0, ellParams.y0, ellParams.a, ellParams.b, radToDegree(ellParams.theta));
+		}
+	}
+}
+
+/// <summary>	The outcome of fitting a list of files, see BatchFitFiles. </summary>
+struct BatchFitOutcome
+{
+	std::vector<EllipseParameters<double>> ellipses;
+
+	/// <summary>	The error message for each file which could not be fitted, empty for the others. </summary>
+	std::vector<std::string> errors;
+	uint64_t pointCount;
+	size_t failedCount;
+	double seconds;
+	unsigned int threadCount;
+	uint64_t stolenCount;
+
+	/// <summary>	The files whose result came from the cache, and those of them which were not even read. </summary>
+	size_t cachedCount;
+	size_t unreadCount;
+
+	/// <summary>	The files which a previous run had completed according to the journal. </summary>
+	size_t journaledCount;
 };
 
-int main(int argc, char* argv[])
+/// <summary>	Reads and fits the file. A file with fewer than five points gets an invalid ellipse. </summary>
+static CachedFit FitPointFile(const std::string& file, const PointFileOptions& pointFileOptions)
 {
-	argc -= (argc > 0); argv += (argc > 0); // skip program name argv[0] if present
-	option::Stats  stats(usage, argc, argv);
-	auto options = std::vector<option::Option>(stats.options_max);
-	options.resize(stats.options_max);
-	auto  buffer = std::vector<option::Option>(stats.buffer_max);
-	buffer.resize(stats.buffer_max);
-	option::Parser parse(usage, argc, argv, options.data(), buffer.data());
+	const NormalizedMomentAccumulator<double> moments = PointFileReader::AccumulateMoments<double>(file.c_str(), pointFileOptions);
 
-	if (!options[COMMAND])
+	// all points have weight one, so the weight sum is their number
+	return CachedFit{ (uint64_t)moments.GetWeightSum(), FitEllipse(moments) };
+}
+
+/// <summary>	Gets the reason why the fit has no result, nullptr if it has one. </summary>
+static const char* GetFitError(const CachedFit& fit)
+{
+	if (fit.pointCount < LeastSquareEllipseFitter<double>::MinPointCount)
 	{
-		return EXIT_FAILURE;
+		return "Too few points for a fit.";
 	}
 
-	const char* command = options[COMMAND].arg;
-	if (strcmp(command, _5POINTTESTOPTION) == 0)
+	return fit.ellipse.IsValid() ? nullptr : "The points do not determine an ellipse.";
+}
+
+/// <summary>	Gets the fit of the file from the cache, or fits it and adds it to the cache. A file whose size and
+/// 			modification time are unchanged is not read; otherwise the content hash decides if it has to be fitted. </summary>
+static CachedFit FitPointFileCached(const std::string& file, const PointFileOptions& pointFileOptions, uint64_t seed, ResultCacheFile& cache, bool& isCached, bool& isUnread)
+{
+	CachedFit fit;
+	uint64_t size;
+	int64_t modificationTime;
+	const bool hasStatus = DirectoryListing::TryGetFileStatus(file.c_str(), size, modificationTime);
+	isUnread = isCached = hasStatus && cache.TryGetByFile(file, seed, size, modificationTime, fit);
+	if (isCached)
 	{
-		const char* filename = nullptr;
-		if (options[SVGOUTPUT])
+		return fit;
+	}
+
+	Hash128 key;
+	{
+		MappedFile mapped(file.c_str(), MappedFile::AccessPattern::Sequential);
+		key = ContentHash::Compute(mapped.GetData(), mapped.GetSize(), seed);
+	}
+
+	isCached = cache.TryGet(key, fit);
+	if (!isCached)
+	{
+		fit = FitPointFile(file, pointFileOptions);
+		cache.Put(key, fit);
+	}
+
+	if (hasStatus)
+	{
+		cache.PutFile(file, seed, size, modificationTime, key);
+	}
+
+	return fit;
+}
+
+/// <summary>	Loads and fits each file as a task of a work-stealing pool with threadCount workers (0 means one per
+/// 			core). The results are written through one LocalBuffer per worker. A file which cannot be read or
+/// 			fitted is recorded in BatchFitOutcome::errors, the other files are not affected. With a cache, the
+/// 			files are fitted through FitPointFileCached. With a journal, the files it has as completed are not
+/// 			fitted (their results come from the journal), and each file fitted is recorded in it. </summary>
+static BatchFitOutcome BatchFitFiles(const std::vector<std::string>& files, const PointFileOptions& pointFileOptions, unsigned int threadCount, ResultWriter* results,
+	ResultCacheFile* cache = nullptr, BatchJournal* journal = nullptr)
+{
+	BatchFitOutcome outcome;
+	outcome.ellipses.assign(files.size(), EllipseParameters<double>::Invalid());
+	outcome.errors.resize(files.size());
+	std::atomic<uint64_t> pointCount(0);
+	std::atomic<size_t> cachedCount(0), unreadCount(0), journaledCount(0);
+	const uint64_t seed = cache != nullptr ? ContentHash::GetOptionsSeed(pointFileOptions) : 0;
+	auto start = std::chrono::high_resolution_clock::now();
+	{
+		WorkStealingThreadPool pool(threadCount);
+		std::vector<std::unique_ptr<ResultWriter::LocalBuffer>> buffers(pool.GetThreadCount());
+		for (size_t i = 0; i < files.size(); ++i)
 		{
-			filename = options[SVGOUTPUT].arg;
+			pool.Submit([&, i]()
+			{
+				try
+				{
+					// the metadata is taken before the file is read, so that a later change is noticed on resume
+					bool isCached = false, isUnread = false, isJournaled = false;
+					uint64_t size;
+					int64_t modificationTime;
+					const bool hasStatus = journal != nullptr && DirectoryListing::TryGetFileStatus(files[i].c_str(), size, modificationTime);
+					CachedFit fit;
+					isJournaled = hasStatus && journal->TryGetCompleted(files[i], size, modificationTime, fit);
+					if (!isJournaled)
+					{
+						fit = cache != nullptr ?
+							FitPointFileCached(files[i], pointFileOptions, seed, *cache, isCached, isUnread) :
+							FitPointFile(files[i], pointFileOptions);
+						if (hasStatus)
+						{
+							journal->Complete(files[i], size, modificationTime, fit);
+						}
+					}
+
+					cachedCount += isCached ? 1 : 0;
+					unreadCount += isUnread ? 1 : 0;
+					journaledCount += isJournaled ? 1 : 0;
+					pointCount += fit.pointCount >= LeastSquareEllipseFitter<double>::MinPointCount ? fit.pointCount : 0;
+					if (const char* error = GetFitError(fit))
+					{
+						throw std::runtime_error(error);
+					}
+
+					outcome.ellipses[i] = fit.ellipse;
+					if (results != nullptr)
+					{
+						std::unique_ptr<ResultWriter::LocalBuffer>& buffer = buffers[WorkStealingThreadPool::GetWorkerIndex()];
+						if (!buffer)
+						{
+							buffer.reset(new ResultWriter::LocalBuffer(*results));
+						}
+
+						buffer->Write(FitResult{ i, DirectoryListing::GetFileName(files[i]).c_str(), fit.pointCount, fit.ellipse });
+					}
+				}
+				catch (const std::exception& e)
+				{
+					outcome.errors[i] = e.what();
+				}
+			});
 		}
 
-		TestEllipseFrom5Points(filename);
+		pool.Wait();
+		outcome.threadCount = pool.GetThreadCount();
+		outcome.stolenCount = 0;
+		for (const auto& statistics : pool.GetStatistics())
+		{
+			outcome.stolenCount += statistics.stolen;
+		}
 	}
-	else if (strcmp(command, LEASTSQUAREELLIPSETESTOPTION) == 0)
+
+	std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+	outcome.seconds = elapsed.count();
+	outcome.pointCount = pointCount.load();
+	outcome.cachedCount = cachedCount.load();
+	outcome.unreadCount = unreadCount.load();
+	outcome.journaledCount = journaledCount.load();
+	outcome.failedCount = std::count_if(outcome.errors.begin(), outcome.errors.end(), [](const std::string& e) { return !e.empty(); });
+	return outcome;
+}
+
+/// <summary>	Same as BatchFitFiles, with the files going through a BatchFitPipeline. The writer stage writes the results
+/// 			(through one LocalBuffer per writer thread) and, if svgDirectory is given, an SVG file per input file. </summary>
+static BatchFitOutcome BatchFitFilesPipelined(const std::vector<std::string>& files, const PointFileOptions& pointFileOptions, const BatchPipelineOptions& pipelineOptions,
+	const char* svgDirectory, ResultWriter* results, BatchPipelineStatistics& statistics)
+{
+	BatchFitOutcome outcome;
+	outcome.ellipses.assign(files.size(), EllipseParameters<double>::Invalid());
+	outcome.errors.resize(files.size());
+	outcome.pointCount = 0;
+	std::vector<std::unique_ptr<ResultWriter::LocalBuffer>> buffers((std::max)(pipelineOptions.writerThreads, 1u));
+	std::mutex mutex;
+	statistics = BatchFitPipeline::Run(files, pointFileOptions, pipelineOptions, [&](BatchFitItem& item, unsigned int writerIndex)
+	{
+		const size_t i = item.index;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			outcome.pointCount += item.x.size();
+		}
+
+		if (!item.error.empty())
+		{
+			outcome.errors[i] = item.error;
+			return;
+		}
+
+		outcome.ellipses[i] = item.ellipse;
+		const std::string name = DirectoryListing::GetFileName(files[i]);
+		if (svgDirectory != nullptr)
+		{
+			LeastSquareEllipseFitter<double>::PointAccessorFromTwoArrays accessor(item.x.data(), item.y.data(), item.x.size());
+			WriteFitSvg(accessor, item.ellipse, DirectoryListing::Combine(svgDirectory, name + ".svg").c_str());
+		}
+
+		if (results != nullptr)
+		{
+			if (!buffers[writerIndex])
+			{
+				buffers[writerIndex].reset(new ResultWriter::LocalBuffer(*results));
+			}
+
+			buffers[writerIndex]->Write(FitResult{ i, name.c_str(), item.x.size(), item.ellipse });
+		}
+	});
+
+	buffers.clear();
+	outcome.seconds = statistics.seconds;
+	outcome.threadCount = statistics.reader.threadCount + statistics.fitter.threadCount + statistics.writer.threadCount;
+	outcome.stolenCount = 0;
+	outcome.cachedCount = outcome.unreadCount = outcome.journaledCount = 0;
+	outcome.failedCount = std::count_if(outcome.errors.begin(), outcome.errors.end(), [](const std::string& e) { return !e.empty(); });
+	return outcome;
+}
+
+/// <summary>	The watcher which Ctrl+C stops, see WatchDirectory. </summary>
+static DirectoryWatcher* activeWatcher = nullptr;
+
+static void StopWatching(int)
+{
+	if (activeWatcher != nullptr)
 	{
-		TestLeastSquareFit();
+		activeWatcher->Stop();
 	}
-	else if (strcmp(command, LEASTSQUAREELLIPSEOPTION) == 0)
+}
+
+/// <summary>	Fits each file written into the directory as soon as the watcher reports it as complete. The files
+/// 			reported together are fitted in parallel on the pool, which stays alive between them, so a file costs
+/// 			no more than its fit and the notification. The results go to the writer, which is flushed after each
+/// 			group of files, or to stdout. Returns when the watcher is stopped. </summary>
+static void WatchDirectory(DirectoryWatcher& watcher, const char* szPatterns, const PointFileOptions& pointFileOptions, WorkStealingThreadPool& pool, ResultWriter* results, ResultCacheFile* cache)
+{
+	const uint64_t seed = ContentHash::GetOptionsSeed(pointFileOptions);
+	uint64_t index = 0;
+	for (;;)
 	{
-		const char* filename = nullptr;
-		if (options[POINTSINPUTFILE])
+		std::vector<std::string> files = watcher.WaitForFiles();
+		if (files.empty())
 		{
-			filename = options[POINTSINPUTFILE].arg;
+			break;
 		}
 
-		const char* svgoutputfilename = nullptr;
-		if (options[SVGOUTPUT])
+		files.erase(std::remove_if(files.begin(), files.end(), [szPatterns](const std::string& file) { return !DirectoryListing::MatchesPattern(DirectoryListing::GetFileName(file), szPatterns); }), files.end());
+
+		const auto start = std::chrono::steady_clock::now();
+		std::vector<CachedFit> fits(files.size());
+		std::vector<std::string> errors(files.size());
+		for (size_t i = 0; i < files.size(); ++i)
 		{
-			svgoutputfilename = options[SVGOUTPUT].arg;
+			pool.Submit([&, i]()
+			{
+				try
+				{
+					bool isCached, isUnread;
+					fits[i] = cache != nullptr ? FitPointFileCached(files[i], pointFileOptions, seed, *cache, isCached, isUnread) : FitPointFile(files[i], pointFileOptions);
+					if (const char* error = GetFitError(fits[i]))
+					{
+						errors[i] = error;
+					}
+				}
+				catch (const std::exception& e)
+				{
+					errors[i] = e.what();
+				}
+			});
+		}
+
+		pool.Wait();
+		const double microseconds = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+		for (size_t i = 0; i < files.size(); ++i, ++index)
+		{
+			const std::string name = DirectoryListing::GetFileName(files[i]);
+			const EllipseParameters<double>& e = fits[i].ellipse;
+			if (!errors[i].empty())
+			{
+				printf("%s: FAILED: %s\n", name.c_str(), errors[i].c_str());
+			}
+			else if (results != nullptr)
+			{
+				results->Write(FitResult{ index, name.c_str(), fits[i].pointCount, e });
+			}
+			else
+			{
+				printf("%s: x0=%lf y0=%lf a=%lf b=%lf angle=%lf\n", name.c_str(), e.x0, e.y0, e.a, e.b, radToDegree(e.theta));
+			}
+		}
+
+		if (results != nullptr)
+		{
+			results->Flush();
+			printf("%u files fitted in %.0lf us\n", (unsigned int)files.size(), microseconds);
+		}
+
+		fflush(stdout);
+	}
+}
+
+static void PrintPipelineStatistics(const BatchPipelineStatistics& statistics)
+{
+	printf("stage    threads  files   busy s  starved s (count)  blocked s (count)\n");
+	const struct { const char* name; const PipelineStageStatistics* stage; } stages[3] =
+	{
+		{ "read", &statistics.reader }, { "fit", &statistics.fitter }, { "write", &statistics.writer }
+	};
+
+	for (const auto& s : stages)
+	{
+		printf("%-8s %7u %6llu %8.3lf %10.3lf (%5llu) %10.3lf (%5llu)\n", s.name, s.stage->threadCount, (unsigned long long)s.stage->itemCount,
+			s.stage->busySeconds, s.stage->starvedSeconds, (unsigned long long)s.stage->starvedCount, s.stage->blockedSeconds, (unsigned long long)s.stage->blockedCount);
+	}
+
+	printf("queue read->fit: capacity %u, average occupancy %.2lf, max. %u\n", (unsigned int)statistics.readQueue.capacity,
+		statistics.readQueue.averageOccupancy, (unsigned int)statistics.readQueue.maxOccupancy);
+	printf("queue fit->write: capacity %u, average occupancy %.2lf, max. %u\n", (unsigned int)statistics.fitQueue.capacity,
+		statistics.fitQueue.averageOccupancy, (unsigned int)statistics.fitQueue.maxOccupancy);
+}
+
+/// <summary>	The files batchfit and watch take from a directory unless --pattern is given - the extensions point files
+/// 			usually have (the format itself is recognized by the content), so scripts and outputs are left alone. </summary>
+static const char* DefaultPointFilePatterns = "*.txt;*.csv;*.xy;*.dat;*.bin;*.npy";
+
+/// <summary>	Fits the files in the directory which match szPatterns, prints the failures and a throughput summary. With
+/// 			pipelineOptions the files go through a BatchFitPipeline (and the stage statistics are printed), otherwise
+/// 			each file is a task of a work-stealing pool with threadCount workers (which may use a cache and a
+/// 			journal). Returns false if any file failed. </summary>
+static bool BatchFitDirectory(const char* szDirectory, const char* szPatterns, const PointFileOptions& pointFileOptions, unsigned int threadCount, const BatchPipelineOptions* pipelineOptions,
+	const char* svgDirectory, ResultWriter* results, ResultCacheFile* cache = nullptr, BatchJournal* journal = nullptr)
+{
+	const std::vector<std::string> files = DirectoryListing::GetFiles(szDirectory, szPatterns);
+	BatchPipelineStatistics statistics;
+	if (svgDirectory != nullptr)
+	{
+		DirectoryListing::CreateDirectoryIfMissing(svgDirectory);
+	}
+
+	const BatchFitOutcome outcome = pipelineOptions != nullptr ?
+		BatchFitFilesPipelined(files, pointFileOptions, *pipelineOptions, svgDirectory, results, statistics) :
+		BatchFitFiles(files, pointFileOptions, threadCount, results, cache, journal);
+	for (size_t i = 0; i < files.size(); ++i)
+	{
+		const std::string name = DirectoryListing::GetFileName(files[i]);
+		if (!outcome.errors[i].empty())
+		{
+			printf("%s: FAILED: %s\n", name.c_str(), outcome.errors[i].c_str());
+		}
+		else if (results == nullptr)
+		{
+			const EllipseParameters<double>& e = outcome.ellipses[i];
+			printf("%s: x0=%lf y0=%lf a=%lf b=%lf angle=%lf\n", name.c_str(), e.x0, e.y0, e.a, e.b, radToDegree(e.theta));
 		}
+	}
+
+	printf("%u files (%u failed), %llu points in %.3lf s: %.0lf files/s, %.0lf points/s",
+		(unsigned int)files.size(), (unsigned int)outcome.failedCount, (unsigned long long)outcome.pointCount, outcome.seconds,
+		files.size() / outcome.seconds, outcome.pointCount / outcome.seconds);
+	if (pipelineOptions != nullptr)
+	{
+		printf("\n");
+		PrintPipelineStatistics(statistics);
+	}
+	else
+	{
+		printf(" (%u threads, %llu tasks stolen)\n", outcome.threadCount, (unsigned long long)outcome.stolenCount);
+	}
+
+	if (cache != nullptr)
+	{
+		printf("%u results from the cache (%u files not read), %u files fitted\n", (unsigned int)outcome.cachedCount, (unsigned int)outcome.unreadCount,
+			(unsigned int)(files.size() - outcome.cachedCount - outcome.journaledCount));
+	}
+
+	if (journal != nullptr)
+	{
+		journal->Close();
+		const BatchJournalStatistics statistics = journal->GetStatistics();
+		printf("%u results from the journal; %llu files journaled in %llu commits (%.3lf s writing)\n", (unsigned int)outcome.journaledCount,
+			(unsigned long long)statistics.committedCount, (unsigned long long)statistics.commitCount, statistics.syncSeconds);
+	}
+
+	return outcome.failedCount == 0;
+}
+
+template <typename tFunc>
+static double MeasureMicrosecondsPerCall(int repeatCount, tFunc func)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < repeatCount; ++i)
+	{
+		func();
+	}
 
+	std::chrono::duration<double, std::micro> elapsed = std::chrono::high_resolution_clock::now() - start;
+	return elapsed.count() / repeatCount;
+}
+
+/// <summary>	Fit the points with the unconstrained fitter, then fit again with the center, orientation and axis ratio
+/// 			fixed to the values found. The constrained fits must reproduce the unconstrained result. </summary>
+template <typename PointAccessor>
+static bool TestConstrainedFit(const PointAccessor& accessor)
+{
+	const double MaxError = 1e-4;
+	const int BenchmarkRepeatCount = 100;
+
+	EllipseParameters<double> reference = EllipseParameters<double>::Invalid();
+	double timeReference = MeasureMicrosecondsPerCall(BenchmarkRepeatCount, [&]()
+	{
+		reference = EllipseParameters<double>::FromAlgebraicParameters(LeastSquareEllipseFitter<double>::Fit(accessor));
+	});
+
+	printf("unconstrained:     x0=%lf y0=%lf a=%lf b=%lf angle=%lf (%.2lf us)\n", reference.x0, reference.y0, reference.a, reference.b, radToDegree(reference.theta), timeReference);
+	if (!reference.IsValid())
+	{
+		return false;
+	}
+
+	// a reference with a zero or non-finite axis (e.g. points on a short, almost straight arc) has no axis ratio to fix
+	if (!(std::isfinite(reference.a) && std::isfinite(reference.b) && (std::min)(reference.a, reference.b) > 0))
+	{
+		printf("degenerate reference, constrained fits skipped\n");
+		return true;
+	}
+
+	struct Variant
+	{
+		const char* name;
+		std::function<EllipseAlgebraicParameters<double>()> fit;
+	};
+
+	const double axisRatio = (std::min)(reference.a, reference.b) / (std::max)(reference.a, reference.b);
+	const Variant variants[] =
+	{
+		{ "known center:     ", [&]() { return ConstrainedLeastSquareEllipseFitter<double>::FitWithKnownCenter(accessor, reference.x0, reference.y0); } },
+		{ "known orientation:", [&]() { return ConstrainedLeastSquareEllipseFitter<double>::FitWithKnownOrientation(accessor, reference.theta); } },
+		{ "known axis ratio: ", [&]() { return ConstrainedLeastSquareEllipseFitter<double>::FitWithKnownAxisRatio(accessor, axisRatio); } }
+	};
 
-		LeastSquareFileFromFile(filename, svgoutputfilename);
+	bool allOk = true;
+	for (const Variant& variant : variants)
+	{
+		EllipseParameters<double> ellParams = EllipseParameters<double>::Invalid();
+		double time = MeasureMicrosecondsPerCall(BenchmarkRepeatCount, [&]()
+		{
+			ellParams = EllipseParameters<double>::FromAlgebraicParameters(variant.fit());
+		});
+
+		bool isOk = IsResultOk(reference.x0, reference.y0, reference.a, reference.b, reference.theta, ellParams, MaxError);
+		printf("%s x0=%lf y0=%lf a=%lf b=%lf angle=%lf (%.2lf us) <- %s\n", variant.name, ellParams.x0, ellParams.y0, ellParams.a, ellParams.b, radToDegree(ellParams.theta), time, isOk ? "OK" : "FAIL");
+		if (!isOk)
+		{
+			allOk = false;
+		}
 	}
 
+	return allOk;
+}
+
+/// <summary>	Fits short, noisy arcs of a known ellipse, without constraint and with the center, the orientation or the axis
+/// 			ratio fixed to the true one. Each constraint must give the better semi-major axis, and the better center where
+/// 			it is not the center itself - for the axis ratio also with half of the points. </summary>
+static bool TestConstrainedFitAccuracy()
+{
+	const double x0 = 500, y0 = 400, a = 200, b = 120, theta = 0.5, arc = M_PI / 2, noise = 0.5;
+	const int TrialCount = 500;
+	const size_t PointCount = 40;
+	std::mt19937 generator(23);
+	std::normal_distribution<double> noiseDistribution(0, noise);
+	std::uniform_real_distribution<double> startDistribution(0, 2 * M_PI);
+
+	// the median errors of the center and of the semi-major axis, an invalid fit counts as an infinite error
+	auto getMedian = [](std::vector<double>& errors) { std::nth_element(errors.begin(), errors.begin() + errors.size() / 2, errors.end()); return errors[errors.size() / 2]; };
+	const int FitCount = 5;
+	std::vector<double> centerErrors[FitCount], axisErrors[FitCount];
+	for (int trial = 0; trial < TrialCount; ++trial)
+	{
+		const double start = startDistribution(generator);
+		std::vector<double> x, y;
+		for (size_t k = 0; k < PointCount; ++k)
+		{
+			const double t = start + arc * k / (PointCount - 1);
+			const double u = a * cos(t), v = b * sin(t);
+			x.push_back(x0 + u * cos(theta) - v * sin(theta) + noiseDistribution(generator));
+			y.push_back(y0 + u * sin(theta) + v * cos(theta) + noiseDistribution(generator));
+		}
+
+		// every other point, for the fit with half of the points
+		std::vector<double> xHalf, yHalf;
+		for (size_t k = 0; k < PointCount; k += 2)
+		{
+			xHalf.push_back(x[k]);
+			yHalf.push_back(y[k]);
+		}
+
+		LeastSquareEllipseFitter<double>::PointAccessorFromTwoVectors all(x, y), half(xHalf, yHalf);
+		const EllipseParameters<double> fits[FitCount] =
+		{
+			EllipseParameters<double>::FromAlgebraicParameters(LeastSquareEllipseFitter<double>::Fit(all)),
+			EllipseParameters<double>::FromAlgebraicParameters(ConstrainedLeastSquareEllipseFitter<double>::FitWithKnownAxisRatio(all, b / a)),
+			EllipseParameters<double>::FromAlgebraicParameters(ConstrainedLeastSquareEllipseFitter<double>::FitWithKnownAxisRatio(half, b / a)),
+			EllipseParameters<double>::FromAlgebraicParameters(ConstrainedLeastSquareEllipseFitter<double>::FitWithKnownCenter(all, x0, y0)),
+			EllipseParameters<double>::FromAlgebraicParameters(ConstrainedLeastSquareEllipseFitter<double>::FitWithKnownOrientation(all, theta))
+		};
+
+		for (int f = 0; f < FitCount; ++f)
+		{
+			const bool isValid = fits[f].IsValid();
+			centerErrors[f].push_back(isValid ? hypot(fits[f].x0 - x0, fits[f].y0 - y0) : std::numeric_limits<double>::infinity());
+			axisErrors[f].push_back(isValid ? abs((std::max)(fits[f].a, fits[f].b) - a) : std::numeric_limits<double>::infinity());
+		}
+	}
+
+	double medianCenterErrors[FitCount], medianAxisErrors[FitCount];
+	for (int f = 0; f < FitCount; ++f)
+	{
+		medianCenterErrors[f] = getMedian(centerErrors[f]);
+		medianAxisErrors[f] = getMedian(axisErrors[f]);
+	}
+
+	bool isOk = true;
+	for (int f = 1; f < FitCount; ++f)
+	{
+		isOk = isOk && medianAxisErrors[f] < medianAxisErrors[0] && (f == 3 || medianCenterErrors[f] < medianCenterErrors[0]);
+	}
+
+	printf("%.0lf degree arcs, noise %.1lf, median errors of center and semi-major axis:\n", radToDegree(arc), noise);
+	printf("  unconstrained, %2u points:     %.3lf %.3lf\n", (unsigned int)PointCount, medianCenterErrors[0], medianAxisErrors[0]);
+	printf("  known center, %2u points:      %.3lf %.3lf\n", (unsigned int)PointCount, medianCenterErrors[3], medianAxisErrors[3]);
+	printf("  known orientation, %2u points: %.3lf %.3lf\n", (unsigned int)PointCount, medianCenterErrors[4], medianAxisErrors[4]);
+	printf("  known axis ratio, %2u points:  %.3lf %.3lf\n", (unsigned int)PointCount, medianCenterErrors[1], medianAxisErrors[1]);
+	printf("  known axis ratio, %2u points:  %.3lf %.3lf <- %s\n", (unsigned int)(PointCount / 2), medianCenterErrors[2], medianAxisErrors[2], isOk ? "OK" : "FAIL");
+	return isOk;
+}
+
+static bool TestConstrainedFit(const char* szPointsFilename, const PointFileOptions& pointFileOptions)
+{
+	if (szPointsFilename != nullptr)
+	{
+		bool isOk = false;
+		PointFileReader::Visit<double>(szPointsFilename, [&](const auto& accessor) { isOk = TestConstrainedFit(accessor); }, pointFileOptions);
+		return isOk;
+	}
+
+	bool allOk = true;
+	for (int i = 0;; ++i)
+	{
+		auto testParams = EllipseLeastSquareFitTestCases::GetTestCase(i);
+		if (testParams == nullptr)
+		{
+			break;
+		}
+
+		LeastSquareEllipseFitter<double>::PointAccessorFromTwoArrays accessor(testParams->pX, testParams->pY, testParams->count);
+		if (!TestConstrainedFit(accessor))
+		{
+			allOk = false;
+		}
+	}
+
+	return TestConstrainedFitAccuracy() && allOk;
+}
+
+/// <summary>	Generates points on partial arcs of concentric ellipses (with noise) and compares the joint fit with the
+/// 			mean of the centers of the individual fits. </summary>
+static bool TestConcentricFit()
+{
+	const double centerX = 512.3, centerY = 384.7, theta = 0.4, noise = 0.5, maxCenterError = 0.1;
+	const double semiAxes[][2] = { { 50, 30 }, { 100, 64 }, { 150, 97 }, { 200, 131 } };
+	const size_t PointsPerRing = 2000;
+	const int ringCount = sizeof(semiAxes) / sizeof(semiAxes[0]);
+
+	std::mt19937 generator(42);
+	std::normal_distribution<double> noiseDistribution(0, noise);
+	std::uniform_real_distribution<double> angleDistribution(0, 1.2 * M_PI);
+	std::vector<std::vector<double>> xPoints(ringCount), yPoints(ringCount);
+	std::vector<LeastSquareEllipseFitter<double>::PointAccessorFromTwoVectors> rings;
+	for (int r = 0; r < ringCount; ++r)
+	{
+		for (size_t i = 0; i < PointsPerRing; ++i)
+		{
+			double t = angleDistribution(generator) + r;
+			double u = semiAxes[r][0] * cos(t), v = semiAxes[r][1] * sin(t);
+			xPoints[r].push_back(centerX + u*cos(theta) - v*sin(theta) + noiseDistribution(generator));
+			yPoints[r].push_back(centerY + u*sin(theta) + v*cos(theta) + noiseDistribution(generator));
+		}
+
+		rings.emplace_back(xPoints[r], yPoints[r]);
+	}
+
+	const int BenchmarkRepeatCount = 20;
+	double meanX = 0, meanY = 0;
+	double timeSeparate = MeasureMicrosecondsPerCall(BenchmarkRepeatCount, [&]()
+	{
+		meanX = meanY = 0;
+		for (const auto& ring : rings)
+		{
+			EllipseParameters<double> p = EllipseParameters<double>::FromAlgebraicParameters(LeastSquareEllipseFitter<double>::Fit(ring));
+			meanX += p.x0 / ringCount;
+			meanY += p.y0 / ringCount;
+		}
+	});
+
+	ConcentricEllipseFitter<double>::Result result;
+	double timeJoint = MeasureMicrosecondsPerCall(BenchmarkRepeatCount, [&]() { result = ConcentricEllipseFitter<double>::Fit(rings); });
+
+	double errorSeparate = hypot(meanX - centerX, meanY - centerY);
+	double errorJoint = hypot(result.x0 - centerX, result.y0 - centerY);
+	printf("separate fits: x0=%lf y0=%lf error=%lf (%.2lf us)\n", meanX, meanY, errorSeparate, timeSeparate);
+	for (const auto& ring : result.rings)
+	{
+		EllipseParameters<double> ellParams = EllipseParameters<double>::FromAlgebraicParameters(ring);
+		printf("  ring: x0=%lf y0=%lf a=%lf b=%lf angle=%lf\n", ellParams.x0, ellParams.y0, ellParams.a, ellParams.b, radToDegree(ellParams.theta));
+	}
+
+	bool isOk = errorJoint < maxCenterError && errorJoint < errorSeparate;
+	printf("joint fit:     x0=%lf y0=%lf error=%lf (%.2lf us, %i iterations) <- %s\n", result.x0, result.y0, errorJoint, timeJoint, result.iterations, isOk ? "OK" : "FAIL");
+	return isOk;
+}
+
+/// <summary>	Generates a point cloud of overlapping ellipses plus uniform background and fits it with the mixture model,
+/// 			starting from perturbed parameters. </summary>
+static bool TestMixtureFit()
+{
+	const double MaxCenterError = 0.5, MaxAxisError = 0.01;
+	const EllipseParameters<double> ellipses[] =
+	{
+		{ 400, 300, 150, 80, 0.3 },
+		{ 520, 340, 120, 100, -0.7 },
+		{ 450, 420, 200, 60, 1.4 }
+	};
+	const size_t PointsPerEllipse = 100000, BackgroundPoints = 20000;
+
+	std::mt19937 generator(42);
+	std::normal_distribution<double> noiseDistribution(0, 1);
+	std::uniform_real_distribution<double> angleDistribution(0, 2 * M_PI);
+	std::uniform_real_distribution<double> backgroundX(150, 750), backgroundY(100, 650);
+	std::vector<double> xPoints, yPoints;
+	std::vector<EllipseParameters<double>> initialEllipses;
+	for (const auto& e : ellipses)
+	{
+		for (size_t i = 0; i < PointsPerEllipse; ++i)
+		{
+			double t = angleDistribution(generator);
+			double u = e.a * cos(t), v = e.b * sin(t);
+			xPoints.push_back(e.x0 + u*cos(e.theta) - v*sin(e.theta) + noiseDistribution(generator));
+			yPoints.push_back(e.y0 + u*sin(e.theta) + v*cos(e.theta) + noiseDistribution(generator));
+		}
+
+		initialEllipses.push_back(EllipseParameters<double>{ e.x0 + 6, e.y0 - 4, e.a * 1.06, e.b * 0.95, e.theta + 0.1 });
+	}
+
+	for (size_t i = 0; i < BackgroundPoints; ++i)
+	{
+		xPoints.push_back(backgroundX(generator));
+		yPoints.push_back(backgroundY(generator));
+	}
+
+	LeastSquareEllipseFitter<double>::PointAccessorFromTwoVectors accessor(xPoints, yPoints);
+	EllipseMixtureFitter<double>::Result result;
+	double time = MeasureMicrosecondsPerCall(1, [&]() { result = EllipseMixtureFitter<double>::Fit(accessor, initialEllipses); });
+	printf("%i iterations, log-likelihood=%lf, background weight=%lf (%.0lf us, %.1lf Mpoints/s per iteration)\n", result.iterations, result.logLikelihood, result.backgroundWeight, time, xPoints.size() * result.iterations / time);
+
+	bool allOk = true;
+	for (size_t k = 0; k < result.components.size(); ++k)
+	{
+		EllipseParameters<double> ellParams = EllipseParameters<double>::FromAlgebraicParameters(result.components[k].ellipse);
+		const EllipseParameters<double>& expected = ellipses[k];
+		bool isOk = ellParams.IsValid() &&
+			hypot(ellParams.x0 - expected.x0, ellParams.y0 - expected.y0) < MaxCenterError &&
+			relativeDifference((std::max)(expected.a, expected.b), (std::max)(ellParams.a, ellParams.b)) < MaxAxisError &&
+			relativeDifference((std::min)(expected.a, expected.b), (std::min)(ellParams.a, ellParams.b)) < MaxAxisError;
+		printf("x0=%lf y0=%lf a=%lf b=%lf angle=%lf weight=%lf sigma=%lf <- %s\n", ellParams.x0, ellParams.y0, ellParams.a, ellParams.b, radToDegree(ellParams.theta), result.components[k].weight, result.components[k].sigma, isOk ? "OK" : "FAIL");
+		if (!isOk)
+		{
+			allOk = false;
+		}
+	}
+
+	// without background and without a valid component no point can be explained - this must not produce NaN
+	{
+		EllipseMixtureFitter<double>::Options options;
+		options.initialBackgroundWeight = 0;
+		const std::vector<EllipseParameters<double>> invalidEllipses(2, EllipseParameters<double>::Invalid());
+		const EllipseMixtureFitter<double>::Result degenerate = EllipseMixtureFitter<double>::Fit(accessor, invalidEllipses, options);
+		bool isOk = std::isfinite(degenerate.logLikelihood) && degenerate.backgroundWeight == 0;
+		for (const auto& component : degenerate.components)
+		{
+			isOk = isOk && component.weight == 0 && !EllipseParameters<double>::FromAlgebraicParameters(component.ellipse).IsValid();
+		}
+
+		printf("no background, only invalid components: %i iteration(s), no NaN <- %s\n", degenerate.iterations, isOk ? "OK" : "FAIL");
+		allOk = allOk && isOk;
+	}
+
+	return allOk;
+}
+
+/// <summary>	Checks the batch geometry functions against reference values (numerical integration, dense sampling)
+/// 			and measures the batch throughput with exact and with approximated trigonometric functions. </summary>
+static bool TestGeometry()
+{
+	const size_t EllipseCount = 1000000;
+	std::mt19937 generator(42);
+	std::uniform_real_distribution<double> positionDistribution(0, 1000), axisDistribution(1, 200), angleDistribution(-M_PI, M_PI);
+	EllipseParameterVectors<double> parameters;
+	for (size_t i = 0; i < EllipseCount; ++i)
+	{
+		parameters.Add(EllipseParameters<double>{ positionDistribution(generator), positionDistribution(generator), axisDistribution(generator), axisDistribution(generator), angleDistribution(generator) });
+	}
+
+	EllipseParameterArrays<double> ellipses = parameters.GetArrays();
+	std::vector<double> perimeters(EllipseCount), minX(EllipseCount), minY(EllipseCount), maxX(EllipseCount), maxY(EllipseCount);
+	std::vector<double> fastMinX(EllipseCount), fastMinY(EllipseCount), fastMaxX(EllipseCount), fastMaxY(EllipseCount);
+	double timePerimeter = MeasureMicrosecondsPerCall(1, [&]() { EllipseGeometry<double>::CalcPerimeters(ellipses, perimeters.data()); });
+	double timeBox = MeasureMicrosecondsPerCall(1, [&]() { EllipseGeometry<double>::CalcBoundingBoxes(ellipses, minX.data(), minY.data(), maxX.data(), maxY.data(), TrigonometricAccuracy::Exact); });
+	double timeFastBox = MeasureMicrosecondsPerCall(1, [&]() { EllipseGeometry<double>::CalcBoundingBoxes(ellipses, fastMinX.data(), fastMinY.data(), fastMaxX.data(), fastMaxY.data(), TrigonometricAccuracy::Fast); });
+	std::vector<double> sinValues(EllipseCount), cosValues(EllipseCount);
+	double timeSinCos = MeasureMicrosecondsPerCall(1, [&]() { EllipseGeometry<double>::SinCos(ellipses.theta, EllipseCount, sinValues.data(), cosValues.data(), TrigonometricAccuracy::Exact); });
+	double timeFastSinCos = MeasureMicrosecondsPerCall(1, [&]() { EllipseGeometry<double>::SinCos(ellipses.theta, EllipseCount, sinValues.data(), cosValues.data(), TrigonometricAccuracy::Fast); });
+	printf("%u ellipses: perimeters %.0lf us, bounding boxes %.0lf us (fast trigonometry: %.0lf us), sin/cos %.0lf us (fast: %.0lf us)\n", (unsigned int)EllipseCount,
+		timePerimeter, timeBox, timeFastBox, timeSinCos, timeFastSinCos);
+
+	double maxPerimeterError = 0, maxSeriesError = 0, maxBoxError = 0, maxFastBoxError = 0, maxSpacingError = 0;
+	const size_t CheckCount = 1000, SampleCount = 64, DenseSampleCount = 100000;
+	std::vector<double> x(DenseSampleCount), y(DenseSampleCount);
+	for (size_t i = 0; i < CheckCount; ++i)
+	{
+		EllipseParameters<double> e{ ellipses.x0[i], ellipses.y0[i], ellipses.a[i], ellipses.b[i], ellipses.theta[i] };
+
+		// reference: polygon with many vertices
+		EllipseGeometry<double>::SampleBoundary(e, DenseSampleCount, x.data(), y.data(), false);
+		double length = 0, boxMinX = x[0], boxMaxX = x[0], boxMinY = y[0], boxMaxY = y[0];
+		for (size_t k = 0; k < DenseSampleCount; ++k)
+		{
+			size_t next = (k + 1) % DenseSampleCount;
+			length += hypot(x[next] - x[k], y[next] - y[k]);
+			boxMinX = (std::min)(boxMinX, x[k]); boxMaxX = (std::max)(boxMaxX, x[k]);
+			boxMinY = (std::min)(boxMinY, y[k]); boxMaxY = (std::max)(boxMaxY, y[k]);
+		}
+
+		maxPerimeterError = (std::max)(maxPerimeterError, relativeDifference(length, perimeters[i]));
+		maxSeriesError = (std::max)(maxSeriesError, relativeDifference(perimeters[i], EllipseGeometry<double>::PerimeterSeries(e.a, e.b, 200)));
+		maxBoxError = (std::max)(maxBoxError, (std::max)((std::max)(abs(boxMinX - minX[i]), abs(boxMaxX - maxX[i])), (std::max)(abs(boxMinY - minY[i]), abs(boxMaxY - maxY[i]))));
+		maxFastBoxError = (std::max)(maxFastBoxError, (std::max)((std::max)(abs(fastMinX[i] - minX[i]), abs(fastMaxX[i] - maxX[i])), (std::max)(abs(fastMinY[i] - minY[i]), abs(fastMaxY[i] - maxY[i]))));
+
+		// the arc length between consecutive samples, integrated numerically from the recovered parameters t
+		EllipseGeometry<double>::SampleBoundary(e, SampleCount, x.data(), y.data(), true, TrigonometricAccuracy::Fast, 64);
+		std::vector<double> t(SampleCount);
+		for (size_t k = 0; k < SampleCount; ++k)
+		{
+			double u = (x[k] - e.x0)*cos(e.theta) + (y[k] - e.y0)*sin(e.theta);
+			double v = -(x[k] - e.x0)*sin(e.theta) + (y[k] - e.y0)*cos(e.theta);
+			t[k] = atan2(v / e.b, u / e.a);
+		}
+
+		for (size_t k = 0; k < SampleCount; ++k)
+		{
+			double t0 = t[k], t1 = t[(k + 1) % SampleCount];
+			while (t1 < t0)
+			{
+				t1 += 2 * M_PI;
+			}
+
+			const int Steps = 1000;
+			double arc = 0;
+			for (int step = 0; step < Steps; ++step)
+			{
+				double tm = t0 + (t1 - t0)*(step + 0.5) / Steps;
+				arc += hypot(e.a*sin(tm), e.b*cos(tm))*(t1 - t0) / Steps;
+			}
+
+			maxSpacingError = (std::max)(maxSpacingError, relativeDifference(perimeters[i] / SampleCount, arc));
+		}
+	}
+
+	bool isOk = maxPerimeterError < 1e-6 && maxSeriesError < 1e-6 && maxBoxError < 1e-4 && maxFastBoxError < 1e-6 && maxSpacingError < 0.01;
+	printf("max. errors: perimeter=%lg series=%lg box=%lg fast box=%lg arc length spacing=%lg <- %s\n", maxPerimeterError, maxSeriesError, maxBoxError, maxFastBoxError, maxSpacingError, isOk ? "OK" : "FAIL");
+
+	// the SVG canvas (from the origin) must reach the far side of the bounding box, also for negative coordinates
+	int negativeX, negativeY, straddlingX, straddlingY;
+	get_svg_size_for_ellipse(-100, -50, 30, 10, 0, negativeX, negativeY);
+	get_svg_size_for_ellipse(10, 5, 30, 10, 0, straddlingX, straddlingY);
+	const bool isSizeOk = negativeX == 130 && negativeY == 60 && straddlingX == 40 && straddlingY == 15;
+	printf("SVG canvas for ellipses at negative coordinates: %ix%i and %ix%i <- %s\n", negativeX, negativeY, straddlingX, straddlingY, isSizeOk ? "OK" : "FAIL");
+	return isOk && isSizeOk;
+}
+
+static bool TestOverlap()
+{
+	typedef EllipseOverlap<double> Overlap;
+	Overlap::Options polygonOptions;
+	polygonOptions.method = OverlapMethod::Polygon;
+	polygonOptions.polygonVertexCount = 4096;
+
+	// cases with a known result: concentric circles, the same ellipse, disjoint ellipses, a tangent pair
+	double knownError = 0;
+	knownError = (std::max)(knownError, abs(Overlap::IntersectionOverUnion(EllipseParameters<double>{ 10, 20, 5, 5, 0 }, EllipseParameters<double>{ 10, 20, 10, 10, 1 }) - 0.25));
+	knownError = (std::max)(knownError, abs(Overlap::IntersectionOverUnion(EllipseParameters<double>{ 10, 20, 30, 5, 0.3 }, EllipseParameters<double>{ 10, 20, 30, 5, 0.3 }) - 1));
+	knownError = (std::max)(knownError, abs(Overlap::IntersectionOverUnion(EllipseParameters<double>{ 0, 0, 30, 5, 0 }, EllipseParameters<double>{ 0, 20, 30, 5, 0 })));
+	knownError = (std::max)(knownError, abs(Overlap::IntersectionOverUnion(EllipseParameters<double>{ 0, 0, 30, 5, 0 }, EllipseParameters<double>{ 0, 10, 30, 5, 0 })));
+
+	const size_t PairCount = 1000000, CheckCount = 2000;
+	std::mt19937 generator(7);
+	std::uniform_real_distribution<double> positionDistribution(0, 100), axisDistribution(2, 60), angleDistribution(-M_PI, M_PI);
+	EllipseParameterVectors<double> first, second;
+	for (size_t i = 0; i < PairCount; ++i)
+	{
+		first.Add(EllipseParameters<double>{ positionDistribution(generator), positionDistribution(generator), axisDistribution(generator), axisDistribution(generator), angleDistribution(generator) });
+		second.Add(EllipseParameters<double>{ positionDistribution(generator), positionDistribution(generator), axisDistribution(generator), axisDistribution(generator), angleDistribution(generator) });
+	}
+
+	std::vector<double> iou(PairCount);
+	double time = MeasureMicrosecondsPerCall(1, [&]() { Overlap::CalcIntersectionOverUnion(first.GetArrays(), second.GetArrays(), iou.data()); });
+	size_t overlapCount = std::count_if(iou.begin(), iou.end(), [](double v) { return v > 0; });
+	printf("%u pairs (%u overlapping): %.0lf us\n", (unsigned int)PairCount, (unsigned int)overlapCount, time);
+
+	double maxError = 0;
+	EllipseParameterArrays<double> a = first.GetArrays(), b = second.GetArrays();
+	for (size_t i = 0; i < CheckCount; ++i)
+	{
+		double reference = Overlap::IntersectionOverUnion(EllipseParameters<double>{ a.x0[i], a.y0[i], a.a[i], a.b[i], a.theta[i] }, EllipseParameters<double>{ b.x0[i], b.y0[i], b.a[i], b.b[i], b.theta[i] }, polygonOptions);
+		maxError = (std::max)(maxError, abs(reference - iou[i]));
+	}
+
+	bool isOk = knownError < 1e-9 && maxError < 1e-5;
+	printf("max. error: known cases=%lg polygon (4096 vertices)=%lg <- %s\n", knownError, maxError, isOk ? "OK" : "FAIL");
+	return isOk;
+}
+
+static bool TestTextPointReader()
+{
+	// a file with the usual lines plus some which the reader has to skip or handle like sscanf does
+	const char* filename = "textpointreadertest.tmp";
+	const size_t LineCount = 2000000;
+	FILE* fp;
+	if (fopen_s(&fp, filename, "wb") != 0)
+	{
+		printf("Couldn't create %s <- FAIL\n", filename);
+		return false;
+	}
+
+	fprintf(fp, "# comment\n\n  -1.5e3\t+2.25E-2 trailing text\r\n.5 7.\n1 x\n12345678901234567890123 1e-400\n");
+	std::mt19937 generator(3);
+	std::uniform_real_distribution<double> distribution(-5000, 5000);
+	for (size_t i = 0; i < LineCount; ++i)
+	{
+		fprintf(fp, "%lf %lf\n", distribution(generator), distribution(generator));
+	}
+
+	fprintf(fp, "0.1 0.2");
+	fclose(fp);
+
+	std::vector<double> xReference, yReference;
+	double timeReference = MeasureMicrosecondsPerCall(1, [&]()
+	{
+		std::ifstream read(filename);
+		std::string line;
+		while (std::getline(read, line))
+		{
+			double x, y;
+			if (sscanf_s(line.c_str(), "%lf %lf", &x, &y) == 2)
+			{
+				xReference.push_back(x);
+				yReference.push_back(y);
+			}
+		}
+	});
+
+	std::vector<double> xPoints, yPoints;
+	double time = MeasureMicrosecondsPerCall(1, [&]() { TextPointReader::ReadFile(filename, xPoints, yPoints); });
+	remove(filename);
+
+	bool isOk = xPoints == xReference && yPoints == yReference;
+	printf("%u points: getline/sscanf %.0lf us, mapped file %.0lf us <- %s\n", (unsigned int)xPoints.size(), timeReference, time, isOk ? "OK" : "FAIL");
+	return isOk;
+}
+
+static bool TestBinaryPointFile()
+{
+	const char* filename = "binarypointfiletest.tmp";
+	auto testParams = EllipseLeastSquareFitTestCases::GetTestCase(0);
+	LeastSquareEllipseFitter<double>::PointAccessorFromTwoArrays reference(testParams->pX, testParams->pY, testParams->count);
+	EllipseParameters<double> expected = EllipseParameters<double>::FromAlgebraicParameters(LeastSquareEllipseFitter<double>::Fit(reference));
+
+	bool allOk = true;
+	const char* typeNames[] = { "f32", "f64", "i32" };
+	const double maxErrors[] = { 1e-5, 1e-12, 1e-2 };
+	for (int t = 0; t < 3; ++t)
+	{
+		PointDataType dataType;
+		BinaryPointFile::TryParseDataType(typeNames[t], dataType);
+		BinaryPointFile::Write(filename, dataType, testParams->pX, testParams->pY, testParams->count);
+
+		bool isOk;
+		EllipseParameters<double> ellParams = EllipseParameters<double>::Invalid();
+		{
+			BinaryPointFile file(filename);
+			isOk = BinaryPointFile::IsBinaryPointFile(filename) && file.GetCount() == (size_t)testParams->count &&
+				(uintptr_t)file.GetXData() % BinaryPointFile::BlockAlignment == 0 && (uintptr_t)file.GetYData() % BinaryPointFile::BlockAlignment == 0;
+			file.Visit<double>([&](const auto& accessor) { ellParams = EllipseParameters<double>::FromAlgebraicParameters(LeastSquareEllipseFitter<double>::Fit(accessor)); });
+		}
+
+		isOk = isOk && relativeDifference(expected.x0, ellParams.x0) < maxErrors[t] && relativeDifference(expected.y0, ellParams.y0) < maxErrors[t] &&
+			relativeDifference(expected.a, ellParams.a) < maxErrors[t] && relativeDifference(expected.b, ellParams.b) < maxErrors[t];
+		printf("%s: x0=%lf y0=%lf a=%lf b=%lf angle=%lf <- %s\n", typeNames[t], ellParams.x0, ellParams.y0, ellParams.a, ellParams.b, radToDegree(ellParams.theta), isOk ? "OK" : "FAIL");
+		allOk = allOk && isOk;
+	}
+
+	// a truncated file must be rejected
+	{
+		std::vector<char> content;
+		{
+			MappedFile file(filename);
+			content.assign(file.GetData(), file.GetData() + file.GetSize() - 1);
+		}
+
+		FILE* fp;
+		fopen_s(&fp, filename, "wb");
+		fwrite(content.data(), 1, content.size(), fp);
+		fclose(fp);
+	}
+
+	bool isRejected = false;
+	try
+	{
+		BinaryPointFile file(filename);
+	}
+	catch (std::runtime_error&)
+	{
+		isRejected = true;
+	}
+
+	remove(filename);
+	printf("truncated file rejected <- %s\n", isRejected ? "OK" : "FAIL");
+	return allOk && isRejected;
+}
+
+static bool TestNpyFile()
+{
+	const char* filename = "npyfiletest.tmp";
+	const char* yFilename = "npyfiletest_y.tmp";
+	auto testParams = EllipseLeastSquareFitTestCases::GetTestCase(0);
+	const uint64_t count = testParams->count;
+	LeastSquareEllipseFitter<double>::PointAccessorFromTwoArrays reference(testParams->pX, testParams->pY, testParams->count);
+	EllipseParameters<double> expected = EllipseParameters<double>::FromAlgebraicParameters(LeastSquareEllipseFitter<double>::Fit(reference));
+
+	std::vector<double> interleaved, planar;
+	for (int i = 0; i < testParams->count; ++i)
+	{
+		interleaved.push_back(testParams->pX[i]);
+		interleaved.push_back(testParams->pY[i]);
+	}
+
+	planar.assign(testParams->pX, testParams->pX + testParams->count);
+	planar.insert(planar.end(), testParams->pY, testParams->pY + testParams->count);
+	std::vector<float> interleavedFloat(interleaved.begin(), interleaved.end());
+
+	auto check = [&](const char* name, const PointFileOptions& options, double maxError) -> bool
+	{
+		EllipseParameters<double> ellParams = {};
+		size_t pointCount = 0;
+		PointFileReader::Visit<double>(filename, [&](const auto& accessor)
+		{
+			pointCount = accessor.GetLength();
+			ellParams = EllipseParameters<double>::FromAlgebraicParameters(LeastSquareEllipseFitter<double>::Fit(accessor));
+		}, options);
+
+		bool isOk = pointCount == (size_t)count && relativeDifference(expected.x0, ellParams.x0) < maxError && relativeDifference(expected.y0, ellParams.y0) < maxError &&
+			relativeDifference(expected.a, ellParams.a) < maxError && relativeDifference(expected.b, ellParams.b) < maxError;
+		printf("%s: x0=%lf y0=%lf a=%lf b=%lf angle=%lf <- %s\n", name, ellParams.x0, ellParams.y0, ellParams.a, ellParams.b, radToDegree(ellParams.theta), isOk ? "OK" : "FAIL");
+		return isOk;
+	};
+
+	bool allOk = true;
+	NpyFile::Write(filename, PointDataType::Float64, { count, 2 }, false, interleaved.data());
+	allOk = check("(N,2) f8", PointFileOptions(), 1e-12) && allOk;
+	NpyFile::Write(filename, PointDataType::Float32, { count, 2 }, false, interleavedFloat.data());
+	allOk = check("(N,2) f4", PointFileOptions(), 1e-5) && allOk;
+	NpyFile::Write(filename, PointDataType::Float64, { 2, count }, true, interleaved.data());
+	allOk = check("(2,N) fortran f8", PointFileOptions(), 1e-12) && allOk;
+	NpyFile::Write(filename, PointDataType::Float64, { 2, count }, false, planar.data());
+	allOk = check("(2,N) f8", PointFileOptions(), 1e-12) && allOk;
+	NpyFile::Write(filename, PointDataType::Float64, { count, 2 }, true, planar.data());
+	allOk = check("(N,2) fortran f8", PointFileOptions(), 1e-12) && allOk;
+
+	PointFileOptions twoFiles;
+	twoFiles.yFilename = yFilename;
+	NpyFile::Write(filename, PointDataType::Float64, { count }, false, testParams->pX);
+	NpyFile::Write(yFilename, PointDataType::Float64, { count }, false, testParams->pY);
+	allOk = check("(N,) (N,) f8", twoFiles, 1e-12) && allOk;
+	remove(yFilename);
+
+	PointFileOptions raw;
+	raw.isRaw = true;
+	for (int layout = 0; layout < 2; ++layout)
+	{
+		raw.rawLayout = layout == 0 ? PointLayout::Interleaved : PointLayout::Planar;
+		const std::vector<double>& data = layout == 0 ? interleaved : planar;
+		FILE* fp;
+		fopen_s(&fp, filename, "wb");
+		fwrite(data.data(), sizeof(double), data.size(), fp);
+		fclose(fp);
+		allOk = check(layout == 0 ? "raw interleaved f64" : "raw planar f64", raw, 1e-12) && allOk;
+	}
+
+	// a file which is smaller than its shape must be rejected
+	NpyFile::Write(filename, PointDataType::Float64, { count + 1, 2 }, false, interleaved.data());
+	bool isRejected = false;
+	{
+		std::vector<char> content;
+		{
+			MappedFile file(filename);
+			content.assign(file.GetData(), file.GetData() + file.GetSize() - 2 * sizeof(double));
+		}
+
+		FILE* fp;
+		fopen_s(&fp, filename, "wb");
+		fwrite(content.data(), 1, content.size(), fp);
+		fclose(fp);
+	}
+
+	try
+	{
+		NpyFile file(filename);
+	}
+	catch (std::runtime_error&)
+	{
+		isRejected = true;
+	}
+
+	remove(filename);
+	printf("truncated file rejected <- %s\n", isRejected ? "OK" : "FAIL");
+	return allOk && isRejected;
+}
+
+/// <summary>	A record with further fields around the coordinates, y before x. </summary>
+struct TestPointRecord
+{
+	int32_t id;
+	double y;
+	float quality;
+	double x;
+};
+
+static bool TestRecordAccessor()
+{
+	const size_t PointCount = 1000000;
+	const int RepeatCount = 20;
+	std::mt19937 generator(5);
+	std::uniform_real_distribution<double> angle(0, 2 * M_PI);
+	std::normal_distribution<double> noise(0, 2);
+	std::vector<double> xPoints, yPoints, interleaved;
+	std::vector<Eigen::Vector2d, Eigen::aligned_allocator<Eigen::Vector2d>> vectors;
+	std::vector<TestPointRecord> records;
+	for (size_t i = 0; i < PointCount; ++i)
+	{
+		double t = angle(generator);
+		double x = 500 + 300 * cos(t) * cos(0.3) - 100 * sin(t) * sin(0.3) + noise(generator);
+		double y = -200 + 300 * cos(t) * sin(0.3) + 100 * sin(t) * cos(0.3) + noise(generator);
+		xPoints.push_back(x); yPoints.push_back(y);
+		interleaved.push_back(x); interleaved.push_back(y);
+		vectors.push_back(Eigen::Vector2d(x, y));
+		records.push_back(TestPointRecord{ (int32_t)i, y, 1.0f, x });
+	}
+
+	std::vector<float> xFloat(xPoints.begin(), xPoints.end()), yFloat(yPoints.begin(), yPoints.end()), interleavedFloat(interleaved.begin(), interleaved.end());
+
+	// the record accessors visit the points in the same order as the array accessors, so the results are identical
+	EllipseAlgebraicParameters<double> reference, result;
+	bool allOk = true;
+	auto run = [&](const char* name, const auto& accessor, bool isReference) -> double
+	{
+		double time = MeasureMicrosecondsPerCall(RepeatCount, [&]() { result = LeastSquareEllipseFitter<double>::Fit(accessor); });
+		bool isOk = true;
+		if (isReference)
+		{
+			reference = result;
+		}
+		else
+		{
+			isOk = memcmp(&reference, &result, sizeof(result)) == 0;
+			allOk = allOk && isOk;
+		}
+
+		printf("%-26s %8.0lf us%s\n", name, time, isReference ? "" : (isOk ? " <- OK" : " <- FAIL"));
+		return time;
+	};
+
+	run("two arrays (f64)", LeastSquareEllipseFitter<double>::PointAccessorFromTwoArrays(xPoints.data(), yPoints.data(), PointCount), true);
+	run("interleaved (f64)", LeastSquareEllipseFitter<double>::PointAccessorFromRecords<double>::FromInterleaved(interleaved.data(), PointCount), false);
+	run("Eigen::Vector2d", LeastSquareEllipseFitter<double>::PointAccessorFromRecords<double>::FromRecords(vectors.data(), PointCount, 0, sizeof(double)), false);
+	run("records (f64, y before x)", LeastSquareEllipseFitter<double>::PointAccessorFromRecords<double>::FromRecords(records.data(), PointCount, offsetof(TestPointRecord, x), offsetof(TestPointRecord, y)), false);
+	run("two arrays (f32)", LeastSquareEllipseFitter<double>::PointAccessorFromTwoTypedArrays<float>(xFloat.data(), yFloat.data(), PointCount), true);
+	run("interleaved (f32)", LeastSquareEllipseFitter<double>::PointAccessorFromRecords<float>::FromInterleaved(interleavedFloat.data(), PointCount), false);
+
+	// odd lengths and offsets exercise the scalar tail of the deinterleaving
+	LeastSquareEllipseFitter<double>::PointAccessorFromRecords<float> tail = LeastSquareEllipseFitter<double>::PointAccessorFromRecords<float>::FromInterleaved(interleavedFloat.data() + 2, 1003);
+	double x[1003], y[1003];
+	tail.GetPoints(0, 1003, x, y);
+	bool isTailOk = true;
+	for (size_t i = 0; i < 1003; ++i)
+	{
+		isTailOk = isTailOk && x[i] == xFloat[i + 1] && y[i] == yFloat[i + 1];
+	}
+
+	printf("unaligned block with tail <- %s\n", isTailOk ? "OK" : "FAIL");
+	return allOk && isTailOk;
+}
+
+/// <summary>	Edge chains with sub-pixel coordinates and steps of about a pixel, which is what the compressed format is
+/// 			made for. Checks the compression ratio, that the streaming fit matches the fit of the decoded points,
+/// 			and that the quantization error stays within quantum / 2. </summary>
+static bool TestCompressedPointFile()
+{
+	const char* filename = "compressedpointfiletest.tmp";
+	const char* binaryFilename = "compressedpointfiletest_f64.tmp";
+	const double Quantum = 1.0 / 256;
+	const int RepeatCount = 20;
+	std::mt19937 generator(7);
+	std::normal_distribution<double> noise(0, 0.1);
+	std::vector<double> xPoints, yPoints;
+	for (int chain = 0; chain < 100; ++chain)
+	{
+		double a = 300 + chain, b = 200 + chain / 2.0;
+		size_t n = (size_t)(2 * M_PI * a);
+		for (size_t i = 0; i < n; ++i)
+		{
+			double t = 2 * M_PI * i / n;
+			xPoints.push_back(1000 + a * cos(t) * cos(0.4) - b * sin(t) * sin(0.4) + noise(generator));
+			yPoints.push_back(800 + a * cos(t) * sin(0.4) + b * sin(t) * cos(0.4) + noise(generator));
+		}
+	}
+
+	CompressedPointFile::Write(filename, xPoints.data(), yPoints.data(), xPoints.size(), Quantum);
+	BinaryPointFile::Write(binaryFilename, PointDataType::Float64, xPoints.data(), yPoints.data(), xPoints.size());
+
+	bool allOk = true;
+	{
+		CompressedPointFile file(filename);
+		BinaryPointFile binaryFile(binaryFilename);
+		MappedFile compressed(filename), uncompressed(binaryFilename);
+		printf("%u points: f64 %u bytes, compressed %u bytes (%.1lf bits per point)\n", (unsigned int)xPoints.size(), (unsigned int)uncompressed.GetSize(),
+			(unsigned int)compressed.GetSize(), 8.0 * compressed.GetSize() / xPoints.size());
+
+		std::vector<double> xDecoded, yDecoded;
+		file.Read(xDecoded, yDecoded);
+		double maxError = 0;
+		for (size_t i = 0; i < xPoints.size(); ++i)
+		{
+			maxError = (std::max)(maxError, (std::max)(std::abs(xDecoded[i] - xPoints[i]), std::abs(yDecoded[i] - yPoints[i])));
+		}
+
+		bool isOk = xDecoded.size() == xPoints.size() && maxError <= Quantum / 2;
+		printf("max. quantization error %lg <- %s\n", maxError, isOk ? "OK" : "FAIL");
+		allOk = allOk && isOk;
+
+		EllipseAlgebraicParameters<double> streamed, decoded, original;
+		double timeStreamed = MeasureMicrosecondsPerCall(RepeatCount, [&]()
+		{
+			NormalizedMomentAccumulator<double> moments(file.GetNormalization<double>());
+			file.AddToMoments(moments);
+			streamed = LeastSquareEllipseFitter<double>::Fit(moments);
+		});
+
+		double timeDecoded = MeasureMicrosecondsPerCall(RepeatCount, [&]()
+		{
+			std::vector<double> x, y;
+			file.Read(x, y);
+			decoded = LeastSquareEllipseFitter<double>::Fit(LeastSquareEllipseFitter<double>::PointAccessorFromTwoArrays(x.data(), y.data(), x.size()));
+		});
+
+		double timeBinary = MeasureMicrosecondsPerCall(RepeatCount, [&]()
+		{
+			binaryFile.Visit<double>([&](const auto& accessor) { original = LeastSquareEllipseFitter<double>::Fit(accessor); });
+		});
+
+		EllipseParameters<double> p1 = EllipseParameters<double>::FromAlgebraicParameters(streamed);
+		EllipseParameters<double> p2 = EllipseParameters<double>::FromAlgebraicParameters(decoded);
+		EllipseParameters<double> p3 = EllipseParameters<double>::FromAlgebraicParameters(original);
+		isOk = relativeDifference(p1.x0, p2.x0) < 1e-10 && relativeDifference(p1.y0, p2.y0) < 1e-10 && relativeDifference(p1.a, p2.a) < 1e-10 && relativeDifference(p1.b, p2.b) < 1e-10 &&
+			relativeDifference(p1.x0, p3.x0) < 1e-5 && relativeDifference(p1.y0, p3.y0) < 1e-5 && relativeDifference(p1.a, p3.a) < 1e-5 && relativeDifference(p1.b, p3.b) < 1e-5;
+		printf("x0=%lf y0=%lf a=%lf b=%lf angle=%lf\n", p1.x0, p1.y0, p1.a, p1.b, radToDegree(p1.theta));
+		printf("streaming fit %.0lf us, decode and fit %.0lf us, f64 file %.0lf us <- %s\n", timeStreamed, timeDecoded, timeBinary, isOk ? "OK" : "FAIL");
+		allOk = allOk && isOk;
+	}
+
+	// a file with a truncated index must be rejected
+	{
+		std::vector<char> content;
+		{
+			MappedFile file(filename);
+			content.assign(file.GetData(), file.GetData() + sizeof(CompressedPointFileHeader) + 16);
+		}
+
+		FILE* fp;
+		fopen_s(&fp, filename, "wb");
+		fwrite(content.data(), 1, content.size(), fp);
+		fclose(fp);
+	}
+
+	bool isRejected = false;
+	try
+	{
+		CompressedPointFile file(filename);
+	}
+	catch (std::runtime_error&)
+	{
+		isRejected = true;
+	}
+
+	remove(filename);
+	remove(binaryFilename);
+	printf("truncated file rejected <- %s\n", isRejected ? "OK" : "FAIL");
+	return allOk && isRejected;
+}
+
+/// <summary>	Writes many results from several threads in all formats and reads them back, and compares the time
+/// 			with fprintf. </summary>
+static bool TestResultWriter()
+{
+	const char* filename = "resultwritertest.tmp";
+	const size_t ResultCount = 1000000;
+	const size_t ThreadCount = 4;
+	std::mt19937 generator(11);
+	std::uniform_real_distribution<double> distribution(-2000, 2000);
+	std::vector<EllipseParameters<double>> ellipses(ResultCount);
+	for (auto& e : ellipses)
+	{
+		e.x0 = distribution(generator); e.y0 = distribution(generator); e.a = std::abs(distribution(generator)); e.b = std::abs(distribution(generator)) / 3; e.theta = distribution(generator) / 1000;
+	}
+
+	bool allOk = true;
+
+	// FormatDouble must agree with printf
+	{
+		std::vector<double> values = { 0, -0.0000004, 0.0000005, 0.0000015, 1.5, -1234.5678905, 999999.9999996, 1e20, -3e-9, 123456789.123456 };
+		std::uniform_real_distribution<double> exponent(-8, 8);
+		for (int i = 0; i < 100000; ++i)
+		{
+			values.push_back(distribution(generator) * pow(10.0, exponent(generator)));
+		}
+
+		bool isOk = true;
+		for (double v : values)
+		{
+			char fast[32], reference[64];
+			fast[ResultWriter::FormatDouble(fast, v, 6)] = '\0';
+			snprintf(reference, sizeof(reference), std::abs(v) * 1e6 < 9e15 ? "%.6f" : "%.17g", v);
+			isOk = isOk && strcmp(fast, reference) == 0;
+		}
+
+		printf("FormatDouble <- %s\n", isOk ? "OK" : "FAIL");
+		allOk = allOk && isOk;
+	}
+
+	double timeReference = MeasureMicrosecondsPerCall(1, [&]()
+	{
+		FILE* fp;
+		fopen_s(&fp, filename, "wb");
+		for (size_t i = 0; i < ResultCount; ++i)
+		{
+			const auto& e = ellipses[i];
+			fprintf(fp, "%u,,100,%lf,%lf,%lf,%lf,%lf\n", (unsigned int)i, e.x0, e.y0, e.a, e.b, e.theta);
+		}
+
+		fclose(fp);
+	});
+
+	printf("fprintf: %.0lf ms\n", timeReference / 1000);
+	const char* formatNames[] = { "csv", "jsonl", "bin" };
+	for (int f = 0; f < 3; ++f)
+	{
+		ResultFormat format;
+		ResultWriter::TryParseFormat(formatNames[f], format);
+		double time = MeasureMicrosecondsPerCall(1, [&]()
+		{
+			ResultWriter writer(filename, format);
+			ParallelFor(ThreadCount, [&](size_t t)
+			{
+				ResultWriter::LocalBuffer buffer(writer);
+				for (size_t i = t; i < ResultCount; i += ThreadCount)
+				{
+					buffer.Write(FitResult{ i, "a \"name\", with separators", 100, ellipses[i] });
+				}
+			}, (unsigned int)ThreadCount);
+			writer.Close();
+		});
+
+		// read back - every index exactly once, with the values within the precision of the format
+		std::vector<bool> isSeen(ResultCount, false);
+		size_t count = 0;
+		bool isOk = true;
+		MappedFile file(filename);
+		const char* p = file.GetData();
+		const char* end = p + file.GetSize();
+		if (format == ResultFormat::Binary)
+		{
+			p += 16;
+			isOk = (end - p) % 56 == 0;
+			for (; isOk && p < end; p += 56)
+			{
+				uint64_t index; double values[5];
+				memcpy(&index, p, 8);
+				memcpy(values, p + 16, sizeof(values));
+				isOk = index < ResultCount && !isSeen[index] && memcmp(values, &ellipses[index], sizeof(values)) == 0;
+				isSeen[index] = true;
+				++count;
+			}
+		}
+		else
+		{
+			if (format == ResultFormat::Csv)
+			{
+				p = TextPointReader::FindNewline(p, end) + 1;
+			}
+
+			while (isOk && p < end)
+			{
+				const char* lineEnd = TextPointReader::FindNewline(p, end);
+				std::string line(p, lineEnd);
+				p = lineEnd + 1;
+				unsigned int index; double x0, y0, a, b, theta;
+				int n = format == ResultFormat::Csv ?
+					sscanf_s(line.c_str(), "%u,\"a \"\"name\"\", with separators\",100,%lf,%lf,%lf,%lf,%lf", &index, &x0, &y0, &a, &b, &theta) :
+					sscanf_s(line.c_str(), "{\"index\":%u,\"name\":\"a \\\"name\\\", with separators\",\"points\":100,\"x0\":%lf,\"y0\":%lf,\"a\":%lf,\"b\":%lf,\"theta\":%lf}", &index, &x0, &y0, &a, &b, &theta);
+				isOk = n == 6 && index < ResultCount && !isSeen[index];
+				if (isOk)
+				{
+					const auto& e = ellipses[index];
+					isOk = std::abs(x0 - e.x0) <= 6e-7 && std::abs(y0 - e.y0) <= 6e-7 && std::abs(a - e.a) <= 6e-7 && std::abs(b - e.b) <= 6e-7 && std::abs(theta - e.theta) <= 6e-7;
+					isSeen[index] = true;
+					++count;
+				}
+			}
+		}
+
+		isOk = isOk && count == ResultCount;
+		printf("%s: %.0lf ms <- %s\n", formatNames[f], time / 1000, isOk ? "OK" : "FAIL");
+		allOk = allOk && isOk;
+	}
+
+	remove(filename);
+	return allOk;
+}
+
+/// <summary>	Writes an SVG with 1M points, with and without decimation, and compares with one circle element per
+/// 			point written with fprintf (the previous implementation). </summary>
+static bool TestSvgWriter()
+{
+	const char* filename = "svgwritertest.tmp";
+	const size_t PointCount = 1000000;
+	std::mt19937 generator(13);
+	std::uniform_real_distribution<double> angle(0, 2 * M_PI);
+	std::normal_distribution<double> noise(0, 3);
+	std::vector<double> xPoints, yPoints;
+	for (size_t i = 0; i < PointCount; ++i)
+	{
+		double t = angle(generator);
+		xPoints.push_back(1000 + 600 * cos(t) + noise(generator));
+		yPoints.push_back(800 + 300 * sin(t) + noise(generator));
+	}
+
+	LeastSquareEllipseFitter<double>::PointAccessorFromTwoArrays accessor(xPoints.data(), yPoints.data(), PointCount);
+	EllipseParameters<double> ellParams = EllipseParameters<double>::FromAlgebraicParameters(LeastSquareEllipseFitter<double>::Fit(accessor));
+
+	double timeReference = MeasureMicrosecondsPerCall(1, [&]()
+	{
+		FILE* fp;
+		fopen_s(&fp, filename, "w");
+		for (size_t i = 0; i < PointCount; ++i)
+		{
+			fprintf(fp, "<circle cx=\"%f\" cy=\"%f\" r=\"%f\" fill=\"black\" />\n", xPoints[i], yPoints[i], 2.0);
+		}
+
+		fclose(fp);
+	});
+
+	size_t sizeReference;
+	{
+		MappedFile file(filename);
+		sizeReference = file.GetSize();
+	}
+
+	bool allOk = true;
+	printf("fprintf, circles:  %7.0lf ms, %9u bytes\n", timeReference / 1000, (unsigned int)sizeReference);
+	for (int decimate = 0; decimate < 2; ++decimate)
+	{
+		SvgOptions options;
+		options.decimate = decimate != 0;
+		options.decimationResolution = 1024;
+		EllipseParameters<double> written = EllipseParameters<double>::Invalid();
+		double time = MeasureMicrosecondsPerCall(1, [&]() { written = LeastSquareFitAndWriteSvg(accessor, filename, options); });
+
+		// count the points (one "M" each), check that the file is complete and has the ellipse of the fit
+		MappedFile file(filename);
+		const char* data = file.GetData();
+		size_t count = std::count(data, data + file.GetSize(), 'M');
+		const char* closingTag = "</svg>\n";
+		char ellipseAttributes[64];
+		snprintf(ellipseAttributes, sizeof(ellipseAttributes), "rx=\"%.6f\" ry=\"%.6f\"", written.a, written.b);
+		bool isOk = file.GetSize() > strlen(closingTag) && memcmp(data + file.GetSize() - strlen(closingTag), closingTag, strlen(closingTag)) == 0 &&
+			(decimate ? count > 0 && count <= 1024 * 1024 : count == PointCount) && relativeDifference(written.a, ellParams.a) < 1e-9 && relativeDifference(written.b, ellParams.b) < 1e-9 &&
+			std::search(data, data + file.GetSize(), ellipseAttributes, ellipseAttributes + strlen(ellipseAttributes)) != data + file.GetSize();
+		printf("%s %7.0lf ms, %9u bytes, %u points <- %s\n", decimate ? "buffered, decimated:" : "buffered:         ", time / 1000, (unsigned int)file.GetSize(), (unsigned int)count, isOk ? "OK" : "FAIL");
+		allOk = allOk && isOk;
+	}
+
+	// with decimation, points outside of the view box are left out
+	{
+		const double xOutside[] = { 50, -10, 150, 50, 50 }, yOutside[] = { 50, 50, 50, -10, 150 };
+		size_t next = 0;
+		SvgOptions options;
+		options.decimate = true;
+		write_svg_points_and_ellipse(filename, 0, 0, 100, 100, [&](double& x, double& y)->bool
+		{
+			if (next == sizeof(xOutside) / sizeof(xOutside[0]))
+			{
+				return false;
+			}
+
+			x = xOutside[next];
+			y = yOutside[next];
+			++next;
+			return true;
+		}, 50, 50, 40, 20, 0, options);
+
+		MappedFile file(filename);
+		size_t count = std::count(file.GetData(), file.GetData() + file.GetSize(), 'M');
+		bool isOk = count == 1;
+		printf("decimated, points outside of the view box: %u of 5 points written <- %s\n", (unsigned int)count, isOk ? "OK" : "FAIL");
+		allOk = allOk && isOk;
+	}
+
+	remove(filename);
+	return allOk;
+}
+
+/// <summary>	Renders 1M points and the ellipse with one and with several threads, the images must be identical, the
+/// 			outline must be drawn where the ellipse is and the inside must stay empty. </summary>
+static bool TestRasterRenderer()
+{
+	const char* filename = "rastertest.tmp";
+	const size_t PointCount = 1000000;
+	const int Width = 2048, Height = 1536;
+	std::mt19937 generator(17);
+	std::uniform_real_distribution<double> angle(0, 2 * M_PI);
+	std::normal_distribution<double> noise(0, 2);
+	std::vector<double> xPoints, yPoints;
+	for (size_t i = 0; i < PointCount; ++i)
+	{
+		double t = angle(generator);
+		xPoints.push_back(1000 + 700 * cos(t) * cos(0.5) - 350 * sin(t) * sin(0.5) + noise(generator));
+		yPoints.push_back(750 + 700 * cos(t) * sin(0.5) + 350 * sin(t) * cos(0.5) + noise(generator));
+	}
+
+	LeastSquareEllipseFitter<double>::PointAccessorFromTwoArrays accessor(xPoints.data(), yPoints.data(), PointCount);
+	EllipseParameters<double> ellParams = EllipseParameters<double>::FromAlgebraicParameters(LeastSquareEllipseFitter<double>::Fit(accessor));
+
+	double minX, minY, maxX, maxY;
+	EllipseGeometry<double>::BoundingBox(ellParams, minX, minY, maxX, maxY);
+	double viewX, viewY, scale;
+	RasterRenderer::FitView(minX - 20, minY - 20, maxX + 20, maxY + 20, Width, Height, 8, viewX, viewY, scale);
+
+	RasterOptions options;
+	options.pointOpacity = 0.25;
+	RasterImage image(Width, Height, 3), reference(Width, Height, 3);
+	options.maxThreads = 1;
+	double timeSingle = MeasureMicrosecondsPerCall(1, [&]() { RasterRenderer(reference, viewX, viewY, scale, options).Render(accessor, &ellParams, 1); });
+	options.maxThreads = 4;
+	double timeParallel = MeasureMicrosecondsPerCall(1, [&]() { RasterRenderer(image, viewX, viewY, scale, options).Render(accessor, &ellParams, 1); });
+
+	bool isIdentical = true;
+	for (int y = 0; y < Height; ++y)
+	{
+		isIdentical = isIdentical && memcmp(image.GetRow(y), reference.GetRow(y), (size_t)Width * 3) == 0;
+	}
+
+	// on the outline the ellipse color dominates (the pixel center is up to 0.7 pixels off the curve, so the coverage
+	// may be below 1 and the points shine through), the center is untouched
+	bool isOutlineOk = true;
+	for (int i = 0; i < 360; ++i)
+	{
+		double x, y;
+		EllipseGeometry<double>::PointOnEllipse(ellParams, i * M_PI / 180, x, y);
+		const uint8_t* pixel = image.GetRow((int)((y - viewY) * scale)) + 3 * (int)((x - viewX) * scale);
+		isOutlineOk = isOutlineOk && std::abs(pixel[0] - options.ellipseColor.r) < 32 && std::abs(pixel[1] - options.ellipseColor.g) < 32 && std::abs(pixel[2] - options.ellipseColor.b) < 32;
+	}
+
+	const uint8_t* center = image.GetRow((int)((ellParams.y0 - viewY) * scale)) + 3 * (int)((ellParams.x0 - viewX) * scale);
+	isOutlineOk = isOutlineOk && center[0] == 255 && center[1] == 255 && center[2] == 255;
+
+	image.WritePnm(filename);
+	size_t fileSize;
+	{
+		MappedFile file(filename);
+		fileSize = file.GetSize();
+		isIdentical = isIdentical && memcmp(file.GetData(), "P6\n2048 1536\n255\n", 17) == 0;
+	}
+
+	remove(filename);
+	bool isOk = isIdentical && isOutlineOk && fileSize == 17 + (size_t)Width * Height * 3;
+	printf("%u points, %dx%d: 1 thread %.0lf ms, %u threads %.0lf ms, identical images <- %s, outline <- %s\n", (unsigned int)PointCount, Width, Height,
+		timeSingle / 1000, 4, timeParallel / 1000, isIdentical ? "OK" : "FAIL", isOutlineOk ? "OK" : "FAIL");
+	return isOk;
+}
+
+/// <summary>	Fits the ellipse to a file which is read in chunks of bounded size, see OutOfCoreEllipseFitter. </summary>
+static void LeastSquareFitOutOfCore(const char* szFilename, const PointFileOptions& pointFileOptions, const OutOfCoreOptions& outOfCoreOptions, ResultWriter* results)
+{
+	OutOfCoreStatistics statistics;
+	EllipseParameters<double> ellParams = EllipseParameters<double>::Invalid();
+	double time = MeasureMicrosecondsPerCall(1, [&]()
+	{
+		ellParams = EllipseParameters<double>::FromAlgebraicParameters(OutOfCoreEllipseFitter::Fit(szFilename, pointFileOptions, outOfCoreOptions, &statistics));
+	});
+
+	if (results != nullptr)
+	{
+		results->Write(FitResult{ 0, szFilename, statistics.pointCount, ellParams });
+	}
+	else
+	{
+		printf("x0=%lf y0=%lf a=%lf b=%lf angle=%lf\n", ellParams.x0, ellParams.y0, ellParams.a, ellParams.b, radToDegree(ellParams.theta));
+	}
+
+	printf("%llu points, %u pass(es), %u re-centering(s), %.1lf MB read in %.2lf s (%.0lf MB/s)\n", (unsigned long long)statistics.pointCount, statistics.passes,
+		statistics.recenterings, statistics.bytesRead / 1e6, time / 1e6, statistics.bytesRead / time);
+}
+
+/// <summary>	Fits the same points from a binary point file, an interleaved raw array and an .npy file with both read
+/// 			methods and both normalizations, with a small buffer, and compares with the in-memory fit. The points
+/// 			are sorted by angle, so the first chunks are not representative for the online normalization. </summary>
+static bool TestOutOfCoreFit()
+{
+	const char* binaryFilename = "outofcoretest.tmp";
+	const char* rawFilename = "outofcoretest_raw.tmp";
+	const char* npyFilename = "outofcoretest.npy";
+	const size_t PointCount = 2000000;
+	std::mt19937 generator(23);
+	std::normal_distribution<double> noise(0, 0.5);
+	std::vector<double> xPoints, yPoints, interleaved;
+	for (size_t i = 0; i < PointCount; ++i)
+	{
+		const double t = 2 * M_PI * i / PointCount;
+		xPoints.push_back(250000 + 900 * cos(t) * cos(1.1) - 300 * sin(t) * sin(1.1) + noise(generator));
+		yPoints.push_back(-40000 + 900 * cos(t) * sin(1.1) + 300 * sin(t) * cos(1.1) + noise(generator));
+		interleaved.push_back(xPoints.back());
+		interleaved.push_back(yPoints.back());
+	}
+
+	const EllipseParameters<double> reference = EllipseParameters<double>::FromAlgebraicParameters(
+		LeastSquareEllipseFitter<double>::Fit(LeastSquareEllipseFitter<double>::PointAccessorFromTwoArrays(xPoints.data(), yPoints.data(), PointCount)));
+
+	BinaryPointFile::Write(binaryFilename, PointDataType::Float64, xPoints.data(), yPoints.data(), PointCount);
+	NpyFile::Write(npyFilename, PointDataType::Float64, std::vector<uint64_t>{ PointCount, 2 }, false, interleaved.data());
+	{
+		FILE* fp;
+		fopen_s(&fp, rawFilename, "wb");
+		fwrite(interleaved.data(), sizeof(double), interleaved.size(), fp);
+		fclose(fp);
+	}
+
+	PointFileOptions rawOptions;
+	rawOptions.isRaw = true;
+	const struct { const char* description; const char* filename; PointFileOptions fileOptions; } files[3] =
+	{
+		{ "binary", binaryFilename, PointFileOptions() },
+		{ "raw", rawFilename, rawOptions },
+		{ "npy", npyFilename, PointFileOptions() }
+	};
+
+	bool allOk = true;
+	for (const auto& file : files)
+	{
+		for (int i = 0; i < 4; ++i)
+		{
+			OutOfCoreOptions options;
+			options.bufferSize = 1 << 20;
+			options.method = i % 2 == 0 ? ChunkedFileReader::Method::Mapping : ChunkedFileReader::Method::Read;
+			options.normalization = i < 2 ? OutOfCoreNormalization::TwoPass : OutOfCoreNormalization::Online;
+			OutOfCoreStatistics statistics;
+			EllipseParameters<double> ellParams = EllipseParameters<double>::Invalid();
+			double time = MeasureMicrosecondsPerCall(1, [&]()
+			{
+				ellParams = EllipseParameters<double>::FromAlgebraicParameters(OutOfCoreEllipseFitter::Fit(file.filename, file.fileOptions, options, &statistics));
+			});
+
+			const bool isOk = statistics.pointCount == PointCount &&
+				std::abs(ellParams.x0 - reference.x0) < 1e-6 * reference.a && std::abs(ellParams.y0 - reference.y0) < 1e-6 * reference.a &&
+				relativeDifference(ellParams.a, reference.a) < 1e-8 && relativeDifference(ellParams.b, reference.b) < 1e-8 && std::abs(ellParams.theta - reference.theta) < 1e-8;
+			printf("%-6s %-4s %-7s: %u pass(es), %2u re-centering(s), %4.0lf MB/s <- %s\n", file.description, i % 2 == 0 ? "mmap" : "read", i < 2 ? "twopass" : "online",
+				statistics.passes, statistics.recenterings, statistics.bytesRead / time, isOk ? "OK" : "FAIL");
+			allOk = allOk && isOk;
+		}
+	}
+
+	// a compressed file is decoded block by block, the reference is the fit of its (quantized) points
+	{
+		const char* compressedFilename = "outofcoretest_compressed.tmp";
+		CompressedPointFile::Write(compressedFilename, xPoints.data(), yPoints.data(), PointCount, 1.0 / 1024);
+		std::vector<double> xQuantized, yQuantized;
+		CompressedPointFile(compressedFilename).Read(xQuantized, yQuantized);
+		const EllipseParameters<double> quantizedReference = EllipseParameters<double>::FromAlgebraicParameters(
+			LeastSquareEllipseFitter<double>::Fit(LeastSquareEllipseFitter<double>::PointAccessorFromTwoArrays(xQuantized.data(), yQuantized.data(), xQuantized.size())));
+
+		OutOfCoreStatistics statistics;
+		EllipseParameters<double> ellParams = EllipseParameters<double>::Invalid();
+		double time = MeasureMicrosecondsPerCall(1, [&]()
+		{
+			ellParams = EllipseParameters<double>::FromAlgebraicParameters(OutOfCoreEllipseFitter::Fit(compressedFilename, PointFileOptions(), OutOfCoreOptions(), &statistics));
+		});
+
+		const CachedFit fit = FitPointFile(compressedFilename, PointFileOptions());
+		bool isOk = statistics.pointCount == PointCount && statistics.passes == 1 && fit.pointCount == PointCount;
+		for (const EllipseParameters<double>& e : { ellParams, fit.ellipse })
+		{
+			isOk = isOk && std::abs(e.x0 - quantizedReference.x0) < 1e-6 * quantizedReference.a && std::abs(e.y0 - quantizedReference.y0) < 1e-6 * quantizedReference.a &&
+				relativeDifference(e.a, quantizedReference.a) < 1e-8 && relativeDifference(e.b, quantizedReference.b) < 1e-8 && std::abs(e.theta - quantizedReference.theta) < 1e-8;
+		}
+
+		printf("compressed, out-of-core and FitPointFile: %u pass, %4.0lf MB/s <- %s\n", statistics.passes, statistics.bytesRead / time, isOk ? "OK" : "FAIL");
+		allOk = allOk && isOk;
+		remove(compressedFilename);
+	}
+
+	// text files cannot be read out-of-core
+	bool isRejected = false;
+	try
+	{
+		OutOfCoreEllipseFitter::Fit("outofcoretest_missing.txt", PointFileOptions(), OutOfCoreOptions());
+	}
+	catch (const std::exception&)
+	{
+		isRejected = true;
+	}
+
+	printf("missing or unsupported file rejected <- %s\n", isRejected ? "OK" : "FAIL");
+	remove(binaryFilename);
+	remove(rawFilename);
+	remove(npyFilename);
+	return allOk && isRejected;
+}
+
+/// <summary>	Writes the test cases and a few larger point sets as text files into the directory, plus files which cannot
+/// 			be fitted. Returns the files, which of them are broken and the results of the sequential fits. </summary>
+static std::vector<std::string> CreateBatchTestDirectory(const std::string& directory, std::vector<bool>& isBroken, std::vector<EllipseParameters<double>>& expected)
+{
+	DirectoryListing::CreateDirectoryIfMissing(directory.c_str());
+	std::mt19937 generator(5);
+	std::normal_distribution<double> noise(0, 1);
+	std::vector<std::string> brokenFiles;
+	auto writeFile = [&](const std::string& name, const double* x, const double* y, size_t count)
+	{
+		FILE* fp;
+		fopen_s(&fp, DirectoryListing::Combine(directory, name).c_str(), "wb");
+		for (size_t i = 0; i < count; ++i)
+		{
+			fprintf(fp, "%.17g %.17g\n", x[i], y[i]);
+		}
+
+		fclose(fp);
+	};
+
+	for (int i = 0;; ++i)
+	{
+		auto testParams = EllipseLeastSquareFitTestCases::GetTestCase(i);
+		if (testParams == nullptr)
+		{
+			break;
+		}
+
+		writeFile("testcase_" + std::to_string(i) + ".txt", testParams->pX, testParams->pY, testParams->count);
+	}
+
+	for (int i = 0; i < 50; ++i)
+	{
+		// sizes from 100 to about 100000 points, so the tasks are of very different cost
+		const size_t count = (size_t)(100 * pow(1000, i / 49.0));
+		std::vector<double> x, y;
+		for (size_t k = 0; k < count; ++k)
+		{
+			const double t = 2 * M_PI * k / count;
+			x.push_back(500 + (100 + i) * cos(t) + noise(generator));
+			y.push_back(400 + (60 + i) * sin(t) + noise(generator));
+		}
+
+		writeFile("generated_" + std::to_string(i) + ".txt", x.data(), y.data(), count);
+	}
+
+	const double x[2] = { 1, 2 }, y[2] = { 3, 4 };
+	writeFile("broken_toofew.txt", x, y, 2);
+	brokenFiles.push_back("broken_toofew.txt");
+	{
+		// the magic number of a binary point file without the rest of the header
+		FILE* fp;
+		fopen_s(&fp, DirectoryListing::Combine(directory, "broken_truncated.bin").c_str(), "wb");
+		fwrite("ELLPTS\r\n", 1, 8, fp);
+		fclose(fp);
+		brokenFiles.push_back("broken_truncated.bin");
+	}
+
+	const std::vector<std::string> files = DirectoryListing::GetFiles(directory.c_str());
+	isBroken.clear();
+	expected.clear();
+	for (const std::string& file : files)
+	{
+		const std::string name = DirectoryListing::GetFileName(file);
+		isBroken.push_back(std::find(brokenFiles.begin(), brokenFiles.end(), name) != brokenFiles.end());
+		EllipseParameters<double> ellParams = EllipseParameters<double>::Invalid();
+		if (!isBroken.back())
+		{
+			PointFileReader::Visit<double>(file.c_str(), [&](const auto& accessor) { ellParams = EllipseParameters<double>::FromAlgebraicParameters(LeastSquareEllipseFitter<double>::Fit(accessor)); });
+		}
+
+		expected.push_back(ellParams);
+	}
+
+	return files;
+}
+
+static void RemoveBatchTestDirectory(const std::string& directory)
+{
+	for (const std::string& file : DirectoryListing::GetFiles(directory.c_str()))
+	{
+		remove(file.c_str());
+	}
+
+	DirectoryListing::RemoveEmptyDirectory(directory.c_str());
+}
+
+/// <summary>	Checks that exactly the broken files failed and the others have the results of the sequential fits. </summary>
+static bool IsBatchOutcomeOk(const BatchFitOutcome& outcome, const std::vector<bool>& isBroken, const std::vector<EllipseParameters<double>>& expected)
+{
+	bool isOk = outcome.failedCount == (size_t)std::count(isBroken.begin(), isBroken.end(), true);
+	for (size_t i = 0; i < expected.size(); ++i)
+	{
+		const EllipseParameters<double>& e = outcome.ellipses[i];
+		isOk = isOk && outcome.errors[i].empty() != isBroken[i] &&
+			(isBroken[i] || (e.x0 == expected[i].x0 && e.y0 == expected[i].y0 && e.a == expected[i].a && e.b == expected[i].b && e.theta == expected[i].theta));
+	}
+
+	return isOk;
+}
+
+/// <summary>	The batch fit with several threads must match the sequential fits and report exactly the broken files. </summary>
+static bool TestBatchFit()
+{
+	const std::string directory = "batchfittest.tmp";
+	std::vector<bool> isBroken;
+	std::vector<EllipseParameters<double>> expected;
+	const std::vector<std::string> files = CreateBatchTestDirectory(directory, isBroken, expected);
+
+	bool allOk = true;
+	const unsigned int threadCounts[3] = { 1, 4, 0 };
+	for (unsigned int threadCount : threadCounts)
+	{
+		const BatchFitOutcome outcome = BatchFitFiles(files, PointFileOptions(), threadCount, nullptr);
+		const bool isOk = IsBatchOutcomeOk(outcome, isBroken, expected);
+		printf("%u threads: %u files (%u failed), %.0lf files/s, %.0lf points/s, %llu tasks stolen <- %s\n", outcome.threadCount, (unsigned int)files.size(),
+			(unsigned int)outcome.failedCount, files.size() / outcome.seconds, outcome.pointCount / outcome.seconds, (unsigned long long)outcome.stolenCount, isOk ? "OK" : "FAIL");
+		allOk = allOk && isOk;
+	}
+
+	{
+		// a script next to the point files is not taken for one
+		FILE* fp;
+		fopen_s(&fp, DirectoryListing::Combine(directory, "runtest.cmd").c_str(), "wb");
+		fputs("EllipseUtils.exe --command batchfit --input-dir .\n", fp);
+		fclose(fp);
+		const bool isOk = DirectoryListing::GetFiles(directory.c_str(), DefaultPointFilePatterns) == files && DirectoryListing::GetFiles(directory.c_str(), "*").size() == files.size() + 1 &&
+			DirectoryListing::MatchesPattern("ArcTest_1.TXT", "*.bin;*.txt") && DirectoryListing::MatchesPattern("a_b.txt", "a*?.t*t") &&
+			!DirectoryListing::MatchesPattern("a.txt.bak", "*.txt") && !DirectoryListing::MatchesPattern("a.txt", ";;");
+		printf("file patterns: runtest.cmd not fitted <- %s\n", isOk ? "OK" : "FAIL");
+		allOk = allOk && isOk;
+	}
+
+	{
+		// e.g. from a raw file read with the wrong data type, where the center comes out finite
+		const double nan = std::numeric_limits<double>::quiet_NaN(), infinity = std::numeric_limits<double>::infinity();
+		const bool isOk = GetFitError(CachedFit{ 80, EllipseParameters<double>{ 1, 2, -nan, 4, 0.5 } }) != nullptr &&
+			GetFitError(CachedFit{ 80, EllipseParameters<double>{ 1, 2, 3, 4, infinity } }) != nullptr && GetFitError(CachedFit{ 80, EllipseParameters<double>{ 1, 2, 3, 4, 0.5 } }) == nullptr;
+		printf("non-finite axes or angle count as failed <- %s\n", isOk ? "OK" : "FAIL");
+		allOk = allOk && isOk;
+	}
+
+	RemoveBatchTestDirectory(directory);
+	return allOk;
+}
+
+/// <summary>	Checks the lock-free queue with several producers and consumers, then runs the batch through pipelines
+/// 			with different numbers of threads per stage and queue sizes, which must match the sequential fits. </summary>
+static bool TestBatchPipeline()
+{
+	bool allOk = true;
+	{
+		const size_t ItemsPerProducer = 250000;
+		const unsigned int ProducerCount = 4, ConsumerCount = 4;
+		BoundedQueue<uint64_t> queue(64);
+		std::atomic<unsigned int> activeProducers(ProducerCount);
+		std::atomic<uint64_t> sum(0), popCount(0);
+		std::vector<std::thread> threads;
+		for (unsigned int p = 0; p < ProducerCount; ++p)
+		{
+			threads.emplace_back([&, p]()
+			{
+				for (uint64_t i = 0; i < ItemsPerProducer; ++i)
+				{
+					uint64_t value = p * ItemsPerProducer + i + 1;
+					while (!queue.TryPush(value))
+					{
+						std::this_thread::yield();
+					}
+				}
+
+				--activeProducers;
+			});
+		}
+
+		for (unsigned int c = 0; c < ConsumerCount; ++c)
+		{
+			threads.emplace_back([&]()
+			{
+				uint64_t value, localSum = 0, localCount = 0;
+				for (;;)
+				{
+					const bool isDone = activeProducers.load() == 0;
+					if (queue.TryPop(value))
+					{
+						localSum += value;
+						++localCount;
+					}
+					else if (isDone)
+					{
+						break;
+					}
+					else
+					{
+						std::this_thread::yield();
+					}
+				}
+
+				sum += localSum;
+				popCount += localCount;
+			});
+		}
+
+		for (auto& thread : threads)
+		{
+			thread.join();
+		}
+
+		const uint64_t n = ProducerCount * ItemsPerProducer;
+		const bool isOk = popCount.load() == n && sum.load() == n * (n + 1) / 2 && queue.GetApproximateSize() == 0;
+		printf("queue: %u producers, %u consumers, %llu items <- %s\n", ProducerCount, ConsumerCount, (unsigned long long)n, isOk ? "OK" : "FAIL");
+		allOk = allOk && isOk;
+	}
+
+	const std::string directory = "pipelinetest.tmp";
+	std::vector<bool> isBroken;
+	std::vector<EllipseParameters<double>> expected;
+	const std::vector<std::string> files = CreateBatchTestDirectory(directory, isBroken, expected);
+	const unsigned int configurations[3][4] = { { 1, 1, 1, 1 }, { 2, 4, 2, 4 }, { 1, 0, 1, 8 } };
+	for (const auto& configuration : configurations)
+	{
+		BatchPipelineOptions options;
+		options.readerThreads = configuration[0];
+		options.fitterThreads = configuration[1];
+		options.writerThreads = configuration[2];
+		options.queueCapacity = configuration[3];
+		BatchPipelineStatistics statistics;
+		const BatchFitOutcome outcome = BatchFitFilesPipelined(files, PointFileOptions(), options, nullptr, nullptr, statistics);
+		const bool isOk = IsBatchOutcomeOk(outcome, isBroken, expected) && statistics.reader.itemCount == files.size() && statistics.fitter.itemCount == files.size() &&
+			statistics.writer.itemCount == files.size() && statistics.readQueue.maxOccupancy <= statistics.readQueue.capacity && statistics.fitQueue.maxOccupancy <= statistics.fitQueue.capacity;
+		printf("%u/%u/%u threads, queues of %u: %u files (%u failed), %.0lf files/s <- %s\n", statistics.reader.threadCount, statistics.fitter.threadCount, statistics.writer.threadCount,
+			(unsigned int)statistics.readQueue.capacity, (unsigned int)files.size(), (unsigned int)outcome.failedCount, files.size() / outcome.seconds, isOk ? "OK" : "FAIL");
+		PrintPipelineStatistics(statistics);
+		allOk = allOk && isOk;
+	}
+
+	RemoveBatchTestDirectory(directory);
+	return allOk;
+}
+
+/// <summary>	Streams 300 point sets (text with irregular blank lines and CRLF, and binary frames) through the
+/// 			service with the results in order and unordered, and compares with direct fits. </summary>
+static bool TestStreamFit()
+{
+	const size_t SetCount = 300;
+	std::mt19937 generator(13);
+	std::normal_distribution<double> noise(0, 0.5);
+	std::uniform_int_distribution<int> sizes(5, 3000);
+	std::vector<std::vector<double>> xSets(SetCount), ySets(SetCount);
+	std::string text = "\n\n";
+	std::vector<char> binary;
+	for (size_t i = 0; i < SetCount; ++i)
+	{
+		// every 50th set has too few points for a fit, and every 50th lies exactly on a circle
+		const bool isExact = i % 50 == 23;
+		const size_t count = i % 50 == 7 ? 3 : isExact ? 5 : (size_t)sizes(generator);
+		for (size_t k = 0; k < count; ++k)
+		{
+			const double t = 2 * M_PI * k / count;
+			xSets[i].push_back(isExact ? 10 + cos(t) : 200 + i + (80 + i % 17) * cos(t) + noise(generator));
+			ySets[i].push_back(isExact ? -5 + sin(t) : -100 + (30 + i % 11) * sin(t) + noise(generator));
+			char line[64];
+			snprintf(line, sizeof(line), "%.17g %.17g%s\n", xSets[i][k], ySets[i][k], k % 3 == 0 ? "\r" : "");
+			text += line;
+		}
+
+		text += i % 4 == 0 ? "\n \t\n\r\n" : "\n";
+		const uint32_t count32 = (uint32_t)count;
+		binary.insert(binary.end(), (const char*)&count32, (const char*)&count32 + 4);
+		for (size_t k = 0; k < count; ++k)
+		{
+			binary.insert(binary.end(), (const char*)&xSets[i][k], (const char*)&xSets[i][k] + 8);
+			binary.insert(binary.end(), (const char*)&ySets[i][k], (const char*)&ySets[i][k] + 8);
+		}
+	}
+
+	std::vector<EllipseParameters<double>> expected;
+	for (size_t i = 0; i < SetCount; ++i)
+	{
+		LeastSquareEllipseFitter<double>::PointAccessorFromTwoArrays accessor(xSets[i].data(), ySets[i].data(), xSets[i].size());
+		expected.push_back(FitEllipse<double>(accessor));
+	}
+
+	bool allOk = true;
+
+	// points exactly on a circle must give that circle
+	{
+		bool isOk = true;
+		for (size_t i = 23; i < SetCount; i += 50)
+		{
+			const EllipseParameters<double>& e = expected[i];
+			isOk = isOk && relativeDifference(e.x0, 10.0) < 1e-9 && relativeDifference(e.y0, -5.0) < 1e-9 && relativeDifference(e.a, 1.0) < 1e-9 && relativeDifference(e.b, 1.0) < 1e-9;
+		}
+
+		printf("points exactly on a circle: the circle <- %s\n", isOk ? "OK" : "FAIL");
+		allOk = allOk && isOk;
+	}
+
+	// the frames must not depend on how the stream is split into pieces
+	for (int f = 0; f < 2; ++f)
+	{
+		const StreamFraming framing = f == 0 ? StreamFraming::BlankLine : StreamFraming::LengthPrefixed;
+		const char* data = f == 0 ? text.data() : binary.data();
+		const size_t size = f == 0 ? text.size() : binary.size();
+		bool isOk = true;
+		for (size_t pieceSize : { (size_t)1, (size_t)7, (size_t)4096, size })
+		{
+			StreamFrameParser parser(framing);
+			size_t frameCount = 0;
+			auto onFrame = [&](std::vector<char>& frame)
+			{
+				std::vector<double> x, y;
+				StreamFrameParser::GetPoints(framing, frame, x, y);
+				isOk = isOk && frameCount < SetCount && x.size() == xSets[frameCount].size() && y.size() == x.size() &&
+					(x.empty() || (relativeDifference(x.back(), xSets[frameCount].back()) < 1e-12 && relativeDifference(y.back(), ySets[frameCount].back()) < 1e-12));
+				++frameCount;
+			};
+
+			for (size_t offset = 0; offset < size; offset += pieceSize)
+			{
+				parser.Feed(data + offset, (std::min)(pieceSize, size - offset), onFrame);
+			}
+
+			parser.Finish(onFrame);
+			isOk = isOk && frameCount == SetCount;
+		}
+
+		bool isTruncationDetected = false, isEmptyLastFrameEmitted = false;
+		if (framing == StreamFraming::LengthPrefixed)
+		{
+			StreamFrameParser parser(framing);
+			parser.Feed(data, size - 1, [](std::vector<char>&) {});
+			try
+			{
+				parser.Finish([](std::vector<char>&) {});
+			}
+			catch (std::runtime_error&)
+			{
+				isTruncationDetected = true;
+			}
+
+			// a frame without points whose prefix ends the stream, with the prefix split over two pieces
+			StreamFrameParser emptyLast(framing);
+			size_t frameCount = 0;
+			const char zeroCount[4] = { 0, 0, 0, 0 };
+			auto onFrame = [&](std::vector<char>& frame) { frameCount += frame.empty() ? 1 : 0; };
+			emptyLast.Feed(zeroCount, 2, onFrame);
+			emptyLast.Feed(zeroCount + 2, 2, onFrame);
+			try
+			{
+				emptyLast.Finish(onFrame);
+				isEmptyLastFrameEmitted = frameCount == 1;
+			}
+			catch (std::runtime_error&)
+			{
+			}
+		}
+
+		isOk = isOk && (framing == StreamFraming::BlankLine || (isTruncationDetected && isEmptyLastFrameEmitted));
+		printf("%s frames, split into pieces: %u sets <- %s\n", f == 0 ? "text" : "binary", (unsigned int)SetCount, isOk ? "OK" : "FAIL");
+		allOk = allOk && isOk;
+	}
+
+	const char* inputFilename = "streamtest.in.tmp";
+	const char* outputFilename = "streamtest.out.tmp";
+	for (int f = 0; f < 2; ++f)
+	{
+		FILE* fp;
+		fopen_s(&fp, inputFilename, "wb");
+		f == 0 ? fwrite(text.data(), 1, text.size(), fp) : fwrite(binary.data(), 1, binary.size(), fp);
+		fclose(fp);
+		for (bool isOrdered : { true, false })
+		{
+			StreamFitOptions options;
+			options.framing = f == 0 ? StreamFraming::BlankLine : StreamFraming::LengthPrefixed;
+			options.format = ResultFormat::Binary;
+			options.isOrdered = isOrdered;
+			options.threadCount = 4;
+			options.maxPendingSets = 16;
+			FILE* input; FILE* output;
+			fopen_s(&input, inputFilename, "rb");
+			fopen_s(&output, outputFilename, "wb");
+			const StreamFitStatistics statistics = StreamFitService::Run(input, output, options);
+			fclose(input);
+			fclose(output);
+
+			// read back - in ordered mode the indices must be ascending
+			std::vector<bool> isSeen(SetCount, false);
+			size_t count = 0;
+			bool isOk = true, isAscending = true;
+			{
+				MappedFile file(outputFilename);
+				const char* p = file.GetData() + 16;
+				const char* end = file.GetData() + file.GetSize();
+				isOk = (end - p) % 56 == 0;
+				for (; isOk && p < end; p += 56)
+				{
+					uint64_t index, pointCount; double values[5];
+					memcpy(&index, p, 8);
+					memcpy(&pointCount, p + 8, 8);
+					memcpy(values, p + 16, sizeof(values));
+					isOk = index < SetCount && !isSeen[index] && pointCount == xSets[index].size();
+					if (isOk)
+					{
+						const EllipseParameters<double>& e = expected[index];
+						isOk = e.IsValid() ? (relativeDifference(values[0], e.x0) < 1e-9 && relativeDifference(values[1], e.y0) < 1e-9 &&
+							relativeDifference(values[2], e.a) < 1e-9 && relativeDifference(values[3], e.b) < 1e-9) : std::isnan(values[0]);
+						isAscending = isAscending && index == count;
+						isSeen[index] = true;
+						++count;
+					}
+				}
+			}
+
+			isOk = isOk && count == SetCount && (!isOrdered || isAscending) && statistics.setCount == SetCount && statistics.failedCount == SetCount / 50;
+			printf("%s frames, %s: %u sets, %.0lf sets/s <- %s\n", f == 0 ? "text" : "binary", isOrdered ? "ordered" : "unordered", (unsigned int)statistics.setCount,
+				statistics.setCount / statistics.seconds, isOk ? "OK" : "FAIL");
+			allOk = allOk && isOk;
+		}
+	}
+
+	remove(inputFilename);
+	remove(outputFilename);
+	return allOk;
+}
+
+/// <summary>	Runs a fit server on a socket in the working directory with synchronous and pipelining clients,
+/// 			compares the responses with direct fits and checks the statistics. </summary>
+static bool TestFitServer()
+{
+	const char* path = "servetest.sock";
+	const size_t SetCount = 64;
+	std::mt19937 generator(17);
+	std::normal_distribution<double> noise(0, 0.5);
+	std::uniform_int_distribution<int> sizes(5, 2000);
+	std::vector<std::vector<double>> xSets(SetCount), ySets(SetCount);
+	std::vector<EllipseParameters<double>> expected;
+	for (size_t i = 0; i < SetCount; ++i)
+	{
+		// one set has too few points for a fit
+		const size_t count = i == 5 ? 3 : (size_t)sizes(generator);
+		for (size_t k = 0; k < count; ++k)
+		{
+			const double t = 2 * M_PI * k / count;
+			xSets[i].push_back(100 + i + (50 + i) * cos(t) + noise(generator));
+			ySets[i].push_back(50 + (20 + i % 7) * sin(t) + noise(generator));
+		}
+
+		LeastSquareEllipseFitter<double>::PointAccessorFromTwoArrays accessor(xSets[i].data(), ySets[i].data(), count);
+		expected.push_back(FitEllipse<double>(accessor));
+	}
+
+	auto isResponseOk = [&](const FitResponse& response, uint32_t id, size_t set)
+	{
+		const EllipseParameters<double> e = FitClient::GetEllipse(response);
+		return response.id == id && response.pointCount == xSets[set].size() && e.IsValid() == expected[set].IsValid() &&
+			(!e.IsValid() || (relativeDifference(e.x0, expected[set].x0) < 1e-9 && relativeDifference(e.a, expected[set].a) < 1e-9 && relativeDifference(e.b, expected[set].b) < 1e-9)) &&
+			(xSets[set].size() >= LeastSquareEllipseFitter<double>::MinPointCount || response.status == FitStatus::TooFewPoints);
+	};
+
+	FitServerOptions options;
+	options.latencyBudgetMicroseconds = 200;
+	options.fitterThreads = 2;
+	FitServer server(path, options);
+	std::thread serverThread([&]() { server.Run(); });
+
+	bool allOk = true;
+	const size_t ClientCount = 4, RequestsPerClient = 200;
+	{
+		std::atomic<bool> isOk(true);
+		std::vector<std::thread> clients;
+		auto start = std::chrono::steady_clock::now();
+		for (size_t c = 0; c < ClientCount; ++c)
+		{
+			clients.emplace_back([&, c]()
+			{
+				try
+				{
+					FitClient client(path);
+					for (size_t r = 0; r < RequestsPerClient; ++r)
+					{
+						const size_t set = (c * 7 + r) % SetCount;
+						const uint32_t id = client.SendFit(xSets[set].data(), ySets[set].data(), xSets[set].size());
+						isOk = isOk && isResponseOk(client.ReceiveFit(), id, set);
+					}
+				}
+				catch (std::runtime_error&)
+				{
+					isOk = false;
+				}
+			});
+		}
+
+		for (auto& client : clients)
+		{
+			client.join();
+		}
+
+		const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		printf("%u synchronous clients: %u requests, %.0lf requests/s <- %s\n", (unsigned int)ClientCount, (unsigned int)(ClientCount * RequestsPerClient),
+			ClientCount * RequestsPerClient / seconds, isOk ? "OK" : "FAIL");
+		allOk = allOk && isOk;
+	}
+
+	// all requests are sent before the first response is read, so they queue up and form batches
+	{
+		bool isOk = true;
+		FitClient client(path);
+		std::vector<uint32_t> ids;
+		for (size_t set = 0; set < SetCount; ++set)
+		{
+			ids.push_back(client.SendFit(xSets[set].data(), ySets[set].data(), xSets[set].size()));
+		}
+
+		for (size_t set = 0; set < SetCount; ++set)
+		{
+			isOk = isOk && isResponseOk(client.ReceiveFit(), ids[set], set);
+		}
+
+		const FitServerStatistics statistics = client.GetStatistics();
+		const uint64_t requestCount = ClientCount * RequestsPerClient + SetCount;
+		isOk = isOk && statistics.requestCount == requestCount && statistics.batchCount <= requestCount && statistics.maxBatchSize > 1 &&
+			statistics.meanBatchSize >= 1 && statistics.latencyP50Microseconds <= statistics.latencyP99Microseconds && statistics.latencyP99Microseconds <= statistics.latencyMaxMicroseconds;
+		printf("pipelined client: %u requests; %llu batches, mean size %.1lf, max %llu; latency p50 %.0lf us, p90 %.0lf us, p99 %.0lf us <- %s\n", (unsigned int)SetCount,
+			(unsigned long long)statistics.batchCount, statistics.meanBatchSize, (unsigned long long)statistics.maxBatchSize,
+			statistics.latencyP50Microseconds, statistics.latencyP90Microseconds, statistics.latencyP99Microseconds, isOk ? "OK" : "FAIL");
+		allOk = allOk && isOk;
+	}
+
+	// a malformed request ends the connection, but not the server
+	{
+		bool isClosed = false;
+		{
+			LocalSocket socket = LocalSocket::Connect(path);
+			const uint32_t garbage[4] = { 77, 0, 0, 0 };
+			char byte;
+			isClosed = socket.SendAll(garbage, sizeof(garbage)) && !socket.ReceiveAll(&byte, 1);
+		}
+
+		FitClient client(path);
+		const bool isOk = isClosed && isResponseOk(client.Fit(xSets[0].data(), ySets[0].data(), xSets[0].size()), 0, 0);
+		printf("malformed request: connection closed, server still serving <- %s\n", isOk ? "OK" : "FAIL");
+		allOk = allOk && isOk;
+	}
+
+	// points exactly on a circle or an ellipse must give that ellipse, collinear points none - and must not take the server down
+	{
+		std::vector<std::vector<double>> xExact = { { 5, 4, 3, 4, 4 + M_SQRT1_2 }, {}, { 0, 1, 2, 3, 4, 5 } };
+		std::vector<std::vector<double>> yExact = { { -3, -2, -3, -4, -3 + M_SQRT1_2 }, {}, { 0, 2, 4, 6, 8, 10 } };
+		for (int k = 0; k < 20; ++k)
+		{
+			xExact[1].push_back(3 + 5 * cos(2 * M_PI * k / 20));
+			yExact[1].push_back(2 + 2 * sin(2 * M_PI * k / 20));
+		}
+
+		bool isOk = true;
+		FitClient client(path);
+		for (size_t k = 0; k < xExact.size(); ++k)
+		{
+			const FitResponse response = client.Fit(xExact[k].data(), yExact[k].data(), xExact[k].size());
+			const EllipseParameters<double> e = FitClient::GetEllipse(response);
+			switch (k)
+			{
+			case 0:
+				isOk = isOk && response.status == FitStatus::Ok && relativeDifference(e.x0, 4.0) < 1e-9 && relativeDifference(e.y0, -3.0) < 1e-9 &&
+					relativeDifference(e.a, 1.0) < 1e-9 && relativeDifference(e.b, 1.0) < 1e-9;
+				break;
+			case 1:
+				isOk = isOk && response.status == FitStatus::Ok && relativeDifference(e.x0, 3.0) < 1e-9 && relativeDifference(e.y0, 2.0) < 1e-9 &&
+					relativeDifference((std::max)(e.a, e.b), 5.0) < 1e-9 && relativeDifference((std::min)(e.a, e.b), 2.0) < 1e-9;
+				break;
+			default:
+				isOk = isOk && response.status == FitStatus::NoEllipse && !e.IsValid();
+				break;
+			}
+		}
+
+		isOk = isOk && isResponseOk(client.Fit(xSets[0].data(), ySets[0].data(), xSets[0].size()), (uint32_t)xExact.size(), 0);
+		printf("exact circle, exact ellipse: fitted exactly; collinear points: no ellipse; server still serving <- %s\n", isOk ? "OK" : "FAIL");
+		allOk = allOk && isOk;
+	}
+
+	server.Stop();
+	serverThread.join();
+
+	// with a cache, repeated sets are answered without a fit - pipelined ones still in the order of the requests
+	{
+		options.cacheCapacity = 1024;
+		FitServer cachingServer(path, options);
+		std::thread cachingThread([&]() { cachingServer.Run(); });
+		bool isOk = true;
+		{
+			FitClient client(path);
+			std::vector<uint32_t> ids;
+			for (size_t r = 0; r < 2 * SetCount; ++r)
+			{
+				ids.push_back(client.SendFit(xSets[r % SetCount].data(), ySets[r % SetCount].data(), xSets[r % SetCount].size()));
+			}
+
+			for (size_t r = 0; r < 2 * SetCount; ++r)
+			{
+				isOk = isOk && isResponseOk(client.ReceiveFit(), ids[r], r % SetCount);
+			}
+
+			for (size_t set = 0; set < SetCount; ++set)
+			{
+				const uint32_t id = client.SendFit(xSets[set].data(), ySets[set].data(), xSets[set].size());
+				isOk = isOk && isResponseOk(client.ReceiveFit(), id, set);
+			}
+		}
+
+		const ResultCacheStatistics statistics = cachingServer.GetCacheStatistics();
+		isOk = isOk && statistics.hitCount >= SetCount && statistics.entryCount == SetCount;
+		printf("result cache: %u requests, %llu hits <- %s\n", (unsigned int)(3 * SetCount), (unsigned long long)statistics.hitCount, isOk ? "OK" : "FAIL");
+		allOk = allOk && isOk;
+		cachingServer.Stop();
+		cachingThread.join();
+	}
+
+	return allOk;
+}
+
+/// <summary>	Fits sets through the shared memory ring with several sets in flight and compares with direct fits,
+/// 			then measures the round trip latency of the ring against the socket server for several set sizes. </summary>
+static bool TestSharedRingFit()
+{
+	const char* ringName = "ellipseutils_ringtest";
+	const char* socketPath = "ringtest.sock";
+	const uint32_t SlotCount = 8, SlotCapacity = 100000;
+	SharedRingFitServer ringServer(ringName, SlotCount, SlotCapacity);
+	std::thread ringThread([&]() { ringServer.Run(); });
+
+	bool allOk = true;
+	{
+		const size_t SetCount = 100;
+		std::mt19937 generator(19);
+		std::normal_distribution<double> noise(0, 0.5);
+		std::uniform_int_distribution<int> sizes(5, 5000);
+		SharedRingFitClient client(ringName);
+		std::deque<EllipseParameters<double>> expected;
+		bool isOk = true;
+		uint32_t nextId = 0;
+		auto receive = [&]()
+		{
+			const FitResponse response = client.ReceiveResult();
+			const EllipseParameters<double> e = FitClient::GetEllipse(response);
+			isOk = isOk && response.id == nextId++ && e.IsValid() == expected.front().IsValid() &&
+				(!e.IsValid() || (relativeDifference(e.x0, expected.front().x0) < 1e-9 && relativeDifference(e.a, expected.front().a) < 1e-9 && relativeDifference(e.b, expected.front().b) < 1e-9));
+			expected.pop_front();
+		};
+
+		for (size_t i = 0; i < SetCount; ++i)
+		{
+			if (expected.size() == SlotCount)
+			{
+				receive();
+			}
+
+			// the points are generated right in the slot
+			SharedRingFitClient::Slot slot = client.AcquireSlot();
+			const uint32_t count = i == 3 ? 3 : (uint32_t)sizes(generator);
+			for (uint32_t k = 0; k < count; ++k)
+			{
+				const double t = 2 * M_PI * k / count;
+				slot.x[k] = 300 + i + (40 + i) * cos(t) + noise(generator);
+				slot.y[k] = 200 + (25 + i % 5) * sin(t) + noise(generator);
+			}
+
+			LeastSquareEllipseFitter<double>::PointAccessorFromTwoArrays accessor(slot.x, slot.y, count);
+			expected.push_back(FitEllipse<double>(accessor));
+			client.Submit(slot, count);
+		}
+
+		bool isFullDetected = expected.size() < SlotCount;
+		try
+		{
+			client.AcquireSlot();
+		}
+		catch (std::logic_error&)
+		{
+			isFullDetected = true;
+		}
+
+		// Fit would receive the result of the oldest set in flight instead of its own
+		bool isInFlightDetected = false;
+		try
+		{
+			const double xy[5] = { 0, 1, 2, 3, 4 };
+			client.Fit(xy, xy, 5);
+		}
+		catch (std::logic_error&)
+		{
+			isInFlightDetected = true;
+		}
+
+		while (!expected.empty())
+		{
+			receive();
+		}
+
+		isOk = isOk && isFullDetected && isInFlightDetected && ringServer.GetCompletedCount() == SetCount;
+		printf("ring: %u sets, up to %u in flight <- %s\n", (unsigned int)SetCount, SlotCount, isOk ? "OK" : "FAIL");
+		allOk = allOk && isOk;
+	}
+
+	// the socket server answers at once, so both measure the transport plus the fit
+	FitServerOptions socketOptions;
+	socketOptions.latencyBudgetMicroseconds = 0;
+	socketOptions.fitterThreads = 1;
+	FitServer socketServer(socketPath, socketOptions);
+	std::thread socketThread([&]() { socketServer.Run(); });
+	{
+		SharedRingFitClient ringClient(ringName);
+		FitClient socketClient(socketPath);
+		std::mt19937 generator(23);
+		std::normal_distribution<double> noise(0, 0.1);
+		for (size_t count : { (size_t)16, (size_t)1000, (size_t)100000 })
+		{
+			std::vector<double> x(count), y(count);
+			for (size_t k = 0; k < count; ++k)
+			{
+				x[k] = 10 * cos(2 * M_PI * k / count) + noise(generator);
+				y[k] = 5 * sin(2 * M_PI * k / count) + noise(generator);
+			}
+
+			const int repeatCount = count > 10000 ? 50 : 500;
+			std::vector<double> ringLatencies, socketLatencies;
+			bool isOk = true;
+			for (int r = 0; r < repeatCount; ++r)
+			{
+				auto start = std::chrono::steady_clock::now();
+				isOk = isOk && ringClient.Fit(x.data(), y.data(), count).status == FitStatus::Ok;
+				auto middle = std::chrono::steady_clock::now();
+				isOk = isOk && socketClient.Fit(x.data(), y.data(), count).status == FitStatus::Ok;
+				ringLatencies.push_back(std::chrono::duration<double, std::micro>(middle - start).count());
+				socketLatencies.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - middle).count());
+			}
+
+			std::sort(ringLatencies.begin(), ringLatencies.end());
+			std::sort(socketLatencies.begin(), socketLatencies.end());
+			printf("%u points: ring p50 %.1lf us, p99 %.1lf us; socket p50 %.1lf us, p99 %.1lf us <- %s\n", (unsigned int)count,
+				ringLatencies[repeatCount / 2], ringLatencies[repeatCount * 99 / 100], socketLatencies[repeatCount / 2], socketLatencies[repeatCount * 99 / 100], isOk ? "OK" : "FAIL");
+			allOk = allOk && isOk;
+		}
+	}
+
+	socketServer.Stop();
+	socketThread.join();
+	ringServer.Stop();
+	ringThread.join();
+	return allOk;
+}
+
+/// <summary>	Calls the C interface like an external caller would and compares with the templates: single and
+/// 			batched fits, the 5-point batch, the conversions, invalid arguments, and one context per thread. </summary>
+static bool TestFitApi()
+{
+	bool allOk = true;
+	const size_t SetCount = 400;
+	std::mt19937 generator(29);
+	std::normal_distribution<double> noise(0, 0.3);
+	std::uniform_int_distribution<int> sizes(0, 500);
+	std::vector<double> x, y, xy;
+	std::vector<size_t> offsets(1, 0);
+	for (size_t i = 0; i < SetCount; ++i)
+	{
+		const size_t count = (size_t)sizes(generator);
+		for (size_t k = 0; k < count; ++k)
+		{
+			const double t = 2 * M_PI * k / count;
+			x.push_back(i + 70 * cos(t) + noise(generator));
+			y.push_back(-20.0 + 30 * sin(t) + noise(generator));
+			xy.push_back(x.back());
+			xy.push_back(y.back());
+		}
+
+		offsets.push_back(x.size());
+	}
+
+	{
+		ellipsefit_context* context = ellipsefit_context_create();
+		std::vector<ellipsefit_ellipse> ellipses(SetCount);
+		std::vector<int32_t> statuses(SetCount);
+		const size_t okCount = ellipsefit_fit_batch(context, x.data(), y.data(), offsets.data(), SetCount, ellipses.data(), statuses.data());
+		bool isOk = ellipsefit_abi_version() == ELLIPSEFIT_ABI_VERSION;
+		size_t expectedOkCount = 0;
+		for (size_t i = 0; i < SetCount; ++i)
+		{
+			const size_t count = offsets[i + 1] - offsets[i];
+			LeastSquareEllipseFitter<double>::PointAccessorFromTwoArrays accessor(x.data() + offsets[i], y.data() + offsets[i], count);
+			const EllipseParameters<double> expected = FitEllipse<double>(accessor);
+			expectedOkCount += expected.IsValid() ? 1 : 0;
+			ellipsefit_ellipse single, interleaved;
+			const int32_t singleStatus = ellipsefit_fit(context, x.data() + offsets[i], y.data() + offsets[i], count, &single);
+			const int32_t interleavedStatus = ellipsefit_fit_interleaved(context, xy.data() + 2 * offsets[i], count, &interleaved);
+			const int32_t expectedStatus = count < LeastSquareEllipseFitter<double>::MinPointCount ? ELLIPSEFIT_TOO_FEW_POINTS : expected.IsValid() ? ELLIPSEFIT_OK : ELLIPSEFIT_NO_ELLIPSE;
+			isOk = isOk && statuses[i] == expectedStatus && singleStatus == expectedStatus && interleavedStatus == expectedStatus;
+			if (isOk && expected.IsValid())
+			{
+				isOk = ellipses[i].x0 == expected.x0 && ellipses[i].a == expected.a && single.theta == expected.theta && relativeDifference(interleaved.b, expected.b) < 1e-12;
+			}
+		}
+
+		uint64_t fitCount, failedCount;
+		ellipsefit_context_counters(context, &fitCount, &failedCount);
+		isOk = isOk && okCount == expectedOkCount && fitCount == 3 * SetCount && failedCount == 3 * (SetCount - expectedOkCount) && ellipsefit_context_last_error(context)[0] == '\0';
+
+		// invalid arguments are reported, not crashed on
+		ellipsefit_ellipse ellipse;
+		const size_t badOffsets[3] = { 0, 10, 5 };
+		isOk = isOk && ellipsefit_fit(nullptr, x.data(), y.data(), 10, &ellipse) == ELLIPSEFIT_INVALID_ARGUMENT &&
+			ellipsefit_fit(context, nullptr, y.data(), 10, &ellipse) == ELLIPSEFIT_INVALID_ARGUMENT && ellipsefit_context_last_error(context)[0] != '\0' &&
+			ellipsefit_fit_batch(context, x.data(), y.data(), badOffsets, 2, ellipses.data(), statuses.data()) < 2 && statuses[1] == ELLIPSEFIT_INVALID_ARGUMENT;
+		ellipsefit_context_destroy(context);
+		printf("fit, fit_interleaved, fit_batch: %u sets (%u ellipses) <- %s\n", (unsigned int)SetCount, (unsigned int)okCount, isOk ? "OK" : "FAIL");
+		allOk = allOk && isOk;
+	}
+
+	// points exactly on a circle or an ellipse must give that ellipse, collinear points no ellipse - as a status
+	{
+		std::vector<std::vector<double>> xExact = { { 5, 4, 3, 4, 4 + M_SQRT1_2 }, {}, { 0, 1, 2, 3, 4, 5 } };
+		std::vector<std::vector<double>> yExact = { { -3, -2, -3, -4, -3 + M_SQRT1_2 }, {}, { 0, 2, 4, 6, 8, 10 } };
+		for (int k = 0; k < 20; ++k)
+		{
+			xExact[1].push_back(-7 + 5 * cos(2 * M_PI * k / 20));
+			yExact[1].push_back(4 + 2 * sin(2 * M_PI * k / 20));
+		}
+
+		bool isOk = true;
+		ellipsefit_context* context = ellipsefit_context_create();
+		ellipsefit_ellipse ellipse;
+		isOk = isOk && ellipsefit_fit(context, xExact[0].data(), yExact[0].data(), xExact[0].size(), &ellipse) == ELLIPSEFIT_OK &&
+			relativeDifference(ellipse.x0, 4.0) < 1e-9 && relativeDifference(ellipse.y0, -3.0) < 1e-9 && relativeDifference(ellipse.a, 1.0) < 1e-9 && relativeDifference(ellipse.b, 1.0) < 1e-9;
+		isOk = isOk && ellipsefit_fit(context, xExact[1].data(), yExact[1].data(), xExact[1].size(), &ellipse) == ELLIPSEFIT_OK &&
+			relativeDifference(ellipse.x0, -7.0) < 1e-9 && relativeDifference(ellipse.y0, 4.0) < 1e-9 &&
+			relativeDifference((std::max)(ellipse.a, ellipse.b), 5.0) < 1e-9 && relativeDifference((std::min)(ellipse.a, ellipse.b), 2.0) < 1e-9;
+		isOk = isOk && ellipsefit_fit(context, xExact[2].data(), yExact[2].data(), xExact[2].size(), &ellipse) == ELLIPSEFIT_NO_ELLIPSE &&
+			std::isnan(ellipse.x0) && std::isnan(ellipse.a);
+
+		isOk = isOk && ellipsefit_context_last_error(context)[0] == '\0';
+		ellipsefit_context_destroy(context);
+		printf("exact circle, exact ellipse: ELLIPSEFIT_OK; collinear points: ELLIPSEFIT_NO_ELLIPSE <- %s\n", isOk ? "OK" : "FAIL");
+		allOk = allOk && isOk;
+	}
+
+	{
+		bool isOk = true;
+		std::vector<double> points;
+		for (int i = 0;; ++i)
+		{
+			auto testParams = EllipseFrom5PointsTestCases::GetTestCase(i);
+			if (testParams == nullptr)
+			{
+				break;
+			}
+
+			points.insert(points.end(), testParams->points, testParams->points + 10);
+		}
+
+		const size_t count = points.size() / 10;
+		std::vector<ellipsefit_conic> conics(count);
+		std::vector<int32_t> statuses(count);
+		ellipsefit_context* context = ellipsefit_context_create();
+		ellipsefit_conic_from_5_points_batch(context, points.data(), count, conics.data(), statuses.data());
+		ellipsefit_context_destroy(context);
+		for (size_t i = 0; i < count; ++i)
+		{
+			const EllipseAlgebraicParameters<double> expected = EllipseAlgebraicParameters<double>::CreateFrom5Points(points.data() + 10 * i);
+			isOk = isOk && conics[i].a == expected.a && conics[i].f == expected.f && (statuses[i] == ELLIPSEFIT_OK) == expected.IsEllipse();
+
+			// conic -> ellipse -> conic -> ellipse must give the same ellipse
+			ellipsefit_ellipse ellipse, roundTrip;
+			ellipsefit_conic conic;
+			if (ellipsefit_conic_to_ellipse(&conics[i], &ellipse) == ELLIPSEFIT_OK)
+			{
+				isOk = isOk && ellipsefit_ellipse_to_conic(&ellipse, &conic) == ELLIPSEFIT_OK && ellipsefit_conic_to_ellipse(&conic, &roundTrip) == ELLIPSEFIT_OK &&
+					relativeDifference(ellipse.x0, roundTrip.x0) < 1e-9 && relativeDifference(ellipse.y0, roundTrip.y0) < 1e-9 &&
+					relativeDifference((std::max)(ellipse.a, ellipse.b), (std::max)(roundTrip.a, roundTrip.b)) < 1e-9;
+			}
+		}
+
+		printf("conic_from_5_points_batch and conversions: %u sets <- %s\n", (unsigned int)count, isOk ? "OK" : "FAIL");
+		allOk = allOk && isOk;
+	}
+
+	// one context per thread
+	{
+		const unsigned int ThreadCount = 4;
+		std::vector<uint64_t> fitCounts(ThreadCount, 0);
+		std::vector<std::vector<ellipsefit_ellipse>> results(ThreadCount, std::vector<ellipsefit_ellipse>(SetCount));
+		ParallelFor(ThreadCount, [&](size_t t)
+		{
+			ellipsefit_context* context = ellipsefit_context_create();
+			for (int repeat = 0; repeat < 5; ++repeat)
+			{
+				ellipsefit_fit_batch(context, x.data(), y.data(), offsets.data(), SetCount, results[t].data(), nullptr);
+			}
+
+			ellipsefit_context_counters(context, &fitCounts[t], nullptr);
+			ellipsefit_context_destroy(context);
+		}, ThreadCount);
+
+		bool isOk = true;
+		for (unsigned int t = 0; t < ThreadCount; ++t)
+		{
+			isOk = isOk && fitCounts[t] == 5 * SetCount && memcmp(results[t].data(), results[0].data(), SetCount * sizeof(ellipsefit_ellipse)) == 0;
+		}
+
+		printf("%u threads with a context each <- %s\n", ThreadCount, isOk ? "OK" : "FAIL");
+		allOk = allOk && isOk;
+	}
+
+	return allOk;
+}
+
+/// <summary>	Splits a point set into shards with very different extents (arcs of the ellipse), summarizes each
+/// 			shard, sends the summaries through their binary form and merges them in different orders; the
+/// 			solution must agree with the fit to all points. </summary>
+static bool TestMomentSummary()
+{
+	bool allOk = true;
+	for (double offset : { 0.0, 1e6 })
+	{
+		const size_t PointCount = 600000;
+		std::mt19937 generator(31);
+		std::normal_distribution<double> noise(0, 1);
+		std::vector<double> x(PointCount), y(PointCount);
+		for (size_t k = 0; k < PointCount; ++k)
+		{
+			const double t = 2 * M_PI * k / PointCount;
+			x[k] = offset + 400 + 300 * cos(t) * cos(0.3) - 120 * sin(t) * sin(0.3) + noise(generator);
+			y[k] = -offset / 2 + 100 + 300 * cos(t) * sin(0.3) + 120 * sin(t) * cos(0.3) + noise(generator);
+		}
+
+		LeastSquareEllipseFitter<double>::PointAccessorFromTwoArrays all(x.data(), y.data(), PointCount);
+		const EllipseParameters<double> expected = EllipseParameters<double>::FromAlgebraicParameters(LeastSquareEllipseFitter<double>::Fit(all));
+
+		// uneven shards, including an empty one and one with a single point
+		const size_t bounds[] = { 0, 1000, 1000, 1001, 90000, 250000, 251000, 480000, PointCount };
+		std::vector<std::vector<unsigned char>> messages;
+		for (size_t s = 0; s + 1 < sizeof(bounds) / sizeof(bounds[0]); ++s)
+		{
+			LeastSquareEllipseFitter<double>::PointAccessorFromTwoArrays shard(x.data() + bounds[s], y.data() + bounds[s], bounds[s + 1] - bounds[s]);
+			messages.emplace_back(MomentSummary::SerializedSize);
+			MomentSummary::FromPoints(shard).Serialize(messages.back().data());
+		}
+
+		std::vector<MomentSummary> summaries;
+		bool isOk = true;
+		for (const auto& message : messages)
+		{
+			summaries.push_back(MomentSummary::Deserialize(message.data(), message.size()));
+			std::vector<unsigned char> again(MomentSummary::SerializedSize);
+			summaries.back().Serialize(again.data());
+			isOk = isOk && again == message;
+		}
+
+		MomentSummary sequential, reversed;
+		for (size_t s = 0; s < summaries.size(); ++s)
+		{
+			sequential.Merge(summaries[s]);
+			reversed.Merge(summaries[summaries.size() - 1 - s]);
+		}
+
+		// pairwise, like a reduction tree
+		std::vector<MomentSummary> level = summaries;
+		while (level.size() > 1)
+		{
+			std::vector<MomentSummary> next;
+			for (size_t s = 0; s < level.size(); s += 2)
+			{
+				next.push_back(level[s]);
+				if (s + 1 < level.size())
+				{
+					next.back().Merge(level[s + 1]);
+				}
+			}
+
+			level = next;
+		}
+
+		const double tolerance = offset == 0 ? 1e-9 : 1e-6;
+		auto isClose = [&](const MomentSummary& summary)
+		{
+			const EllipseParameters<double> e = EllipseParameters<double>::FromAlgebraicParameters(summary.Solve());
+			return summary.GetPointCount() == PointCount && relativeDifference(e.x0, expected.x0) < tolerance && relativeDifference(e.y0, expected.y0) < tolerance &&
+				relativeDifference(e.a, expected.a) < tolerance && relativeDifference(e.b, expected.b) < tolerance && std::abs(e.theta - expected.theta) < tolerance;
+		};
+
+		isOk = isOk && isClose(sequential) && isClose(reversed) && isClose(level[0]);
+		printf("center offset %g: %u shards merged sequentially, reversed and as a tree <- %s\n", offset, (unsigned int)summaries.size(), isOk ? "OK" : "FAIL");
+		allOk = allOk && isOk;
+	}
+
+	// malformed input is rejected
+	{
+		std::vector<unsigned char> message(MomentSummary::SerializedSize);
+		const double x[5] = { 1, 2, 3, 2, 1 }, y[5] = { 0, 1, 0, -1, 0.5 };
+		MomentSummary::FromPoints(LeastSquareEllipseFitter<double>::PointAccessorFromTwoArrays(x, y, 5)).Serialize(message.data());
+		int rejectedCount = 0;
+		auto tryDeserialize = [&](const std::vector<unsigned char>& data, size_t size)
+		{
+			try
+			{
+				MomentSummary::Deserialize(data.data(), size);
+			}
+			catch (std::runtime_error&)
+			{
+				++rejectedCount;
+			}
+		};
+
+		tryDeserialize(message, message.size() - 1);
+		std::vector<unsigned char> badMagic = message, badVersion = message;
+		badMagic[0] = 'X';
+		badVersion[8] = 99;
+		tryDeserialize(badMagic, badMagic.size());
+		tryDeserialize(badVersion, badVersion.size());
+		tryDeserialize(message, message.size());
+		const bool isOk = rejectedCount == 3;
+		printf("truncated, wrong magic, wrong version rejected <- %s\n", isOk ? "OK" : "FAIL");
+		allOk = allOk && isOk;
+	}
+
+	return allOk;
+}
+
+/// <summary>	Checks the content hash, the options seed, the eviction of the LRU cache, and the cache file: batch fits through it must give
+/// 			the results of the fits, the results must survive reopening, the metadata must be compared, and the
+/// 			tables must grow. </summary>
+static bool TestResultCache()
+{
+	bool allOk = true;
+	{
+		// the reference value of MurmurHash3_x64_128
+		const char* text = "The quick brown fox jumps over the lazy dog";
+		const Hash128 hash = ContentHash::Compute(text, strlen(text));
+		std::string flipped = text;
+		flipped[20] ^= 1;
+		const bool isOk = hash.low == 0xe34bbc7bbc071b6cULL && hash.high == 0x7a433ca9c49a9347ULL &&
+			ContentHash::Compute(flipped.data(), flipped.size()) != hash && ContentHash::Compute(text, strlen(text), 1) != hash;
+		printf("content hash <- %s\n", isOk ? "OK" : "FAIL");
+		allOk = allOk && isOk;
+	}
+
+	// the options seed depends on the content of the y-file
+	{
+		const char* yFilename = "resultcachetest_y.tmp";
+		auto getSeed = [&](const char* szContent)
+		{
+			FILE* fp;
+			fopen_s(&fp, yFilename, "wb");
+			fputs(szContent, fp);
+			fclose(fp);
+			PointFileOptions options;
+			options.yFilename = yFilename;
+			return ContentHash::GetOptionsSeed(options);
+		};
+
+		const uint64_t seed = getSeed("1 2 3 4 5");
+		const bool isOk = getSeed("1 2 3 4 5") == seed && getSeed("1 2 3 4 6") != seed && seed != ContentHash::GetOptionsSeed(PointFileOptions());
+		remove(yFilename);
+		printf("options seed covers the y-file <- %s\n", isOk ? "OK" : "FAIL");
+		allOk = allOk && isOk;
+	}
+
+	{
+		ResultLruCache cache(4, 1);
+		auto put = [&](uint64_t k) { cache.Put(Hash128{ k, 0 }, CachedFit{ k, EllipseParameters<double>::Invalid() }); };
+		CachedFit fit;
+		put(0); put(1); put(2); put(3);
+		bool isOk = cache.TryGet(Hash128{ 0, 0 }, fit) && fit.pointCount == 0;
+		put(4);
+		isOk = isOk && !cache.TryGet(Hash128{ 1, 0 }, fit) && cache.TryGet(Hash128{ 0, 0 }, fit) && cache.TryGet(Hash128{ 4, 0 }, fit) && fit.pointCount == 4;
+		const ResultCacheStatistics statistics = cache.GetStatistics();
+		isOk = isOk && statistics.hitCount == 3 && statistics.missCount == 1 && statistics.evictionCount == 1 && statistics.entryCount == 4;
+		printf("LRU cache evicts the least recently used entry <- %s\n", isOk ? "OK" : "FAIL");
+		allOk = allOk && isOk;
+	}
+
+	const char* cacheFilename = "resultcachetest.tmp";
+	remove(cacheFilename);
+	{
+		const std::string directory = "resultcachetest.dir.tmp";
+		std::vector<bool> isBroken;
+		std::vector<EllipseParameters<double>> expected;
+		const std::vector<std::string> files = CreateBatchTestDirectory(directory, isBroken, expected);
+
+		// the unreadable file is fitted each time, the one with too few points is cached
+		for (int run = 0; run < 3; ++run)
+		{
+			ResultCacheFile cache(cacheFilename);
+			const BatchFitOutcome outcome = BatchFitFiles(files, PointFileOptions(), 0, nullptr, &cache);
+			const bool isOk = IsBatchOutcomeOk(outcome, isBroken, expected) && outcome.cachedCount == (run == 0 ? 0 : files.size() - 1);
+			printf("run %d: %u files, %u from the cache, %.0lf files/s <- %s\n", run + 1, (unsigned int)files.size(), (unsigned int)outcome.cachedCount,
+				files.size() / outcome.seconds, isOk ? "OK" : "FAIL");
+			allOk = allOk && isOk;
+		}
+
+		RemoveBatchTestDirectory(directory);
+	}
+
+	{
+		// the files were modified just now, so the metadata is only recorded for old times
+		const int64_t oldTime = 1000000000LL * 1000000000LL;
+		const Hash128 key = ContentHash::Compute("abc", 3);
+		const CachedFit stored{ 123, EllipseParameters<double>{ 1, 2, 3, 4, 0.5 } };
+		CachedFit fit;
+		bool isOk;
+		{
+			ResultCacheFile cache(cacheFilename);
+			cache.Put(key, stored);
+			cache.PutFile("old.txt", 0, 100, oldTime, key);
+			cache.PutFile("new.txt", 0, 100, std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count(), key);
+
+			// the file is locked while it is open
+			bool isLocked = false;
+			try
+			{
+				ResultCacheFile other(cacheFilename);
+			}
+			catch (std::runtime_error&)
+			{
+				isLocked = true;
+			}
+
+			isOk = isLocked;
+		}
+
+		ResultCacheFile cache(cacheFilename);
+		isOk = isOk && cache.TryGetByFile("old.txt", 0, 100, oldTime, fit) && fit.pointCount == 123 && fit.ellipse.theta == 0.5 &&
+			!cache.TryGetByFile("old.txt", 0, 101, oldTime, fit) && !cache.TryGetByFile("old.txt", 0, 100, oldTime + 1, fit) && !cache.TryGetByFile("new.txt", 0, 100, oldTime, fit);
+
+		// the metadata of the file says nothing about the options it was read with
+		isOk = isOk && !cache.TryGetByFile("old.txt", 1, 100, oldTime, fit);
+		printf("lookup by file metadata, other options, locking <- %s\n", isOk ? "OK" : "FAIL");
+		allOk = allOk && isOk;
+	}
+
+	remove(cacheFilename);
+	{
+		const uint64_t Count = 5000;
+		{
+			ResultCacheFile cache(cacheFilename, 16);
+			for (uint64_t i = 0; i < Count; ++i)
+			{
+				cache.Put(ContentHash::Compute(&i, sizeof(i)), CachedFit{ i, EllipseParameters<double>::Invalid() });
+			}
+		}
+
+		ResultCacheFile cache(cacheFilename);
+		bool isOk = cache.GetStatistics().entryCount == Count;
+		for (uint64_t i = 0; i < Count && isOk; ++i)
+		{
+			CachedFit fit;
+			isOk = cache.TryGet(ContentHash::Compute(&i, sizeof(i)), fit) && fit.pointCount == i;
+		}
+
+		printf("%llu entries after growing from 16 and reopening <- %s\n", (unsigned long long)Count, isOk ? "OK" : "FAIL");
+		allOk = allOk && isOk;
+	}
+
+	remove(cacheFilename);
+	return allOk;
+}
+
+/// <summary>	Checks that a file which exists already is not reported, that a file written in several steps is reported
+/// 			once after the last one, that a burst of files is reported completely, and that Stop ends the wait;
+/// 			then measures the time from closing a file to having its fit. </summary>
+static bool TestDirectoryWatcher()
+{
+	const std::string directory = "watchtest.tmp";
+	DirectoryListing::CreateDirectoryIfMissing(directory.c_str());
+	std::mt19937 generator(23);
+	std::normal_distribution<double> noise(0, 0.5);
+	auto writeFile = [&](const std::string& name, const char* mode, size_t count)
+	{
+		FILE* fp;
+		fopen_s(&fp, DirectoryListing::Combine(directory, name).c_str(), mode);
+		for (size_t k = 0; k < count; ++k)
+		{
+			const double t = 2 * M_PI * k / count;
+			fprintf(fp, "%.17g %.17g\n", 300 + 80 * cos(t) + noise(generator), 200 + 50 * sin(t) + noise(generator));
+		}
+
+		fclose(fp);
+	};
+
+	bool allOk = true;
+	writeFile("existing.txt", "wb", 50);
+	{
+		DirectoryWatcher watcher(directory.c_str(), 50);
+		bool isOk = watcher.WaitForFiles(100).empty();
+		for (int part = 0; part < 3; ++part)
+		{
+			writeFile("parts.txt", part == 0 ? "wb" : "ab", 20);
+			std::this_thread::sleep_for(std::chrono::milliseconds(5));
+		}
+
+		const std::vector<std::string> files = watcher.WaitForFiles(1000);
+		isOk = isOk && files.size() == 1 && DirectoryListing::GetFileName(files[0]) == "parts.txt" && FitPointFile(files[0], PointFileOptions()).pointCount == 60 &&
+			watcher.WaitForFiles(100).empty();
+		printf("existing file ignored, file written in three steps reported once <- %s\n", isOk ? "OK" : "FAIL");
+		allOk = allOk && isOk;
+	}
+
+	{
+		const size_t FileCount = 100;
+		DirectoryWatcher watcher(directory.c_str(), 5);
+		for (size_t i = 0; i < FileCount; ++i)
+		{
+			writeFile("burst_" + std::to_string(i) + ".txt", "wb", 30);
+		}
+
+		std::vector<std::string> reported;
+		for (std::vector<std::string> files; !(files = watcher.WaitForFiles(500)).empty();)
+		{
+			reported.insert(reported.end(), files.begin(), files.end());
+		}
+
+		std::sort(reported.begin(), reported.end());
+		const bool isOk = reported.size() == FileCount && std::unique(reported.begin(), reported.end()) == reported.end();
+		printf("burst of %u files: %u reported <- %s\n", (unsigned int)FileCount, (unsigned int)reported.size(), isOk ? "OK" : "FAIL");
+		allOk = allOk && isOk;
+	}
+
+	{
+		DirectoryWatcher watcher(directory.c_str());
+		std::thread stopper([&]() { std::this_thread::sleep_for(std::chrono::milliseconds(50)); watcher.Stop(); });
+		const bool isOk = watcher.WaitForFiles().empty() && watcher.IsStopped();
+		stopper.join();
+		printf("Stop ends the wait <- %s\n", isOk ? "OK" : "FAIL");
+		allOk = allOk && isOk;
+	}
+
+	{
+		// without debouncing, from the close of the file to the fit of its 200 points
+		const int FileCount = 200;
+		DirectoryWatcher watcher(directory.c_str(), 0);
+		std::vector<double> latencies;
+		bool isOk = true;
+		for (int i = 0; i < FileCount && isOk; ++i)
+		{
+			writeFile("latency_" + std::to_string(i) + ".txt", "wb", 200);
+			const auto closed = std::chrono::steady_clock::now();
+			const std::vector<std::string> files = watcher.WaitForFiles(1000);
+			isOk = files.size() == 1 && FitPointFile(files[0], PointFileOptions()).ellipse.IsValid();
+			latencies.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - closed).count());
+		}
+
+		std::sort(latencies.begin(), latencies.end());
+		printf("close to fit: median %.0lf us, max %.0lf us <- %s\n", latencies[latencies.size() / 2], latencies.back(), isOk ? "OK" : "FAIL");
+		allOk = allOk && isOk;
+	}
+
+	RemoveBatchTestDirectory(directory);
+	return allOk;
+}
+
+/// <summary>	Checks the batch journal: a run which stopped halfway must be resumed without fitting the completed files
+/// 			again and with their results, a torn tail must be cut off, changed files and other options must not
+/// 			match, and the records must be written in groups. </summary>
+static bool TestBatchJournal()
+{
+	bool allOk = true;
+	const std::string directory = "batchjournaltest.dir.tmp";
+	const char* journalFilename = "batchjournaltest.tmp";
+	remove(journalFilename);
+	std::vector<bool> isBroken;
+	std::vector<EllipseParameters<double>> expected;
+	const std::vector<std::string> files = CreateBatchTestDirectory(directory, isBroken, expected);
+	const uint64_t seed = ContentHash::GetOptionsSeed(PointFileOptions());
+
+	// the unreadable file is not journaled, the one with too few points is (and fails again when resumed)
+	size_t completedCount = 0;
+	{
+		const std::vector<std::string> firstHalf(files.begin(), files.begin() + files.size() / 2);
+		BatchJournal journal(journalFilename, seed);
+		const BatchFitOutcome outcome = BatchFitFiles(firstHalf, PointFileOptions(), 0, nullptr, nullptr, &journal);
+		journal.Close();
+		completedCount = (size_t)journal.GetStatistics().committedCount;
+		const bool isOk = outcome.journaledCount == 0 && completedCount == firstHalf.size() - 1;
+		printf("first half: %u files journaled <- %s\n", (unsigned int)completedCount, isOk ? "OK" : "FAIL");
+		allOk = allOk && isOk;
+	}
+
+	{
+		BatchJournal journal(journalFilename, seed);
+		const BatchFitOutcome outcome = BatchFitFiles(files, PointFileOptions(), 0, nullptr, nullptr, &journal);
+		journal.Close();
+		const BatchJournalStatistics statistics = journal.GetStatistics();
+		const bool isOk = IsBatchOutcomeOk(outcome, isBroken, expected) && statistics.loadedCount == completedCount && outcome.journaledCount == completedCount &&
+			statistics.committedCount == files.size() - 1 - completedCount;
+		printf("resumed: %u of %u files from the journal <- %s\n", (unsigned int)outcome.journaledCount, (unsigned int)files.size(), isOk ? "OK" : "FAIL");
+		allOk = allOk && isOk;
+	}
+
+	{
+		// a record cut off by a crash
+		FILE* fp;
+		fopen_s(&fp, journalFilename, "ab");
+		const char garbage[50] = { 1, 2, 3 };
+		fwrite(garbage, 1, sizeof(garbage), fp);
+		fclose(fp);
+
+		uint64_t size;
+		int64_t modificationTime;
+		CachedFit fit;
+		bool isOk;
+		{
+			BatchJournal journal(journalFilename, seed);
+			isOk = journal.GetStatistics().loadedCount == files.size() - 1 && DirectoryListing::TryGetFileStatus(journalFilename, size, modificationTime) &&
+				size == BatchJournal::HeaderSize + (files.size() - 1) * BatchJournal::RecordSize;
+
+			// a file with another size or modification time has changed since it was fitted
+			const std::string& file = files.back();
+			isOk = isOk && DirectoryListing::TryGetFileStatus(file.c_str(), size, modificationTime) && journal.TryGetCompleted(file, size, modificationTime, fit) &&
+				fit.ellipse.x0 == expected.back().x0 && !journal.TryGetCompleted(file, size + 1, modificationTime, fit) &&
+				!journal.TryGetCompleted(file, size, modificationTime + 1, fit);
+		}
+
+		try
+		{
+			BatchJournal journal(journalFilename, seed + 1);
+			isOk = false;
+		}
+		catch (std::runtime_error&)
+		{
+		}
+
+		printf("torn tail truncated, changed files and other options rejected <- %s\n", isOk ? "OK" : "FAIL");
+		allOk = allOk && isOk;
+	}
+
+	{
+		// the fits of the first run are not cached by the OS any more than those of the second
+		remove(journalFilename);
+		const BatchFitOutcome plain = BatchFitFiles(files, PointFileOptions(), 0, nullptr);
+		BatchJournal journal(journalFilename, seed);
+		const BatchFitOutcome journaled = BatchFitFiles(files, PointFileOptions(), 0, nullptr, nullptr, &journal);
+		journal.Close();
+		const BatchJournalStatistics statistics = journal.GetStatistics();
+		const bool isOk = IsBatchOutcomeOk(journaled, isBroken, expected) && statistics.committedCount == files.size() - 1;
+		printf("%.0lf files/s without, %.0lf files/s with the journal, %u records in %u commits (%.3lf s writing) <- %s\n", files.size() / plain.seconds,
+			files.size() / journaled.seconds, (unsigned int)statistics.committedCount, (unsigned int)statistics.commitCount, statistics.syncSeconds, isOk ? "OK" : "FAIL");
+		allOk = allOk && isOk;
+	}
+
+	{
+		// many small completions, as from a job of tiny files
+		const int RecordCount = 100000;
+		remove(journalFilename);
+		const auto start = std::chrono::steady_clock::now();
+		BatchJournal journal(journalFilename, seed);
+		for (int i = 0; i < RecordCount; ++i)
+		{
+			journal.Complete("file_" + std::to_string(i) + ".txt", i, i, CachedFit{ 100, EllipseParameters<double>{ 1, 2, 3, 4, 0.5 } });
+		}
+
+		journal.Close();
+		const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		const BatchJournalStatistics statistics = journal.GetStatistics();
+		bool isOk = statistics.committedCount == RecordCount && statistics.commitCount < RecordCount / 100;
+		BatchJournal reopened(journalFilename, seed);
+		CachedFit fit;
+		isOk = isOk && reopened.GetStatistics().loadedCount == RecordCount && reopened.TryGetCompleted("file_777.txt", 777, 777, fit) && fit.pointCount == 100;
+		printf("%d records in %u commits, %.0lf records/s <- %s\n", RecordCount, (unsigned int)statistics.commitCount, RecordCount / seconds, isOk ? "OK" : "FAIL");
+		allOk = allOk && isOk;
+	}
+
+	remove(journalFilename);
+	RemoveBatchTestDirectory(directory);
+	return allOk;
+}
+
+static bool TestPointArchive()
+{
+	const char* filename = "pointarchivetest.tmp";
+	std::vector<EllipseParameters<double>> expected;
+	std::vector<std::string> names;
+	{
+		PointArchiveWriter writer(filename);
+		auto add = [&](const std::string& name, const double* x, const double* y, size_t count)
+		{
+			LeastSquareEllipseFitter<double>::PointAccessorFromTwoArrays accessor(x, y, count);
+			expected.push_back(EllipseParameters<double>::FromAlgebraicParameters(LeastSquareEllipseFitter<double>::Fit(accessor)));
+			names.push_back(name);
+			writer.Add(name, PointDataType::Float64, x, y, count);
+		};
+
+		for (int i = 0;; ++i)
+		{
+			auto testParams = EllipseLeastSquareFitTestCases::GetTestCase(i);
+			if (testParams == nullptr)
+			{
+				break;
+			}
+
+			add("testcase_" + std::to_string(i), testParams->pX, testParams->pY, testParams->count);
+		}
+
+		// sizes from 5 to about 50000 points, and names which are not added in their sorted order
+		std::mt19937 generator(31);
+		std::normal_distribution<double> noise(0, 0.5);
+		for (int i = 0; i < 200; ++i)
+		{
+			const size_t count = (size_t)(5 * pow(10000, (i % 50) / 49.0));
+			std::vector<double> x, y;
+			for (size_t k = 0; k < count; ++k)
+			{
+				const double t = 2 * M_PI * k / count;
+				x.push_back(300 + i + (90 + i % 13) * cos(t) + noise(generator));
+				y.push_back(200 + (40 + i % 7) * sin(t) + noise(generator));
+			}
+
+			add("generated_" + std::to_string((i * 37) % 200), x.data(), y.data(), count);
+		}
+
+		writer.Finish();
+	}
+
+	auto isSame = [](const EllipseParameters<double>& a, const EllipseParameters<double>& b)
+	{
+		// the accessors differ, so the compiler may contract differently; five points lie exactly on a conic, which gives no ellipse
+		return (relativeDifference(a.x0, b.x0) < 1e-9 && relativeDifference(a.y0, b.y0) < 1e-9 && relativeDifference(a.a, b.a) < 1e-9 && relativeDifference(a.b, b.b) < 1e-9) ||
+			(!a.IsValid() && !b.IsValid());
+	};
+
+	bool isOk;
+	{
+		PointArchive archive(filename);
+		isOk = PointArchive::IsPointArchive(filename) && archive.GetEntryCount() == expected.size();
+
+		// the first and the last name in sorted order, and missing names before, between and after them
+		std::vector<std::string> sortedNames = names;
+		std::sort(sortedNames.begin(), sortedNames.end());
+		isOk = isOk && archive.Find(sortedNames.front()) == (size_t)(std::find(names.begin(), names.end(), sortedNames.front()) - names.begin()) &&
+			archive.Find(sortedNames.back()) == (size_t)(std::find(names.begin(), names.end(), sortedNames.back()) - names.begin()) &&
+			archive.Find("a") == PointArchive::NotFound && archive.Find("generated_1000") == PointArchive::NotFound && archive.Find("zzz") == PointArchive::NotFound &&
+			archive.Find("") == PointArchive::NotFound;
+
+		// random access by name, backwards
+		for (size_t i = expected.size(); i-- > 0;)
+		{
+			size_t index = archive.Find(names[i]);
+			EllipseParameters<double> ellParams = EllipseParameters<double>::Invalid();
+			if (index != PointArchive::NotFound)
+			{
+				archive.Visit<double>(index, [&](const auto& accessor) { ellParams = EllipseParameters<double>::FromAlgebraicParameters(LeastSquareEllipseFitter<double>::Fit(accessor)); });
+			}
+
+			isOk = isOk && index == i && isSame(ellParams, expected[i]);
+		}
+
+		// sequential, with a prefetch window much smaller than the archive
+		size_t visited = 0;
+		PointArchive::SequentialReader reader(archive, 4);
+		while (reader.Next())
+		{
+			EllipseParameters<double> ellParams = EllipseParameters<double>::Invalid();
+			reader.Visit<double>([&](const auto& accessor) { ellParams = EllipseParameters<double>::FromAlgebraicParameters(LeastSquareEllipseFitter<double>::Fit(accessor)); });
+			isOk = isOk && reader.GetIndex() == visited && reader.GetIndex() < expected.size() && isSame(ellParams, expected[visited]) &&
+				archive.GetName(reader.GetIndex()) == names[visited];
+			++visited;
+		}
+
+		isOk = isOk && visited == expected.size();
+	}
+
+	// an archive which was not finished is rejected
+	bool isRejected = false;
+	{
+		PointArchiveWriter writer(filename);
+		const double x = 1, y = 2;
+		writer.Add("unfinished", PointDataType::Float64, &x, &y, 1);
+	}
+
+	try
+	{
+		PointArchive archive(filename);
+	}
+	catch (std::runtime_error&)
+	{
+		isRejected = true;
+	}
+
+	remove(filename);
+	printf("%u entries, access by name and sequential <- %s, unfinished archive rejected <- %s\n", (unsigned int)expected.size(), isOk ? "OK" : "FAIL", isRejected ? "OK" : "FAIL");
+	return isOk && isRejected;
+}
+
+static const char* _5POINTTESTOPTION = "5pointtest";
+static const char* LEASTSQUAREELLIPSETESTOPTION = "leastsquarefittest";
+static const char* LEASTSQUAREELLIPSEOPTION = "leastsquarefit";
+static const char* CONSTRAINEDFITTESTOPTION = "constrainedfittest";
+static const char* CONCENTRICFITTESTOPTION = "concentricfittest";
+static const char* MIXTUREFITTESTOPTION = "mixturefittest";
+static const char* GEOMETRYTESTOPTION = "geometrytest";
+static const char* OVERLAPTESTOPTION = "overlaptest";
+static const char* TEXTREADERTESTOPTION = "textreadertest";
+static const char* BINARYFILETESTOPTION = "binaryfiletest";
+static const char* CONVERTOPTION = "convert";
+static const char* ARCHIVETESTOPTION = "archivetest";
+static const char* NPYTESTOPTION = "npytest";
+static const char* RECORDACCESSORTESTOPTION = "recordaccessortest";
+static const char* COMPRESSEDTESTOPTION = "compressedtest";
+static const char* RESULTWRITERTESTOPTION = "resultwritertest";
+static const char* SVGTESTOPTION = "svgtest";
+static const char* RASTERTESTOPTION = "rastertest";
+static const char* OUTOFCORETESTOPTION = "outofcoretest";
+static const char* OUTOFCOREFITOPTION = "outofcorefit";
+static const char* BATCHFITTESTOPTION = "batchfittest";
+static const char* BATCHFITOPTION = "batchfit";
+static const char* PIPELINETESTOPTION = "pipelinetest";
+static const char* STREAMOPTION = "stream";
+static const char* STREAMTESTOPTION = "streamtest";
+static const char* SERVEOPTION = "serve";
+static const char* SERVERSTATSOPTION = "serverstats";
+static const char* SERVETESTOPTION = "servetest";
+static const char* SERVESHMOPTION = "serveshm";
+static const char* SHMTESTOPTION = "shmtest";
+static const char* CAPITESTOPTION = "capitest";
+static const char* SUMMARIZEOPTION = "summarize";
+static const char* SUMMARYFITOPTION = "summaryfit";
+static const char* MOMENTSUMMARYTESTOPTION = "momentsummarytest";
+static const char* CACHETESTOPTION = "cachetest";
+static const char* WATCHOPTION = "watch";
+static const char* WATCHTESTOPTION = "watchtest";
+static const char* JOURNALTESTOPTION = "journaltest";
+static const char* PACKOPTION = "pack";
+static const char* UNPACKOPTION = "unpack";
+static const char* ARCHIVEFITOPTION = "archivefit";
+
+static option::ArgStatus CommandArgRequired(const option::Option& option, bool msg)
+{
+	if (option.arg != 0)
+	{
+		if (strcmp(option.arg, _5POINTTESTOPTION) == 0 ||
+			strcmp(option.arg, LEASTSQUAREELLIPSETESTOPTION) == 0 ||
+			strcmp(option.arg, LEASTSQUAREELLIPSEOPTION) == 0 ||
+			strcmp(option.arg, CONSTRAINEDFITTESTOPTION) == 0 ||
+			strcmp(option.arg, CONCENTRICFITTESTOPTION) == 0 ||
+			strcmp(option.arg, MIXTUREFITTESTOPTION) == 0 ||
+			strcmp(option.arg, GEOMETRYTESTOPTION) == 0 ||
+			strcmp(option.arg, OVERLAPTESTOPTION) == 0 ||
+			strcmp(option.arg, TEXTREADERTESTOPTION) == 0 ||
+			strcmp(option.arg, BINARYFILETESTOPTION) == 0 ||
+			strcmp(option.arg, CONVERTOPTION) == 0 ||
+			strcmp(option.arg, ARCHIVETESTOPTION) == 0 ||
+			strcmp(option.arg, NPYTESTOPTION) == 0 ||
+			strcmp(option.arg, RECORDACCESSORTESTOPTION) == 0 ||
+			strcmp(option.arg, COMPRESSEDTESTOPTION) == 0 ||
+			strcmp(option.arg, RESULTWRITERTESTOPTION) == 0 ||
+			strcmp(option.arg, SVGTESTOPTION) == 0 ||
+			strcmp(option.arg, RASTERTESTOPTION) == 0 ||
+			strcmp(option.arg, OUTOFCORETESTOPTION) == 0 ||
+			strcmp(option.arg, OUTOFCOREFITOPTION) == 0 ||
+			strcmp(option.arg, BATCHFITTESTOPTION) == 0 ||
+			strcmp(option.arg, BATCHFITOPTION) == 0 ||
+			strcmp(option.arg, PIPELINETESTOPTION) == 0 ||
+			strcmp(option.arg, STREAMOPTION) == 0 ||
+			strcmp(option.arg, STREAMTESTOPTION) == 0 ||
+			strcmp(option.arg, SERVEOPTION) == 0 ||
+			strcmp(option.arg, SERVERSTATSOPTION) == 0 ||
+			strcmp(option.arg, SERVETESTOPTION) == 0 ||
+			strcmp(option.arg, SERVESHMOPTION) == 0 ||
+			strcmp(option.arg, SHMTESTOPTION) == 0 ||
+			strcmp(option.arg, CAPITESTOPTION) == 0 ||
+			strcmp(option.arg, SUMMARIZEOPTION) == 0 ||
+			strcmp(option.arg, SUMMARYFITOPTION) == 0 ||
+			strcmp(option.arg, MOMENTSUMMARYTESTOPTION) == 0 ||
+			strcmp(option.arg, CACHETESTOPTION) == 0 ||
+			strcmp(option.arg, WATCHOPTION) == 0 ||
+			strcmp(option.arg, WATCHTESTOPTION) == 0 ||
+			strcmp(option.arg, JOURNALTESTOPTION) == 0 ||
+			strcmp(option.arg, PACKOPTION) == 0 ||
+			strcmp(option.arg, UNPACKOPTION) == 0 ||
+			strcmp(option.arg, ARCHIVEFITOPTION) == 0)
+		{
+			return option::ARG_OK;
+		}
+	}
+
+	return option::ARG_ILLEGAL;
+}
+
+static option::ArgStatus FilenameArgRequired(const option::Option& option, bool msg)
+{
+	if (option.arg != 0)
+	{
+		return option::ARG_OK;
+	}
+
+	return option::ARG_ILLEGAL;
+}
+
+enum  optionIndex { UNKNOWN, HELP, COMMAND, SVGOUTPUT, POINTSINPUTFILE, OUTPUTFILE, DATATYPE, YPOINTSINPUTFILE, RAWDATATYPE, RAWLAYOUT, QUANTUM, RESULTS, RESULTFORMAT, DECIMATE, IMAGE, IMAGESIZE, BUFFERSIZE, ONLINE, IOMETHOD, INPUTDIRECTORY, THREADS, PIPELINE, QUEUESIZE, FRAMING, UNORDERED, SOCKETPATH, LATENCYBUDGET, MAXBATCH, SHMNAME, SLOTS, SLOTPOINTS, CACHE, CACHESIZE, DEBOUNCE, JOURNAL, PATTERN };
+const option::Descriptor usage[] =
+{
+	{ UNKNOWN, 0,"" , ""    ,option::Arg::None, "USAGE: example [options]\n\n"
+	"Options:" },
+	{ HELP,    0,"" , "help",option::Arg::None, "  --help  \tPrint usage and exit." },
+	{ COMMAND,    0,"c", "command",CommandArgRequired, "  --command, -c  \tspecifies command." },
+	{ SVGOUTPUT,  0,"s" ,  "svg"   ,FilenameArgRequired, "  --svg, -s  \tspecifies filename for SVG-output." },
+	{ POINTSINPUTFILE,  0,"p" ,  "points"   ,FilenameArgRequired, "  --points, -p  \tspecifies filename with list of points" },
+	{ OUTPUTFILE,  0,"o" ,  "output"   ,FilenameArgRequired, "  --output, -o  \tspecifies the output file (convert, pack, summarize) or directory (unpack, batchfit --pipeline: SVG files)." },
+	{ DATATYPE,  0,"t" ,  "dtype"   ,FilenameArgRequired, "  --dtype, -t  \tspecifies the data type f32, f64 or i32 (convert, pack)." },
+	{ YPOINTSINPUTFILE,  0,"" ,  "points-y"   ,FilenameArgRequired, "  --points-y  \tspecifies a 1-D .npy file with the y-coordinates, --points has the x-coordinates." },
+	{ RAWDATATYPE,  0,"" ,  "raw"   ,FilenameArgRequired, "  --raw  \treads --points as raw array with the data type f32, f64 or i32." },
+	{ QUANTUM,  0,"" ,  "quantum"   ,FilenameArgRequired, "  --quantum  \twrites a compressed point file with the coordinates quantized to multiples of the value (convert)." },
+	{ RESULTS,  0,"r" ,  "results"   ,FilenameArgRequired, "  --results, -r  \twrites the fit results to the file (leastsquarefit, leastsquarefittest, 5pointtest, archivefit)." },
+	{ RESULTFORMAT,  0,"" ,  "format"   ,FilenameArgRequired, "  --format  \tthe format of the results: csv (default, jsonl for stream), jsonl or bin." },
+	{ DECIMATE,  0,"" ,  "decimate"   ,option::Arg::None, "  --decimate  \twrites only the points which are visible at the resolution of the SVG (leastsquarefit)." },
+	{ IMAGE,  0,"" ,  "image"   ,FilenameArgRequired, "  --image  \twrites an image of the points and the ellipse, PGM for *.pgm, otherwise PPM (leastsquarefit)." },
+	{ IMAGESIZE,  0,"" ,  "image-size"   ,FilenameArgRequired, "  --image-size  \tthe size of the longer side of the image in pixels (default 1024)." },
+	{ BUFFERSIZE,  0,"" ,  "buffer-size"   ,FilenameArgRequired, "  --buffer-size  \tthe read buffer in MB (outofcorefit, default 64)." },
+	{ ONLINE,  0,"" ,  "online"   ,option::Arg::None, "  --online  \tnormalizes the points in a single pass with online re-centering (outofcorefit)." },
+	{ IOMETHOD,  0,"" ,  "io"   ,FilenameArgRequired, "  --io  \treads the file through a mapping (mmap, default) or with positional reads (read) (outofcorefit)." },
+	{ INPUTDIRECTORY,  0,"" ,  "input-dir"   ,FilenameArgRequired, "  --input-dir  \tthe directory with the point files (batchfit, watch) or the moment summaries (summaryfit)." },
+	{ THREADS,  0,"" ,  "threads"   ,FilenameArgRequired, "  --threads  \tthe number of worker threads, 0 (default) for one per core (batchfit, stream, serve, watch)." },
+	{ PIPELINE,  0,"" ,  "pipeline"   ,FilenameArgRequired, "  --pipeline  \truns read, fit and write as a pipeline with the given threads per stage, e.g. 1,4,1 (0 fitters for one per core) (batchfit)." },
+	{ QUEUESIZE,  0,"" ,  "queue-size"   ,FilenameArgRequired, "  --queue-size  \tthe number of files each queue of the pipeline can hold (default 8)." },
+	{ FRAMING,  0,"" ,  "framing"   ,FilenameArgRequired, "  --framing  \tthe framing of the point sets on stdin: text (default, sets separated by blank lines) or binary (length-prefixed) (stream)." },
+	{ UNORDERED,  0,"" ,  "unordered"   ,option::Arg::None, "  --unordered  \twrites the results as soon as they are ready instead of in the order of the sets (stream)." },
+	{ SOCKETPATH,  0,"" ,  "socket"   ,FilenameArgRequired, "  --socket  \tthe path of the Unix domain socket (serve, serverstats)." },
+	{ LATENCYBUDGET,  0,"" ,  "latency-budget"   ,FilenameArgRequired, "  --latency-budget  \tthe longest time in microseconds a request waits to be batched with others (default 200) (serve)." },
+	{ MAXBATCH,  0,"" ,  "max-batch"   ,FilenameArgRequired, "  --max-batch  \tthe largest number of requests fitted as one batch (default 256) (serve)." },
+	{ SHMNAME,  0,"" ,  "shm"   ,FilenameArgRequired, "  --shm  \tthe name of the shared memory ring (serveshm)." },
+	{ SLOTS,  0,"" ,  "slots"   ,FilenameArgRequired, "  --slots  \tthe number of point set slots in the ring (default 8) (serveshm)." },
+	{ SLOTPOINTS,  0,"" ,  "slot-points"   ,FilenameArgRequired, "  --slot-points  \tthe largest number of points per slot (default 1000000) (serveshm)." },
+	{ CACHE,  0,"" ,  "cache"   ,FilenameArgRequired, "  --cache  \tkeeps the fit results in the file, files with unchanged size and modification time or known content are not fitted again (batchfit, watch)." },
+	{ CACHESIZE,  0,"" ,  "cache-size"   ,FilenameArgRequired, "  --cache-size  \tthe number of results kept in memory to answer repeated point sets (default 0: no cache) (serve)." },
+	{ DEBOUNCE,  0,"" ,  "debounce"   ,FilenameArgRequired, "  --debounce  \tthe time in milliseconds without writes after which a file counts as complete (default 10) (watch)." },
+	{ JOURNAL,  0,"" ,  "journal"   ,FilenameArgRequired, "  --journal  \trecords the completed files in the journal, a batch run with the same journal skips them (batchfit)." },
+	{ PATTERN,  0,"" ,  "pattern"   ,FilenameArgRequired, "  --pattern  \tthe files to fit, wildcards separated by ';' (default *.txt;*.csv;*.xy;*.dat;*.bin;*.npy, * for all) (batchfit, watch)." },
+	{ RAWLAYOUT,  0,"" ,  "layout"   ,FilenameArgRequired, "  --layout  \tthe layout of the raw array: interleaved (default) or planar." },
+	{ 0,0,0,0,0,0 }
+};
+
+static bool GetPointFileOptions(const std::vector<option::Option>& options, PointFileOptions& pointFileOptions)
+{
+	if (options[YPOINTSINPUTFILE])
+	{
+		pointFileOptions.yFilename = options[YPOINTSINPUTFILE].arg;
+	}
+
+	if (options[RAWDATATYPE])
+	{
+		pointFileOptions.isRaw = true;
+		if (!BinaryPointFile::TryParseDataType(options[RAWDATATYPE].arg, pointFileOptions.rawDataType))
+		{
+			printf("Unknown data type \"%s\", use f32, f64 or i32.\n", options[RAWDATATYPE].arg);
+			return false;
+		}
+	}
+
+	if (options[RAWLAYOUT])
+	{
+		if (_stricmp(options[RAWLAYOUT].arg, "interleaved") == 0)
+		{
+			pointFileOptions.rawLayout = PointLayout::Interleaved;
+		}
+		else if (_stricmp(options[RAWLAYOUT].arg, "planar") == 0)
+		{
+			pointFileOptions.rawLayout = PointLayout::Planar;
+		}
+		else
+		{
+			printf("Unknown layout \"%s\", use interleaved or planar.\n", options[RAWLAYOUT].arg);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+int main(int argc, char* argv[])
+{
+	argc -= (argc > 0); argv += (argc > 0); // skip program name argv[0] if present
+	option::Stats  stats(usage, argc, argv);
+	auto options = std::vector<option::Option>(stats.options_max);
+	options.resize(stats.options_max);
+	auto  buffer = std::vector<option::Option>(stats.buffer_max);
+	buffer.resize(stats.buffer_max);
+	option::Parser parse(usage, argc, argv, options.data(), buffer.data());
+
+	if (!options[COMMAND])
+	{
+		return EXIT_FAILURE;
+	}
+
+	PointFileOptions pointFileOptions;
+	if (!GetPointFileOptions(options, pointFileOptions))
+	{
+		return EXIT_FAILURE;
+	}
+
+	std::unique_ptr<ResultWriter> results;
+	if (options[RESULTS])
+	{
+		ResultFormat format = ResultFormat::Csv;
+		if (options[RESULTFORMAT] && !ResultWriter::TryParseFormat(options[RESULTFORMAT].arg, format))
+		{
+			printf("Unknown result format \"%s\", use csv, jsonl or bin.\n", options[RESULTFORMAT].arg);
+			return EXIT_FAILURE;
+		}
+
+		results.reset(new ResultWriter(options[RESULTS].arg, format));
+	}
+
+	const char* command = options[COMMAND].arg;
+	if (strcmp(command, _5POINTTESTOPTION) == 0)
+	{
+		const char* filename = nullptr;
+		if (options[SVGOUTPUT])
+		{
+			filename = options[SVGOUTPUT].arg;
+		}
+
+		TestEllipseFrom5Points(filename, results.get());
+	}
+	else if (strcmp(command, LEASTSQUAREELLIPSETESTOPTION) == 0)
+	{
+		TestLeastSquareFit(results.get());
+	}
+	else if (strcmp(command, LEASTSQUAREELLIPSEOPTION) == 0)
+	{
+		const char* filename = nullptr;
+		if (options[POINTSINPUTFILE])
+		{
+			filename = options[POINTSINPUTFILE].arg;
+		}
+
+		const char* svgoutputfilename = nullptr;
+		if (options[SVGOUTPUT])
+		{
+			svgoutputfilename = options[SVGOUTPUT].arg;
+		}
+
+
+		SvgOptions svgOptions;
+		svgOptions.decimate = options[DECIMATE] != nullptr;
+		int imageSize = options[IMAGESIZE] ? atoi(options[IMAGESIZE].arg) : 1024;
+		if (imageSize < 16)
+		{
+			printf("The image size must be at least 16.\n");
+			return EXIT_FAILURE;
+		}
+
+		LeastSquareFileFromFile(filename, pointFileOptions, svgoutputfilename, svgOptions, options[IMAGE] ? options[IMAGE].arg : nullptr, imageSize, results.get());
+	}
+	else if (strcmp(command, CONSTRAINEDFITTESTOPTION) == 0)
+	{
+		const char* filename = nullptr;
+		if (options[POINTSINPUTFILE])
+		{
+			filename = options[POINTSINPUTFILE].arg;
+		}
+
+		TestConstrainedFit(filename, pointFileOptions);
+	}
+	else if (strcmp(command, CONCENTRICFITTESTOPTION) == 0)
+	{
+		TestConcentricFit();
+	}
+	else if (strcmp(command, MIXTUREFITTESTOPTION) == 0)
+	{
+		TestMixtureFit();
+	}
+	else if (strcmp(command, GEOMETRYTESTOPTION) == 0)
+	{
+		TestGeometry();
+	}
+	else if (strcmp(command, OVERLAPTESTOPTION) == 0)
+	{
+		TestOverlap();
+	}
+	else if (strcmp(command, TEXTREADERTESTOPTION) == 0)
+	{
+		TestTextPointReader();
+	}
+	else if (strcmp(command, BINARYFILETESTOPTION) == 0)
+	{
+		TestBinaryPointFile();
+	}
+	else if (strcmp(command, CONVERTOPTION) == 0)
+	{
+		if (!options[POINTSINPUTFILE] || !options[OUTPUTFILE])
+		{
+			printf("convert requires --points and --output.\n");
+			return EXIT_FAILURE;
+		}
+
+		PointDataType dataType = PointDataType::Float64;
+		if (options[DATATYPE] && !BinaryPointFile::TryParseDataType(options[DATATYPE].arg, dataType))
+		{
+			printf("Unknown data type \"%s\", use f32, f64 or i32.\n", options[DATATYPE].arg);
+			return EXIT_FAILURE;
+		}
+
+		if (options[QUANTUM])
+		{
+			double quantum = atof(options[QUANTUM].arg);
+			if (!(quantum > 0))
+			{
+				printf("The quantum must be positive.\n");
+				return EXIT_FAILURE;
+			}
+
+			ConvertToCompressedPointFile(options[POINTSINPUTFILE].arg, pointFileOptions, options[OUTPUTFILE].arg, quantum);
+		}
+		else
+		{
+			ConvertToBinaryPointFile(options[POINTSINPUTFILE].arg, pointFileOptions, options[OUTPUTFILE].arg, dataType);
+		}
+	}
+	else if (strcmp(command, ARCHIVETESTOPTION) == 0)
+	{
+		TestPointArchive();
+	}
+	else if (strcmp(command, NPYTESTOPTION) == 0)
+	{
+		TestNpyFile();
+	}
+	else if (strcmp(command, RECORDACCESSORTESTOPTION) == 0)
+	{
+		TestRecordAccessor();
+	}
+	else if (strcmp(command, COMPRESSEDTESTOPTION) == 0)
+	{
+		TestCompressedPointFile();
+	}
+	else if (strcmp(command, RESULTWRITERTESTOPTION) == 0)
+	{
+		TestResultWriter();
+	}
+	else if (strcmp(command, SVGTESTOPTION) == 0)
+	{
+		TestSvgWriter();
+	}
+	else if (strcmp(command, RASTERTESTOPTION) == 0)
+	{
+		TestRasterRenderer();
+	}
+	else if (strcmp(command, OUTOFCORETESTOPTION) == 0)
+	{
+		TestOutOfCoreFit();
+	}
+	else if (strcmp(command, BATCHFITTESTOPTION) == 0)
+	{
+		TestBatchFit();
+	}
+	else if (strcmp(command, PIPELINETESTOPTION) == 0)
+	{
+		TestBatchPipeline();
+	}
+	else if (strcmp(command, STREAMTESTOPTION) == 0)
+	{
+		TestStreamFit();
+	}
+	else if (strcmp(command, STREAMOPTION) == 0)
+	{
+		// stdout carries the results, so everything else goes to stderr
+		StreamFitOptions streamOptions;
+		if (options[FRAMING] && !StreamFrameParser::TryParseFraming(options[FRAMING].arg, streamOptions.framing))
+		{
+			fprintf(stderr, "Unknown framing \"%s\", use text or binary.\n", options[FRAMING].arg);
+			return EXIT_FAILURE;
+		}
+
+		if (options[RESULTFORMAT] && !ResultWriter::TryParseFormat(options[RESULTFORMAT].arg, streamOptions.format))
+		{
+			fprintf(stderr, "Unknown result format \"%s\", use csv, jsonl or bin.\n", options[RESULTFORMAT].arg);
+			return EXIT_FAILURE;
+		}
+
+		streamOptions.isOrdered = !options[UNORDERED];
+		streamOptions.threadCount = options[THREADS] ? (unsigned int)atoi(options[THREADS].arg) : 0;
+		try
+		{
+			const StreamFitStatistics statistics = StreamFitService::Run(stdin, stdout, streamOptions);
+			fprintf(stderr, "%llu sets, %llu points, %llu failed, %.3lf s\n", (unsigned long long)statistics.setCount, (unsigned long long)statistics.pointCount,
+				(unsigned long long)statistics.failedCount, statistics.seconds);
+		}
+		catch (std::exception& e)
+		{
+			fprintf(stderr, "%s\n", e.what());
+			return EXIT_FAILURE;
+		}
+	}
+	else if (strcmp(command, SERVETESTOPTION) == 0)
+	{
+		TestFitServer();
+	}
+	else if (strcmp(command, SERVEOPTION) == 0 || strcmp(command, SERVERSTATSOPTION) == 0)
+	{
+		if (!options[SOCKETPATH])
+		{
+			printf("%s requires --socket.\n", command);
+			return EXIT_FAILURE;
+		}
+
+		try
+		{
+			if (strcmp(command, SERVERSTATSOPTION) == 0)
+			{
+				const FitServerStatistics statistics = FitClient(options[SOCKETPATH].arg).GetStatistics();
+				printf("%llu requests in %llu batches (mean size %.1lf, max %llu)\nlatency p50 %.0lf us, p90 %.0lf us, p99 %.0lf us, max %.0lf us\n",
+					(unsigned long long)statistics.requestCount, (unsigned long long)statistics.batchCount, statistics.meanBatchSize, (unsigned long long)statistics.maxBatchSize,
+					statistics.latencyP50Microseconds, statistics.latencyP90Microseconds, statistics.latencyP99Microseconds, statistics.latencyMaxMicroseconds);
+			}
+			else
+			{
+				FitServerOptions serverOptions;
+				if (options[LATENCYBUDGET])
+				{
+					serverOptions.latencyBudgetMicroseconds = (std::max)(atof(options[LATENCYBUDGET].arg), 0.0);
+				}
+
+				if (options[MAXBATCH])
+				{
+					serverOptions.maxBatchSize = (size_t)(std::max)(atoi(options[MAXBATCH].arg), 1);
+				}
+
+				serverOptions.fitterThreads = options[THREADS] ? (unsigned int)atoi(options[THREADS].arg) : 0;
+				serverOptions.cacheCapacity = options[CACHESIZE] ? (size_t)(std::max)(atoi(options[CACHESIZE].arg), 0) : 0;
+				FitServer server(options[SOCKETPATH].arg, serverOptions);
+				printf("Serving on %s.\n", options[SOCKETPATH].arg);
+				fflush(stdout);
+				server.Run();
+			}
+		}
+		catch (std::runtime_error& e)
+		{
+			printf("%s\n", e.what());
+			return EXIT_FAILURE;
+		}
+	}
+	else if (strcmp(command, SHMTESTOPTION) == 0)
+	{
+		TestSharedRingFit();
+	}
+	else if (strcmp(command, SERVESHMOPTION) == 0)
+	{
+		if (!options[SHMNAME])
+		{
+			printf("serveshm requires --shm.\n");
+			return EXIT_FAILURE;
+		}
+
+		const uint32_t slotCount = options[SLOTS] ? (uint32_t)(std::max)(atoi(options[SLOTS].arg), 1) : 8;
+		const uint32_t slotPoints = options[SLOTPOINTS] ? (uint32_t)(std::max)(atoi(options[SLOTPOINTS].arg), 5) : 1000000;
+		try
+		{
+			SharedRingFitServer server(options[SHMNAME].arg, slotCount, slotPoints);
+			printf("Serving on shared memory \"%s\" (%u slots of %u points).\n", options[SHMNAME].arg, slotCount, slotPoints);
+			fflush(stdout);
+			server.Run();
+		}
+		catch (std::runtime_error& e)
+		{
+			printf("%s\n", e.what());
+			return EXIT_FAILURE;
+		}
+	}
+	else if (strcmp(command, CAPITESTOPTION) == 0)
+	{
+		TestFitApi();
+	}
+	else if (strcmp(command, MOMENTSUMMARYTESTOPTION) == 0)
+	{
+		TestMomentSummary();
+	}
+	else if (strcmp(command, SUMMARIZEOPTION) == 0)
+	{
+		if (!options[POINTSINPUTFILE] || !options[OUTPUTFILE])
+		{
+			printf("summarize requires --points and --output.\n");
+			return EXIT_FAILURE;
+		}
+
+		MomentSummary summary;
+		PointFileReader::Visit<double>(options[POINTSINPUTFILE].arg, [&](const auto& accessor) { summary = MomentSummary::FromPoints(accessor); });
+		summary.WriteFile(options[OUTPUTFILE].arg);
+		printf("%llu points summarized in %u bytes.\n", (unsigned long long)summary.GetPointCount(), (unsigned int)MomentSummary::SerializedSize);
+	}
+	else if (strcmp(command, SUMMARYFITOPTION) == 0)
+	{
+		if (!options[INPUTDIRECTORY])
+		{
+			printf("summaryfit requires --input-dir.\n");
+			return EXIT_FAILURE;
+		}
+
+		MomentSummary summary;
+		const std::vector<std::string> files = DirectoryListing::GetFiles(options[INPUTDIRECTORY].arg);
+		for (const std::string& file : files)
+		{
+			summary.Merge(MomentSummary::ReadFile(file.c_str()));
+		}
+
+		if (summary.GetPointCount() < LeastSquareEllipseFitter<double>::MinPointCount)
+		{
+			printf("Too few points (%llu) for a fit.\n", (unsigned long long)summary.GetPointCount());
+			return EXIT_FAILURE;
+		}
+
+		EllipseParameters<double> ellParams = EllipseParameters<double>::FromAlgebraicParameters(summary.Solve());
+		if (results)
+		{
+			results->Write(FitResult{ 0, options[INPUTDIRECTORY].arg, summary.GetPointCount(), ellParams });
+		}
+		else
+		{
+			printf("x0=%lf y0=%lf a=%lf b=%lf angle=%lf\n", ellParams.x0, ellParams.y0, ellParams.a, ellParams.b, radToDegree(ellParams.theta));
+		}
+
+		printf("%u summaries, %llu points\n", (unsigned int)files.size(), (unsigned long long)summary.GetPointCount());
+	}
+	else if (strcmp(command, CACHETESTOPTION) == 0)
+	{
+		TestResultCache();
+	}
+	else if (strcmp(command, WATCHTESTOPTION) == 0)
+	{
+		TestDirectoryWatcher();
+	}
+	else if (strcmp(command, JOURNALTESTOPTION) == 0)
+	{
+		TestBatchJournal();
+	}
+	else if (strcmp(command, WATCHOPTION) == 0)
+	{
+		if (!options[INPUTDIRECTORY])
+		{
+			printf("watch requires --input-dir.\n");
+			return EXIT_FAILURE;
+		}
+
+		// the options seed covers the content of the y-file when the watch starts, it may change while watching
+		if (options[CACHE] && pointFileOptions.yFilename != nullptr)
+		{
+			printf("--cache cannot be combined with --points-y.\n");
+			return EXIT_FAILURE;
+		}
+
+		try
+		{
+			std::unique_ptr<ResultCacheFile> cache;
+			if (options[CACHE])
+			{
+				cache.reset(new ResultCacheFile(options[CACHE].arg));
+			}
+
+			WorkStealingThreadPool pool(options[THREADS] ? (unsigned int)atoi(options[THREADS].arg) : 0);
+			DirectoryWatcher watcher(options[INPUTDIRECTORY].arg, options[DEBOUNCE] ? atof(options[DEBOUNCE].arg) : 10);
+			activeWatcher = &watcher;
+			std::signal(SIGINT, StopWatching);
+			printf("Watching %s, Ctrl+C to stop.\n", options[INPUTDIRECTORY].arg);
+			fflush(stdout);
+			WatchDirectory(watcher, options[PATTERN] ? options[PATTERN].arg : DefaultPointFilePatterns, pointFileOptions, pool, results.get(), cache.get());
+			std::signal(SIGINT, SIG_DFL);
+			activeWatcher = nullptr;
+		}
+		catch (std::runtime_error& e)
+		{
+			printf("%s\n", e.what());
+			return EXIT_FAILURE;
+		}
+	}
+	else if (strcmp(command, BATCHFITOPTION) == 0)
+	{
+		if (!options[INPUTDIRECTORY])
+		{
+			printf("batchfit requires --input-dir.\n");
+			return EXIT_FAILURE;
+		}
+
+		const unsigned int threadCount = options[THREADS] ? (unsigned int)atoi(options[THREADS].arg) : 0;
+		BatchPipelineOptions pipelineOptions;
+		if (options[PIPELINE])
+		{
+			if (sscanf_s(options[PIPELINE].arg, "%u,%u,%u", &pipelineOptions.readerThreads, &pipelineOptions.fitterThreads, &pipelineOptions.writerThreads) != 3)
+			{
+				printf("--pipeline expects the threads per stage as readers,fitters,writers.\n");
+				return EXIT_FAILURE;
+			}
+
+			if (options[QUEUESIZE])
+			{
+				pipelineOptions.queueCapacity = (size_t)(std::max)(atoi(options[QUEUESIZE].arg), 1);
+			}
+		}
+
+		std::unique_ptr<ResultCacheFile> cache;
+		std::unique_ptr<BatchJournal> journal;
+		if (options[CACHE] || options[JOURNAL])
+		{
+			// the pipeline reads the files in its own stage
+			if (options[PIPELINE])
+			{
+				printf("--cache and --journal cannot be combined with --pipeline.\n");
+				return EXIT_FAILURE;
+			}
+
+			try
+			{
+				// also reads the y-file, if there is one
+				const uint64_t seed = ContentHash::GetOptionsSeed(pointFileOptions);
+				if (options[CACHE])
+				{
+					cache.reset(new ResultCacheFile(options[CACHE].arg));
+				}
+
+				if (options[JOURNAL])
+				{
+					journal.reset(new BatchJournal(options[JOURNAL].arg, seed));
+				}
+			}
+			catch (std::runtime_error& e)
+			{
+				printf("%s\n", e.what());
+				return EXIT_FAILURE;
+			}
+		}
+
+		if (!BatchFitDirectory(options[INPUTDIRECTORY].arg, options[PATTERN] ? options[PATTERN].arg : DefaultPointFilePatterns, pointFileOptions, threadCount, options[PIPELINE] ? &pipelineOptions : nullptr,
+			options[PIPELINE] && options[OUTPUTFILE] ? options[OUTPUTFILE].arg : nullptr, results.get(), cache.get(), journal.get()))
+		{
+			if (results)
+			{
+				results->Close();
+			}
+
+			return EXIT_FAILURE;
+		}
+	}
+	else if (strcmp(command, OUTOFCOREFITOPTION) == 0)
+	{
+		if (!options[POINTSINPUTFILE])
+		{
+			printf("outofcorefit requires --points.\n");
+			return EXIT_FAILURE;
+		}
+
+		OutOfCoreOptions outOfCoreOptions;
+		if (options[BUFFERSIZE])
+		{
+			const double megabytes = atof(options[BUFFERSIZE].arg);
+			if (!(megabytes > 0))
+			{
+				printf("The buffer size must be positive.\n");
+				return EXIT_FAILURE;
+			}
+
+			outOfCoreOptions.bufferSize = (size_t)(megabytes * (1 << 20));
+		}
+
+		if (options[IOMETHOD] && !ChunkedFileReader::TryParseMethod(options[IOMETHOD].arg, outOfCoreOptions.method))
+		{
+			printf("Unknown read method \"%s\", use mmap or read.\n", options[IOMETHOD].arg);
+			return EXIT_FAILURE;
+		}
+
+		outOfCoreOptions.normalization = options[ONLINE] ? OutOfCoreNormalization::Online : OutOfCoreNormalization::TwoPass;
+		LeastSquareFitOutOfCore(options[POINTSINPUTFILE].arg, pointFileOptions, outOfCoreOptions, results.get());
+	}
+	else if (strcmp(command, PACKOPTION) == 0)
+	{
+		if (!options[POINTSINPUTFILE] || !options[OUTPUTFILE])
+		{
+			printf("pack requires --points (a directory) and --output.\n");
+			return EXIT_FAILURE;
+		}
+
+		PointDataType dataType = PointDataType::Float64;
+		if (options[DATATYPE] && !BinaryPointFile::TryParseDataType(options[DATATYPE].arg, dataType))
+		{
+			printf("Unknown data type \"%s\", use f32, f64 or i32.\n", options[DATATYPE].arg);
+			return EXIT_FAILURE;
+		}
+
+		PackPointArchive(options[POINTSINPUTFILE].arg, options[OUTPUTFILE].arg, dataType);
+	}
+	else if (strcmp(command, UNPACKOPTION) == 0)
+	{
+		if (!options[POINTSINPUTFILE] || !options[OUTPUTFILE])
+		{
+			printf("unpack requires --points (the archive) and --output (a directory).\n");
+			return EXIT_FAILURE;
+		}
+
+		UnpackPointArchive(options[POINTSINPUTFILE].arg, options[OUTPUTFILE].arg);
+	}
+	else if (strcmp(command, ARCHIVEFITOPTION) == 0)
+	{
+		if (!options[POINTSINPUTFILE])
+		{
+			printf("archivefit requires --points (the archive).\n");
+			return EXIT_FAILURE;
+		}
+
+		LeastSquareFitArchive(options[POINTSINPUTFILE].arg, results.get());
+	}
+
+	if (results)
+	{
+		results->Close();
+	}
 
 	return 0;
 }
@@ -0,0 +1,276 @@
+#include "stdafx.h"
+#include "batchFitPipeline.h"
+#include "boundedQueue.h"
+#include "parallelFor.h"
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+using namespace EllipseUtils;
+
+typedef std::chrono::steady_clock PipelineClock;
+
+static double SecondsSince(PipelineClock::time_point start)
+{
+	return std::chrono::duration<double>(PipelineClock::now() - start).count();
+}
+
+/// <summary>	Waits by yielding first, then by sleeping, so a stage which waits long does not burn a core. </summary>
+class Backoff
+{
+private:
+	int count = 0;
+public:
+	void Pause()
+	{
+		if (++this->count < 64)
+		{
+			std::this_thread::yield();
+		}
+		else
+		{
+			std::this_thread::sleep_for(std::chrono::microseconds(50));
+		}
+	}
+};
+
+/// <summary>	The counters of one thread of a stage, added to the totals when the thread ends. </summary>
+struct StageCounters
+{
+	uint64_t itemCount = 0;
+	double busySeconds = 0, starvedSeconds = 0, blockedSeconds = 0;
+	uint64_t starvedCount = 0, blockedCount = 0;
+	double occupancySum = 0;
+	size_t maxOccupancy = 0;
+};
+
+/// <summary>	Pushes the item, waiting while the queue is full. </summary>
+static void Push(BoundedQueue<BatchFitItem>& queue, BatchFitItem& item, StageCounters& counters)
+{
+	if (!queue.TryPush(item))
+	{
+		++counters.blockedCount;
+		auto start = PipelineClock::now();
+		Backoff backoff;
+		do
+		{
+			backoff.Pause();
+		}
+		while (!queue.TryPush(item));
+		counters.blockedSeconds += SecondsSince(start);
+	}
+
+	const size_t occupancy = queue.GetApproximateSize();
+	counters.occupancySum += occupancy;
+	counters.maxOccupancy = (std::max)(counters.maxOccupancy, occupancy);
+}
+
+/// <summary>	Pops an item, waiting while the queue is empty. Returns false when the queue is empty and all
+/// 			producers are finished. </summary>
+static bool Pop(BoundedQueue<BatchFitItem>& queue, const std::atomic<unsigned int>& activeProducers, BatchFitItem& item, StageCounters& counters)
+{
+	if (queue.TryPop(item))
+	{
+		return true;
+	}
+
+	++counters.starvedCount;
+	auto start = PipelineClock::now();
+	Backoff backoff;
+	bool hasItem = false;
+	for (;;)
+	{
+		// the producers are checked before the queue, so an item pushed by the last producer is not missed
+		const bool isDone = activeProducers.load() == 0;
+		if (queue.TryPop(item))
+		{
+			hasItem = true;
+			break;
+		}
+
+		if (isDone)
+		{
+			break;
+		}
+
+		backoff.Pause();
+	}
+
+	counters.starvedSeconds += SecondsSince(start);
+	return hasItem;
+}
+
+/// <summary>	The totals of a stage and of the queue it pushes to. </summary>
+struct StageTotals
+{
+	std::mutex mutex;
+	PipelineStageStatistics stage = PipelineStageStatistics{};
+	uint64_t pushCount = 0;
+	double occupancySum = 0;
+	size_t maxOccupancy = 0;
+
+	void Add(const StageCounters& counters, bool hasOutput)
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->stage.itemCount += counters.itemCount;
+		this->stage.busySeconds += counters.busySeconds;
+		this->stage.starvedSeconds += counters.starvedSeconds;
+		this->stage.starvedCount += counters.starvedCount;
+		this->stage.blockedSeconds += counters.blockedSeconds;
+		this->stage.blockedCount += counters.blockedCount;
+		if (hasOutput)
+		{
+			this->pushCount += counters.itemCount;
+			this->occupancySum += counters.occupancySum;
+			this->maxOccupancy = (std::max)(this->maxOccupancy, counters.maxOccupancy);
+		}
+	}
+
+	PipelineQueueStatistics GetQueueStatistics(size_t capacity) const
+	{
+		return PipelineQueueStatistics{ capacity, this->pushCount > 0 ? this->occupancySum / this->pushCount : 0, this->maxOccupancy };
+	}
+};
+
+/*static*/BatchPipelineStatistics BatchFitPipeline::Run(const std::vector<std::string>& files, const PointFileOptions& pointFileOptions, const BatchPipelineOptions& options, const WriteFunction& write)
+{
+	const unsigned int readerThreads = (std::max)(options.readerThreads, 1u);
+	const unsigned int fitterThreads = options.fitterThreads > 0 ? options.fitterThreads : GetDefaultThreadCount();
+	const unsigned int writerThreads = (std::max)(options.writerThreads, 1u);
+	BoundedQueue<BatchFitItem> readQueue(options.queueCapacity), fitQueue(options.queueCapacity);
+	std::atomic<size_t> nextFile(0);
+	std::atomic<unsigned int> activeReaders(readerThreads), activeFitters(fitterThreads);
+	StageTotals readerTotals, fitterTotals, writerTotals;
+	std::mutex exceptionMutex;
+	std::exception_ptr exception;
+	auto start = PipelineClock::now();
+
+	auto reader = [&]()
+	{
+		StageCounters counters;
+		for (;;)
+		{
+			const size_t index = nextFile.fetch_add(1);
+			if (index >= files.size())
+			{
+				break;
+			}
+
+			auto workStart = PipelineClock::now();
+			BatchFitItem item;
+			item.index = index;
+			item.ellipse = EllipseParameters<double>::Invalid();
+			try
+			{
+				PointFileReader::Read(files[index].c_str(), item.x, item.y, pointFileOptions);
+			}
+			catch (const std::exception& e)
+			{
+				item.error = e.what();
+			}
+
+			counters.busySeconds += SecondsSince(workStart);
+			++counters.itemCount;
+			Push(readQueue, item, counters);
+		}
+
+		readerTotals.Add(counters, true);
+		--activeReaders;
+	};
+
+	auto fitter = [&]()
+	{
+		StageCounters counters;
+		BatchFitItem item;
+		while (Pop(readQueue, activeReaders, item, counters))
+		{
+			auto workStart = PipelineClock::now();
+			if (item.error.empty())
+			{
+				item.ellipse = FitEllipse<double>(LeastSquareEllipseFitter<double>::PointAccessorFromTwoArrays(item.x.data(), item.y.data(), item.x.size()));
+				if (item.x.size() < LeastSquareEllipseFitter<double>::MinPointCount)
+				{
+					item.error = "Too few points for a fit.";
+				}
+				else if (!item.ellipse.IsValid())
+				{
+					item.error = "The points do not determine an ellipse.";
+				}
+			}
+
+			counters.busySeconds += SecondsSince(workStart);
+			++counters.itemCount;
+			Push(fitQueue, item, counters);
+		}
+
+		fitterTotals.Add(counters, true);
+		--activeFitters;
+	};
+
+	auto writer = [&](unsigned int writerIndex)
+	{
+		StageCounters counters;
+		BatchFitItem item;
+		while (Pop(fitQueue, activeFitters, item, counters))
+		{
+			auto workStart = PipelineClock::now();
+			try
+			{
+				write(item, writerIndex);
+			}
+			catch (...)
+			{
+				std::lock_guard<std::mutex> lock(exceptionMutex);
+				if (!exception)
+				{
+					exception = std::current_exception();
+				}
+			}
+
+			// release the points now rather than when the next item is moved in
+			item = BatchFitItem();
+			counters.busySeconds += SecondsSince(workStart);
+			++counters.itemCount;
+		}
+
+		writerTotals.Add(counters, false);
+	};
+
+	std::vector<std::thread> threads;
+	for (unsigned int i = 0; i < readerThreads; ++i)
+	{
+		threads.emplace_back(reader);
+	}
+
+	for (unsigned int i = 0; i < fitterThreads; ++i)
+	{
+		threads.emplace_back(fitter);
+	}
+
+	for (unsigned int i = 0; i < writerThreads; ++i)
+	{
+		threads.emplace_back(writer, i);
+	}
+
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+
+	if (exception)
+	{
+		std::rethrow_exception(exception);
+	}
+
+	BatchPipelineStatistics statistics;
+	statistics.reader = readerTotals.stage;
+	statistics.reader.threadCount = readerThreads;
+	statistics.fitter = fitterTotals.stage;
+	statistics.fitter.threadCount = fitterThreads;
+	statistics.writer = writerTotals.stage;
+	statistics.writer.threadCount = writerThreads;
+	statistics.readQueue = readerTotals.GetQueueStatistics(readQueue.GetCapacity());
+	statistics.fitQueue = fitterTotals.GetQueueStatistics(fitQueue.GetCapacity());
+	statistics.seconds = SecondsSince(start);
+	return statistics;
+}
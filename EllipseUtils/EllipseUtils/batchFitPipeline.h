@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include "ellipseParameters.h"
+#include "pointFileReader.h"
+
+namespace EllipseUtils
+{
+	/// <summary>	A file on its way through the pipeline. </summary>
+	struct BatchFitItem
+	{
+		/// <summary>	The position of the file in the list. </summary>
+		size_t index;
+		std::vector<double> x, y;
+		EllipseParameters<double> ellipse;
+
+		/// <summary>	Set by the stage in which reading or fitting the file failed, the later stages pass it on. </summary>
+		std::string error;
+	};
+
+	struct BatchPipelineOptions
+	{
+		/// <summary>	The number of threads of each stage, 0 fitter threads means one per core. </summary>
+		unsigned int readerThreads = 1;
+		unsigned int fitterThreads = 0;
+		unsigned int writerThreads = 1;
+
+		/// <summary>	The number of files each of the two queues can hold. At most about twice this number plus the
+		/// 			number of threads of files are in memory at the same time. </summary>
+		size_t queueCapacity = 8;
+	};
+
+	struct PipelineStageStatistics
+	{
+		unsigned int threadCount;
+		uint64_t itemCount;
+
+		/// <summary>	The time spent on the work of the stage, summed over its threads. </summary>
+		double busySeconds;
+
+		/// <summary>	The time spent waiting for an item from the previous stage (and how often that happened). </summary>
+		double starvedSeconds;
+		uint64_t starvedCount;
+
+		/// <summary>	The time spent waiting for room in the queue to the next stage (and how often that happened). </summary>
+		double blockedSeconds;
+		uint64_t blockedCount;
+	};
+
+	struct PipelineQueueStatistics
+	{
+		size_t capacity;
+
+		/// <summary>	The occupancy of the queue right after each push. </summary>
+		double averageOccupancy;
+		size_t maxOccupancy;
+	};
+
+	struct BatchPipelineStatistics
+	{
+		PipelineStageStatistics reader, fitter, writer;
+
+		/// <summary>	The queues between reader and fitter, and between fitter and writer. </summary>
+		PipelineQueueStatistics readQueue, fitQueue;
+		double seconds;
+	};
+
+	/// <summary>	Fits a list of files in three stages - reading, fitting and writing - which run concurrently with
+	/// 			their own threads and are connected by bounded lock-free queues (see BoundedQueue). A full queue
+	/// 			makes the previous stage wait, which caps the memory; the statistics tell which stage waits for
+	/// 			which, i.e. where the bottleneck is. The files reach the writers in no particular order. </summary>
+	class BatchFitPipeline
+	{
+	public:
+		/// <summary>	Called by the writer threads for each file, with the index of the writer thread (so it can use
+		/// 			per-thread buffers). item.error is set if the file could not be read or fitted. </summary>
+		typedef std::function<void(BatchFitItem& item, unsigned int writerIndex)> WriteFunction;
+
+		/// <summary>	Runs the pipeline until all files have been written. Errors of reading and fitting are reported
+		/// 			to write; the first exception thrown by write is re-thrown after all threads have stopped. </summary>
+		static BatchPipelineStatistics Run(const std::vector<std::string>& files, const PointFileOptions& pointFileOptions, const BatchPipelineOptions& options, const WriteFunction& write);
+	};
+}
@@ -0,0 +1,271 @@
+#include "stdafx.h"
+#include "batchJournal.h"
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+using namespace EllipseUtils;
+
+/*static*/const size_t BatchJournal::HeaderSize;
+/*static*/const size_t BatchJournal::RecordSize;
+
+static const char JournalMagic[8] = { 'E', 'L', 'L', 'J', 'R', 'N', '\r', '\n' };
+static const uint32_t JournalVersion = 1;
+
+struct JournalHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t reserved;
+	uint64_t optionsSeed;
+	uint64_t reserved2;
+};
+
+static_assert(sizeof(JournalHeader) == BatchJournal::HeaderSize, "The header must not contain padding.");
+
+/// <summary>	Cuts the file off after length bytes. </summary>
+static bool TruncateFile(const char* szFilename, uint64_t length)
+{
+#if defined(_WIN32)
+	HANDLE handle = CreateFileA(szFilename, GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (handle == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	LARGE_INTEGER position;
+	position.QuadPart = (LONGLONG)length;
+	const bool ok = SetFilePointerEx(handle, position, nullptr, FILE_BEGIN) && SetEndOfFile(handle);
+	CloseHandle(handle);
+	return ok;
+#else
+	return truncate(szFilename, (off_t)length) == 0;
+#endif
+}
+
+/// <summary>	Writes the buffered data of the file to the disk. </summary>
+static bool SyncFile(FILE* fp)
+{
+	if (fflush(fp) != 0)
+	{
+		return false;
+	}
+
+#if defined(_WIN32)
+	return _commit(_fileno(fp)) == 0;
+#else
+	return fsync(fileno(fp)) == 0;
+#endif
+}
+
+BatchJournal::BatchJournal(const char* szFilename, uint64_t optionsSeed, double commitIntervalMilliseconds, size_t maxGroupSize)
+	: fp(nullptr), commitInterval(std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double, std::milli>((std::max)(commitIntervalMilliseconds, 0.0)))),
+	maxGroupSize((std::max)(maxGroupSize, (size_t)1)), isClosing(false), hasFailed(false)
+{
+	memset(&this->statistics, 0, sizeof(this->statistics));
+
+	// a file without a complete header is one whose creation was interrupted
+	bool isValid = false, isTorn = false;
+	FILE* input;
+	if (fopen_s(&input, szFilename, "rb") == 0)
+	{
+		JournalHeader header;
+		isValid = fread(&header, sizeof(header), 1, input) == 1;
+		if (isValid && (memcmp(header.magic, JournalMagic, sizeof(JournalMagic)) != 0 || header.version != JournalVersion))
+		{
+			fclose(input);
+			throw std::runtime_error("The file is not a journal.");
+		}
+
+		if (isValid && header.optionsSeed != optionsSeed)
+		{
+			fclose(input);
+			throw std::runtime_error("The journal was written with other options.");
+		}
+
+		std::vector<char> chunk(RecordSize * 4096);
+		for (size_t length; isValid && !isTorn && (length = fread(chunk.data(), 1, chunk.size(), input)) > 0;)
+		{
+			isTorn = length % RecordSize != 0;
+			for (size_t offset = 0; offset + RecordSize <= length; offset += RecordSize)
+			{
+				Record record;
+				memcpy(&record, chunk.data() + offset, RecordSize);
+				if (record.check != GetCheck(record))
+				{
+					isTorn = true;
+					break;
+				}
+
+				this->index[record.pathKey] = this->records.size();
+				this->records.push_back(record);
+			}
+		}
+
+		fclose(input);
+	}
+
+	if (!isValid)
+	{
+		JournalHeader header;
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, JournalMagic, sizeof(JournalMagic));
+		header.version = JournalVersion;
+		header.optionsSeed = optionsSeed;
+		FILE* output;
+		if (fopen_s(&output, szFilename, "wb") != 0)
+		{
+			throw std::runtime_error("Couldn't create the journal.");
+		}
+
+		const bool ok = fwrite(&header, sizeof(header), 1, output) == 1 && SyncFile(output);
+		if (fclose(output) != 0 || !ok)
+		{
+			throw std::runtime_error("Couldn't write the journal.");
+		}
+	}
+	else if (isTorn && !TruncateFile(szFilename, HeaderSize + this->records.size() * RecordSize))
+	{
+		throw std::runtime_error("Couldn't truncate the journal.");
+	}
+
+	if (fopen_s(&this->fp, szFilename, "ab") != 0)
+	{
+		throw std::runtime_error("Couldn't open the journal.");
+	}
+
+	this->statistics.loadedCount = this->records.size();
+	this->committer = std::thread([this]() { this->RunCommitter(); });
+}
+
+BatchJournal::~BatchJournal()
+{
+	try
+	{
+		this->Close();
+	}
+	catch (...)
+	{
+	}
+}
+
+bool BatchJournal::TryGetCompleted(const std::string& path, uint64_t size, int64_t modificationTime, CachedFit& fit) const
+{
+	auto found = this->index.find(ContentHash::Compute(path.data(), path.size()));
+	if (found == this->index.end())
+	{
+		return false;
+	}
+
+	const Record& record = this->records[found->second];
+	if (record.fileSize != size || record.modificationTime != modificationTime)
+	{
+		return false;
+	}
+
+	fit.pointCount = record.pointCount;
+	fit.ellipse = EllipseParameters<double>{ record.x0, record.y0, record.a, record.b, record.theta };
+	return true;
+}
+
+void BatchJournal::Complete(const std::string& path, uint64_t size, int64_t modificationTime, const CachedFit& fit)
+{
+	Record record;
+	record.pathKey = ContentHash::Compute(path.data(), path.size());
+	record.fileSize = size;
+	record.modificationTime = modificationTime;
+	record.pointCount = fit.pointCount;
+	record.x0 = fit.ellipse.x0;
+	record.y0 = fit.ellipse.y0;
+	record.a = fit.ellipse.a;
+	record.b = fit.ellipse.b;
+	record.theta = fit.ellipse.theta;
+	record.check = GetCheck(record);
+
+	bool isWakeUp;
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->pending.push_back(record);
+
+		// the committer only needs to wake up for the first record of a group and for a full group
+		isWakeUp = this->pending.size() == 1 || this->pending.size() >= this->maxGroupSize;
+	}
+
+	if (isWakeUp)
+	{
+		this->recordAdded.notify_one();
+	}
+}
+
+void BatchJournal::Close()
+{
+	if (this->fp == nullptr)
+	{
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->isClosing = true;
+	}
+
+	this->recordAdded.notify_one();
+	this->committer.join();
+
+	const bool ok = fclose(this->fp) == 0 && !this->hasFailed;
+	this->fp = nullptr;
+	if (!ok)
+	{
+		throw std::runtime_error("Couldn't write the journal.");
+	}
+}
+
+BatchJournalStatistics BatchJournal::GetStatistics()
+{
+	std::lock_guard<std::mutex> lock(this->mutex);
+	return this->statistics;
+}
+
+void BatchJournal::RunCommitter()
+{
+	std::vector<Record> group;
+	std::unique_lock<std::mutex> lock(this->mutex);
+	for (;;)
+	{
+		this->recordAdded.wait(lock, [this]() { return this->isClosing || !this->pending.empty(); });
+		if (this->pending.empty())
+		{
+			break;
+		}
+
+		// give the group time to fill up
+		this->recordAdded.wait_for(lock, this->commitInterval, [this]() { return this->isClosing || this->pending.size() >= this->maxGroupSize; });
+		group.swap(this->pending);
+		lock.unlock();
+
+		const auto start = std::chrono::steady_clock::now();
+		const bool ok = fwrite(group.data(), RecordSize, group.size(), this->fp) == group.size() && SyncFile(this->fp);
+		const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		lock.lock();
+		this->hasFailed = this->hasFailed || !ok;
+		this->statistics.committedCount += group.size();
+		++this->statistics.commitCount;
+		this->statistics.syncSeconds += seconds;
+		group.clear();
+	}
+}
+
+/*static*/uint64_t BatchJournal::GetCheck(const Record& record)
+{
+	return ContentHash::Compute(&record, offsetof(Record, check), 0x6a6f75726e616cULL).low;
+}
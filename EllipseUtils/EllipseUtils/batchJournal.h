@@ -0,0 +1,101 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "resultCache.h"
+
+namespace EllipseUtils
+{
+	struct BatchJournalStatistics
+	{
+		/// <summary>	The records found when the journal was opened. </summary>
+		uint64_t loadedCount;
+
+		/// <summary>	The records written since, and the number of writes (each followed by a sync) they took. </summary>
+		uint64_t committedCount;
+		uint64_t commitCount;
+		double syncSeconds;
+	};
+
+	/// <summary>	An append-only log of the inputs a batch job has completed, so that a job which was killed can be
+	/// 			resumed without fitting those inputs again. Each record has the hash of the path, the size and the
+	/// 			modification time of the file when it was read, and its fit (so the record offset is where the
+	/// 			result lives - a resumed job writes the results of completed inputs from the journal), followed by
+	/// 			a checksum. When the journal is opened, its records are loaded into a hash index; a record which
+	/// 			is incomplete or does not match its checksum ends the log, and the file is truncated there.
+	/// 			Completed inputs are collected and written by a background thread in groups, each with a single
+	/// 			write and sync, so the fitting threads never wait for the disk. A group is written when it has
+	/// 			maxGroupSize records, or commitInterval after its first record. Records of the last interval
+	/// 			may be lost when the process is killed, those inputs are fitted again. </summary>
+	class BatchJournal
+	{
+	public:
+		static const size_t HeaderSize = 32;
+		static const size_t RecordSize = 88;
+
+	private:
+		struct Record
+		{
+			Hash128 pathKey;
+			uint64_t fileSize;
+			int64_t modificationTime;
+			uint64_t pointCount;
+			double x0, y0, a, b, theta;
+			uint64_t check;
+		};
+
+		static_assert(sizeof(Record) == RecordSize, "The record must not contain padding.");
+
+		FILE* fp;
+		std::vector<Record> records;
+
+		/// <summary>	The position of the last record of each path in records. </summary>
+		std::unordered_map<Hash128, size_t, Hash128Hasher> index;
+		std::chrono::steady_clock::duration commitInterval;
+		size_t maxGroupSize;
+
+		std::mutex mutex;
+		std::condition_variable recordAdded;
+		std::vector<Record> pending;
+		bool isClosing;
+		bool hasFailed;
+		BatchJournalStatistics statistics;
+		std::thread committer;
+
+	public:
+		/// <summary>	Opens the journal, or creates it. The options seed (see ContentHash::GetOptionsSeed) is stored
+		/// 			in the header; a journal written with other options is rejected. Throws std::runtime_error. </summary>
+		BatchJournal(const char* szFilename, uint64_t optionsSeed, double commitIntervalMilliseconds = 20, size_t maxGroupSize = 4096);
+
+		/// <summary>	Closes the journal, errors are ignored - call Close to get them. </summary>
+		~BatchJournal();
+
+		BatchJournal(const BatchJournal&) = delete;
+		BatchJournal& operator=(const BatchJournal&) = delete;
+
+		/// <summary>	Looks up the file (by its path as given) among the completed inputs loaded when the journal was
+		/// 			opened; it only counts as completed if its size and modification time are unchanged. Does not
+		/// 			change the index, so it may be called from any thread without locking. </summary>
+		bool TryGetCompleted(const std::string& path, uint64_t size, int64_t modificationTime, CachedFit& fit) const;
+
+		/// <summary>	Records the file as completed, with the size and modification time it had when it was read. </summary>
+		void Complete(const std::string& path, uint64_t size, int64_t modificationTime, const CachedFit& fit);
+
+		/// <summary>	Writes the remaining records and closes the file, throws std::runtime_error if writing failed. </summary>
+		void Close();
+
+		BatchJournalStatistics GetStatistics();
+
+	private:
+		void RunCommitter();
+
+		static uint64_t GetCheck(const Record& record);
+	};
+}
@@ -0,0 +1,202 @@
+#include "stdafx.h"
+#include "binaryPointFile.h"
+
+using namespace EllipseUtils;
+
+static const char Magic[8] = { 'E', 'L', 'L', 'P', 'T', 'S', '\r', '\n' };
+
+static_assert(sizeof(BinaryPointFileHeader) == 72, "The header must not contain padding.");
+
+static uint64_t AlignOffset(uint64_t offset)
+{
+	return (offset + BinaryPointFile::BlockAlignment - 1) / BinaryPointFile::BlockAlignment * BinaryPointFile::BlockAlignment;
+}
+
+BinaryPointFile::BinaryPointFile(const char* szFilename, MappedFile::AccessPattern accessPattern)
+	: file(szFilename, accessPattern)
+{
+	if (this->file.GetSize() < sizeof(BinaryPointFileHeader))
+	{
+		throw std::runtime_error("The file is too small for a binary point file.");
+	}
+
+	memcpy(&this->header, this->file.GetData(), sizeof(BinaryPointFileHeader));
+	ValidateHeader(this->header, this->file.GetSize());
+}
+
+/*static*/bool BinaryPointFile::IsBinaryPointFile(const char* szFilename)
+{
+	FILE* fp;
+	if (fopen_s(&fp, szFilename, "rb") != 0)
+	{
+		return false;
+	}
+
+	char magic[sizeof(Magic)];
+	bool isBinary = fread(magic, 1, sizeof(magic), fp) == sizeof(magic) && memcmp(magic, Magic, sizeof(Magic)) == 0;
+	fclose(fp);
+	return isBinary;
+}
+
+/*static*/void BinaryPointFile::ValidateHeader(const BinaryPointFileHeader& header, size_t fileSize)
+{
+	if (memcmp(header.magic, Magic, sizeof(Magic)) != 0)
+	{
+		throw std::runtime_error("Not a binary point file.");
+	}
+
+	if (header.version != CurrentVersion)
+	{
+		throw std::runtime_error("Unsupported version of the binary point file.");
+	}
+
+	if (header.dataType != PointDataType::Float32 && header.dataType != PointDataType::Float64 && header.dataType != PointDataType::Int32)
+	{
+		throw std::runtime_error("Unknown data type in the binary point file.");
+	}
+
+	if (!AreBlocksValid(header.dataType, header.count, header.xOffset, header.yOffset, sizeof(BinaryPointFileHeader), fileSize))
+	{
+		throw std::runtime_error("Invalid point count or block offsets in the binary point file.");
+	}
+
+	if (header.count > 0 && !(header.minX <= header.maxX && header.minY <= header.maxY))
+	{
+		throw std::runtime_error("Invalid bounding box in the binary point file.");
+	}
+}
+
+/*static*/bool BinaryPointFile::AreBlocksValid(PointDataType dataType, uint64_t count, uint64_t xOffset, uint64_t yOffset, uint64_t firstOffset, size_t fileSize)
+{
+	const uint64_t elementSize = GetElementSize(dataType);
+	if (count > (uint64_t)fileSize / elementSize)
+	{
+		return false;
+	}
+
+	const uint64_t blockSize = count * elementSize;
+	return xOffset % BlockAlignment == 0 && yOffset % BlockAlignment == 0 &&
+		xOffset >= firstOffset && yOffset >= firstOffset &&
+		xOffset <= fileSize && fileSize - xOffset >= blockSize &&
+		yOffset <= fileSize && fileSize - yOffset >= blockSize &&
+		(blockSize == 0 || xOffset >= yOffset + blockSize || yOffset >= xOffset + blockSize);
+}
+
+/*static*/void BinaryPointFile::Write(const char* szFilename, PointDataType dataType, const double* x, const double* y, size_t count)
+{
+	const size_t elementSize = GetElementSize(dataType);
+	BinaryPointFileHeader header = {};
+	memcpy(header.magic, Magic, sizeof(Magic));
+	header.version = CurrentVersion;
+	header.dataType = dataType;
+	header.count = count;
+	header.xOffset = AlignOffset(sizeof(BinaryPointFileHeader));
+	header.yOffset = AlignOffset(header.xOffset + count * elementSize);
+
+	// convert first, so that the bounding box is the one of the stored values
+	std::vector<char> xBlock, yBlock;
+	EncodeBlock(dataType, x, count, xBlock, header.minX, header.maxX);
+	EncodeBlock(dataType, y, count, yBlock, header.minY, header.maxY);
+
+	FILE* fp;
+	if (fopen_s(&fp, szFilename, "wb") != 0)
+	{
+		throw std::runtime_error("Couldn't create file.");
+	}
+
+	static const char padding[BlockAlignment] = {};
+	bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+	ok = ok && fwrite(padding, 1, (size_t)(header.xOffset - sizeof(header)), fp) == header.xOffset - sizeof(header);
+	ok = ok && fwrite(xBlock.data(), 1, xBlock.size(), fp) == xBlock.size();
+	ok = ok && fwrite(padding, 1, (size_t)(header.yOffset - header.xOffset - xBlock.size()), fp) == header.yOffset - header.xOffset - xBlock.size();
+	ok = ok && fwrite(yBlock.data(), 1, yBlock.size(), fp) == yBlock.size();
+	ok = fclose(fp) == 0 && ok;
+	if (!ok)
+	{
+		throw std::runtime_error("Couldn't write file.");
+	}
+}
+
+/*static*/void BinaryPointFile::EncodeBlock(PointDataType dataType, const double* values, size_t count, std::vector<char>& block, double& minimum, double& maximum)
+{
+	const size_t elementSize = GetElementSize(dataType);
+	const size_t start = block.size();
+	block.resize(start + count * elementSize);
+	char* destination = block.data() + start;
+	minimum = maximum = 0;
+	for (size_t i = 0; i < count; ++i)
+	{
+		double v = values[i];
+		switch (dataType)
+		{
+		case PointDataType::Float32:
+		{
+			if (std::abs(v) > (std::numeric_limits<float>::max)())
+			{
+				throw std::invalid_argument("The coordinate is out of the range of float32.");
+			}
+
+			float f = (float)v;
+			memcpy(destination + i * elementSize, &f, sizeof(f));
+			v = f;
+			break;
+		}
+		case PointDataType::Float64:
+			memcpy(destination + i * elementSize, &v, sizeof(v));
+			break;
+		case PointDataType::Int32:
+		{
+			double rounded = floor(v + 0.5);
+			if (!(rounded >= (std::numeric_limits<int32_t>::min)() && rounded <= (std::numeric_limits<int32_t>::max)()))
+			{
+				throw std::invalid_argument("The coordinate is out of the range of int32.");
+			}
+
+			int32_t n = (int32_t)rounded;
+			memcpy(destination + i * elementSize, &n, sizeof(n));
+			v = rounded;
+			break;
+		}
+		}
+
+		minimum = i == 0 ? v : (std::min)(minimum, v);
+		maximum = i == 0 ? v : (std::max)(maximum, v);
+	}
+}
+
+/*static*/size_t BinaryPointFile::GetElementSize(PointDataType dataType)
+{
+	switch (dataType)
+	{
+	case PointDataType::Float32:
+		return sizeof(float);
+	case PointDataType::Float64:
+		return sizeof(double);
+	case PointDataType::Int32:
+		return sizeof(int32_t);
+	}
+
+	throw std::invalid_argument("Unknown data type.");
+}
+
+/*static*/bool BinaryPointFile::TryParseDataType(const char* sz, PointDataType& dataType)
+{
+	if (_stricmp(sz, "f32") == 0)
+	{
+		dataType = PointDataType::Float32;
+	}
+	else if (_stricmp(sz, "f64") == 0)
+	{
+		dataType = PointDataType::Float64;
+	}
+	else if (_stricmp(sz, "i32") == 0)
+	{
+		dataType = PointDataType::Int32;
+	}
+	else
+	{
+		return false;
+	}
+
+	return true;
+}
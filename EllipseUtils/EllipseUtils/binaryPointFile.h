@@ -0,0 +1,140 @@
+#pragma once
+
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+#include "mappedFile.h"
+#include "leastSquareEllipseFit.h"
+
+namespace EllipseUtils
+{
+	enum class PointDataType : uint32_t
+	{
+		Float32 = 0,
+		Float64 = 1,
+		Int32 = 2
+	};
+
+	/// <summary>	Calls func with an accessor for the two arrays, which hold elements of the given data type. </summary>
+	template <typename tFloat, typename tFunc>
+	void VisitPointArrays(PointDataType dataType, const void* x, const void* y, size_t count, tFunc func)
+	{
+		switch (dataType)
+		{
+		case PointDataType::Float32:
+			func(typename LeastSquareEllipseFitter<tFloat>::template PointAccessorFromTwoTypedArrays<float>(static_cast<const float*>(x), static_cast<const float*>(y), count));
+			break;
+		case PointDataType::Float64:
+			func(typename LeastSquareEllipseFitter<tFloat>::template PointAccessorFromTwoTypedArrays<double>(static_cast<const double*>(x), static_cast<const double*>(y), count));
+			break;
+		case PointDataType::Int32:
+			func(typename LeastSquareEllipseFitter<tFloat>::template PointAccessorFromTwoTypedArrays<int32_t>(static_cast<const int32_t*>(x), static_cast<const int32_t*>(y), count));
+			break;
+		}
+	}
+
+	/// <summary>	The header of a binary point file. All fields are little-endian. The x- and y-coordinates follow as
+	/// 			two separate arrays at the given offsets, which are multiples of BinaryPointFile::BlockAlignment. </summary>
+	struct BinaryPointFileHeader
+	{
+		char magic[8];
+		uint32_t version;
+		PointDataType dataType;
+		uint64_t count;
+		double minX, minY, maxX, maxY;
+		uint64_t xOffset;
+		uint64_t yOffset;
+	};
+
+	/// <summary>	A binary point file, which is memory-mapped. The coordinates are used in place - GetAccessor and Visit
+	/// 			give views into the mapping, so the file must outlive them. </summary>
+	class BinaryPointFile
+	{
+	public:
+		static const uint32_t CurrentVersion = 1;
+		static const size_t BlockAlignment = 64;
+
+	private:
+		MappedFile file;
+		BinaryPointFileHeader header;
+
+	public:
+		/// <summary>	Maps the file and validates the header, throws std::runtime_error if the file is not a valid
+		/// 			binary point file. </summary>
+		explicit BinaryPointFile(const char* szFilename, MappedFile::AccessPattern accessPattern = MappedFile::AccessPattern::Normal);
+
+		const BinaryPointFileHeader& GetHeader() const
+		{
+			return this->header;
+		}
+
+		size_t GetCount() const
+		{
+			return (size_t)this->header.count;
+		}
+
+		PointDataType GetDataType() const
+		{
+			return this->header.dataType;
+		}
+
+		const void* GetXData() const
+		{
+			return this->file.GetData() + this->header.xOffset;
+		}
+
+		const void* GetYData() const
+		{
+			return this->file.GetData() + this->header.yOffset;
+		}
+
+		/// <summary>	Gets an accessor for the coordinates, which must be stored with the type tValue. </summary>
+		template <typename tFloat, typename tValue>
+		typename LeastSquareEllipseFitter<tFloat>::template PointAccessorFromTwoTypedArrays<tValue> GetAccessor() const
+		{
+			if (this->header.dataType != DataTypeOf<tValue>())
+			{
+				throw std::logic_error("The requested type does not match the data type of the file.");
+			}
+
+			return typename LeastSquareEllipseFitter<tFloat>::template PointAccessorFromTwoTypedArrays<tValue>(
+				static_cast<const tValue*>(this->GetXData()), static_cast<const tValue*>(this->GetYData()), this->GetCount());
+		}
+
+		/// <summary>	Calls func with an accessor for the data type of the file. </summary>
+		template <typename tFloat, typename tFunc>
+		void Visit(tFunc func) const
+		{
+			VisitPointArrays<tFloat>(this->header.dataType, this->GetXData(), this->GetYData(), this->GetCount(), func);
+		}
+
+		/// <summary>	Checks the magic number at the start of the file. </summary>
+		static bool IsBinaryPointFile(const char* szFilename);
+
+		/// <summary>	Validates a header against the size of the file, throws std::runtime_error. </summary>
+		static void ValidateHeader(const BinaryPointFileHeader& header, size_t fileSize);
+
+		/// <summary>	Checks that the x- and y-blocks are aligned, do not overlap and lie within [firstOffset, fileSize). </summary>
+		static bool AreBlocksValid(PointDataType dataType, uint64_t count, uint64_t xOffset, uint64_t yOffset, uint64_t firstOffset, size_t fileSize);
+
+		/// <summary>	Writes the points with the given data type. Int32 rounds to the nearest integer, values outside
+		/// 			of the range of the data type result in std::invalid_argument. </summary>
+		static void Write(const char* szFilename, PointDataType dataType, const double* x, const double* y, size_t count);
+
+		/// <summary>	Converts the values to the data type and appends them to the block. The minimum and maximum are
+		/// 			the ones of the converted values. </summary>
+		static void EncodeBlock(PointDataType dataType, const double* values, size_t count, std::vector<char>& block, double& minimum, double& maximum);
+
+		static size_t GetElementSize(PointDataType dataType);
+
+		/// <summary>	Parses "f32", "f64" or "i32". </summary>
+		static bool TryParseDataType(const char* sz, PointDataType& dataType);
+
+		template <typename tValue>
+		static PointDataType DataTypeOf();
+	};
+
+	template <> inline PointDataType BinaryPointFile::DataTypeOf<float>() { return PointDataType::Float32; }
+	template <> inline PointDataType BinaryPointFile::DataTypeOf<double>() { return PointDataType::Float64; }
+	template <> inline PointDataType BinaryPointFile::DataTypeOf<int32_t>() { return PointDataType::Int32; }
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+namespace EllipseUtils
+{
+	/// <summary>	A bounded lock-free queue for any number of producers and consumers (D. Vyukov's array-based
+	/// 			design). Each cell has a sequence number which tells whether it is ready to be written or to be
+	/// 			read in the current round, so producers and consumers only contend on their respective position
+	/// 			counter. The capacity is rounded up to a power of two. TryPush and TryPop never block; the
+	/// 			caller decides how to wait. </summary>
+	template <typename T>
+	class BoundedQueue
+	{
+	private:
+		struct Cell
+		{
+			std::atomic<size_t> sequence;
+			T value;
+		};
+
+		std::unique_ptr<Cell[]> cells;
+		size_t mask;
+		alignas(64) std::atomic<size_t> enqueuePosition;
+		alignas(64) std::atomic<size_t> dequeuePosition;
+
+	public:
+		explicit BoundedQueue(size_t capacity)
+			: enqueuePosition(0), dequeuePosition(0)
+		{
+			size_t size = 2;
+			while (size < capacity)
+			{
+				size *= 2;
+			}
+
+			this->cells.reset(new Cell[size]);
+			this->mask = size - 1;
+			for (size_t i = 0; i < size; ++i)
+			{
+				this->cells[i].sequence.store(i, std::memory_order_relaxed);
+			}
+		}
+
+		BoundedQueue(const BoundedQueue&) = delete;
+		BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+		size_t GetCapacity() const
+		{
+			return this->mask + 1;
+		}
+
+		/// <summary>	Gets the number of items in the queue, which may be outdated by the time it is returned. </summary>
+		size_t GetApproximateSize() const
+		{
+			const size_t enqueued = this->enqueuePosition.load(std::memory_order_relaxed);
+			const size_t dequeued = this->dequeuePosition.load(std::memory_order_relaxed);
+			return enqueued >= dequeued ? enqueued - dequeued : 0;
+		}
+
+		/// <summary>	Moves the value into the queue, returns false (leaving the value untouched) if it is full. </summary>
+		bool TryPush(T& value)
+		{
+			size_t position = this->enqueuePosition.load(std::memory_order_relaxed);
+			for (;;)
+			{
+				Cell& cell = this->cells[position & this->mask];
+				const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+				const ptrdiff_t difference = (ptrdiff_t)sequence - (ptrdiff_t)position;
+				if (difference == 0)
+				{
+					if (this->enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+					{
+						cell.value = std::move(value);
+						cell.sequence.store(position + 1, std::memory_order_release);
+						return true;
+					}
+				}
+				else if (difference < 0)
+				{
+					return false;
+				}
+				else
+				{
+					position = this->enqueuePosition.load(std::memory_order_relaxed);
+				}
+			}
+		}
+
+		/// <summary>	Moves the oldest value out of the queue, returns false if it is empty. </summary>
+		bool TryPop(T& value)
+		{
+			size_t position = this->dequeuePosition.load(std::memory_order_relaxed);
+			for (;;)
+			{
+				Cell& cell = this->cells[position & this->mask];
+				const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+				const ptrdiff_t difference = (ptrdiff_t)sequence - (ptrdiff_t)(position + 1);
+				if (difference == 0)
+				{
+					if (this->dequeuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+					{
+						value = std::move(cell.value);
+						cell.sequence.store(position + this->mask + 1, std::memory_order_release);
+						return true;
+					}
+				}
+				else if (difference < 0)
+				{
+					return false;
+				}
+				else
+				{
+					position = this->dequeuePosition.load(std::memory_order_relaxed);
+				}
+			}
+		}
+	};
+}
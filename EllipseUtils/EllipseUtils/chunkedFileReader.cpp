@@ -0,0 +1,152 @@
+#include "stdafx.h"
+#include "chunkedFileReader.h"
+#include <stdexcept>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace EllipseUtils;
+
+ChunkedFileReader::ChunkedFileReader(const char* szFilename, Method method, size_t chunkSize)
+	: method(method), chunkSize((std::max)(chunkSize, (size_t)1)), fileSize(0), previousOffset(0), previousLength(0)
+{
+	if (method == Method::Mapping)
+	{
+#if defined(_WIN32)
+		this->fileHandle = nullptr;
+#else
+		this->fileDescriptor = -1;
+#endif
+		this->mapping.reset(new MappedFile(szFilename, MappedFile::AccessPattern::Sequential));
+		this->fileSize = this->mapping->GetSize();
+		return;
+	}
+
+#if defined(_WIN32)
+	this->fileHandle = CreateFileA(szFilename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (this->fileHandle == INVALID_HANDLE_VALUE)
+	{
+		this->fileHandle = nullptr;
+		throw std::runtime_error("Couldn't open file.");
+	}
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(this->fileHandle, &size))
+	{
+		CloseHandle(this->fileHandle);
+		throw std::runtime_error("Couldn't determine the size of the file.");
+	}
+
+	this->fileSize = (uint64_t)size.QuadPart;
+#else
+	this->fileDescriptor = open(szFilename, O_RDONLY);
+	if (this->fileDescriptor < 0)
+	{
+		throw std::runtime_error("Couldn't open file.");
+	}
+
+	struct stat fileStatus;
+	if (fstat(this->fileDescriptor, &fileStatus) != 0)
+	{
+		close(this->fileDescriptor);
+		throw std::runtime_error("Couldn't determine the size of the file.");
+	}
+
+	this->fileSize = (uint64_t)fileStatus.st_size;
+#if defined(POSIX_FADV_SEQUENTIAL)
+	posix_fadvise(this->fileDescriptor, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+#endif
+
+	this->buffer.resize((size_t)(std::min)((uint64_t)this->chunkSize, (std::max)(this->fileSize, (uint64_t)1)));
+}
+
+ChunkedFileReader::~ChunkedFileReader()
+{
+#if defined(_WIN32)
+	if (this->fileHandle != nullptr)
+	{
+		CloseHandle(this->fileHandle);
+	}
+#else
+	if (this->fileDescriptor >= 0)
+	{
+		close(this->fileDescriptor);
+	}
+#endif
+}
+
+const char* ChunkedFileReader::Read(uint64_t offset, size_t length)
+{
+	if (length > this->chunkSize || offset > this->fileSize || length > this->fileSize - offset)
+	{
+		throw std::runtime_error("The range is not within the file or larger than the chunk size.");
+	}
+
+	if (this->method == Method::Mapping)
+	{
+		// the previous chunk has been processed, the next one is likely to follow
+		if (this->previousLength > 0 && this->previousOffset != offset)
+		{
+			this->mapping->Release((size_t)this->previousOffset, this->previousLength);
+		}
+
+		this->mapping->Prefetch((size_t)(offset + length), length);
+		this->previousOffset = offset;
+		this->previousLength = length;
+		return this->mapping->GetData() + offset;
+	}
+
+	char* dest = this->buffer.data();
+	size_t remaining = length;
+	while (remaining > 0)
+	{
+#if defined(_WIN32)
+		OVERLAPPED overlapped = {};
+		overlapped.Offset = (DWORD)(offset & 0xffffffff);
+		overlapped.OffsetHigh = (DWORD)(offset >> 32);
+		DWORD bytesRead = 0;
+		DWORD bytesToRead = (DWORD)(std::min)(remaining, (size_t)(1 << 30));
+		if (!ReadFile(this->fileHandle, dest, bytesToRead, &bytesRead, &overlapped) || bytesRead == 0)
+		{
+			throw std::runtime_error("Couldn't read file.");
+		}
+#else
+		ssize_t bytesRead = pread(this->fileDescriptor, dest, remaining, (off_t)offset);
+		if (bytesRead <= 0)
+		{
+			throw std::runtime_error("Couldn't read file.");
+		}
+#endif
+		dest += bytesRead;
+		offset += (uint64_t)bytesRead;
+		remaining -= (size_t)bytesRead;
+	}
+
+	return this->buffer.data();
+}
+
+/*static*/bool ChunkedFileReader::TryParseMethod(const char* sz, Method& method)
+{
+	if (_stricmp(sz, "mmap") == 0)
+	{
+		method = Method::Mapping;
+	}
+	else if (_stricmp(sz, "read") == 0)
+	{
+		method = Method::Read;
+	}
+	else
+	{
+		return false;
+	}
+
+	return true;
+}
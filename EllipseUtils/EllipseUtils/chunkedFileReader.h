@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "mappedFile.h"
+
+namespace EllipseUtils
+{
+	/// <summary>	Reads a file front to back in chunks of a bounded size, so that the memory used does not depend on
+	/// 			the size of the file. With Method::Mapping the file is mapped for sequential access, the chunk after
+	/// 			the current one is prefetched and the previous one is released from the working set. With
+	/// 			Method::Read the chunks are read with positional reads (pread, ReadFile with an offset on
+	/// 			Windows) into a buffer which is allocated once - this also works for files which do not fit
+	/// 			into the address space of a 32-bit process. </summary>
+	class ChunkedFileReader
+	{
+	public:
+		enum class Method
+		{
+			Mapping,
+			Read
+		};
+
+	private:
+		Method method;
+		size_t chunkSize;
+		uint64_t fileSize;
+		std::unique_ptr<MappedFile> mapping;
+		std::vector<char> buffer;
+#if defined(_WIN32)
+		void* fileHandle;
+#else
+		int fileDescriptor;
+#endif
+		uint64_t previousOffset;
+		size_t previousLength;
+
+	public:
+		/// <summary>	Opens the file, throws std::runtime_error. </summary>
+		ChunkedFileReader(const char* szFilename, Method method, size_t chunkSize);
+		~ChunkedFileReader();
+
+		ChunkedFileReader(const ChunkedFileReader&) = delete;
+		ChunkedFileReader& operator=(const ChunkedFileReader&) = delete;
+
+		uint64_t GetFileSize() const
+		{
+			return this->fileSize;
+		}
+
+		size_t GetChunkSize() const
+		{
+			return this->chunkSize;
+		}
+
+		/// <summary>	Gets the bytes [offset, offset+length) of the file, length must not exceed the chunk size. The
+		/// 			data stays valid until the next call. Throws std::runtime_error if the range is not within the
+		/// 			file or reading fails. </summary>
+		const char* Read(uint64_t offset, size_t length);
+
+		/// <summary>	Parses "mmap" or "read". </summary>
+		static bool TryParseMethod(const char* sz, Method& method);
+	};
+}
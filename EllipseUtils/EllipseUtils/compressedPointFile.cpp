@@ -0,0 +1,266 @@
+#include "stdafx.h"
+#include "compressedPointFile.h"
+#include <cmath>
+#include <limits>
+
+using namespace EllipseUtils;
+
+static const char Magic[8] = { 'E', 'L', 'L', 'P', 'T', 'Z', '\r', '\n' };
+
+static_assert(sizeof(CompressedPointFileHeader) == 88, "The header must not contain padding.");
+
+/// <summary>	A block starts with the first point and the bit widths of the x- and y-differences. </summary>
+static const size_t BlockHeaderSize = 12;
+
+/// <summary>	Zero bytes after the last block, so that the decoder can always load 8 bytes at once. </summary>
+static const size_t TrailingPadding = 8;
+
+static const unsigned int MaxBitWidth = 33;
+
+static uint64_t ZigZagEncode(int64_t v)
+{
+	return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+}
+
+static int64_t ZigZagDecode(uint64_t z)
+{
+	return static_cast<int64_t>(z >> 1) ^ -static_cast<int64_t>(z & 1);
+}
+
+static unsigned int BitWidth(uint64_t v)
+{
+	unsigned int bits = 0;
+	for (; v != 0; v >>= 1)
+	{
+		++bits;
+	}
+
+	return bits;
+}
+
+static size_t PackedSize(size_t count, unsigned int bits)
+{
+	return (count * bits + 7) / 8;
+}
+
+/// <summary>	Appends the values with the given bit width, least significant bit first. </summary>
+static void PackBits(std::vector<uint8_t>& destination, const std::vector<uint64_t>& values, unsigned int bits)
+{
+	const size_t start = destination.size();
+	destination.resize(start + PackedSize(values.size(), bits), 0);
+	uint8_t* p = destination.data() + start;
+	size_t bitPosition = 0;
+	for (uint64_t v : values)
+	{
+		for (unsigned int i = 0; i < bits; ++i, ++bitPosition)
+		{
+			p[bitPosition / 8] |= static_cast<uint8_t>(((v >> i) & 1) << (bitPosition % 8));
+		}
+	}
+}
+
+/// <summary>	Unpacks count differences and accumulates them, starting with first. At least 8 bytes must be
+/// 			readable from every byte of the packed data. </summary>
+static void UnpackDeltas(const uint8_t* p, unsigned int bits, size_t count, int32_t first, int32_t* destination)
+{
+	const uint64_t mask = (uint64_t(1) << bits) - 1;
+	int64_t v = first;
+	destination[0] = first;
+	size_t bitPosition = 0;
+	for (size_t i = 1; i <= count; ++i, bitPosition += bits)
+	{
+		uint64_t word;
+		memcpy(&word, p + bitPosition / 8, sizeof(word));
+		v += ZigZagDecode((word >> (bitPosition % 8)) & mask);
+		destination[i] = static_cast<int32_t>(v);
+	}
+}
+
+CompressedPointFile::CompressedPointFile(const char* szFilename, MappedFile::AccessPattern accessPattern)
+	: file(szFilename, accessPattern)
+{
+	const size_t fileSize = this->file.GetSize();
+	if (fileSize < sizeof(CompressedPointFileHeader))
+	{
+		throw std::runtime_error("The file is too small for a compressed point file.");
+	}
+
+	memcpy(&this->header, this->file.GetData(), sizeof(CompressedPointFileHeader));
+	if (memcmp(this->header.magic, Magic, sizeof(Magic)) != 0)
+	{
+		throw std::runtime_error("Not a compressed point file.");
+	}
+
+	if (this->header.version != CurrentVersion)
+	{
+		throw std::runtime_error("Unsupported version of the compressed point file.");
+	}
+
+	if (this->header.blockLength == 0 || this->header.blockLength > MaxBlockLength ||
+		this->header.blockCount != (this->header.count + this->header.blockLength - 1) / this->header.blockLength ||
+		!(this->header.quantum > 0) || !std::isfinite(this->header.quantum))
+	{
+		throw std::runtime_error("Invalid header in the compressed point file.");
+	}
+
+	// the index, and the blocks in ascending order between the index and the padding
+	const uint64_t indexEnd = sizeof(CompressedPointFileHeader) + (this->header.blockCount + 1) * sizeof(uint64_t);
+	if (this->header.blockCount > fileSize / BlockHeaderSize || indexEnd + TrailingPadding > fileSize)
+	{
+		throw std::runtime_error("Invalid block count in the compressed point file.");
+	}
+
+	uint64_t previous = indexEnd;
+	for (uint64_t i = 0; i <= this->header.blockCount; ++i)
+	{
+		uint64_t offset;
+		memcpy(&offset, this->file.GetData() + sizeof(CompressedPointFileHeader) + i * sizeof(uint64_t), sizeof(offset));
+		if (offset < previous || (i > 0 && offset - previous < BlockHeaderSize) || offset > fileSize - TrailingPadding)
+		{
+			throw std::runtime_error("Invalid block offsets in the compressed point file.");
+		}
+
+		previous = offset;
+	}
+
+	if (this->header.count > 0 && !(this->header.minX <= this->header.maxX && this->header.minY <= this->header.maxY))
+	{
+		throw std::runtime_error("Invalid bounding box in the compressed point file.");
+	}
+}
+
+size_t CompressedPointFile::DecodeBlock(size_t blockIndex, int32_t* qx, int32_t* qy) const
+{
+	const char* index = this->file.GetData() + sizeof(CompressedPointFileHeader);
+	uint64_t start, end;
+	memcpy(&start, index + blockIndex * sizeof(uint64_t), sizeof(start));
+	memcpy(&end, index + (blockIndex + 1) * sizeof(uint64_t), sizeof(end));
+
+	const size_t n = (size_t)(std::min)(uint64_t(this->header.blockLength), this->header.count - uint64_t(blockIndex) * this->header.blockLength);
+	const uint8_t* p = reinterpret_cast<const uint8_t*>(this->file.GetData() + start);
+	int32_t firstX, firstY;
+	memcpy(&firstX, p, sizeof(firstX));
+	memcpy(&firstY, p + 4, sizeof(firstY));
+	const unsigned int bitsX = p[8], bitsY = p[9];
+	if (bitsX > MaxBitWidth || bitsY > MaxBitWidth || end - start != BlockHeaderSize + PackedSize(n - 1, bitsX) + PackedSize(n - 1, bitsY))
+	{
+		throw std::runtime_error("Corrupt block in the compressed point file.");
+	}
+
+	UnpackDeltas(p + BlockHeaderSize, bitsX, n - 1, firstX, qx);
+	UnpackDeltas(p + BlockHeaderSize + PackedSize(n - 1, bitsX), bitsY, n - 1, firstY, qy);
+	return n;
+}
+
+void CompressedPointFile::Read(std::vector<double>& xPoints, std::vector<double>& yPoints) const
+{
+	const size_t start = xPoints.size();
+	xPoints.resize(start + this->GetCount());
+	yPoints.resize(start + this->GetCount());
+	for (size_t b = 0; b < this->GetBlockCount(); ++b)
+	{
+		const size_t offset = start + b * this->header.blockLength;
+		this->DecodeBlock(b, xPoints.data() + offset, yPoints.data() + offset);
+	}
+}
+
+/*static*/bool CompressedPointFile::IsCompressedPointFile(const char* szFilename)
+{
+	FILE* fp;
+	if (fopen_s(&fp, szFilename, "rb") != 0)
+	{
+		return false;
+	}
+
+	char magic[sizeof(Magic)];
+	bool isCompressed = fread(magic, 1, sizeof(magic), fp) == sizeof(magic) && memcmp(magic, Magic, sizeof(Magic)) == 0;
+	fclose(fp);
+	return isCompressed;
+}
+
+/*static*/void CompressedPointFile::Write(const char* szFilename, const double* x, const double* y, size_t count, double quantum, uint32_t blockLength)
+{
+	if (!(quantum > 0) || !std::isfinite(quantum))
+	{
+		throw std::invalid_argument("The quantum must be positive.");
+	}
+
+	if (blockLength == 0 || blockLength > MaxBlockLength)
+	{
+		throw std::invalid_argument("Invalid block length.");
+	}
+
+	CompressedPointFileHeader header = {};
+	memcpy(header.magic, Magic, sizeof(Magic));
+	header.version = CurrentVersion;
+	header.blockLength = blockLength;
+	header.count = count;
+	header.blockCount = (count + blockLength - 1) / blockLength;
+	header.quantum = quantum;
+
+	std::vector<int32_t> qx(count), qy(count);
+	for (size_t i = 0; i < count; ++i)
+	{
+		double rx = floor(x[i] / quantum + 0.5), ry = floor(y[i] / quantum + 0.5);
+		if (!(rx >= (std::numeric_limits<int32_t>::min)() && rx <= (std::numeric_limits<int32_t>::max)() &&
+			ry >= (std::numeric_limits<int32_t>::min)() && ry <= (std::numeric_limits<int32_t>::max)()))
+		{
+			throw std::invalid_argument("The coordinate is out of range for the quantum.");
+		}
+
+		qx[i] = (int32_t)rx;
+		qy[i] = (int32_t)ry;
+
+		// the bounding box and the sums are the ones of the decoded values
+		double dx = qx[i] * quantum, dy = qy[i] * quantum;
+		header.minX = i == 0 ? dx : (std::min)(header.minX, dx); header.maxX = i == 0 ? dx : (std::max)(header.maxX, dx);
+		header.minY = i == 0 ? dy : (std::min)(header.minY, dy); header.maxY = i == 0 ? dy : (std::max)(header.maxY, dy);
+		header.sumX += dx; header.sumY += dy;
+	}
+
+	std::vector<uint64_t> offsets;
+	std::vector<uint8_t> blocks;
+	std::vector<uint64_t> deltasX, deltasY;
+	const uint64_t blocksStart = sizeof(CompressedPointFileHeader) + (header.blockCount + 1) * sizeof(uint64_t);
+	for (size_t blockStart = 0; blockStart < count; blockStart += blockLength)
+	{
+		const size_t n = (std::min)(count - blockStart, (size_t)blockLength);
+		deltasX.clear(); deltasY.clear();
+		uint64_t allX = 0, allY = 0;
+		for (size_t i = blockStart + 1; i < blockStart + n; ++i)
+		{
+			deltasX.push_back(ZigZagEncode(int64_t(qx[i]) - qx[i - 1]));
+			deltasY.push_back(ZigZagEncode(int64_t(qy[i]) - qy[i - 1]));
+			allX |= deltasX.back();
+			allY |= deltasY.back();
+		}
+
+		offsets.push_back(blocksStart + blocks.size());
+		uint8_t blockHeader[BlockHeaderSize] = {};
+		memcpy(blockHeader, &qx[blockStart], 4);
+		memcpy(blockHeader + 4, &qy[blockStart], 4);
+		blockHeader[8] = (uint8_t)BitWidth(allX);
+		blockHeader[9] = (uint8_t)BitWidth(allY);
+		blocks.insert(blocks.end(), blockHeader, blockHeader + BlockHeaderSize);
+		PackBits(blocks, deltasX, blockHeader[8]);
+		PackBits(blocks, deltasY, blockHeader[9]);
+	}
+
+	offsets.push_back(blocksStart + blocks.size());
+	blocks.resize(blocks.size() + TrailingPadding, 0);
+
+	FILE* fp;
+	if (fopen_s(&fp, szFilename, "wb") != 0)
+	{
+		throw std::runtime_error("Couldn't create file.");
+	}
+
+	bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+	ok = ok && fwrite(offsets.data(), sizeof(uint64_t), offsets.size(), fp) == offsets.size();
+	ok = ok && fwrite(blocks.data(), 1, blocks.size(), fp) == blocks.size();
+	ok = fclose(fp) == 0 && ok;
+	if (!ok)
+	{
+		throw std::runtime_error("Couldn't write file.");
+	}
+}
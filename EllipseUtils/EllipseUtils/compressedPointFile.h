@@ -0,0 +1,125 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "mappedFile.h"
+#include "momentAccumulator.h"
+
+namespace EllipseUtils
+{
+	/// <summary>	The header of a compressed point file. All fields are little-endian. The header is followed by
+	/// 			blockCount + 1 offsets (uint64_t) of the blocks, the last one is the end of the last block. </summary>
+	struct CompressedPointFileHeader
+	{
+		char magic[8];
+		uint32_t version;
+
+		/// <summary>	The number of points per block (the last block may have less). </summary>
+		uint32_t blockLength;
+		uint64_t count;
+		uint64_t blockCount;
+
+		/// <summary>	The grid the coordinates are quantized to: x = qx * quantum with the integer qx. </summary>
+		double quantum;
+		double minX, minY, maxX, maxY;
+
+		/// <summary>	The sums of the (quantized) coordinates, so that the normalization is known without decoding. </summary>
+		double sumX, sumY;
+	};
+
+	/// <summary>	A compressed point file for coherent point sequences like edge chains. The coordinates are quantized
+	/// 			to a fixed grid and split into blocks; a block holds its first point and the zigzag-encoded
+	/// 			differences to the previous point, bit-packed with the smallest width that fits all of them
+	/// 			(separately for x and y). Unpacking fixed-width fields is branch-free, and the blocks can be
+	/// 			decoded independently, so the moments are accumulated block by block without decoding the
+	/// 			whole file first (see AddToMoments). </summary>
+	class CompressedPointFile
+	{
+	public:
+		static const uint32_t CurrentVersion = 1;
+		static const uint32_t DefaultBlockLength = 256;
+		static const uint32_t MaxBlockLength = 1024;
+
+	private:
+		MappedFile file;
+		CompressedPointFileHeader header;
+
+	public:
+		/// <summary>	Maps the file and validates the header and the block offsets, throws std::runtime_error. </summary>
+		explicit CompressedPointFile(const char* szFilename, MappedFile::AccessPattern accessPattern = MappedFile::AccessPattern::Sequential);
+
+		const CompressedPointFileHeader& GetHeader() const
+		{
+			return this->header;
+		}
+
+		size_t GetCount() const
+		{
+			return (size_t)this->header.count;
+		}
+
+		size_t GetBlockCount() const
+		{
+			return (size_t)this->header.blockCount;
+		}
+
+		/// <summary>	Gets the normalization of the points from the header. </summary>
+		template <typename tFloat>
+		PointNormalization<tFloat> GetNormalization() const
+		{
+			return PointNormalization<tFloat>::FromMeanMinMax(
+				tFloat(this->header.sumX / this->header.count), tFloat(this->header.sumY / this->header.count),
+				tFloat(this->header.minX), tFloat(this->header.minY), tFloat(this->header.maxX), tFloat(this->header.maxY));
+		}
+
+		/// <summary>	Decodes the quantized coordinates of a block to qx and qy, which must have room for blockLength
+		/// 			values. Returns the number of points in the block, throws std::runtime_error if the block is
+		/// 			corrupt. </summary>
+		size_t DecodeBlock(size_t blockIndex, int32_t* qx, int32_t* qy) const;
+
+		/// <summary>	Decodes the coordinates of a block, see above. </summary>
+		template <typename tFloat>
+		size_t DecodeBlock(size_t blockIndex, tFloat* x, tFloat* y) const
+		{
+			int32_t qx[MaxBlockLength], qy[MaxBlockLength];
+			const size_t n = this->DecodeBlock(blockIndex, qx, qy);
+			const double quantum = this->header.quantum;
+			for (size_t i = 0; i < n; ++i)
+			{
+				x[i] = tFloat(qx[i] * quantum);
+				y[i] = tFloat(qy[i] * quantum);
+			}
+
+			return n;
+		}
+
+		/// <summary>	Decodes the blocks [firstBlock, endBlock) one at a time and adds the points to the moments. </summary>
+		template <typename tFloat>
+		void AddToMoments(NormalizedMomentAccumulator<tFloat>& moments, size_t firstBlock, size_t endBlock) const
+		{
+			tFloat x[MaxBlockLength], y[MaxBlockLength];
+			for (size_t b = firstBlock; b < endBlock; ++b)
+			{
+				const size_t n = this->DecodeBlock(b, x, y);
+				moments.AddPointBlock(x, y, n);
+			}
+		}
+
+		template <typename tFloat>
+		void AddToMoments(NormalizedMomentAccumulator<tFloat>& moments) const
+		{
+			this->AddToMoments(moments, 0, this->GetBlockCount());
+		}
+
+		/// <summary>	Decodes all points into the vectors (appending). </summary>
+		void Read(std::vector<double>& xPoints, std::vector<double>& yPoints) const;
+
+		/// <summary>	Checks the magic number at the start of the file. </summary>
+		static bool IsCompressedPointFile(const char* szFilename);
+
+		/// <summary>	Writes the points quantized to multiples of quantum, so each coordinate changes by at most
+		/// 			quantum / 2. Throws std::invalid_argument if quantum is not positive or a quantized coordinate
+		/// 			does not fit into an int32. </summary>
+		static void Write(const char* szFilename, const double* x, const double* y, size_t count, double quantum, uint32_t blockLength = DefaultBlockLength);
+	};
+}
@@ -0,0 +1,237 @@
+#pragma once
+
+#include <vector>
+#include "ellipseParameters.h"
+#include "inc_eigen.h"
+#include "momentAccumulator.h"
+#include "leastSquareEllipseFit.h"
+#include "constrainedLeastSquareEllipseFit.h"
+#include "parallelFor.h"
+
+namespace EllipseUtils
+{
+	/// <summary>	Joint fit of several concentric ellipses (one point set per ring) with one shared center and
+	/// 			individual axes and orientation per ring.
+	///
+	/// 			The unknowns are the center and (A,B,C,F) for each ring. The normal equations have an arrow-head
+	/// 			structure: the blocks of the rings are only coupled through the center. For a given center the
+	/// 			ring blocks are solved independently (the known-center fit of ConstrainedLeastSquareEllipseFitter),
+	/// 			what remains is the 2x2 system for the center (Schur complement), which is solved by Gauss-Newton
+	/// 			iterations. All of this only operates on the moments of the rings, so the cost of an iteration
+	/// 			grows linearly with the number of rings and does not depend on the number of points. </summary>
+	template<typename tFloat>
+	class ConcentricEllipseFitter
+	{
+	public:
+		/// <summary>	Number of points which are accumulated in one task. </summary>
+		static const size_t ChunkSize = 64 * 1024;
+
+		/// <summary>	Number of points below which an additional thread does not pay for its start-up. </summary>
+		static const size_t MinPointsPerThread = 2 * ChunkSize;
+
+		static const int MaxIterations = 50;
+
+		struct Result
+		{
+			tFloat x0, y0;
+			std::vector<EllipseAlgebraicParameters<tFloat>> rings;
+			int iterations;
+		};
+
+		template <typename PointAccessor>
+		static Result Fit(const std::vector<PointAccessor>& rings, unsigned int maxThreads = 0)
+		{
+			return Fit(AccumulateRingMoments(rings, maxThreads));
+		}
+
+		/// <summary>	Accumulates the moments of each ring. The rings are split into chunks, which are processed in parallel -
+		/// 			small inputs (fewer than MinPointsPerThread points per thread) on fewer threads or the calling thread only. </summary>
+		template <typename PointAccessor>
+		static std::vector<NormalizedMomentAccumulator<tFloat>> AccumulateRingMoments(const std::vector<PointAccessor>& rings, unsigned int maxThreads = 0)
+		{
+			size_t pointCount = 0;
+			for (const auto& ring : rings)
+			{
+				pointCount += ring.GetLength();
+			}
+
+			const unsigned int threadLimit = (unsigned int)(std::max)(pointCount / MinPointsPerThread, (size_t)1);
+			maxThreads = (std::min)(maxThreads > 0 ? maxThreads : GetDefaultThreadCount(), threadLimit);
+
+			std::vector<PointNormalization<tFloat>> normalizations(rings.size());
+			ParallelFor(rings.size(), [&](size_t i) { normalizations[i] = PointNormalization<tFloat>::FromPoints(rings[i]); }, maxThreads);
+
+			struct Chunk
+			{
+				size_t ring, start, end;
+			};
+
+			std::vector<Chunk> chunks;
+			std::vector<NormalizedMomentAccumulator<tFloat>> partialMoments;
+			for (size_t r = 0; r < rings.size(); ++r)
+			{
+				size_t length = rings[r].GetLength();
+				for (size_t start = 0; start < length; start += ChunkSize)
+				{
+					chunks.push_back(Chunk{ r, start, (std::min)(start + ChunkSize, length) });
+					partialMoments.push_back(NormalizedMomentAccumulator<tFloat>(normalizations[r]));
+				}
+			}
+
+			ParallelFor(chunks.size(), [&](size_t i) { partialMoments[i].AddPoints(rings[chunks[i].ring], chunks[i].start, chunks[i].end); }, maxThreads);
+
+			std::vector<NormalizedMomentAccumulator<tFloat>> ringMoments;
+			ringMoments.reserve(rings.size());
+			for (size_t r = 0; r < rings.size(); ++r)
+			{
+				ringMoments.push_back(NormalizedMomentAccumulator<tFloat>(normalizations[r]));
+			}
+
+			for (size_t i = 0; i < chunks.size(); ++i)
+			{
+				ringMoments[chunks[i].ring].Merge(partialMoments[i]);
+			}
+
+			return ringMoments;
+		}
+
+		static Result Fit(const std::vector<NormalizedMomentAccumulator<tFloat>>& ringMoments)
+		{
+			if (ringMoments.empty())
+			{
+				throw std::invalid_argument("At least one ring is required.");
+			}
+
+			PointNormalization<tFloat> normalization = CalcCommonNormalization(ringMoments);
+
+			// start with the (weighted) mean of the centers of the individual fits
+			tFloat x0 = 0, y0 = 0, weightSum = 0;
+			for (const auto& moments : ringMoments)
+			{
+				EllipseParameters<tFloat> p = EllipseParameters<tFloat>::FromAlgebraicParameters(LeastSquareEllipseFitter<tFloat>::Fit(moments));
+				if (p.IsValid())
+				{
+					x0 += p.x0 * moments.GetWeightSum();
+					y0 += p.y0 * moments.GetWeightSum();
+					weightSum += moments.GetWeightSum();
+				}
+			}
+
+			if (weightSum > 0)
+			{
+				normalization.mx = x0 / weightSum;
+				normalization.my = y0 / weightSum;
+			}
+
+			Result result;
+			std::vector<tFloat> conics(6 * ringMoments.size());
+			for (result.iterations = 1; ; ++result.iterations)
+			{
+				Eigen::Matrix<tFloat, 2, 2> h = Eigen::Matrix<tFloat, 2, 2>::Zero();
+				Eigen::Matrix<tFloat, 2, 1> rhs = Eigen::Matrix<tFloat, 2, 1>::Zero();
+				for (size_t r = 0; r < ringMoments.size(); ++r)
+				{
+					AccumulateCenterNormalEquations(ringMoments[r].Renormalized(normalization), &conics[6 * r], h, rhs);
+				}
+
+				if (result.iterations >= MaxIterations || h.determinant() == 0)
+				{
+					break;
+				}
+
+				Eigen::Matrix<tFloat, 2, 1> delta = h.inverse()*rhs;
+				if (delta.norm() < std::numeric_limits<tFloat>::epsilon() * 16)
+				{
+					break;
+				}
+
+				normalization.mx += delta(0) * normalization.sx;
+				normalization.my += delta(1) * normalization.sy;
+			}
+
+			result.x0 = normalization.mx;
+			result.y0 = normalization.my;
+			for (size_t r = 0; r < ringMoments.size(); ++r)
+			{
+				result.rings.push_back(LeastSquareEllipseFitter<tFloat>::Denormalize(&conics[6 * r], normalization));
+			}
+
+			return result;
+		}
+
+	private:
+		static PointNormalization<tFloat> CalcCommonNormalization(const std::vector<NormalizedMomentAccumulator<tFloat>>& ringMoments)
+		{
+			PointNormalization<tFloat> n = {};
+			tFloat weightSum = 0;
+			for (const auto& moments : ringMoments)
+			{
+				n.mx += moments.GetNormalization().mx * moments.GetWeightSum();
+				n.my += moments.GetNormalization().my * moments.GetWeightSum();
+				weightSum += moments.GetWeightSum();
+			}
+
+			n.mx /= weightSum;
+			n.my /= weightSum;
+			for (const auto& moments : ringMoments)
+			{
+				const PointNormalization<tFloat>& m = moments.GetNormalization();
+				n.sx = (std::max)(n.sx, std::abs(m.mx - n.mx) + m.sx);
+				n.sy = (std::max)(n.sy, std::abs(m.my - n.my) + m.sy);
+			}
+
+			return n;
+		}
+
+		/// <summary>	Solves for the conic of one ring with the center at the current estimate (the reference point of the
+		/// 			moments) and adds the contribution of the ring to the Gauss-Newton equations for a correction of the
+		/// 			center. With r = A*u^2 + B*u*v + C*v^2 + F, moving the center by (dx,dy) changes the residual by
+		/// 			-(2A*u + B*v)*dx - (B*u + 2C*v)*dy. The ring's own block (restricted to changes of (A,B,C,F) which
+		/// 			keep 4AC-B^2 constant) is eliminated right here, so only its Schur complement is added. </summary>
+		static void AccumulateCenterNormalEquations(const NormalizedMomentAccumulator<tFloat>& moments, tFloat* A, Eigen::Matrix<tFloat, 2, 2>& h, Eigen::Matrix<tFloat, 2, 1>& rhs)
+		{
+			if (!ConstrainedLeastSquareEllipseFitter<tFloat>::SolveWithKnownCenter(moments, A))
+			{
+				for (int i = 0; i < 6; ++i)
+				{
+					A[i] = 0;
+				}
+
+				return;
+			}
+
+			tFloat scatterM[6 * 6];
+			moments.GetScatterMatrix(scatterM);
+			Eigen::Map<const Eigen::Matrix<tFloat, 6, 6, Eigen::RowMajor>> s(scatterM);
+
+			Eigen::Matrix<tFloat, 6, 1> conic, dx, dy;
+			conic << A[0], A[1], A[2], 0, 0, A[5];
+			dx << 0, 0, 0, 2 * A[0], A[1], 0;
+			dy << 0, 0, 0, A[1], 2 * A[2], 0;
+
+			// the ring's parameters (A,B,C,F) within the 6-vector of the conic
+			Eigen::Matrix<tFloat, 6, 4> e = Eigen::Matrix<tFloat, 6, 4>::Zero();
+			e(0, 0) = e(1, 1) = e(2, 2) = e(5, 3) = 1;
+
+			// basis of the changes of (A,B,C,F) which are orthogonal to the gradient of the constraint 4AC-B^2
+			Eigen::Matrix<tFloat, 4, 1> constraintGradient;
+			constraintGradient << 4 * A[2], -2 * A[1], 4 * A[0], 0;
+			Eigen::HouseholderQR<Eigen::Matrix<tFloat, 4, 1>> qr(constraintGradient);
+			Eigen::Matrix<tFloat, 4, 4> q = qr.householderQ();
+			Eigen::Matrix<tFloat, 6, 3> tangent = e*q.template rightCols<3>();
+
+			Eigen::Matrix<tFloat, 6, 1> sdx = s*dx, sdy = s*dy, sConic = s*conic;
+			Eigen::Matrix<tFloat, 2, 3> w;
+			w.row(0) = -(sdx.transpose()*tangent);
+			w.row(1) = -(sdy.transpose()*tangent);
+			Eigen::Matrix<tFloat, 3, 3> v = tangent.transpose()*s*tangent;
+			Eigen::Matrix<tFloat, 3, 1> b = -(tangent.transpose()*sConic);
+			Eigen::LDLT<Eigen::Matrix<tFloat, 3, 3>> vDecomposition(v);
+
+			Eigen::Matrix<tFloat, 2, 2> u;
+			u << dx.dot(sdx), dx.dot(sdy), dy.dot(sdx), dy.dot(sdy);
+			h += u - w*vDecomposition.solve(w.transpose());
+			rhs += Eigen::Matrix<tFloat, 2, 1>(conic.dot(sdx), conic.dot(sdy)) - w*vDecomposition.solve(b);
+		}
+	};
+}
@@ -0,0 +1,359 @@
+#pragma once
+
+#include "ellipseParameters.h"
+#include "inc_eigen.h"
+#include "momentAccumulator.h"
+#include "leastSquareEllipseFit.h"
+
+namespace EllipseUtils
+{
+	/// <summary>	Variants of the direct least-square fit (see LeastSquareEllipseFitter) where some of the ellipse's
+	/// 			parameters are known beforehand. The conic is expressed as a linear family a = G*p in the
+	/// 			normalized coordinates, so the 6x6 scatter matrix reduces to the (smaller) matrix G^T*S*G, and
+	/// 			only this reduced system has to be solved. </summary>
+	template<typename tFloat>
+	class ConstrainedLeastSquareEllipseFitter
+	{
+	public:
+		/// <summary>	Number of samples for the initial search of the orientation when fitting with known axis ratio. </summary>
+		static const int AxisRatioOrientationSamples = 36;
+
+		/// <summary>	Fit an ellipse with the center (x0,y0). The moments are accumulated relative to the center, so
+		/// 			only the quadratic terms and the constant remain (4 unknowns instead of 6) - and only the moments
+		/// 			of even degree are needed, 9 of the 15 (see AccumulateEvenMoments). </summary>
+		template <typename PointAccessor>
+		static EllipseAlgebraicParameters<tFloat> FitWithKnownCenter(const PointAccessor& ptAccessor, tFloat x0, tFloat y0)
+		{
+			PointNormalization<tFloat> normalization = PointNormalization<tFloat>::FromPoints(ptAccessor);
+			normalization.mx = x0;
+			normalization.my = y0;
+			const NormalizedMomentAccumulator<tFloat> moments = AccumulateEvenMoments(ptAccessor, normalization);
+
+			tFloat A[6];
+			if (!SolveWithKnownCenter(moments, A))
+			{
+				return EllipseAlgebraicParameters<tFloat>{ 0, 0, 0, 0, 0, 0 };
+			}
+
+			return LeastSquareEllipseFitter<tFloat>::Denormalize(A, normalization);
+		}
+
+		/// <summary>	Determines the conic (in normalized coordinates) with its center at the reference point of the
+		/// 			moments' normalization, i.e. A[3] = A[4] = 0. </summary>
+		static bool SolveWithKnownCenter(const NormalizedMomentAccumulator<tFloat>& moments, tFloat* A)
+		{
+			tFloat scatterM[6 * 6];
+			moments.GetScatterMatrix(scatterM);
+
+			// p = (A, B, C, F)
+			Eigen::Matrix<tFloat, 6, 4> g = Eigen::Matrix<tFloat, 6, 4>::Zero();
+			g(0, 0) = g(1, 1) = g(2, 2) = g(5, 3) = 1;
+
+			// constraint 4AC - B^2 = 1
+			Eigen::Matrix<tFloat, 3, 3> constraint = Eigen::Matrix<tFloat, 3, 3>::Zero();
+			constraint(0, 2) = constraint(2, 0) = 2;
+			constraint(1, 1) = -1;
+
+			return SolveLinearFamily<4, 3>(scatterM, g, constraint, A);
+		}
+
+		/// <summary>	Fit an ellipse whose major axis has the angle theta with the x-axis (5 unknowns instead of 6). The
+		/// 			points are accumulated in the rotated frame, where G^T*S*G needs 13 sums instead of the 15
+		/// 			moments (see AccumulateRotatedScatterMatrix). </summary>
+		template <typename PointAccessor>
+		static EllipseAlgebraicParameters<tFloat> FitWithKnownOrientation(const PointAccessor& ptAccessor, tFloat theta)
+		{
+			const PointNormalization<tFloat> normalization = PointNormalization<tFloat>::FromPoints(ptAccessor);
+			return SolveWithKnownOrientation(AccumulateRotatedScatterMatrix(ptAccessor, normalization, theta), normalization, theta);
+		}
+
+		static EllipseAlgebraicParameters<tFloat> FitWithKnownOrientation(const NormalizedMomentAccumulator<tFloat>& moments, tFloat theta)
+		{
+			tFloat scatterM[6 * 6];
+			moments.GetScatterMatrix(scatterM);
+			Eigen::Map<const Eigen::Matrix<tFloat, 6, 6, Eigen::RowMajor>> s(scatterM);
+			const Eigen::Matrix<tFloat, 6, 5> g = GetKnownOrientationFamily(moments.GetNormalization(), theta);
+			return SolveWithKnownOrientation(g.transpose()*s*g, moments.GetNormalization(), theta);
+		}
+
+		/// <summary>	Fit an ellipse with the ratio of the semi-minor to the semi-major axis given by axisRatio. For a
+		/// 			given orientation this is a linear problem with 3 unknowns, the orientation is determined by a
+		/// 			one-dimensional search which only operates on the (already accumulated) moments.
+		/// 			The search solves the small system about 100 times (AxisRatioOrientationSamples samples and up
+		/// 			to 64 golden-section steps), so for small point sets the fit costs about ten times the
+		/// 			unconstrained one (~20 us vs. ~2 us); for large point sets accumulating the moments dominates. It pays off
+		/// 			where the points do not determine the ellipse well: on short, noisy arcs the center and the
+		/// 			axes are several times more accurate than those of the unconstrained fit, even with half of
+		/// 			the points (see constrainedfittest). </summary>
+		template <typename PointAccessor>
+		static EllipseAlgebraicParameters<tFloat> FitWithKnownAxisRatio(const PointAccessor& ptAccessor, tFloat axisRatio)
+		{
+			NormalizedMomentAccumulator<tFloat> moments(PointNormalization<tFloat>::FromPoints(ptAccessor));
+			moments.AddPoints(ptAccessor);
+			return FitWithKnownAxisRatio(moments, axisRatio);
+		}
+
+		static EllipseAlgebraicParameters<tFloat> FitWithKnownAxisRatio(const NormalizedMomentAccumulator<tFloat>& moments, tFloat axisRatio)
+		{
+			if (!(axisRatio > 0))
+			{
+				throw std::invalid_argument("The axis ratio must be positive.");
+			}
+
+			if (axisRatio > 1)
+			{
+				axisRatio = 1 / axisRatio;
+			}
+
+			tFloat scatterM[6 * 6];
+			moments.GetScatterMatrix(scatterM);
+			Eigen::Map<const Eigen::Matrix<tFloat, 6, 6, Eigen::RowMajor>> s(scatterM);
+			const tFloat k = 1 / (axisRatio*axisRatio);
+			const PointNormalization<tFloat>& normalization = moments.GetNormalization();
+
+			// coarse search over [0,pi), followed by a golden-section search around the best sample
+			const tFloat step = tFloat(M_PI) / AxisRatioOrientationSamples;
+			tFloat bestTheta = 0, bestResidual = (std::numeric_limits<tFloat>::max)();
+			for (int i = 0; i < AxisRatioOrientationSamples; ++i)
+			{
+				tFloat residual = CalcAxisRatioResidual(s, normalization, k, i*step, nullptr);
+				if (residual < bestResidual)
+				{
+					bestResidual = residual;
+					bestTheta = i*step;
+				}
+			}
+
+			const tFloat invPhi = tFloat(0.6180339887498949);
+			tFloat lo = bestTheta - step, hi = bestTheta + step;
+			tFloat t1 = hi - invPhi*(hi - lo), t2 = lo + invPhi*(hi - lo);
+			tFloat r1 = CalcAxisRatioResidual(s, normalization, k, t1, nullptr);
+			tFloat r2 = CalcAxisRatioResidual(s, normalization, k, t2, nullptr);
+			for (int i = 0; i < 64 && hi - lo > std::numeric_limits<tFloat>::epsilon() * 4; ++i)
+			{
+				if (r1 < r2)
+				{
+					hi = t2; t2 = t1; r2 = r1;
+					t1 = hi - invPhi*(hi - lo);
+					r1 = CalcAxisRatioResidual(s, normalization, k, t1, nullptr);
+				}
+				else
+				{
+					lo = t1; t1 = t2; r1 = r2;
+					t2 = lo + invPhi*(hi - lo);
+					r2 = CalcAxisRatioResidual(s, normalization, k, t2, nullptr);
+				}
+			}
+
+			tFloat A[6];
+			CalcAxisRatioResidual(s, normalization, k, (lo + hi) / 2, A);
+			return LeastSquareEllipseFitter<tFloat>::Denormalize(A, normalization);
+		}
+
+	private:
+		/// <summary>	Accumulates the moments of even degree (0, 2 and 4), which are all that G^T*S*G of the fit with
+		/// 			known center has. The moments of odd degree are left at zero. </summary>
+		template <typename PointAccessor>
+		static NormalizedMomentAccumulator<tFloat> AccumulateEvenMoments(const PointAccessor& ptAccessor, const PointNormalization<tFloat>& normalization)
+		{
+			const tFloat mx = normalization.mx, my = normalization.my, invSx = 1 / normalization.sx, invSy = 1 / normalization.sy;
+			const size_t count = ptAccessor.GetLength();
+			tFloat s[9] = {};
+			for (size_t k = 0; k < count; ++k)
+			{
+				const tFloat x = (ptAccessor.GetX(k) - mx) * invSx, y = (ptAccessor.GetY(k) - my) * invSy;
+				const tFloat xx = x*x, xy = x*y, yy = y*y;
+				s[0] += 1;
+				s[1] += xx; s[2] += xy; s[3] += yy;
+				s[4] += xx*xx; s[5] += xx*xy; s[6] += xx*yy; s[7] += xy*yy; s[8] += yy*yy;
+			}
+
+			NormalizedMomentAccumulator<tFloat> moments(normalization);
+			moments.SetMoment(0, 0, s[0]);
+			moments.SetMoment(2, 0, s[1]); moments.SetMoment(1, 1, s[2]); moments.SetMoment(0, 2, s[3]);
+			moments.SetMoment(4, 0, s[4]); moments.SetMoment(3, 1, s[5]); moments.SetMoment(2, 2, s[6]); moments.SetMoment(1, 3, s[7]); moments.SetMoment(0, 4, s[8]);
+			return moments;
+		}
+
+		/// <summary>	Accumulates G^T*S*G of the fit with known orientation directly in the rotated frame (see
+		/// 			CalcRotatedFrame), where the monomials are (u^2, v^2, u, v, 1). </summary>
+		template <typename PointAccessor>
+		static Eigen::Matrix<tFloat, 5, 5> AccumulateRotatedScatterMatrix(const PointAccessor& ptAccessor, const PointNormalization<tFloat>& normalization, tFloat theta)
+		{
+			tFloat a1, a2, b1, b2;
+			CalcRotatedFrame(normalization, theta, a1, a2, b1, b2);
+			const tFloat mx = normalization.mx, my = normalization.my, invSx = 1 / normalization.sx, invSy = 1 / normalization.sy;
+			const size_t count = ptAccessor.GetLength();
+			tFloat s[13] = {};
+			for (size_t k = 0; k < count; ++k)
+			{
+				const tFloat x = (ptAccessor.GetX(k) - mx) * invSx, y = (ptAccessor.GetY(k) - my) * invSy;
+				const tFloat u = a1*x + a2*y, v = b1*x + b2*y;
+				const tFloat uu = u*u, uv = u*v, vv = v*v;
+				s[0] += 1; s[1] += u; s[2] += v;
+				s[3] += uu; s[4] += uv; s[5] += vv;
+				s[6] += uu*u; s[7] += uu*v; s[8] += u*vv; s[9] += vv*v;
+				s[10] += uu*uu; s[11] += uu*vv; s[12] += vv*vv;
+			}
+
+			Eigen::Matrix<tFloat, 5, 5> reduced;
+			reduced <<
+				s[10], s[11], s[6], s[7], s[3],
+				s[11], s[12], s[8], s[9], s[5],
+				s[6], s[8], s[3], s[4], s[1],
+				s[7], s[9], s[4], s[5], s[2],
+				s[3], s[5], s[1], s[2], s[0];
+			return reduced;
+		}
+
+		/// <summary>	p = (A, C, D, E, F) with the conic A*u^2 + C*v^2 + D*u + E*v + F in the rotated frame. </summary>
+		static Eigen::Matrix<tFloat, 6, 5> GetKnownOrientationFamily(const PointNormalization<tFloat>& normalization, tFloat theta)
+		{
+			Eigen::Matrix<tFloat, 6, 5> g = Eigen::Matrix<tFloat, 6, 5>::Zero();
+			SetRotatedQuadraticColumns(g, normalization, theta, 0, 1);
+			SetRotatedLinearColumns(g, normalization, theta, 2, 3);
+			g(5, 4) = 1;
+			return g;
+		}
+
+		static EllipseAlgebraicParameters<tFloat> SolveWithKnownOrientation(const Eigen::Matrix<tFloat, 5, 5>& reduced, const PointNormalization<tFloat>& normalization, tFloat theta)
+		{
+			// constraint 4AC = 1
+			Eigen::Matrix<tFloat, 2, 2> constraint = Eigen::Matrix<tFloat, 2, 2>::Zero();
+			constraint(0, 1) = constraint(1, 0) = 2;
+
+			Eigen::Matrix<tFloat, 5, 1> p;
+			if (!SolveReducedFamily<5, 2>(reduced, constraint, p))
+			{
+				return EllipseAlgebraicParameters<tFloat>{ 0, 0, 0, 0, 0, 0 };
+			}
+
+			Eigen::Matrix<tFloat, 6, 1> a = GetKnownOrientationFamily(normalization, theta)*p;
+			return LeastSquareEllipseFitter<tFloat>::Denormalize(a.data(), normalization);
+		}
+
+		/// <summary>	Sets the coefficients of u^2 and v^2 (with u,v the coordinates in the frame rotated by theta,
+		/// 			in units of the larger of the two normalization scales) in the columns colU and colV. </summary>
+		template <typename tMatrix>
+		static void SetRotatedQuadraticColumns(tMatrix& g, const PointNormalization<tFloat>& normalization, tFloat theta, int colU, int colV)
+		{
+			tFloat a1, a2, b1, b2;
+			CalcRotatedFrame(normalization, theta, a1, a2, b1, b2);
+			g(0, colU) = a1*a1; g(1, colU) = 2 * a1*a2; g(2, colU) = a2*a2;
+			g(0, colV) = b1*b1; g(1, colV) = 2 * b1*b2; g(2, colV) = b2*b2;
+		}
+
+		template <typename tMatrix>
+		static void SetRotatedLinearColumns(tMatrix& g, const PointNormalization<tFloat>& normalization, tFloat theta, int colU, int colV)
+		{
+			tFloat a1, a2, b1, b2;
+			CalcRotatedFrame(normalization, theta, a1, a2, b1, b2);
+			g(3, colU) = a1; g(4, colU) = a2;
+			g(3, colV) = b1; g(4, colV) = b2;
+		}
+
+		/// <summary>	u = a1*x' + a2*y' and v = b1*x' + b2*y'. </summary>
+		static void CalcRotatedFrame(const PointNormalization<tFloat>& normalization, tFloat theta, tFloat& a1, tFloat& a2, tFloat& b1, tFloat& b2)
+		{
+			tFloat scale = (std::max)(normalization.sx, normalization.sy);
+			tFloat rx = normalization.sx / scale, ry = normalization.sy / scale;
+			tFloat c = cos(theta), s = sin(theta);
+			a1 = c*rx; a2 = s*ry;
+			b1 = -s*rx; b2 = c*ry;
+		}
+
+		/// <summary>	For the conic u^2 + k*v^2 + D*u + E*v + F (in the frame rotated by theta) determine D,E,F
+		/// 			and return the algebraic residual. If ptrA is non-null, the normalized conic is stored there. </summary>
+		template <typename tScatterMatrix>
+		static tFloat CalcAxisRatioResidual(const tScatterMatrix& s, const PointNormalization<tFloat>& normalization, tFloat k, tFloat theta, tFloat* ptrA)
+		{
+			Eigen::Matrix<tFloat, 6, 2> quadratic = Eigen::Matrix<tFloat, 6, 2>::Zero();
+			SetRotatedQuadraticColumns(quadratic, normalization, theta, 0, 1);
+			Eigen::Matrix<tFloat, 6, 1> q = quadratic.col(0) + k*quadratic.col(1);
+
+			Eigen::Matrix<tFloat, 6, 3> g = Eigen::Matrix<tFloat, 6, 3>::Zero();
+			SetRotatedLinearColumns(g, normalization, theta, 0, 1);
+			g(5, 2) = 1;
+
+			Eigen::Matrix<tFloat, 6, 1> sq = s*q;
+			Eigen::Matrix<tFloat, 3, 3> gsg = g.transpose()*s*g;
+			Eigen::Matrix<tFloat, 3, 1> p = gsg.ldlt().solve(-(g.transpose()*sq));
+			Eigen::Matrix<tFloat, 6, 1> a = q + g*p;
+			if (ptrA != nullptr)
+			{
+				for (int i = 0; i < 6; ++i)
+				{
+					ptrA[i] = a(i);
+				}
+			}
+
+			return a.dot(s*a);
+		}
+
+		/// <summary>	Minimizes a^T*S*a for a = G*p subject to the quadratic constraint q^T*C*q = 1, where q are the
+		/// 			first tQuadratic components of p (see SolveReducedFamily). The resulting conic (in normalized
+		/// 			coordinates) is stored in A. </summary>
+		template <int tCount, int tQuadratic>
+		static bool SolveLinearFamily(const tFloat* scatterM, const Eigen::Matrix<tFloat, 6, tCount>& g, const Eigen::Matrix<tFloat, tQuadratic, tQuadratic>& constraint, tFloat* A)
+		{
+			Eigen::Map<const Eigen::Matrix<tFloat, 6, 6, Eigen::RowMajor>> s(scatterM);
+			Eigen::Matrix<tFloat, tCount, 1> p;
+			if (!SolveReducedFamily<tCount, tQuadratic>(g.transpose()*s*g, constraint, p))
+			{
+				return false;
+			}
+
+			Eigen::Matrix<tFloat, 6, 1> a = g*p;
+			for (int i = 0; i < 6; ++i)
+			{
+				A[i] = a(i);
+			}
+
+			return true;
+		}
+
+		/// <summary>	Minimizes p^T*R*p with the reduced scatter matrix R = G^T*S*G subject to q^T*C*q = 1. The
+		/// 			components of p after q are eliminated (as in the unconstrained fit) and the generalized
+		/// 			eigenvalue problem for q is solved. </summary>
+		template <int tCount, int tQuadratic>
+		static bool SolveReducedFamily(const Eigen::Matrix<tFloat, tCount, tCount>& reduced, const Eigen::Matrix<tFloat, tQuadratic, tQuadratic>& constraint, Eigen::Matrix<tFloat, tCount, 1>& p)
+		{
+			const int tLinear = tCount - tQuadratic;
+			Eigen::Matrix<tFloat, tQuadratic, tQuadratic> s1 = reduced.template topLeftCorner<tQuadratic, tQuadratic>();
+			Eigen::Matrix<tFloat, tQuadratic, tLinear> s2 = reduced.template topRightCorner<tQuadratic, tLinear>();
+			Eigen::Matrix<tFloat, tLinear, tLinear> s3 = reduced.template bottomRightCorner<tLinear, tLinear>();
+
+			// linear part as function of the quadratic part: l = t*q
+			Eigen::Matrix<tFloat, tLinear, tQuadratic> t = s3.ldlt().solve(-s2.transpose());
+			Eigen::Matrix<tFloat, tQuadratic, tQuadratic> m = s1 + s2*t;
+
+			Eigen::EigenSolver<Eigen::Matrix<tFloat, tQuadratic, tQuadratic>> eigenSolver;
+			eigenSolver.compute(constraint.inverse()*m, true);
+			auto eigenVecs = eigenSolver.eigenvectors();
+
+			// exactly one eigenvector fulfills the constraint (q^T*C*q > 0) - use the one where this is most pronounced
+			int index = -1;
+			tFloat best = 0;
+			for (int i = 0; i < tQuadratic; ++i)
+			{
+				Eigen::Matrix<tFloat, tQuadratic, 1> v = eigenVecs.col(i).real();
+				tFloat value = v.dot(constraint*v) / v.squaredNorm();
+				if (value > best)
+				{
+					best = value;
+					index = i;
+				}
+			}
+
+			if (index < 0)
+			{
+				return false;
+			}
+
+			Eigen::Matrix<tFloat, tQuadratic, 1> q = eigenVecs.col(index).real();
+			p.template head<tQuadratic>() = q;
+			p.template tail<tLinear>() = t*q;
+			return true;
+		}
+	};
+}
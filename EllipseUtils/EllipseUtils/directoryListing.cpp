@@ -0,0 +1,200 @@
+#include "stdafx.h"
+#include "directoryListing.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <unistd.h>
+#endif
+
+using namespace EllipseUtils;
+
+/*static*/std::vector<std::string> DirectoryListing::GetFiles(const char* szDirectory, const char* szPatterns)
+{
+	std::vector<std::string> files;
+#if defined(_WIN32)
+	WIN32_FIND_DATAA findData;
+	HANDLE handle = FindFirstFileA(Combine(szDirectory, "*").c_str(), &findData);
+	if (handle == INVALID_HANDLE_VALUE)
+	{
+		throw std::runtime_error("Couldn't read directory.");
+	}
+
+	do
+	{
+		if ((findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0)
+		{
+			files.push_back(Combine(szDirectory, findData.cFileName));
+		}
+	} while (FindNextFileA(handle, &findData));
+
+	FindClose(handle);
+#else
+	DIR* directory = opendir(szDirectory);
+	if (directory == nullptr)
+	{
+		throw std::runtime_error("Couldn't read directory.");
+	}
+
+	while (struct dirent* entry = readdir(directory))
+	{
+		std::string path = Combine(szDirectory, entry->d_name);
+		struct stat status;
+		if (stat(path.c_str(), &status) == 0 && S_ISREG(status.st_mode))
+		{
+			files.push_back(path);
+		}
+	}
+
+	closedir(directory);
+#endif
+
+	if (szPatterns != nullptr)
+	{
+		files.erase(std::remove_if(files.begin(), files.end(), [szPatterns](const std::string& path) { return !MatchesPattern(GetFileName(path), szPatterns); }), files.end());
+	}
+
+	std::sort(files.begin(), files.end());
+	return files;
+}
+
+/// <summary>	Matches the name against the pattern up to patternEnd, backtracking to the last '*'. </summary>
+static bool MatchesWildcard(const char* name, const char* pattern, const char* patternEnd)
+{
+	const char* star = nullptr;
+	const char* starName = nullptr;
+	while (*name != '\0')
+	{
+		if (pattern != patternEnd && *pattern == '*')
+		{
+			star = pattern++;
+			starName = name;
+		}
+		else if (pattern != patternEnd && (*pattern == '?' || tolower((unsigned char)*pattern) == tolower((unsigned char)*name)))
+		{
+			++pattern;
+			++name;
+		}
+		else if (star != nullptr)
+		{
+			pattern = star + 1;
+			name = ++starName;
+		}
+		else
+		{
+			return false;
+		}
+	}
+
+	while (pattern != patternEnd && *pattern == '*')
+	{
+		++pattern;
+	}
+
+	return pattern == patternEnd;
+}
+
+/*static*/bool DirectoryListing::MatchesPattern(const std::string& name, const char* szPatterns)
+{
+	for (const char* pattern = szPatterns;; ++pattern)
+	{
+		const char* end = strchr(pattern, ';');
+		if (end == nullptr)
+		{
+			end = pattern + strlen(pattern);
+		}
+
+		if (end != pattern && MatchesWildcard(name.c_str(), pattern, end))
+		{
+			return true;
+		}
+
+		if (*end == '\0')
+		{
+			return false;
+		}
+
+		pattern = end;
+	}
+}
+
+/*static*/std::string DirectoryListing::GetFileName(const std::string& path)
+{
+	size_t separator = path.find_last_of("/\\");
+	return separator == std::string::npos ? path : path.substr(separator + 1);
+}
+
+/*static*/std::string DirectoryListing::Combine(const std::string& directory, const std::string& name)
+{
+	if (directory.empty() || directory.back() == '/' || directory.back() == '\\')
+	{
+		return directory + name;
+	}
+
+#if defined(_WIN32)
+	return directory + "\\" + name;
+#else
+	return directory + "/" + name;
+#endif
+}
+
+/*static*/bool DirectoryListing::TryGetFileStatus(const char* szPath, uint64_t& size, int64_t& modificationTime)
+{
+#if defined(_WIN32)
+	WIN32_FILE_ATTRIBUTE_DATA attributes;
+	if (!GetFileAttributesExA(szPath, GetFileExInfoStandard, &attributes))
+	{
+		return false;
+	}
+
+	size = ((uint64_t)attributes.nFileSizeHigh << 32) | attributes.nFileSizeLow;
+
+	// FILETIME counts 100 ns intervals since 1601-01-01
+	const int64_t ticks = (int64_t)(((uint64_t)attributes.ftLastWriteTime.dwHighDateTime << 32) | attributes.ftLastWriteTime.dwLowDateTime);
+	modificationTime = (ticks - 116444736000000000LL) * 100;
+#else
+	struct stat status;
+	if (stat(szPath, &status) != 0)
+	{
+		return false;
+	}
+
+	size = (uint64_t)status.st_size;
+#if defined(__APPLE__)
+	modificationTime = (int64_t)status.st_mtimespec.tv_sec * 1000000000 + status.st_mtimespec.tv_nsec;
+#else
+	modificationTime = (int64_t)status.st_mtim.tv_sec * 1000000000 + status.st_mtim.tv_nsec;
+#endif
+#endif
+	return true;
+}
+
+/*static*/void DirectoryListing::CreateDirectoryIfMissing(const char* szDirectory)
+{
+#if defined(_WIN32)
+	if (!CreateDirectoryA(szDirectory, nullptr) && GetLastError() != ERROR_ALREADY_EXISTS)
+#else
+	if (mkdir(szDirectory, 0777) != 0 && errno != EEXIST)
+#endif
+	{
+		throw std::runtime_error("Couldn't create directory.");
+	}
+}
+
+/*static*/bool DirectoryListing::RemoveEmptyDirectory(const char* szDirectory)
+{
+#if defined(_WIN32)
+	return RemoveDirectoryA(szDirectory) != 0;
+#else
+	return rmdir(szDirectory) == 0;
+#endif
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace EllipseUtils
+{
+	/// <summary>	Minimal file system helpers (FindFirstFile on Windows, opendir elsewhere). </summary>
+	class DirectoryListing
+	{
+	public:
+		/// <summary>	Gets the paths of the regular files in the directory (not recursive), sorted by name - with
+		/// 			szPatterns only those whose name matches it (see MatchesPattern). Throws std::runtime_error if
+		/// 			the directory cannot be read. </summary>
+		static std::vector<std::string> GetFiles(const char* szDirectory, const char* szPatterns = nullptr);
+
+		/// <summary>	Checks the file name against a list of wildcard patterns separated by ';' (e.g. "*.txt;*.bin"),
+		/// 			with '*' for any characters and '?' for one. Letters are compared ignoring case. </summary>
+		static bool MatchesPattern(const std::string& name, const char* szPatterns);
+
+		/// <summary>	Gets the part of the path after the last separator. </summary>
+		static std::string GetFileName(const std::string& path);
+
+		static std::string Combine(const std::string& directory, const std::string& name);
+
+		/// <summary>	Gets the size and the time of the last modification (in nanoseconds since 1970-01-01 UTC) of the
+		/// 			file. Returns false if the file does not exist or cannot be queried. </summary>
+		static bool TryGetFileStatus(const char* szPath, uint64_t& size, int64_t& modificationTime);
+
+		/// <summary>	Creates the directory if it does not exist yet. </summary>
+		static void CreateDirectoryIfMissing(const char* szDirectory);
+
+		/// <summary>	Removes the directory, which must be empty. Returns false if that fails. </summary>
+		static bool RemoveEmptyDirectory(const char* szDirectory);
+	};
+}
@@ -0,0 +1,355 @@
+#include "stdafx.h"
+#include "directoryWatcher.h"
+#include "directoryListing.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/inotify.h>
+#endif
+#endif
+
+using namespace EllipseUtils;
+
+/// <summary>	The interval of the scans where there are no change notifications. </summary>
+static const int ScanIntervalMilliseconds = 100;
+
+DirectoryWatcher::DirectoryWatcher(const char* szDirectory, double debounceMilliseconds)
+	: directory(szDirectory), debounce(std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>((std::max)(debounceMilliseconds, 0.0)))),
+	isStopped(false)
+{
+#if defined(_WIN32)
+	this->changeEvent = this->stopEvent = this->overlapped = nullptr;
+	this->directoryHandle = CreateFileA(szDirectory, FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+		FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, nullptr);
+	if (this->directoryHandle == INVALID_HANDLE_VALUE)
+	{
+		this->directoryHandle = nullptr;
+		throw std::runtime_error("Couldn't open the directory.");
+	}
+
+	this->changeEvent = CreateEventA(nullptr, TRUE, FALSE, nullptr);
+	this->stopEvent = CreateEventA(nullptr, TRUE, FALSE, nullptr);
+	OVERLAPPED* o = new OVERLAPPED();
+	o->hEvent = this->changeEvent;
+	this->overlapped = o;
+
+	// FILE_NOTIFY_INFORMATION has to be DWORD-aligned
+	this->buffer.resize(16384);
+#else
+	this->stopPipe[0] = this->stopPipe[1] = -1;
+	this->notifyDescriptor = -1;
+	if (pipe(this->stopPipe) != 0)
+	{
+		throw std::runtime_error("Couldn't create a pipe.");
+	}
+
+#if defined(__linux__)
+	this->buffer.resize(65536);
+	this->notifyDescriptor = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (this->notifyDescriptor < 0 || inotify_add_watch(this->notifyDescriptor, szDirectory, IN_CLOSE_WRITE | IN_MOVED_TO | IN_MODIFY | IN_ONLYDIR) < 0)
+	{
+		this->Close();
+		throw std::runtime_error("Couldn't watch the directory.");
+	}
+#endif
+#endif
+
+	try
+	{
+		this->Scan(true);
+#if defined(_WIN32)
+		this->StartRead();
+#endif
+	}
+	catch (...)
+	{
+		this->Close();
+		throw;
+	}
+}
+
+DirectoryWatcher::~DirectoryWatcher()
+{
+	this->Close();
+}
+
+std::vector<std::string> DirectoryWatcher::WaitForFiles(int timeoutMilliseconds)
+{
+	const bool hasTimeout = timeoutMilliseconds >= 0;
+	const Clock::time_point end = Clock::now() + std::chrono::milliseconds((std::max)(timeoutMilliseconds, 0));
+	for (;;)
+	{
+		if (this->isStopped)
+		{
+			return std::vector<std::string>();
+		}
+
+		std::vector<std::string> ready = this->TakeReadyFiles();
+		if (!ready.empty() || (hasTimeout && Clock::now() >= end))
+		{
+			return ready;
+		}
+
+		// wait for the next event, until the next pending file is due or the timeout
+		Clock::time_point deadline = end;
+		bool hasDeadline = hasTimeout;
+		for (const auto& file : this->pending)
+		{
+			if (!hasDeadline || file.second < deadline)
+			{
+				deadline = file.second;
+				hasDeadline = true;
+			}
+		}
+
+		if (!this->ReadEvents(deadline, hasDeadline))
+		{
+			return std::vector<std::string>();
+		}
+	}
+}
+
+void DirectoryWatcher::Stop()
+{
+	this->isStopped = true;
+#if defined(_WIN32)
+	SetEvent(this->stopEvent);
+#else
+	const char byte = 0;
+	if (write(this->stopPipe[1], &byte, 1) < 0)
+	{
+		// the pipe is full, so a wake-up is pending anyway
+	}
+#endif
+}
+
+bool DirectoryWatcher::IsStopped() const
+{
+	return this->isStopped;
+}
+
+void DirectoryWatcher::AddEvent(const std::string& name)
+{
+	this->pending[name] = Clock::now() + this->debounce;
+}
+
+void DirectoryWatcher::Scan(bool isInitial)
+{
+	for (const std::string& path : DirectoryListing::GetFiles(this->directory.c_str()))
+	{
+		FileState state;
+		if (!DirectoryListing::TryGetFileStatus(path.c_str(), state.size, state.modificationTime))
+		{
+			continue;
+		}
+
+		const std::string name = DirectoryListing::GetFileName(path);
+		auto found = this->known.find(name);
+		if (found == this->known.end() || found->second.size != state.size || found->second.modificationTime != state.modificationTime)
+		{
+			this->known[name] = state;
+			if (!isInitial)
+			{
+				this->AddEvent(name);
+			}
+		}
+	}
+}
+
+bool DirectoryWatcher::ReadEvents(Clock::time_point deadline, bool hasDeadline)
+{
+	// rounded up, so that the file is due when the wait ends
+	int timeout = -1;
+	if (hasDeadline)
+	{
+		const double milliseconds = std::chrono::duration<double, std::milli>(deadline - Clock::now()).count();
+		timeout = (int)(std::min)((std::max)(std::ceil(milliseconds), 0.0), 1e9);
+	}
+
+#if defined(_WIN32)
+	HANDLE handles[2] = { this->stopEvent, this->changeEvent };
+	const DWORD result = WaitForMultipleObjects(2, handles, FALSE, timeout < 0 ? INFINITE : (DWORD)timeout);
+	if (result == WAIT_OBJECT_0)
+	{
+		return false;
+	}
+
+	if (result == WAIT_OBJECT_0 + 1)
+	{
+		DWORD length = 0;
+		if (!GetOverlappedResult(this->directoryHandle, static_cast<OVERLAPPED*>(this->overlapped), &length, FALSE))
+		{
+			length = 0;
+		}
+
+		// no data means that the changes did not fit into the buffer
+		if (length == 0)
+		{
+			this->Scan(false);
+		}
+
+		for (DWORD offset = 0; length > 0;)
+		{
+			const FILE_NOTIFY_INFORMATION* info = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(reinterpret_cast<const char*>(this->buffer.data()) + offset);
+			if (info->Action == FILE_ACTION_ADDED || info->Action == FILE_ACTION_MODIFIED || info->Action == FILE_ACTION_RENAMED_NEW_NAME)
+			{
+				const int wideLength = (int)(info->FileNameLength / sizeof(WCHAR));
+				std::string name(WideCharToMultiByte(CP_ACP, 0, info->FileName, wideLength, nullptr, 0, nullptr, nullptr), '\0');
+				WideCharToMultiByte(CP_ACP, 0, info->FileName, wideLength, &name[0], (int)name.size(), nullptr, nullptr);
+				this->AddEvent(name);
+			}
+
+			if (info->NextEntryOffset == 0)
+			{
+				break;
+			}
+
+			offset += info->NextEntryOffset;
+		}
+
+		ResetEvent(this->changeEvent);
+		this->StartRead();
+	}
+#else
+	struct pollfd descriptors[2] = { { this->stopPipe[0], POLLIN, 0 }, { this->notifyDescriptor, POLLIN, 0 } };
+	const bool isScanning = this->notifyDescriptor < 0;
+	if (isScanning && (timeout < 0 || timeout > ScanIntervalMilliseconds))
+	{
+		timeout = ScanIntervalMilliseconds;
+	}
+
+	const int count = poll(descriptors, isScanning ? 1 : 2, timeout);
+	if (count < 0 && errno != EINTR)
+	{
+		throw std::runtime_error("Couldn't wait for changes.");
+	}
+
+	if (count > 0 && (descriptors[0].revents & POLLIN) != 0)
+	{
+		return false;
+	}
+
+	if (isScanning)
+	{
+		this->Scan(false);
+	}
+#if defined(__linux__)
+	else if (count > 0 && (descriptors[1].revents & POLLIN) != 0)
+	{
+		ssize_t length;
+		while ((length = read(this->notifyDescriptor, this->buffer.data(), this->buffer.size())) > 0)
+		{
+			for (ssize_t offset = 0; offset < length;)
+			{
+				const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(this->buffer.data() + offset);
+				if ((event->mask & IN_Q_OVERFLOW) != 0)
+				{
+					this->Scan(false);
+				}
+				else if (event->len > 0 && (event->mask & IN_ISDIR) == 0)
+				{
+					// a modification only delays a file which is already pending, the close makes it pending
+					if ((event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) != 0 || this->pending.count(event->name) != 0)
+					{
+						this->AddEvent(event->name);
+					}
+				}
+
+				offset += sizeof(struct inotify_event) + event->len;
+			}
+		}
+	}
+#endif
+#endif
+	return !this->isStopped;
+}
+
+std::vector<std::string> DirectoryWatcher::TakeReadyFiles()
+{
+	std::vector<std::string> ready;
+	const Clock::time_point now = Clock::now();
+	for (auto it = this->pending.begin(); it != this->pending.end();)
+	{
+		if (it->second > now)
+		{
+			++it;
+			continue;
+		}
+
+		// a file which was removed in the meantime is not reported
+		const std::string path = DirectoryListing::Combine(this->directory, it->first);
+		FileState state;
+		if (DirectoryListing::TryGetFileStatus(path.c_str(), state.size, state.modificationTime))
+		{
+			this->known[it->first] = state;
+			ready.push_back(path);
+		}
+
+		it = this->pending.erase(it);
+	}
+
+	std::sort(ready.begin(), ready.end());
+	return ready;
+}
+
+#if defined(_WIN32)
+void DirectoryWatcher::StartRead()
+{
+	if (!ReadDirectoryChangesW(this->directoryHandle, this->buffer.data(), (DWORD)(this->buffer.size() * sizeof(uint32_t)), FALSE,
+		FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_SIZE, nullptr, static_cast<OVERLAPPED*>(this->overlapped), nullptr))
+	{
+		throw std::runtime_error("Couldn't watch the directory.");
+	}
+}
+#endif
+
+void DirectoryWatcher::Close()
+{
+#if defined(_WIN32)
+	if (this->directoryHandle != nullptr)
+	{
+		// the pending read has to end before its buffer goes away
+		DWORD length;
+		if (CancelIoEx(this->directoryHandle, static_cast<OVERLAPPED*>(this->overlapped)))
+		{
+			GetOverlappedResult(this->directoryHandle, static_cast<OVERLAPPED*>(this->overlapped), &length, TRUE);
+		}
+
+		CloseHandle(this->directoryHandle);
+	}
+
+	if (this->changeEvent != nullptr)
+	{
+		CloseHandle(this->changeEvent);
+	}
+
+	if (this->stopEvent != nullptr)
+	{
+		CloseHandle(this->stopEvent);
+	}
+
+	delete static_cast<OVERLAPPED*>(this->overlapped);
+	this->directoryHandle = this->changeEvent = this->stopEvent = this->overlapped = nullptr;
+#else
+	for (int descriptor : { this->notifyDescriptor, this->stopPipe[0], this->stopPipe[1] })
+	{
+		if (descriptor >= 0)
+		{
+			close(descriptor);
+		}
+	}
+
+	this->notifyDescriptor = this->stopPipe[0] = this->stopPipe[1] = -1;
+#endif
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace EllipseUtils
+{
+	/// <summary>	Reports the files written into a directory (not recursive) - inotify on Linux (a file is complete when
+	/// 			the writer closes it, or when it is moved into the directory), ReadDirectoryChangesW on Windows (which
+	/// 			has no close event, so each write counts), otherwise the directory is scanned for changed sizes and
+	/// 			modification times. A file is reported once no event for it arrived for the debounce time, so a
+	/// 			writer which closes and reopens a file, or writes it in several steps, does not make it appear
+	/// 			half-written. The files which exist when watching starts are not reported, unless they change. </summary>
+	class DirectoryWatcher
+	{
+	private:
+		typedef std::chrono::steady_clock Clock;
+
+		struct FileState
+		{
+			uint64_t size;
+			int64_t modificationTime;
+		};
+
+		std::string directory;
+		Clock::duration debounce;
+
+		/// <summary>	The files with events, and when they are reported unless another event arrives. </summary>
+		std::unordered_map<std::string, Clock::time_point> pending;
+
+		/// <summary>	The size and modification time of the files when they were last seen (reported, scanned, or
+		/// 			found when watching started), to find the changes after a scan. </summary>
+		std::unordered_map<std::string, FileState> known;
+		std::atomic<bool> isStopped;
+#if defined(_WIN32)
+		void* directoryHandle;
+		void* changeEvent;
+		void* stopEvent;
+		void* overlapped;
+		std::vector<uint32_t> buffer;
+#else
+		/// <summary>	The inotify instance, -1 where the directory is scanned. </summary>
+		int notifyDescriptor;
+		int stopPipe[2];
+		std::vector<char> buffer;
+#endif
+
+	public:
+		/// <summary>	Starts watching, throws std::runtime_error. </summary>
+		DirectoryWatcher(const char* szDirectory, double debounceMilliseconds = 10);
+		~DirectoryWatcher();
+
+		DirectoryWatcher(const DirectoryWatcher&) = delete;
+		DirectoryWatcher& operator=(const DirectoryWatcher&) = delete;
+
+		/// <summary>	Waits until files are complete and gets their paths, or an empty list after Stop (or the timeout,
+		/// 			if not negative). </summary>
+		std::vector<std::string> WaitForFiles(int timeoutMilliseconds = -1);
+
+		/// <summary>	Makes WaitForFiles return, may be called from any thread (and from a signal handler on POSIX). </summary>
+		void Stop();
+
+		bool IsStopped() const;
+
+	private:
+		/// <summary>	Handles an event for the file. </summary>
+		void AddEvent(const std::string& name);
+
+		/// <summary>	Adds an event for each file whose size or modification time changed since it was last seen. </summary>
+		void Scan(bool isInitial);
+
+		/// <summary>	Waits for events until the deadline and handles them, returns false if stopped. </summary>
+		bool ReadEvents(Clock::time_point deadline, bool hasDeadline);
+
+		/// <summary>	Removes the files whose debounce time is over from pending and gets them. </summary>
+		std::vector<std::string> TakeReadyFiles();
+#if defined(_WIN32)
+
+		/// <summary>	Starts the asynchronous read of the next changes. </summary>
+		void StartRead();
+#endif
+
+		void Close();
+	};
+}
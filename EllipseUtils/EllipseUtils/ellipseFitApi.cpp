@@ -0,0 +1,227 @@
+// does not use the precompiled header, so the library can be built from this file alone
+#define _USE_MATH_DEFINES
+#include <cmath>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <limits>
+#include <vector>
+#include "ellipseFitApi.h"
+#include "leastSquareEllipseFit.h"
+
+using namespace EllipseUtils;
+
+struct ellipsefit_context
+{
+	uint64_t fitCount;
+	uint64_t failedCount;
+
+	/// <summary>	A fixed buffer, so reporting an error does not allocate either. </summary>
+	char lastError[256];
+};
+
+static void SetLastError(ellipsefit_context* context, const char* szMessage)
+{
+	if (context != nullptr)
+	{
+		snprintf(context->lastError, sizeof(context->lastError), "%s", szMessage);
+	}
+}
+
+static void ToEllipse(const EllipseParameters<double>& parameters, ellipsefit_ellipse* ellipse)
+{
+	ellipse->x0 = parameters.x0;
+	ellipse->y0 = parameters.y0;
+	ellipse->a = parameters.a;
+	ellipse->b = parameters.b;
+	ellipse->theta = parameters.theta;
+}
+
+/// <summary>	Fits the points of the accessor, catching everything - no exception may cross the C interface. Points
+/// 			which determine no ellipse (exactly on a conic, or on a line) give NaN from the fitter, not an error. </summary>
+template <typename PointAccessor>
+static int32_t FitPoints(ellipsefit_context* context, const PointAccessor& accessor, ellipsefit_ellipse* ellipse)
+{
+	EllipseParameters<double> parameters = EllipseParameters<double>::Invalid();
+	int32_t status;
+
+	if (accessor.GetLength() < LeastSquareEllipseFitter<double>::MinPointCount)
+	{
+		status = ELLIPSEFIT_TOO_FEW_POINTS;
+	}
+	else
+	{
+		try
+		{
+			parameters = FitEllipse<double>(accessor);
+			status = parameters.IsValid() ? ELLIPSEFIT_OK : ELLIPSEFIT_NO_ELLIPSE;
+		}
+		catch (std::exception& e)
+		{
+			SetLastError(context, e.what());
+			status = ELLIPSEFIT_INTERNAL_ERROR;
+		}
+		catch (...)
+		{
+			SetLastError(context, "Unknown error.");
+			status = ELLIPSEFIT_INTERNAL_ERROR;
+		}
+	}
+
+	ToEllipse(status == ELLIPSEFIT_OK ? parameters : EllipseParameters<double>::Invalid(), ellipse);
+	++context->fitCount;
+	context->failedCount += status == ELLIPSEFIT_OK ? 0 : 1;
+	return status;
+}
+
+extern "C" uint32_t ellipsefit_abi_version(void)
+{
+	return ELLIPSEFIT_ABI_VERSION;
+}
+
+extern "C" ellipsefit_context* ellipsefit_context_create(void)
+{
+	ellipsefit_context* context = new (std::nothrow) ellipsefit_context;
+	if (context != nullptr)
+	{
+		context->fitCount = 0;
+		context->failedCount = 0;
+		context->lastError[0] = '\0';
+	}
+
+	return context;
+}
+
+extern "C" void ellipsefit_context_destroy(ellipsefit_context* context)
+{
+	delete context;
+}
+
+extern "C" const char* ellipsefit_context_last_error(const ellipsefit_context* context)
+{
+	return context != nullptr ? context->lastError : "No context.";
+}
+
+extern "C" void ellipsefit_context_counters(const ellipsefit_context* context, uint64_t* fitCount, uint64_t* failedCount)
+{
+	if (fitCount != nullptr)
+	{
+		*fitCount = context != nullptr ? context->fitCount : 0;
+	}
+
+	if (failedCount != nullptr)
+	{
+		*failedCount = context != nullptr ? context->failedCount : 0;
+	}
+}
+
+extern "C" int32_t ellipsefit_fit(ellipsefit_context* context, const double* x, const double* y, size_t count, ellipsefit_ellipse* ellipse)
+{
+	if (context == nullptr || ellipse == nullptr || (count > 0 && (x == nullptr || y == nullptr)))
+	{
+		SetLastError(context, "Invalid argument.");
+		return ELLIPSEFIT_INVALID_ARGUMENT;
+	}
+
+	context->lastError[0] = '\0';
+	return FitPoints(context, LeastSquareEllipseFitter<double>::PointAccessorFromTwoArrays(x, y, count), ellipse);
+}
+
+extern "C" int32_t ellipsefit_fit_interleaved(ellipsefit_context* context, const double* xy, size_t count, ellipsefit_ellipse* ellipse)
+{
+	if (context == nullptr || ellipse == nullptr || (count > 0 && xy == nullptr))
+	{
+		SetLastError(context, "Invalid argument.");
+		return ELLIPSEFIT_INVALID_ARGUMENT;
+	}
+
+	context->lastError[0] = '\0';
+	return FitPoints(context, LeastSquareEllipseFitter<double>::PointAccessorFromRecords<double>::FromInterleaved(xy, count), ellipse);
+}
+
+extern "C" size_t ellipsefit_fit_batch(ellipsefit_context* context, const double* x, const double* y, const size_t* offsets, size_t setCount,
+	ellipsefit_ellipse* ellipses, int32_t* statuses)
+{
+	if (context == nullptr || offsets == nullptr || ellipses == nullptr || (setCount > 0 && offsets[setCount] > offsets[0] && (x == nullptr || y == nullptr)))
+	{
+		SetLastError(context, "Invalid argument.");
+		return 0;
+	}
+
+	context->lastError[0] = '\0';
+	size_t okCount = 0;
+	for (size_t i = 0; i < setCount; ++i)
+	{
+		int32_t status;
+		if (offsets[i + 1] < offsets[i])
+		{
+			SetLastError(context, "The offsets must not decrease.");
+			ToEllipse(EllipseParameters<double>::Invalid(), &ellipses[i]);
+			status = ELLIPSEFIT_INVALID_ARGUMENT;
+		}
+		else
+		{
+			status = FitPoints(context, LeastSquareEllipseFitter<double>::PointAccessorFromTwoArrays(x + offsets[i], y + offsets[i], offsets[i + 1] - offsets[i]), &ellipses[i]);
+		}
+
+		okCount += status == ELLIPSEFIT_OK ? 1 : 0;
+		if (statuses != nullptr)
+		{
+			statuses[i] = status;
+		}
+	}
+
+	return okCount;
+}
+
+extern "C" size_t ellipsefit_conic_from_5_points_batch(ellipsefit_context* context, const double* points, size_t setCount, ellipsefit_conic* conics, int32_t* statuses)
+{
+	if (context == nullptr || conics == nullptr || (setCount > 0 && points == nullptr))
+	{
+		SetLastError(context, "Invalid argument.");
+		return 0;
+	}
+
+	context->lastError[0] = '\0';
+	size_t ellipseCount = 0;
+	for (size_t i = 0; i < setCount; ++i)
+	{
+		const EllipseAlgebraicParameters<double> p = EllipseAlgebraicParameters<double>::CreateFrom5Points(points + 10 * i);
+		conics[i] = ellipsefit_conic{ p.a, p.b, p.c, p.d, p.e, p.f };
+		const bool isEllipse = p.IsEllipse();
+		ellipseCount += isEllipse ? 1 : 0;
+		if (statuses != nullptr)
+		{
+			statuses[i] = isEllipse ? ELLIPSEFIT_OK : ELLIPSEFIT_NO_ELLIPSE;
+		}
+	}
+
+	return ellipseCount;
+}
+
+extern "C" int32_t ellipsefit_conic_to_ellipse(const ellipsefit_conic* conic, ellipsefit_ellipse* ellipse)
+{
+	if (conic == nullptr || ellipse == nullptr)
+	{
+		return ELLIPSEFIT_INVALID_ARGUMENT;
+	}
+
+	const EllipseAlgebraicParameters<double> p = { conic->a, conic->b, conic->c, conic->d, conic->e, conic->f };
+	const EllipseParameters<double> parameters = EllipseParameters<double>::FromAlgebraicParameters(p);
+	ToEllipse(parameters, ellipse);
+	return parameters.IsValid() ? ELLIPSEFIT_OK : ELLIPSEFIT_NO_ELLIPSE;
+}
+
+extern "C" int32_t ellipsefit_ellipse_to_conic(const ellipsefit_ellipse* ellipse, ellipsefit_conic* conic)
+{
+	if (ellipse == nullptr || conic == nullptr || std::isnan(ellipse->x0) || std::isnan(ellipse->y0) || std::isnan(ellipse->a) || std::isnan(ellipse->b) || std::isnan(ellipse->theta))
+	{
+		return ELLIPSEFIT_INVALID_ARGUMENT;
+	}
+
+	const EllipseParameters<double> parameters = { ellipse->x0, ellipse->y0, ellipse->a, ellipse->b, ellipse->theta };
+	const EllipseAlgebraicParameters<double> p = parameters.ToAlgebraicParameters();
+	*conic = ellipsefit_conic{ p.a, p.b, p.c, p.d, p.e, p.f };
+	return ELLIPSEFIT_OK;
+}
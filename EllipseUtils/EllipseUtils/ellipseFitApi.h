@@ -0,0 +1,98 @@
+#pragma once
+
+/// <summary>	The C interface of the ellipse fitter (libellipsefit), for C, Python (ctypes), Rust and other callers.
+/// 			All output goes to buffers owned by the caller, and the fit functions do not allocate memory. The
+/// 			state of a caller lives in a context: functions are reentrant, and any number of threads can fit at
+/// 			the same time as long as each thread uses its own context. No C++ exception leaves the library.
+/// 			On Linux the library is built from ellipseFitApi.cpp alone, e.g.
+/// 				g++ -std=c++14 -O2 -fPIC -shared -fvisibility=hidden -DELLIPSEFIT_BUILD ellipseFitApi.cpp -o libellipsefit.so
+/// 			(on Windows, define ELLIPSEFIT_BUILD for the DLL and ELLIPSEFIT_SHARED for its users). </summary>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+#if defined(ELLIPSEFIT_BUILD)
+#define ELLIPSEFIT_API __declspec(dllexport)
+#elif defined(ELLIPSEFIT_SHARED)
+#define ELLIPSEFIT_API __declspec(dllimport)
+#else
+#define ELLIPSEFIT_API
+#endif
+#else
+#define ELLIPSEFIT_API __attribute__((visibility("default")))
+#endif
+
+/// <summary>	Incremented on incompatible changes of the interface. </summary>
+#define ELLIPSEFIT_ABI_VERSION 1
+
+/// <summary>	The status codes returned by the functions (and per set by the batch functions). </summary>
+#define ELLIPSEFIT_OK 0
+#define ELLIPSEFIT_TOO_FEW_POINTS 1
+#define ELLIPSEFIT_NO_ELLIPSE 2
+#define ELLIPSEFIT_INVALID_ARGUMENT 3
+#define ELLIPSEFIT_INTERNAL_ERROR 4
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+	/// <summary>	An ellipse with center (x0, y0), semi-axes a and b, and the angle theta between the x-axis and
+	/// 			the axis a. All fields are NaN if there is no ellipse. </summary>
+	typedef struct ellipsefit_ellipse
+	{
+		double x0, y0, a, b, theta;
+	} ellipsefit_ellipse;
+
+	/// <summary>	The conic a*x^2 + b*x*y + c*y^2 + d*x + e*y + f = 0. </summary>
+	typedef struct ellipsefit_conic
+	{
+		double a, b, c, d, e, f;
+	} ellipsefit_conic;
+
+	typedef struct ellipsefit_context ellipsefit_context;
+
+	/// <summary>	Gets ELLIPSEFIT_ABI_VERSION of the library, to check against the header. </summary>
+	ELLIPSEFIT_API uint32_t ellipsefit_abi_version(void);
+
+	/// <summary>	Creates a context, returns NULL if out of memory. </summary>
+	ELLIPSEFIT_API ellipsefit_context* ellipsefit_context_create(void);
+
+	ELLIPSEFIT_API void ellipsefit_context_destroy(ellipsefit_context* context);
+
+	/// <summary>	Gets a description of the last error in the context (valid until the next call with the context),
+	/// 			an empty string if there was none. </summary>
+	ELLIPSEFIT_API const char* ellipsefit_context_last_error(const ellipsefit_context* context);
+
+	/// <summary>	Gets the number of sets fitted with the context and how many of them gave no ellipse. </summary>
+	ELLIPSEFIT_API void ellipsefit_context_counters(const ellipsefit_context* context, uint64_t* fitCount, uint64_t* failedCount);
+
+	/// <summary>	Least-squares fit of an ellipse to the points (x[i], y[i]), i < count. Returns a status code, the
+	/// 			ellipse is NaN unless the status is ELLIPSEFIT_OK. </summary>
+	ELLIPSEFIT_API int32_t ellipsefit_fit(ellipsefit_context* context, const double* x, const double* y, size_t count, ellipsefit_ellipse* ellipse);
+
+	/// <summary>	Same as ellipsefit_fit, with the points stored as x0 y0 x1 y1 ... </summary>
+	ELLIPSEFIT_API int32_t ellipsefit_fit_interleaved(ellipsefit_context* context, const double* xy, size_t count, ellipsefit_ellipse* ellipse);
+
+	/// <summary>	Fits setCount sets. The points of set i are x[k], y[k] for offsets[i] <= k < offsets[i + 1], so
+	/// 			offsets has setCount + 1 entries. Writes ellipses[i] and (if not NULL) statuses[i], returns the number
+	/// 			of sets with status ELLIPSEFIT_OK. </summary>
+	ELLIPSEFIT_API size_t ellipsefit_fit_batch(ellipsefit_context* context, const double* x, const double* y, const size_t* offsets, size_t setCount,
+		ellipsefit_ellipse* ellipses, int32_t* statuses);
+
+	/// <summary>	Gets the conic through five points for setCount sets; points holds ten doubles per set (x0 y0 ...
+	/// 			x4 y4). The status of a set is ELLIPSEFIT_NO_ELLIPSE if the conic is not an ellipse (the conic is
+	/// 			written nonetheless). Returns the number of sets whose conic is an ellipse. </summary>
+	ELLIPSEFIT_API size_t ellipsefit_conic_from_5_points_batch(ellipsefit_context* context, const double* points, size_t setCount, ellipsefit_conic* conics, int32_t* statuses);
+
+	/// <summary>	Gets center, axes and angle of a conic, returns ELLIPSEFIT_NO_ELLIPSE (and NaNs) if it is not an
+	/// 			ellipse. </summary>
+	ELLIPSEFIT_API int32_t ellipsefit_conic_to_ellipse(const ellipsefit_conic* conic, ellipsefit_ellipse* ellipse);
+
+	/// <summary>	Gets the conic of an ellipse - not normalized, the coefficients are of the order of the squared
+	/// 			axes. Returns ELLIPSEFIT_INVALID_ARGUMENT for NaN parameters. </summary>
+	ELLIPSEFIT_API int32_t ellipsefit_ellipse_to_conic(const ellipsefit_ellipse* ellipse, ellipsefit_conic* conic);
+
+#if defined(__cplusplus)
+}
+#endif
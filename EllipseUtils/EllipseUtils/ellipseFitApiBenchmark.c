@@ -0,0 +1,178 @@
+/* ellipseFitApiBenchmark.c : measures the C interface of libellipsefit, e.g. on Linux
+ *     cc -O2 ellipseFitApiBenchmark.c -L. -lellipsefit -lm -o ellipsefit_benchmark && LD_LIBRARY_PATH=. ./ellipsefit_benchmark
+ * Returns a non-zero exit code if a fit is off. */
+
+#if !defined(_WIN32)
+#define _POSIX_C_SOURCE 199309L	/* clock_gettime */
+#endif
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "ellipseFitApi.h"
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+static double GetSeconds(void)
+{
+	LARGE_INTEGER counter, frequency;
+	QueryPerformanceCounter(&counter);
+	QueryPerformanceFrequency(&frequency);
+	return (double)counter.QuadPart / (double)frequency.QuadPart;
+}
+#else
+#include <time.h>
+
+static double GetSeconds(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double)now.tv_sec + now.tv_nsec * 1e-9;
+}
+#endif
+
+#define SET_COUNT 20000
+#define POINTS_PER_SET 200
+#define CONIC_COUNT 1000000
+
+/// <summary>	A uniform random number in [-1, 1) from a linear congruential generator, so the data does not depend
+/// 			on the C library. </summary>
+static double Random(unsigned long long* state)
+{
+	*state = *state * 6364136223846793005ull + 1442695040888963407ull;
+	return (double)(*state >> 11) / 4503599627370496.0 - 1.0;
+}
+
+int main(void)
+{
+	const double pi = 3.14159265358979323846;
+	unsigned long long state = 1;
+	size_t i, k;
+	int failed = 0;
+	double start, seconds;
+	size_t okCount;
+	uint64_t fitCount, failedCount;
+
+	double* x = (double*)malloc(sizeof(double) * SET_COUNT * POINTS_PER_SET);
+	double* y = (double*)malloc(sizeof(double) * SET_COUNT * POINTS_PER_SET);
+	double* xy = (double*)malloc(sizeof(double) * 2 * SET_COUNT * POINTS_PER_SET);
+	size_t* offsets = (size_t*)malloc(sizeof(size_t) * (SET_COUNT + 1));
+	ellipsefit_ellipse* ellipses = (ellipsefit_ellipse*)malloc(sizeof(ellipsefit_ellipse) * SET_COUNT);
+	int32_t* statuses = (int32_t*)malloc(sizeof(int32_t) * SET_COUNT);
+	double* fivePoints = (double*)malloc(sizeof(double) * 10 * CONIC_COUNT);
+	ellipsefit_conic* conics = (ellipsefit_conic*)malloc(sizeof(ellipsefit_conic) * CONIC_COUNT);
+	ellipsefit_context* context = ellipsefit_context_create();
+	if (x == NULL || y == NULL || xy == NULL || offsets == NULL || ellipses == NULL || statuses == NULL || fivePoints == NULL || conics == NULL || context == NULL)
+	{
+		printf("Out of memory.\n");
+		return EXIT_FAILURE;
+	}
+
+	if (ellipsefit_abi_version() != ELLIPSEFIT_ABI_VERSION)
+	{
+		printf("The library has ABI version %u, the header %u.\n", (unsigned int)ellipsefit_abi_version(), ELLIPSEFIT_ABI_VERSION);
+		return EXIT_FAILURE;
+	}
+
+	/* set i: center (i % 100, i / 100), axes 50 and 20 */
+	for (i = 0; i < SET_COUNT; ++i)
+	{
+		offsets[i] = i * POINTS_PER_SET;
+		for (k = 0; k < POINTS_PER_SET; ++k)
+		{
+			const double t = 2 * pi * k / POINTS_PER_SET;
+			const size_t n = i * POINTS_PER_SET + k;
+			x[n] = (double)(i % 100) + 50 * cos(t) + 0.1 * Random(&state);
+			y[n] = (double)(i / 100) + 20 * sin(t) + 0.1 * Random(&state);
+			xy[2 * n] = x[n];
+			xy[2 * n + 1] = y[n];
+		}
+	}
+
+	offsets[SET_COUNT] = SET_COUNT * POINTS_PER_SET;
+
+	start = GetSeconds();
+	okCount = ellipsefit_fit_batch(context, x, y, offsets, SET_COUNT, ellipses, statuses);
+	seconds = GetSeconds() - start;
+	printf("ellipsefit_fit_batch: %d sets of %d points, %.2lf us per set\n", SET_COUNT, POINTS_PER_SET, seconds * 1e6 / SET_COUNT);
+	for (i = 0; i < SET_COUNT; ++i)
+	{
+		const double a = ellipses[i].a > ellipses[i].b ? ellipses[i].a : ellipses[i].b;
+		if (statuses[i] != ELLIPSEFIT_OK || fabs(ellipses[i].x0 - (double)(i % 100)) > 0.2 || fabs(ellipses[i].y0 - (double)(i / 100)) > 0.2 || fabs(a - 50) > 0.2)
+		{
+			failed = 1;
+		}
+	}
+
+	start = GetSeconds();
+	for (i = 0; i < SET_COUNT; ++i)
+	{
+		ellipsefit_ellipse ellipse;
+		okCount += ellipsefit_fit(context, x + offsets[i], y + offsets[i], POINTS_PER_SET, &ellipse) == ELLIPSEFIT_OK ? 1 : 0;
+		failed |= fabs(ellipse.x0 - ellipses[i].x0) > 1e-9;
+	}
+
+	seconds = GetSeconds() - start;
+	printf("ellipsefit_fit: %.2lf us per set\n", seconds * 1e6 / SET_COUNT);
+
+	start = GetSeconds();
+	for (i = 0; i < SET_COUNT; ++i)
+	{
+		ellipsefit_ellipse ellipse;
+		okCount += ellipsefit_fit_interleaved(context, xy + 2 * offsets[i], POINTS_PER_SET, &ellipse) == ELLIPSEFIT_OK ? 1 : 0;
+		failed |= fabs(ellipse.x0 - ellipses[i].x0) > 1e-9;
+	}
+
+	seconds = GetSeconds() - start;
+	printf("ellipsefit_fit_interleaved: %.2lf us per set\n", seconds * 1e6 / SET_COUNT);
+
+	/* five points on an ellipse each, so every conic is an ellipse */
+	for (i = 0; i < CONIC_COUNT; ++i)
+	{
+		for (k = 0; k < 5; ++k)
+		{
+			const double t = 2 * pi * (k + 0.2 * Random(&state)) / 5;
+			fivePoints[10 * i + 2 * k] = 10 * Random(&state) + 30 * cos(t);
+			fivePoints[10 * i + 2 * k + 1] = 10 * sin(t);
+		}
+	}
+
+	start = GetSeconds();
+	if (ellipsefit_conic_from_5_points_batch(context, fivePoints, CONIC_COUNT, conics, NULL) == 0)
+	{
+		failed = 1;
+	}
+
+	seconds = GetSeconds() - start;
+	printf("ellipsefit_conic_from_5_points_batch: %d sets, %.1lf ns per set\n", CONIC_COUNT, seconds * 1e9 / CONIC_COUNT);
+
+	start = GetSeconds();
+	for (i = 0; i < SET_COUNT; ++i)
+	{
+		ellipsefit_conic conic;
+		ellipsefit_ellipse ellipse;
+		ellipsefit_ellipse_to_conic(&ellipses[i], &conic);
+		ellipsefit_conic_to_ellipse(&conic, &ellipse);
+		failed |= fabs(ellipse.x0 - ellipses[i].x0) > 1e-6 || fabs(ellipse.y0 - ellipses[i].y0) > 1e-6;
+	}
+
+	seconds = GetSeconds() - start;
+	printf("ellipse -> conic -> ellipse: %.1lf ns per conversion\n", seconds * 1e9 / SET_COUNT);
+
+	ellipsefit_context_counters(context, &fitCount, &failedCount);
+	failed |= okCount != 3 * SET_COUNT || fitCount != 3 * SET_COUNT || failedCount != 0;
+	printf("%llu fits, %llu failed <- %s\n", (unsigned long long)fitCount, (unsigned long long)failedCount, failed ? "FAIL" : "OK");
+
+	ellipsefit_context_destroy(context);
+	free(x);
+	free(y);
+	free(xy);
+	free(offsets);
+	free(ellipses);
+	free(statuses);
+	free(fivePoints);
+	free(conics);
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,365 @@
+#pragma once
+
+#include <cmath>
+#include <vector>
+#include "ellipseParameters.h"
+#include "pointRecordAccessor.h"
+
+namespace EllipseUtils
+{
+	/// <summary>	Selects the implementation of sin/cos used in the batch functions. "Fast" uses a branch-free
+	/// 			polynomial approximation (absolute error below 1e-8), which is evaluated for two angles at once
+	/// 			with SSE2 where available. </summary>
+	enum class TrigonometricAccuracy
+	{
+		Exact,
+		Fast
+	};
+
+	/// <summary>	A view of the parameters of many ellipses, stored as separate arrays (structure of arrays). </summary>
+	template<typename tFloat>
+	struct EllipseParameterArrays
+	{
+		const tFloat* x0;
+		const tFloat* y0;
+		const tFloat* a;
+		const tFloat* b;
+		const tFloat* theta;
+		size_t count;
+	};
+
+	/// <summary>	Owns the arrays for EllipseParameterArrays. </summary>
+	template<typename tFloat>
+	class EllipseParameterVectors
+	{
+	private:
+		std::vector<tFloat> x0, y0, a, b, theta;
+	public:
+		EllipseParameterVectors() {}
+
+		explicit EllipseParameterVectors(const std::vector<EllipseParameters<tFloat>>& ellipses)
+		{
+			for (const auto& e : ellipses)
+			{
+				this->Add(e);
+			}
+		}
+
+		void Add(const EllipseParameters<tFloat>& e)
+		{
+			this->x0.push_back(e.x0); this->y0.push_back(e.y0);
+			this->a.push_back(e.a); this->b.push_back(e.b);
+			this->theta.push_back(e.theta);
+		}
+
+		EllipseParameterArrays<tFloat> GetArrays() const
+		{
+			return EllipseParameterArrays<tFloat>{ this->x0.data(), this->y0.data(), this->a.data(), this->b.data(), this->theta.data(), this->x0.size() };
+		}
+	};
+
+	/// <summary>	Area, perimeter, bounding box and boundary samples of ellipses - for a single ellipse and in batch
+	/// 			over EllipseParameterArrays. The semi-axis "a" is in the direction given by theta. </summary>
+	template<typename tFloat>
+	class EllipseGeometry
+	{
+	public:
+		static tFloat Area(tFloat a, tFloat b)
+		{
+			return tFloat(M_PI) * std::abs(a*b);
+		}
+
+		/// <summary>	Perimeter with the arithmetic-geometric mean (Gauss-Legendre), which converges quadratically. The
+		/// 			iteration stops when the correction is below tolerance (relative). </summary>
+		static tFloat Perimeter(tFloat a, tFloat b, tFloat tolerance = std::numeric_limits<tFloat>::epsilon())
+		{
+			a = std::abs(a); b = std::abs(b);
+			if (a < b)
+			{
+				std::swap(a, b);
+			}
+
+			if (b == 0)
+			{
+				return 4 * a;
+			}
+
+			tFloat an = a, bn = b;
+			tFloat cn2 = a*a - b*b;
+			tFloat sum = cn2 / 2, powerOf2 = tFloat(0.5);
+			for (int i = 0; i < 32 && cn2 > tolerance*a*a; ++i)
+			{
+				tFloat an1 = (an + bn) / 2;
+				tFloat cn = (an - bn) / 2;
+				bn = sqrt(an*bn);
+				an = an1;
+				cn2 = cn*cn;
+				powerOf2 *= 2;
+				sum += powerOf2*cn2;
+			}
+
+			return tFloat(4 * M_PI) * (a*a - sum) / (an + bn);
+		}
+
+		/// <summary>	Perimeter with the Gauss-Kummer series in h = ((a-b)/(a+b))^2, using the given number of terms.
+		/// 			It converges fast for ellipses which are close to circles. </summary>
+		static tFloat PerimeterSeries(tFloat a, tFloat b, int terms)
+		{
+			a = std::abs(a); b = std::abs(b);
+			tFloat h = (a - b) / (a + b);
+			h *= h;
+			tFloat sum = 1, coefficient = 1, hn = 1;
+			for (int n = 1; n < terms; ++n)
+			{
+				// binomial(1/2, n)
+				coefficient *= tFloat(1.5 - n) / n;
+				hn *= h;
+				sum += coefficient*coefficient*hn;
+			}
+
+			return tFloat(M_PI) * (a + b) * sum;
+		}
+
+		/// <summary>	Gets the axis-aligned bounding box of the ellipse. </summary>
+		static void BoundingBox(const EllipseParameters<tFloat>& e, tFloat& minX, tFloat& minY, tFloat& maxX, tFloat& maxY)
+		{
+			tFloat halfWidth, halfHeight;
+			CalcHalfExtent(e.a, e.b, cos(e.theta), sin(e.theta), halfWidth, halfHeight);
+			minX = e.x0 - halfWidth; maxX = e.x0 + halfWidth;
+			minY = e.y0 - halfHeight; maxY = e.y0 + halfHeight;
+		}
+
+		/// <summary>	Gets the point on the ellipse for the parameter t, i.e. (a*cos(t), b*sin(t)) in the ellipse's frame. </summary>
+		static void PointOnEllipse(const EllipseParameters<tFloat>& e, tFloat t, tFloat& x, tFloat& y)
+		{
+			tFloat u = e.a*cos(t), v = e.b*sin(t);
+			tFloat c = cos(e.theta), s = sin(e.theta);
+			x = e.x0 + u*c - v*s;
+			y = e.y0 + u*s + v*c;
+		}
+
+		static void CalcAreas(const EllipseParameterArrays<tFloat>& ellipses, tFloat* areas)
+		{
+			for (size_t i = 0; i < ellipses.count; ++i)
+			{
+				areas[i] = Area(ellipses.a[i], ellipses.b[i]);
+			}
+		}
+
+		static void CalcPerimeters(const EllipseParameterArrays<tFloat>& ellipses, tFloat* perimeters, tFloat tolerance = std::numeric_limits<tFloat>::epsilon())
+		{
+			for (size_t i = 0; i < ellipses.count; ++i)
+			{
+				perimeters[i] = Perimeter(ellipses.a[i], ellipses.b[i], tolerance);
+			}
+		}
+
+		static void CalcBoundingBoxes(const EllipseParameterArrays<tFloat>& ellipses, tFloat* minX, tFloat* minY, tFloat* maxX, tFloat* maxY, TrigonometricAccuracy accuracy = TrigonometricAccuracy::Exact)
+		{
+			const size_t BlockSize = 256;
+			tFloat c[BlockSize], s[BlockSize];
+			for (size_t start = 0; start < ellipses.count; start += BlockSize)
+			{
+				size_t n = (std::min)(BlockSize, ellipses.count - start);
+				SinCos(ellipses.theta + start, n, s, c, accuracy);
+				for (size_t i = 0; i < n; ++i)
+				{
+					size_t j = start + i;
+					tFloat halfWidth, halfHeight;
+					CalcHalfExtent(ellipses.a[j], ellipses.b[j], c[i], s[i], halfWidth, halfHeight);
+					minX[j] = ellipses.x0[j] - halfWidth; maxX[j] = ellipses.x0[j] + halfWidth;
+					minY[j] = ellipses.y0[j] - halfHeight; maxY[j] = ellipses.y0[j] + halfHeight;
+				}
+			}
+		}
+
+		/// <summary>	Samples "count" points on the boundary of the ellipse. With equalArcLength, the points are spaced
+		/// 			evenly along the perimeter (the arc length is integrated on a grid with "refinement" points per
+		/// 			sample), otherwise they are spaced evenly in the parameter t. </summary>
+		static void SampleBoundary(const EllipseParameters<tFloat>& e, size_t count, tFloat* x, tFloat* y, bool equalArcLength, TrigonometricAccuracy accuracy = TrigonometricAccuracy::Exact, int refinement = 8)
+		{
+			std::vector<tFloat> t(count);
+			if (!equalArcLength || count < 2)
+			{
+				for (size_t i = 0; i < count; ++i)
+				{
+					t[i] = tFloat(2 * M_PI) * i / count;
+				}
+			}
+			else
+			{
+				CalcEqualArcLengthParameters(e.a, e.b, count, refinement, accuracy, t.data());
+			}
+
+			std::vector<tFloat> s(count), c(count);
+			SinCos(t.data(), count, s.data(), c.data(), accuracy);
+			tFloat cosTheta = cos(e.theta), sinTheta = sin(e.theta);
+			for (size_t i = 0; i < count; ++i)
+			{
+				tFloat u = e.a*c[i], v = e.b*s[i];
+				x[i] = e.x0 + u*cosTheta - v*sinTheta;
+				y[i] = e.y0 + u*sinTheta + v*cosTheta;
+			}
+		}
+
+		/// <summary>	Samples "count" points on each of the ellipses, the points of ellipse i are stored at x[i*count]
+		/// 			and y[i*count]. </summary>
+		static void SampleBoundaries(const EllipseParameterArrays<tFloat>& ellipses, size_t count, tFloat* x, tFloat* y, bool equalArcLength, TrigonometricAccuracy accuracy = TrigonometricAccuracy::Exact, int refinement = 8)
+		{
+			for (size_t i = 0; i < ellipses.count; ++i)
+			{
+				EllipseParameters<tFloat> e{ ellipses.x0[i], ellipses.y0[i], ellipses.a[i], ellipses.b[i], ellipses.theta[i] };
+				SampleBoundary(e, count, x + i*count, y + i*count, equalArcLength, accuracy, refinement);
+			}
+		}
+
+		/// <summary>	Calculates sin and cos for "count" angles. </summary>
+		static void SinCos(const tFloat* angle, size_t count, tFloat* sinValues, tFloat* cosValues, TrigonometricAccuracy accuracy)
+		{
+			if (accuracy == TrigonometricAccuracy::Exact)
+			{
+				for (size_t i = 0; i < count; ++i)
+				{
+					sinValues[i] = sin(angle[i]);
+					cosValues[i] = cos(angle[i]);
+				}
+
+				return;
+			}
+
+			size_t i = SinCosFast(angle, count, sinValues, cosValues);
+			for (; i < count; ++i)
+			{
+				double s, c;
+				SinCosFast(angle[i], s, c);
+				sinValues[i] = tFloat(s);
+				cosValues[i] = tFloat(c);
+			}
+		}
+
+	private:
+		// reduce to r in [-pi/4,pi/4] with angle = r + quadrant*pi/2 (the constant pi/2 is split in two parts
+		// in order to keep the reduction accurate), then use the Taylor polynomials - everything branch-free
+		static constexpr double PiHalf1 = 1.5707963267341256, PiHalf2 = 6.077100506506192e-11;
+
+		static void SinCosFast(double x, double& sinValue, double& cosValue)
+		{
+			double quadrant = std::floor(x * (2 / M_PI) + 0.5);
+			double r = (x - quadrant*PiHalf1) - quadrant*PiHalf2;
+			double r2 = r*r;
+			double s = r*(1 + r2*(-1.0 / 6 + r2*(1.0 / 120 + r2*(-1.0 / 5040 + r2*(1.0 / 362880 + r2*(-1.0 / 39916800))))));
+			double c = 1 + r2*(-0.5 + r2*(1.0 / 24 + r2*(-1.0 / 720 + r2*(1.0 / 40320 + r2*(-1.0 / 3628800 + r2*(1.0 / 479001600))))));
+			long long q = (long long)quadrant & 3;
+			double sinR = (q & 1) ? c : s;
+			double cosR = (q & 1) ? s : c;
+			sinValue = (q & 2) ? -sinR : sinR;
+			cosValue = ((q + 1) & 2) ? -cosR : cosR;
+		}
+
+		/// <summary>	The vectorized part of the fast sin/cos, returns the number of angles done. The generic version
+		/// 			handles none and leaves everything to the scalar loop. </summary>
+		template<typename tValue>
+		static size_t SinCosFast(const tValue* /*angle*/, size_t /*count*/, tValue* /*sinValues*/, tValue* /*cosValues*/)
+		{
+			return 0;
+		}
+
+#if defined(ELLIPSEUTILS_SSE2)
+		/// <summary>	Two angles per iteration, the same steps as the scalar version: the quadrant is rounded with
+		/// 			cvtpd_epi32, the swap of sin and cos and the signs are selected by bit masks. Angles beyond
+		/// 			the int32 range of the quadrant are left to the scalar loop. </summary>
+		static size_t SinCosFast(const double* angle, size_t count, double* sinValues, double* cosValues)
+		{
+			const __m128d twoOverPi = _mm_set1_pd(2 / M_PI), maxAngle = _mm_set1_pd(1e9);
+			const __m128d absMask = _mm_castsi128_pd(_mm_set_epi32(0x7fffffff, -1, 0x7fffffff, -1));
+			const __m128i one = _mm_set1_epi32(1), two = _mm_set1_epi32(2);
+			size_t i = 0;
+			for (; i + 2 <= count; i += 2)
+			{
+				__m128d x = _mm_loadu_pd(angle + i);
+				if (_mm_movemask_pd(_mm_cmple_pd(_mm_and_pd(x, absMask), maxAngle)) != 3)
+				{
+					break;
+				}
+
+				__m128i q = _mm_cvtpd_epi32(_mm_mul_pd(x, twoOverPi));
+				__m128d quadrant = _mm_cvtepi32_pd(q);
+				__m128d r = _mm_sub_pd(_mm_sub_pd(x, _mm_mul_pd(quadrant, _mm_set1_pd(PiHalf1))), _mm_mul_pd(quadrant, _mm_set1_pd(PiHalf2)));
+				__m128d r2 = _mm_mul_pd(r, r);
+
+				__m128d s = _mm_set1_pd(-1.0 / 39916800);
+				s = _mm_add_pd(_mm_mul_pd(s, r2), _mm_set1_pd(1.0 / 362880));
+				s = _mm_add_pd(_mm_mul_pd(s, r2), _mm_set1_pd(-1.0 / 5040));
+				s = _mm_add_pd(_mm_mul_pd(s, r2), _mm_set1_pd(1.0 / 120));
+				s = _mm_add_pd(_mm_mul_pd(s, r2), _mm_set1_pd(-1.0 / 6));
+				s = _mm_mul_pd(r, _mm_add_pd(_mm_mul_pd(s, r2), _mm_set1_pd(1)));
+
+				__m128d c = _mm_set1_pd(1.0 / 479001600);
+				c = _mm_add_pd(_mm_mul_pd(c, r2), _mm_set1_pd(-1.0 / 3628800));
+				c = _mm_add_pd(_mm_mul_pd(c, r2), _mm_set1_pd(1.0 / 40320));
+				c = _mm_add_pd(_mm_mul_pd(c, r2), _mm_set1_pd(-1.0 / 720));
+				c = _mm_add_pd(_mm_mul_pd(c, r2), _mm_set1_pd(1.0 / 24));
+				c = _mm_add_pd(_mm_mul_pd(c, r2), _mm_set1_pd(-0.5));
+				c = _mm_add_pd(_mm_mul_pd(c, r2), _mm_set1_pd(1));
+
+				// the quadrant of each angle in both halves of a 64-bit lane; bit 0 swaps sin and cos, bit 1
+				// (of q for sin, of q + 1 for cos) shifted to bit 63 is the sign
+				__m128i q64 = _mm_shuffle_epi32(q, _MM_SHUFFLE(1, 1, 0, 0));
+				__m128d swap = _mm_castsi128_pd(_mm_cmpeq_epi32(_mm_and_si128(q64, one), one));
+				__m128d sinR = _mm_or_pd(_mm_and_pd(swap, c), _mm_andnot_pd(swap, s));
+				__m128d cosR = _mm_or_pd(_mm_and_pd(swap, s), _mm_andnot_pd(swap, c));
+				__m128d sinSign = _mm_castsi128_pd(_mm_slli_epi64(_mm_and_si128(q64, two), 62));
+				__m128d cosSign = _mm_castsi128_pd(_mm_slli_epi64(_mm_and_si128(_mm_add_epi32(q64, one), two), 62));
+				_mm_storeu_pd(sinValues + i, _mm_xor_pd(sinR, sinSign));
+				_mm_storeu_pd(cosValues + i, _mm_xor_pd(cosR, cosSign));
+			}
+
+			return i;
+		}
+#endif
+
+		static void CalcHalfExtent(tFloat a, tFloat b, tFloat cosTheta, tFloat sinTheta, tFloat& halfWidth, tFloat& halfHeight)
+		{
+			tFloat aa = a*a, bb = b*b, cc = cosTheta*cosTheta, ss = sinTheta*sinTheta;
+			halfWidth = sqrt(aa*cc + bb*ss);
+			halfHeight = sqrt(aa*ss + bb*cc);
+		}
+
+		static void CalcEqualArcLengthParameters(tFloat a, tFloat b, size_t count, int refinement, TrigonometricAccuracy accuracy, tFloat* t)
+		{
+			// cumulative arc length on a fine grid (trapezoidal rule, which is spectrally accurate for periodic functions)
+			const size_t gridSize = count * (std::max)(refinement, 1);
+			const tFloat step = tFloat(2 * M_PI) / gridSize;
+			std::vector<tFloat> gridT(gridSize + 1), s(gridSize + 1), c(gridSize + 1), cumulative(gridSize + 1);
+			for (size_t i = 0; i <= gridSize; ++i)
+			{
+				gridT[i] = i*step;
+			}
+
+			SinCos(gridT.data(), gridSize + 1, s.data(), c.data(), accuracy);
+			cumulative[0] = 0;
+			tFloat previousSpeed = std::abs(b);
+			for (size_t i = 1; i <= gridSize; ++i)
+			{
+				tFloat speed = sqrt(a*a*s[i] * s[i] + b*b*c[i] * c[i]);
+				cumulative[i] = cumulative[i - 1] + (previousSpeed + speed) * step / 2;
+				previousSpeed = speed;
+			}
+
+			const tFloat perimeter = cumulative[gridSize];
+			size_t j = 0;
+			for (size_t i = 0; i < count; ++i)
+			{
+				tFloat target = perimeter * i / count;
+				while (j + 1 < gridSize && cumulative[j + 1] < target)
+				{
+					++j;
+				}
+
+				tFloat segment = cumulative[j + 1] - cumulative[j];
+				tFloat f = segment > 0 ? (target - cumulative[j]) / segment : 0;
+				t[i] = gridT[j] + f*step;
+			}
+		}
+	};
+}
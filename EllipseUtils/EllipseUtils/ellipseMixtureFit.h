@@ -0,0 +1,301 @@
+#pragma once
+
+#include <vector>
+#include "ellipseParameters.h"
+#include "momentAccumulator.h"
+#include "leastSquareEllipseFit.h"
+#include "parallelFor.h"
+
+namespace EllipseUtils
+{
+	/// <summary>	Expectation-maximization for a mixture of ellipses (plus an optional uniform background) in one
+	/// 			unordered point cloud.
+	///
+	/// 			E-step: the responsibility of a component for a point is derived from the (Sampson-) distance of
+	/// 			the point to the ellipse with a Gaussian kernel. M-step: each component is re-fitted with the
+	/// 			algebraic fit from the moments weighted with the responsibilities. Both steps are fused into one
+	/// 			parallel pass over the points - every chunk of points accumulates its own weighted moments per
+	/// 			component, which are merged afterwards, so no responsibility matrix is stored. Within a chunk the
+	/// 			points are processed in blocks, with tight loops over the points of a block which the compiler
+	/// 			can vectorize. </summary>
+	template<typename tFloat>
+	class EllipseMixtureFitter
+	{
+	public:
+		struct Component
+		{
+			EllipseAlgebraicParameters<tFloat> ellipse;
+
+			/// <summary>	The mixing weight. </summary>
+			tFloat weight;
+
+			/// <summary>	The standard deviation of the distance of the points to the ellipse. </summary>
+			tFloat sigma;
+		};
+
+		struct Options
+		{
+			int maxIterations = 100;
+
+			/// <summary>	Stop if the relative change of the log-likelihood is below this value. </summary>
+			tFloat tolerance = tFloat(1e-7);
+
+			tFloat initialSigma = 2;
+			tFloat minSigma = tFloat(0.01);
+
+			/// <summary>	A component is re-fitted only if the sum of its responsibilities (its effective number of
+			/// 			points) is above this value, otherwise it keeps its ellipse and sigma. </summary>
+			tFloat minEffectivePointCount = 5;
+
+			/// <summary>	The initial weight of the uniform background, zero disables the background component. </summary>
+			tFloat initialBackgroundWeight = tFloat(0.05);
+
+			unsigned int maxThreads = 0;
+			size_t chunkSize = 64 * 1024;
+		};
+
+		struct Result
+		{
+			std::vector<Component> components;
+			tFloat backgroundWeight;
+			tFloat logLikelihood;
+			int iterations;
+		};
+
+		template <typename PointAccessor>
+		static Result Fit(const PointAccessor& ptAccessor, const std::vector<EllipseParameters<tFloat>>& initialEllipses, const Options& options = Options())
+		{
+			const size_t numOfPoints = ptAccessor.GetLength();
+			const size_t componentCount = initialEllipses.size();
+			const PointNormalization<tFloat> normalization = PointNormalization<tFloat>::FromPoints(ptAccessor);
+
+			// density of the background: uniform over the bounding box of the points
+			const tFloat logBackgroundDensity = -log(4 * normalization.sx * normalization.sy);
+
+			Result result;
+			result.backgroundWeight = options.initialBackgroundWeight;
+			for (const auto& e : initialEllipses)
+			{
+				result.components.push_back(Component{ e.ToAlgebraicParameters(), (1 - options.initialBackgroundWeight) / componentCount, options.initialSigma });
+			}
+
+			result.logLikelihood = -(std::numeric_limits<tFloat>::max)();
+			const size_t chunkCount = (numOfPoints + options.chunkSize - 1) / options.chunkSize;
+			for (result.iterations = 1; result.iterations <= options.maxIterations; ++result.iterations)
+			{
+				std::vector<ComponentState> states = PrepareComponents(result, normalization);
+
+				std::vector<ChunkAccumulator> chunkResults;
+				chunkResults.reserve(chunkCount);
+				for (size_t c = 0; c < chunkCount; ++c)
+				{
+					chunkResults.push_back(ChunkAccumulator(componentCount, normalization));
+				}
+
+				ParallelFor(chunkCount, [&](size_t c)
+				{
+					size_t start = c * options.chunkSize;
+					ProcessChunk(ptAccessor, start, (std::min)(start + options.chunkSize, numOfPoints), normalization, states, result.backgroundWeight > 0 ? log(result.backgroundWeight) + logBackgroundDensity : -(std::numeric_limits<tFloat>::infinity)(), chunkResults[c]);
+				}, options.maxThreads);
+
+				ChunkAccumulator total(componentCount, normalization);
+				for (const auto& chunk : chunkResults)
+				{
+					total.Merge(chunk);
+				}
+
+				// M-step
+				for (size_t k = 0; k < componentCount; ++k)
+				{
+					Component& component = result.components[k];
+					tFloat weightSum = total.moments[k].GetWeightSum();
+					component.weight = weightSum / numOfPoints;
+					if (weightSum > options.minEffectivePointCount)
+					{
+						component.ellipse = LeastSquareEllipseFitter<tFloat>::Fit(total.moments[k]);
+						component.sigma = (std::max)(options.minSigma, sqrt(total.squaredDistanceSums[k] / weightSum));
+					}
+				}
+
+				if (result.backgroundWeight > 0)
+				{
+					result.backgroundWeight = total.backgroundWeightSum / numOfPoints;
+				}
+
+				tFloat previousLogLikelihood = result.logLikelihood;
+				result.logLikelihood = total.logLikelihood;
+				if (std::abs(result.logLikelihood - previousLogLikelihood) <= options.tolerance * std::abs(result.logLikelihood))
+				{
+					break;
+				}
+			}
+
+			return result;
+		}
+
+	private:
+		static const size_t BlockSize = 256;
+
+		/// <summary>	Per-iteration data of a component, which is used in the E-step. </summary>
+		struct ComponentState
+		{
+			/// <summary>	The conic in normalized coordinates. </summary>
+			tFloat A[6];
+
+			/// <summary>	Everything in the log-density which does not depend on the point. </summary>
+			tFloat logNormalization;
+
+			/// <summary>	-1/(2*sigma^2) </summary>
+			tFloat exponentFactor;
+
+			bool isValid;
+		};
+
+		struct ChunkAccumulator
+		{
+			std::vector<NormalizedMomentAccumulator<tFloat>> moments;
+			std::vector<tFloat> squaredDistanceSums;
+			tFloat backgroundWeightSum;
+			tFloat logLikelihood;
+
+			ChunkAccumulator(size_t componentCount, const PointNormalization<tFloat>& normalization)
+				: squaredDistanceSums(componentCount, 0), backgroundWeightSum(0), logLikelihood(0)
+			{
+				moments.reserve(componentCount);
+				for (size_t k = 0; k < componentCount; ++k)
+				{
+					moments.push_back(NormalizedMomentAccumulator<tFloat>(normalization));
+				}
+			}
+
+			void Merge(const ChunkAccumulator& other)
+			{
+				for (size_t k = 0; k < this->moments.size(); ++k)
+				{
+					this->moments[k].Merge(other.moments[k]);
+					this->squaredDistanceSums[k] += other.squaredDistanceSums[k];
+				}
+
+				this->backgroundWeightSum += other.backgroundWeightSum;
+				this->logLikelihood += other.logLikelihood;
+			}
+		};
+
+		static std::vector<ComponentState> PrepareComponents(const Result& result, const PointNormalization<tFloat>& normalization)
+		{
+			std::vector<ComponentState> states(result.components.size());
+			for (size_t k = 0; k < result.components.size(); ++k)
+			{
+				const Component& component = result.components[k];
+				ComponentState& state = states[k];
+				EllipseParameters<tFloat> p = EllipseParameters<tFloat>::FromAlgebraicParameters(component.ellipse);
+				state.isValid = p.IsValid() && component.weight > 0;
+				if (!state.isValid)
+				{
+					continue;
+				}
+
+				LeastSquareEllipseFitter<tFloat>::Normalize(component.ellipse, normalization, state.A);
+
+				// the points are assumed to be distributed uniformly along the perimeter (Ramanujan's approximation)
+				tFloat perimeter = tFloat(M_PI) * (3 * (p.a + p.b) - sqrt((3 * p.a + p.b)*(p.a + 3 * p.b)));
+				state.logNormalization = log(component.weight) - log(component.sigma * perimeter) - tFloat(0.5) * log(2 * tFloat(M_PI));
+				state.exponentFactor = -1 / (2 * component.sigma*component.sigma);
+			}
+
+			return states;
+		}
+
+		template <typename PointAccessor>
+		static void ProcessChunk(const PointAccessor& ptAccessor, size_t start, size_t end, const PointNormalization<tFloat>& normalization, const std::vector<ComponentState>& states, tFloat logBackground, ChunkAccumulator& accumulator)
+		{
+			const size_t componentCount = states.size();
+			const tFloat invSx = 1 / normalization.sx, invSy = 1 / normalization.sy;
+			const tFloat invSx2 = invSx*invSx, invSy2 = invSy*invSy;
+
+			tFloat x[BlockSize], y[BlockSize], maxLog[BlockSize], sum[BlockSize];
+			std::vector<tFloat> logDensity(componentCount * BlockSize), squaredDistance(componentCount * BlockSize);
+			for (size_t blockStart = start; blockStart < end; blockStart += BlockSize)
+			{
+				const size_t n = (std::min)(BlockSize, end - blockStart);
+				for (size_t i = 0; i < n; ++i)
+				{
+					x[i] = (ptAccessor.GetX(blockStart + i) - normalization.mx) * invSx;
+					y[i] = (ptAccessor.GetY(blockStart + i) - normalization.my) * invSy;
+					maxLog[i] = logBackground;
+				}
+
+				for (size_t k = 0; k < componentCount; ++k)
+				{
+					const ComponentState& state = states[k];
+					tFloat* pLog = &logDensity[k * BlockSize];
+					tFloat* pDist = &squaredDistance[k * BlockSize];
+					if (!state.isValid)
+					{
+						std::fill(pLog, pLog + n, -(std::numeric_limits<tFloat>::infinity)());
+						std::fill(pDist, pDist + n, tFloat(0));
+						continue;
+					}
+
+					const tFloat a0 = state.A[0], a1 = state.A[1], a2 = state.A[2], a3 = state.A[3], a4 = state.A[4], a5 = state.A[5];
+					for (size_t i = 0; i < n; ++i)
+					{
+						// Sampson distance: Q^2/|grad Q|^2, with the gradient w.r.t. the original coordinates
+						tFloat q = a0*x[i] * x[i] + a1*x[i] * y[i] + a2*y[i] * y[i] + a3*x[i] + a4*y[i] + a5;
+						tFloat gx = 2 * a0*x[i] + a1*y[i] + a3;
+						tFloat gy = a1*x[i] + 2 * a2*y[i] + a4;
+						tFloat d2 = q*q / (gx*gx*invSx2 + gy*gy*invSy2 + std::numeric_limits<tFloat>::min());
+						pDist[i] = d2;
+						pLog[i] = state.logNormalization + state.exponentFactor*d2;
+						maxLog[i] = (std::max)(maxLog[i], pLog[i]);
+					}
+				}
+
+				// a point which neither a component nor the background can explain (all of them invalid or disabled)
+				// has maxLog = -inf - it is skipped: its responsibilities are zero and it adds nothing to the likelihood
+				for (size_t i = 0; i < n; ++i)
+				{
+					maxLog[i] = maxLog[i] > -(std::numeric_limits<tFloat>::infinity)() ? maxLog[i] : 0;
+					sum[i] = exp(logBackground - maxLog[i]);
+				}
+
+				for (size_t k = 0; k < componentCount; ++k)
+				{
+					tFloat* pLog = &logDensity[k * BlockSize];
+					for (size_t i = 0; i < n; ++i)
+					{
+						pLog[i] = exp(pLog[i] - maxLog[i]);
+						sum[i] += pLog[i];
+					}
+				}
+
+				for (size_t i = 0; i < n; ++i)
+				{
+					if (sum[i] > 0)
+					{
+						accumulator.logLikelihood += maxLog[i] + log(sum[i]);
+						sum[i] = 1 / sum[i];
+					}
+
+					accumulator.backgroundWeightSum += exp(logBackground - maxLog[i]) * sum[i];
+				}
+
+				// logDensity now holds the responsibilities
+				for (size_t k = 0; k < componentCount; ++k)
+				{
+					tFloat* pResponsibility = &logDensity[k * BlockSize];
+					const tFloat* pDist = &squaredDistance[k * BlockSize];
+					tFloat distanceSum = 0;
+					for (size_t i = 0; i < n; ++i)
+					{
+						pResponsibility[i] *= sum[i];
+						distanceSum += pResponsibility[i] * pDist[i];
+					}
+
+					accumulator.squaredDistanceSums[k] += distanceSum;
+					accumulator.moments[k].AddNormalizedPoints(x, y, pResponsibility, n);
+				}
+			}
+		}
+	};
+}
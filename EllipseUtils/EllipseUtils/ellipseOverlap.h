@@ -0,0 +1,443 @@
+#pragma once
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include "ellipseParameters.h"
+#include "ellipseGeometry.h"
+#include "parallelFor.h"
+
+namespace EllipseUtils
+{
+	enum class OverlapMethod
+	{
+		/// <summary>	Intersection points from the quartic of the two conics, areas from elliptic sectors. Falls back to
+		/// 			the polygon approximation for (almost) identical ellipses. </summary>
+		Analytic,
+
+		/// <summary>	Clip the inscribed polygons of the two ellipses. </summary>
+		Polygon
+	};
+
+	/// <summary>	Area of the intersection and intersection-over-union of two ellipses, for single pairs and in batch
+	/// 			over EllipseParameterArrays. There are three stages: pairs whose bounding boxes do not overlap are
+	/// 			rejected right away, otherwise the intersection points are computed analytically (a quartic in the
+	/// 			tangent half-angle on the first ellipse) and the area is assembled from the arcs between them. The
+	/// 			polygon approximation is used if requested or if the analytic path is not reliable. </summary>
+	template<typename tFloat>
+	class EllipseOverlap
+	{
+	public:
+		struct Options
+		{
+			OverlapMethod method = OverlapMethod::Analytic;
+
+			/// <summary>	The number of vertices per ellipse in the polygon approximation. </summary>
+			int polygonVertexCount = 256;
+
+			unsigned int maxThreads = 0;
+			size_t chunkSize = 4096;
+		};
+
+		static tFloat IntersectionArea(const EllipseParameters<tFloat>& e1, const EllipseParameters<tFloat>& e2, const Options& options = Options())
+		{
+			if (!(e1.a > 0 && e1.b > 0 && e2.a > 0 && e2.b > 0))
+			{
+				return 0;
+			}
+
+			tFloat minX1, minY1, maxX1, maxY1, minX2, minY2, maxX2, maxY2;
+			EllipseGeometry<tFloat>::BoundingBox(e1, minX1, minY1, maxX1, maxY1);
+			EllipseGeometry<tFloat>::BoundingBox(e2, minX2, minY2, maxX2, maxY2);
+			if (maxX1 < minX2 || maxX2 < minX1 || maxY1 < minY2 || maxY2 < minY1)
+			{
+				return 0;
+			}
+
+			tFloat area;
+			if (options.method == OverlapMethod::Analytic && CalcAnalyticIntersectionArea(e1, e2, area))
+			{
+				return area;
+			}
+
+			return PolygonIntersectionArea(e1, e2, options.polygonVertexCount);
+		}
+
+		static tFloat IntersectionOverUnion(const EllipseParameters<tFloat>& e1, const EllipseParameters<tFloat>& e2, const Options& options = Options())
+		{
+			tFloat intersection = IntersectionArea(e1, e2, options);
+			if (intersection <= 0)
+			{
+				return 0;
+			}
+
+			return intersection / (EllipseGeometry<tFloat>::Area(e1.a, e1.b) + EllipseGeometry<tFloat>::Area(e2.a, e2.b) - intersection);
+		}
+
+		/// <summary>	Calculates the intersection-over-union of the pairs (first[i], second[i]) in parallel. </summary>
+		static void CalcIntersectionOverUnion(const EllipseParameterArrays<tFloat>& first, const EllipseParameterArrays<tFloat>& second, tFloat* iou, const Options& options = Options())
+		{
+			if (first.count != second.count)
+			{
+				throw std::invalid_argument("The arrays of ellipses must have the same length.");
+			}
+
+			const size_t chunkCount = (first.count + options.chunkSize - 1) / options.chunkSize;
+			ParallelFor(chunkCount, [&](size_t c)
+			{
+				size_t end = (std::min)((c + 1) * options.chunkSize, first.count);
+				for (size_t i = c * options.chunkSize; i < end; ++i)
+				{
+					iou[i] = IntersectionOverUnion(
+						EllipseParameters<tFloat>{ first.x0[i], first.y0[i], first.a[i], first.b[i], first.theta[i] },
+						EllipseParameters<tFloat>{ second.x0[i], second.y0[i], second.a[i], second.b[i], second.theta[i] },
+						options);
+				}
+			}, options.maxThreads);
+		}
+
+		/// <summary>	Area of the intersection of the two inscribed polygons with "vertexCount" vertices. The polygons
+		/// 			are scaled such that they have the same area as the ellipses. </summary>
+		static tFloat PolygonIntersectionArea(const EllipseParameters<tFloat>& e1, const EllipseParameters<tFloat>& e2, int vertexCount)
+		{
+			const size_t n = (std::max)(vertexCount, 3);
+			const tFloat scale = sqrt(tFloat(2 * M_PI) / (n * sin(tFloat(2 * M_PI) / n)));
+			std::vector<tFloat> x1(n), y1(n), x2(n), y2(n);
+			EllipseGeometry<tFloat>::SampleBoundary(EllipseParameters<tFloat>{ e1.x0, e1.y0, e1.a*scale, e1.b*scale, e1.theta }, n, x1.data(), y1.data(), false);
+			EllipseGeometry<tFloat>::SampleBoundary(EllipseParameters<tFloat>{ e2.x0, e2.y0, e2.a*scale, e2.b*scale, e2.theta }, n, x2.data(), y2.data(), false);
+
+			// Sutherland-Hodgman: clip the first polygon with every edge of the second (both are convex and counter-clockwise)
+			std::vector<tFloat> clippedX, clippedY;
+			for (size_t e = 0; e < n && !x1.empty(); ++e)
+			{
+				const tFloat ax = x2[e], ay = y2[e];
+				const tFloat ex = x2[(e + 1) % n] - ax, ey = y2[(e + 1) % n] - ay;
+				clippedX.clear(); clippedY.clear();
+				const size_t m = x1.size();
+				for (size_t k = 0; k < m; ++k)
+				{
+					const size_t next = (k + 1) % m;
+					tFloat side = ex*(y1[k] - ay) - ey*(x1[k] - ax);
+					tFloat sideNext = ex*(y1[next] - ay) - ey*(x1[next] - ax);
+					if (side >= 0)
+					{
+						clippedX.push_back(x1[k]); clippedY.push_back(y1[k]);
+					}
+
+					if ((side >= 0) != (sideNext >= 0))
+					{
+						tFloat f = side / (side - sideNext);
+						clippedX.push_back(x1[k] + f*(x1[next] - x1[k])); clippedY.push_back(y1[k] + f*(y1[next] - y1[k]));
+					}
+				}
+
+				x1.swap(clippedX); y1.swap(clippedY);
+			}
+
+			tFloat area = 0;
+			for (size_t k = 0; k < x1.size(); ++k)
+			{
+				const size_t next = (k + 1) % x1.size();
+				area += x1[k] * y1[next] - x1[next] * y1[k];
+			}
+
+			return area / 2;
+		}
+
+	private:
+		/// <summary>	The second ellipse in the frame in which the first one is the unit circle: it is the set of the
+		/// 			points c + M*(cos(s), sin(s)), or equivalently Q(x,y) = A*x^2 + B*x*y + C*y^2 + D*x + E*y + F = 0
+		/// 			with Q < 0 inside. </summary>
+		struct NormalizedEllipse
+		{
+			tFloat cx, cy;
+			tFloat m[4];
+			tFloat inverse[4];
+			tFloat A, B, C, D, E, F;
+
+			void Rotate(tFloat angle)
+			{
+				const tFloat c = cos(angle), s = sin(angle);
+				tFloat x = c*this->cx - s*this->cy, y = s*this->cx + c*this->cy;
+				this->cx = x; this->cy = y;
+				tFloat m0 = c*this->m[0] - s*this->m[2], m1 = c*this->m[1] - s*this->m[3];
+				tFloat m2 = s*this->m[0] + c*this->m[2], m3 = s*this->m[1] + c*this->m[3];
+				this->m[0] = m0; this->m[1] = m1; this->m[2] = m2; this->m[3] = m3;
+				this->Update();
+			}
+
+			void Update()
+			{
+				tFloat det = this->m[0] * this->m[3] - this->m[1] * this->m[2];
+				this->inverse[0] = this->m[3] / det; this->inverse[1] = -this->m[1] / det;
+				this->inverse[2] = -this->m[2] / det; this->inverse[3] = this->m[0] / det;
+
+				// K = N^T*N with N = M^-1, and Q(p) = (p-c)^T*K*(p-c) - 1
+				tFloat k00 = this->inverse[0] * this->inverse[0] + this->inverse[2] * this->inverse[2];
+				tFloat k01 = this->inverse[0] * this->inverse[1] + this->inverse[2] * this->inverse[3];
+				tFloat k11 = this->inverse[1] * this->inverse[1] + this->inverse[3] * this->inverse[3];
+				this->A = k00; this->B = 2 * k01; this->C = k11;
+				this->D = -2 * (k00*this->cx + k01*this->cy);
+				this->E = -2 * (k01*this->cx + k11*this->cy);
+				this->F = k00*this->cx*this->cx + 2 * k01*this->cx*this->cy + k11*this->cy*this->cy - 1;
+			}
+
+			tFloat Evaluate(tFloat x, tFloat y) const
+			{
+				return this->A*x*x + this->B*x*y + this->C*y*y + this->D*x + this->E*y + this->F;
+			}
+
+			/// <summary>	The parameter s of a point on the ellipse. </summary>
+			tFloat GetParameter(tFloat x, tFloat y) const
+			{
+				x -= this->cx; y -= this->cy;
+				return atan2(this->inverse[2] * x + this->inverse[3] * y, this->inverse[0] * x + this->inverse[1] * y);
+			}
+
+			/// <summary>	Integral of (x*dy - y*dx)/2 along the ellipse from s0 to s1. </summary>
+			tFloat SectorArea(tFloat s0, tFloat s1) const
+			{
+				tFloat dc = cos(s1) - cos(s0), ds = sin(s1) - sin(s0);
+				tFloat det = this->m[0] * this->m[3] - this->m[1] * this->m[2];
+				return (det*(s1 - s0) + this->cx*(this->m[2] * dc + this->m[3] * ds) - this->cy*(this->m[0] * dc + this->m[1] * ds)) / 2;
+			}
+		};
+
+		/// <summary>	Real roots of u^4 + a*u^3 + b*u^2 + c*u + d (Ferrari). Complex pairs with a tiny imaginary part are
+		/// 			reported as a double root, so that tangent points are not lost to rounding. </summary>
+		static int SolveQuartic(tFloat a, tFloat b, tFloat c, tFloat d, tFloat* roots)
+		{
+			// depressed quartic y^4 + p*y^2 + q*y + r with u = y - a/4
+			const tFloat shift = a / 4, aa = a*a;
+			const tFloat p = b - 3 * aa / 8;
+			const tFloat q = c - a*b / 2 + aa*a / 8;
+			const tFloat r = d - a*c / 4 + aa*b / 16 - 3 * aa*aa / 256;
+
+			// largest root of the resolvent cubic m^3 + p*m^2 + (p^2/4 - r)*m - q^2/8, which is non-negative
+			tFloat m = SolveCubicLargestRoot(p, p*p / 4 - r, -q*q / 8);
+			int count = 0;
+			if (!(m > std::numeric_limits<tFloat>::epsilon() * (std::abs(p) + std::abs(r) + 1)))
+			{
+				// (almost) biquadratic: y^4 + p*y^2 + r = 0
+				tFloat y2[2];
+				int n = SolveQuadratic(p, r, y2);
+				for (int i = 0; i < n; ++i)
+				{
+					if (y2[i] >= 0)
+					{
+						tFloat y = sqrt(y2[i]);
+						roots[count++] = y - shift;
+						roots[count++] = -y - shift;
+					}
+				}
+
+				return count;
+			}
+
+			// (y^2 + p/2 + m)^2 = 2m*(y - q/(4m))^2, i.e. y^2 -+ sqrt(2m)*y + p/2 + m +- q/(2*sqrt(2m)) = 0
+			const tFloat s = sqrt(2 * m);
+			for (int sign = -1; sign <= 1; sign += 2)
+			{
+				tFloat y[2];
+				int n = SolveQuadratic(sign*s, p / 2 + m - sign*q / (2 * s), y);
+				for (int i = 0; i < n; ++i)
+				{
+					roots[count++] = y[i] - shift;
+				}
+			}
+
+			return count;
+		}
+
+		/// <summary>	Real roots of y^2 + b*y + c, see SolveQuartic for the treatment of almost real roots. </summary>
+		static int SolveQuadratic(tFloat b, tFloat c, tFloat* roots)
+		{
+			tFloat discriminant = b*b - 4 * c;
+			tFloat middle = -b / 2;
+			if (discriminant < 0)
+			{
+				if (sqrt(-discriminant) / 2 > tFloat(1e-6) * (1 + std::abs(middle)))
+				{
+					return 0;
+				}
+
+				roots[0] = roots[1] = middle;
+				return 2;
+			}
+
+			// avoid the cancellation in -b/2 +- sqrt(discriminant)/2
+			tFloat h = middle + (middle < 0 ? -1 : 1) * sqrt(discriminant) / 2;
+			roots[0] = h;
+			roots[1] = h != 0 ? c / h : 0;
+			return 2;
+		}
+
+		/// <summary>	Largest real root of m^3 + b*m^2 + c*m + d. </summary>
+		static tFloat SolveCubicLargestRoot(tFloat b, tFloat c, tFloat d)
+		{
+			// depressed cubic z^3 + p*z + q with m = z - b/3
+			const tFloat shift = b / 3;
+			const tFloat p = c - b*shift;
+			const tFloat q = d - c*shift + 2 * shift*shift*shift;
+			tFloat z;
+			tFloat discriminant = q*q / 4 + p*p*p / 27;
+			if (discriminant > 0)
+			{
+				tFloat w = sqrt(discriminant);
+				z = cbrt(-q / 2 + w) + cbrt(-q / 2 - w);
+			}
+			else
+			{
+				// three real roots (p <= 0), the largest one is the one with k = 0
+				tFloat rho = sqrt(-p / 3);
+				tFloat argument = rho > 0 ? (std::max)(tFloat(-1), (std::min)(tFloat(1), -q / (2 * rho*rho*rho))) : 0;
+				z = 2 * rho*cos(acos(argument) / 3);
+			}
+
+			// one Newton step against the rounding in cbrt/acos
+			tFloat m = z - shift;
+			tFloat f = ((m + b)*m + c)*m + d, derivative = (3 * m + 2 * b)*m + c;
+			if (derivative != 0)
+			{
+				m -= f / derivative;
+			}
+
+			return m;
+		}
+
+		static bool CalcAnalyticIntersectionArea(const EllipseParameters<tFloat>& e1, const EllipseParameters<tFloat>& e2, tFloat& area)
+		{
+			const tFloat TwoPi = tFloat(2 * M_PI);
+
+			// p' = diag(1/a1, 1/b1) * R1^T * (p - c1) maps the first ellipse to the unit circle
+			NormalizedEllipse q;
+			const tFloat c1 = cos(e1.theta), s1 = sin(e1.theta);
+			const tFloat dx = e2.x0 - e1.x0, dy = e2.y0 - e1.y0;
+			q.cx = (c1*dx + s1*dy) / e1.a;
+			q.cy = (-s1*dx + c1*dy) / e1.b;
+			const tFloat cd = cos(e2.theta - e1.theta), sd = sin(e2.theta - e1.theta);
+			q.m[0] = cd*e2.a / e1.a; q.m[1] = -sd*e2.b / e1.a;
+			q.m[2] = sd*e2.a / e1.b; q.m[3] = cd*e2.b / e1.b;
+			q.Update();
+
+			// the substitution u = tan(t/2) misses t = pi, so rotate the frame such that the point of the circle which
+			// is farthest from the second ellipse (in terms of Q) ends up there - this keeps the leading coefficient large
+			tFloat bestValue = 0, bestAngle = 0;
+			for (int k = 0; k < 8; ++k)
+			{
+				tFloat angle = k * tFloat(M_PI / 4);
+				tFloat value = std::abs(q.Evaluate(cos(angle), sin(angle)));
+				if (value > bestValue)
+				{
+					bestValue = value;
+					bestAngle = angle;
+				}
+			}
+
+			if (!(bestValue > tFloat(1e-9) * (1 + std::abs(q.F))))
+			{
+				// (almost) the same ellipse
+				return false;
+			}
+
+			q.Rotate(tFloat(M_PI) - bestAngle);
+
+			// Q(cos(t), sin(t)) * (1+u^2)^2 as polynomial in u = tan(t/2)
+			const tFloat p4 = q.A - q.D + q.F;
+			const tFloat p3 = 2 * (q.E - q.B);
+			const tFloat p2 = 2 * (2 * q.C - q.A + q.F);
+			const tFloat p1 = 2 * (q.B + q.E);
+			const tFloat p0 = q.A + q.D + q.F;
+			tFloat roots[4];
+			const int rootCount = SolveQuartic(p3 / p4, p2 / p4, p1 / p4, p0 / p4, roots);
+			tFloat t[4];
+			int count = 0;
+			for (int i = 0; i < rootCount; ++i)
+			{
+				// polish the root with Newton's method on Q(cos(t), sin(t))
+				tFloat angle = 2 * atan(roots[i]);
+				for (int iteration = 0; iteration < 3; ++iteration)
+				{
+					tFloat x = cos(angle), y = sin(angle);
+					tFloat derivative = -(2 * q.A*x + q.B*y + q.D)*y + (q.B*x + 2 * q.C*y + q.E)*x;
+					if (std::abs(derivative) < tFloat(1e-12))
+					{
+						break;
+					}
+
+					angle -= q.Evaluate(x, y) / derivative;
+				}
+
+				angle = fmod(angle, TwoPi);
+				t[count++] = angle < 0 ? angle + TwoPi : angle;
+			}
+
+			std::sort(t, t + count);
+
+			// tangent points are double roots
+			int unique = 0;
+			for (int i = 0; i < count; ++i)
+			{
+				if (unique == 0 || t[i] - t[unique - 1] > tFloat(1e-6))
+				{
+					t[unique++] = t[i];
+				}
+			}
+
+			if (unique > 1 && t[unique - 1] - t[0] > TwoPi - tFloat(1e-6))
+			{
+				--unique;
+			}
+
+			const tFloat area1 = EllipseGeometry<tFloat>::Area(e1.a, e1.b), area2 = EllipseGeometry<tFloat>::Area(e2.a, e2.b);
+			if (unique < 2)
+			{
+				// no crossing: one ellipse contains the other or they are disjoint, test points away from a tangent point
+				tFloat angle = unique == 0 ? 0 : t[0] + tFloat(M_PI);
+				if (q.Evaluate(cos(angle), sin(angle)) < 0)
+				{
+					area = area1;
+					return true;
+				}
+
+				tFloat s = unique == 0 ? 0 : q.GetParameter(cos(t[0]), sin(t[0])) + tFloat(M_PI);
+				tFloat x = q.cx + q.m[0] * cos(s) + q.m[1] * sin(s), y = q.cy + q.m[2] * cos(s) + q.m[3] * sin(s);
+				area = x*x + y*y < 1 ? area2 : 0;
+				return true;
+			}
+
+			// walk counter-clockwise around the circle, the boundary of the intersection follows whichever curve is inside
+			tFloat normalizedArea = 0;
+			for (int i = 0; i < unique; ++i)
+			{
+				tFloat t0 = t[i], t1 = i + 1 < unique ? t[i + 1] : t[0] + TwoPi;
+				tFloat middle = (t0 + t1) / 2;
+				if (q.Evaluate(cos(middle), sin(middle)) < 0)
+				{
+					normalizedArea += (t1 - t0) / 2;
+				}
+				else
+				{
+					tFloat s0 = q.GetParameter(cos(t0), sin(t0)), s1 = q.GetParameter(cos(t1), sin(t1));
+					while (s1 < s0)
+					{
+						s1 += TwoPi;
+					}
+
+					normalizedArea += q.SectorArea(s0, s1);
+				}
+			}
+
+			area = normalizedArea * e1.a * e1.b;
+			const tFloat maxArea = (std::min)(area1, area2);
+			if (!(area > -tFloat(1e-6) * maxArea && area < maxArea * (1 + tFloat(1e-6))))
+			{
+				return false;
+			}
+
+			area = (std::max)(tFloat(0), (std::min)(area, maxArea));
+			return true;
+		}
+	};
+}
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cmath>
 #include <limits>
 
 namespace EllipseUtils
@@ -125,9 +126,11 @@ namespace EllipseUtils
 		/// <summary>	The angle  between the x-axis and the major-axis. < / summary>
 		tFloat theta;
 
+		/// <summary>	A fit of points which do not determine an ellipse (or of non-finite coordinates, e.g. a raw file
+		/// 			read with the wrong data type) has a NaN or infinite parameter - not necessarily x0. </summary>
 		bool IsValid() const
 		{
-			return !std::isnan(this->x0);
+			return std::isfinite(this->x0) && std::isfinite(this->y0) && std::isfinite(this->a) && std::isfinite(this->b) && std::isfinite(this->theta);
 		}
 
 		static EllipseParameters<tFloat> Invalid()
@@ -174,6 +177,21 @@ namespace EllipseUtils
 
 			return p;
 		}
+
+		/// <summary>	Gets the implicit representation, with the axis "a" in the direction given by theta. </summary>
+		EllipseAlgebraicParameters<tFloat> ToAlgebraicParameters() const
+		{
+			tFloat c = cos(this->theta), s = sin(this->theta);
+			tFloat aa = this->a*this->a, bb = this->b*this->b;
+			EllipseAlgebraicParameters<tFloat> p;
+			p.a = aa*s*s + bb*c*c;
+			p.b = 2 * (bb - aa)*s*c;
+			p.c = aa*c*c + bb*s*s;
+			p.d = -2 * p.a*this->x0 - p.b*this->y0;
+			p.e = -p.b*this->x0 - 2 * p.c*this->y0;
+			p.f = p.a*this->x0*this->x0 + p.b*this->x0*this->y0 + p.c*this->y0*this->y0 - aa*bb;
+			return p;
+		}
 	};
 
 }
\ No newline at end of file
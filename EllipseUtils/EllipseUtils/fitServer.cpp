@@ -0,0 +1,441 @@
+#include "stdafx.h"
+#include "fitServer.h"
+#include "leastSquareEllipseFit.h"
+#include "pointFileReader.h"
+#include <cstring>
+#include <stdexcept>
+
+using namespace EllipseUtils;
+
+FitServer::FitServer(const char* szPath, const FitServerOptions& options)
+	: path(szPath), options(options), listener(LocalSocket::Listen(szPath)), isStopping(false), pendingPointCount(0), pool(options.fitterThreads),
+	secondsPerPoint(0), secondsPerBatch(0), requestCount(0), batchCount(0), batchSizeSum(0), maxBatchSize(0), nextLatency(0)
+{
+	this->options.maxBatchSize = (std::max)(this->options.maxBatchSize, (size_t)1);
+	this->options.latencyWindow = (std::max)(this->options.latencyWindow, (size_t)1);
+	if (this->options.cacheCapacity > 0)
+	{
+		// a request has the same bytes as a raw file of interleaved doubles
+		PointFileOptions requestOptions;
+		requestOptions.isRaw = true;
+		requestOptions.rawDataType = PointDataType::Float64;
+		requestOptions.rawLayout = PointLayout::Interleaved;
+		this->cache.reset(new ResultLruCache(this->options.cacheCapacity));
+		this->cacheSeed = ContentHash::GetOptionsSeed(requestOptions);
+	}
+}
+
+FitServer::~FitServer()
+{
+	this->listener.Close();
+	LocalSocket::RemovePath(this->path.c_str());
+}
+
+void FitServer::Run()
+{
+	std::thread batcher(&FitServer::RunBatcher, this);
+	std::vector<std::shared_ptr<Connection>> connections;
+	while (!this->isStopping)
+	{
+		LocalSocket socket = this->listener.Accept();
+		if (this->isStopping)
+		{
+			break;
+		}
+
+		// join the threads of closed connections, so a long running server does not collect them
+		for (auto it = connections.begin(); it != connections.end();)
+		{
+			if ((*it)->isFinished)
+			{
+				(*it)->thread.join();
+				it = connections.erase(it);
+			}
+			else
+			{
+				++it;
+			}
+		}
+
+		if (!socket.IsOpen())
+		{
+			continue;
+		}
+
+		std::shared_ptr<Connection> connection = std::make_shared<Connection>();
+		connection->socket = std::move(socket);
+		connection->isFinished = false;
+		connection->pendingCount = 0;
+		connection->thread = std::thread(&FitServer::ServeConnection, this, connection);
+		connections.push_back(connection);
+	}
+
+	for (auto& connection : connections)
+	{
+		connection->socket.Shutdown();
+		connection->thread.join();
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->requestQueued.notify_all();
+	}
+
+	batcher.join();
+}
+
+void FitServer::Stop()
+{
+	this->isStopping = true;
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->requestQueued.notify_all();
+	}
+
+	// wake up Accept
+	try
+	{
+		LocalSocket::Connect(this->path.c_str());
+	}
+	catch (std::runtime_error&)
+	{
+	}
+}
+
+FitServerStatistics FitServer::GetStatistics() const
+{
+	std::vector<float> window;
+	FitServerStatistics statistics;
+	{
+		std::lock_guard<std::mutex> lock(this->statisticsMutex);
+		window = this->latencies;
+		statistics.requestCount = this->requestCount;
+		statistics.batchCount = this->batchCount;
+		statistics.maxBatchSize = this->maxBatchSize;
+		statistics.meanBatchSize = this->batchCount > 0 ? (double)this->batchSizeSum / this->batchCount : 0;
+	}
+
+	auto percentile = [&](double p) -> double
+	{
+		if (window.empty())
+		{
+			return 0;
+		}
+
+		const size_t k = (std::min)((size_t)(p * window.size()), window.size() - 1);
+		std::nth_element(window.begin(), window.begin() + k, window.end());
+		return window[k];
+	};
+
+	statistics.latencyP50Microseconds = percentile(0.5);
+	statistics.latencyP90Microseconds = percentile(0.9);
+	statistics.latencyP99Microseconds = percentile(0.99);
+	statistics.latencyMaxMicroseconds = window.empty() ? 0 : *std::max_element(window.begin(), window.end());
+	return statistics;
+}
+
+ResultCacheStatistics FitServer::GetCacheStatistics() const
+{
+	if (!this->cache)
+	{
+		return ResultCacheStatistics();
+	}
+
+	return this->cache->GetStatistics();
+}
+
+/// <summary>	Gets the response to a fit request with the result. </summary>
+static FitResponse MakeResponse(uint32_t id, const CachedFit& fit)
+{
+	FitResponse response;
+	response.type = FitMessageType::Fit;
+	response.id = id;
+	response.pointCount = (uint32_t)fit.pointCount;
+	response.status = fit.pointCount < LeastSquareEllipseFitter<double>::MinPointCount ? FitStatus::TooFewPoints : fit.ellipse.IsValid() ? FitStatus::Ok : FitStatus::NoEllipse;
+	response.x0 = fit.ellipse.x0;
+	response.y0 = fit.ellipse.y0;
+	response.a = fit.ellipse.a;
+	response.b = fit.ellipse.b;
+	response.theta = fit.ellipse.theta;
+	return response;
+}
+
+void FitServer::ServeConnection(const std::shared_ptr<Connection>& connection)
+{
+	FitRequestHeader header;
+	while (connection->socket.ReceiveAll(&header, sizeof(header)))
+	{
+		if (header.type == FitMessageType::Statistics && header.pointCount == 0)
+		{
+			StatisticsResponse response;
+			memset(&response, 0, sizeof(response));
+			response.type = FitMessageType::Statistics;
+			response.id = header.id;
+			response.status = FitStatus::Ok;
+			response.statistics = this->GetStatistics();
+			std::lock_guard<std::mutex> lock(connection->sendMutex);
+			if (!connection->socket.SendAll(&response, sizeof(response)))
+			{
+				break;
+			}
+
+			continue;
+		}
+
+		if (header.type != FitMessageType::Fit || header.pointCount > this->options.maxPointsPerRequest)
+		{
+			break;
+		}
+
+		PendingFit fit;
+		fit.connection = connection;
+		fit.id = header.id;
+		fit.xy.resize((size_t)header.pointCount * 2);
+		if (!connection->socket.ReceiveAll(fit.xy.data(), fit.xy.size() * sizeof(double)))
+		{
+			break;
+		}
+
+		fit.arrival = Clock::now();
+		fit.isCached = false;
+		if (this->cache)
+		{
+			fit.key = ContentHash::Compute(fit.xy.data(), fit.xy.size() * sizeof(double), this->cacheSeed);
+			fit.isCached = this->cache->TryGet(fit.key, fit.cached);
+			if (fit.isCached && connection->pendingCount == 0)
+			{
+				// counted before it is sent, so the statistics the client asks for next include the request
+				const FitResponse response = MakeResponse(fit.id, fit.cached);
+				this->AddLatency(std::chrono::duration<double, std::micro>(Clock::now() - fit.arrival).count());
+				std::lock_guard<std::mutex> lock(connection->sendMutex);
+				if (!connection->socket.SendAll(&response, sizeof(response)))
+				{
+					break;
+				}
+
+				continue;
+			}
+		}
+
+		++connection->pendingCount;
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->pendingPointCount += header.pointCount;
+		this->pending.push_back(std::move(fit));
+		this->requestQueued.notify_one();
+	}
+
+	// a protocol error or the end of the connection - the pending responses of the connection fail to send
+	connection->socket.Shutdown();
+	connection->isFinished = true;
+}
+
+void FitServer::RunBatcher()
+{
+	const auto budget = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::micro>(this->options.latencyBudgetMicroseconds));
+	std::vector<PendingFit> batch;
+	std::unique_lock<std::mutex> lock(this->mutex);
+	for (;;)
+	{
+		this->requestQueued.wait(lock, [&]() { return this->isStopping || !this->pending.empty(); });
+		if (this->pending.empty())
+		{
+			break;
+		}
+
+		// wait for more requests as long as the oldest one can still be answered within the budget
+		const auto deadline = this->pending.front().arrival + budget;
+		while (this->pending.size() < this->options.maxBatchSize && !this->isStopping)
+		{
+			const double expectedSeconds = this->secondsPerBatch + this->secondsPerPoint * this->pendingPointCount;
+			const auto closeAt = deadline - std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(expectedSeconds));
+			if (Clock::now() >= closeAt)
+			{
+				break;
+			}
+
+			this->requestQueued.wait_until(lock, closeAt);
+		}
+
+		const size_t count = (std::min)(this->pending.size(), this->options.maxBatchSize);
+		batch.clear();
+		for (size_t i = 0; i < count; ++i)
+		{
+			this->pendingPointCount -= this->pending.front().xy.size() / 2;
+			batch.push_back(std::move(this->pending.front()));
+			this->pending.pop_front();
+		}
+
+		lock.unlock();
+		this->FitBatch(batch);
+		lock.lock();
+	}
+}
+
+void FitServer::FitBatch(std::vector<PendingFit>& batch)
+{
+	auto start = Clock::now();
+	std::vector<FitResponse> responses(batch.size());
+	size_t pointCount = 0;
+	auto fit = [&](size_t i)
+	{
+		PendingFit& item = batch[i];
+		if (!item.isCached)
+		{
+			const size_t count = item.xy.size() / 2;
+			item.cached.pointCount = count;
+			item.cached.ellipse = FitEllipse<double>(LeastSquareEllipseFitter<double>::PointAccessorFromRecords<double>::FromInterleaved(item.xy.data(), count));
+
+			if (this->cache)
+			{
+				this->cache->Put(item.key, item.cached);
+			}
+		}
+
+		responses[i] = MakeResponse(item.id, item.cached);
+	};
+
+	// a single request is fitted right here, handing it to a worker would only add latency
+	if (batch.size() == 1)
+	{
+		fit(0);
+	}
+	else
+	{
+		for (size_t i = 0; i < batch.size(); ++i)
+		{
+			this->pool.Submit([&fit, i]() { fit(i); });
+		}
+
+		this->pool.Wait();
+	}
+
+	for (const PendingFit& item : batch)
+	{
+		pointCount += item.xy.size() / 2;
+	}
+
+	const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+	// the batch and its requests are counted before the responses are sent, so the statistics a client asks for
+	// after receiving its responses include them
+	{
+		std::lock_guard<std::mutex> lock(this->statisticsMutex);
+		++this->batchCount;
+		this->batchSizeSum += batch.size();
+		this->maxBatchSize = (std::max)(this->maxBatchSize, (uint64_t)batch.size());
+	}
+
+	for (size_t i = 0; i < batch.size(); ++i)
+	{
+		this->AddLatency(std::chrono::duration<double, std::micro>(Clock::now() - batch[i].arrival).count());
+		{
+			std::lock_guard<std::mutex> lock(batch[i].connection->sendMutex);
+			batch[i].connection->socket.SendAll(&responses[i], sizeof(responses[i]));
+		}
+
+		--batch[i].connection->pendingCount;
+	}
+
+	// split the fit time into a part per batch and a part per point with exponential moving averages; the
+	// overhead is attributed to single requests, the rest to the points
+	const double smoothing = 0.1;
+	if (batch.size() == 1 && pointCount < 64)
+	{
+		this->secondsPerBatch += smoothing * (seconds - this->secondsPerBatch);
+	}
+	else if (pointCount > 0)
+	{
+		this->secondsPerPoint += smoothing * ((std::max)(seconds - this->secondsPerBatch, 0.0) / pointCount - this->secondsPerPoint);
+	}
+}
+
+void FitServer::AddLatency(double microseconds)
+{
+	std::lock_guard<std::mutex> lock(this->statisticsMutex);
+	++this->requestCount;
+	if (this->latencies.size() < this->options.latencyWindow)
+	{
+		this->latencies.push_back((float)microseconds);
+	}
+	else
+	{
+		this->latencies[this->nextLatency] = (float)microseconds;
+		this->nextLatency = (this->nextLatency + 1) % this->latencies.size();
+	}
+}
+
+FitClient::FitClient(const char* szPath)
+	: socket(LocalSocket::Connect(szPath)), nextId(0)
+{
+}
+
+uint32_t FitClient::SendFit(const double* x, const double* y, size_t count)
+{
+	FitRequestHeader header;
+	header.type = FitMessageType::Fit;
+	header.id = this->nextId++;
+	header.pointCount = (uint32_t)count;
+	header.reserved = 0;
+	std::vector<double> xy(count * 2);
+	for (size_t i = 0; i < count; ++i)
+	{
+		xy[2 * i] = x[i];
+		xy[2 * i + 1] = y[i];
+	}
+
+	if (!this->socket.SendAll(&header, sizeof(header)) || !this->socket.SendAll(xy.data(), xy.size() * sizeof(double)))
+	{
+		throw std::runtime_error("Couldn't send the request.");
+	}
+
+	return header.id;
+}
+
+FitResponse FitClient::ReceiveFit()
+{
+	FitResponse response;
+	if (!this->socket.ReceiveAll(&response, sizeof(response)) || response.type != FitMessageType::Fit)
+	{
+		throw std::runtime_error("Couldn't receive the response.");
+	}
+
+	return response;
+}
+
+FitResponse FitClient::Fit(const double* x, const double* y, size_t count)
+{
+	this->SendFit(x, y, count);
+	return this->ReceiveFit();
+}
+
+FitServerStatistics FitClient::GetStatistics()
+{
+	FitRequestHeader header;
+	header.type = FitMessageType::Statistics;
+	header.id = this->nextId++;
+	header.pointCount = 0;
+	header.reserved = 0;
+	StatisticsResponse response;
+	if (!this->socket.SendAll(&header, sizeof(header)) || !this->socket.ReceiveAll(&response, sizeof(response)) || response.type != FitMessageType::Statistics)
+	{
+		throw std::runtime_error("Couldn't get the statistics.");
+	}
+
+	return response.statistics;
+}
+
+/*static*/EllipseParameters<double> FitClient::GetEllipse(const FitResponse& response)
+{
+	if (response.status != FitStatus::Ok)
+	{
+		return EllipseParameters<double>::Invalid();
+	}
+
+	EllipseParameters<double> ellipse;
+	ellipse.x0 = response.x0;
+	ellipse.y0 = response.y0;
+	ellipse.a = response.a;
+	ellipse.b = response.b;
+	ellipse.theta = response.theta;
+	return ellipse;
+}
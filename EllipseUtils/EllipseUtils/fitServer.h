@@ -0,0 +1,225 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "ellipseParameters.h"
+#include "localSocket.h"
+#include "resultCache.h"
+#include "workStealingThreadPool.h"
+
+namespace EllipseUtils
+{
+	/// <summary>	The messages of the fit protocol. All fields are little-endian; a message starts with its type
+	/// 			and the id chosen by the client, which the response repeats. </summary>
+	enum class FitMessageType : uint32_t
+	{
+		/// <summary>	FitRequestHeader followed by pointCount pairs of doubles x, y; answered by FitResponse. </summary>
+		Fit = 1,
+
+		/// <summary>	FitRequestHeader with pointCount 0; answered by StatisticsResponse. </summary>
+		Statistics = 2
+	};
+
+	enum class FitStatus : uint32_t
+	{
+		Ok = 0,
+
+		/// <summary>	Fewer than five points. </summary>
+		TooFewPoints = 1,
+
+		/// <summary>	The points do not determine an ellipse, the parameters are NaN. </summary>
+		NoEllipse = 2
+	};
+
+	struct FitRequestHeader
+	{
+		FitMessageType type;
+		uint32_t id;
+		uint32_t pointCount;
+		uint32_t reserved;
+	};
+
+	struct FitResponse
+	{
+		FitMessageType type;
+		uint32_t id;
+		FitStatus status;
+		uint32_t pointCount;
+		double x0, y0, a, b, theta;
+	};
+
+	/// <summary>	The latencies are measured from the complete receipt of a request to its response being sent. The
+	/// 			percentiles are over the most recent requests (FitServerOptions::latencyWindow). </summary>
+	struct FitServerStatistics
+	{
+		uint64_t requestCount;
+		uint64_t batchCount;
+		uint64_t maxBatchSize;
+		double meanBatchSize;
+		double latencyP50Microseconds;
+		double latencyP90Microseconds;
+		double latencyP99Microseconds;
+		double latencyMaxMicroseconds;
+	};
+
+	struct StatisticsResponse
+	{
+		FitMessageType type;
+		uint32_t id;
+		FitStatus status;
+		uint32_t reserved;
+		FitServerStatistics statistics;
+	};
+
+	static_assert(sizeof(FitRequestHeader) == 16 && sizeof(FitResponse) == 56 && sizeof(StatisticsResponse) == 80, "The messages must not contain padding.");
+
+	struct FitServerOptions
+	{
+		/// <summary>	The longest time a request waits for other requests to join its batch. </summary>
+		double latencyBudgetMicroseconds = 200;
+
+		/// <summary>	A batch is fitted as soon as it has this many requests. </summary>
+		size_t maxBatchSize = 256;
+
+		/// <summary>	The number of threads fitting a batch, 0 means one per core. </summary>
+		unsigned int fitterThreads = 0;
+
+		/// <summary>	Requests with more points are rejected by closing the connection. </summary>
+		uint32_t maxPointsPerRequest = 1 << 24;
+
+		/// <summary>	The number of recent requests the latency percentiles are computed over. </summary>
+		size_t latencyWindow = 65536;
+
+		/// <summary>	The number of results kept to answer repeated point sets without a fit, 0 for no cache. </summary>
+		size_t cacheCapacity = 0;
+	};
+
+	/// <summary>	Serves fit requests on a Unix domain socket. Each connection has a thread which receives its
+	/// 			requests and queues them; a batcher thread collects the queued requests into batches and fits
+	/// 			each batch in parallel. A batch is closed when it is full or when waiting longer would make its
+	/// 			oldest request miss the latency budget, taking the expected fit time of the batch (measured on
+	/// 			the previous batches) into account - so under low load requests are fitted immediately, and
+	/// 			under high load the batches grow. Statistics requests are answered right away, and so are fit
+	/// 			requests for point sets found in the result cache (if there is one). </summary>
+	class FitServer
+	{
+	private:
+		typedef std::chrono::steady_clock Clock;
+
+		struct Connection
+		{
+			LocalSocket socket;
+			std::mutex sendMutex;
+			std::atomic<bool> isFinished;
+
+			/// <summary>	The fit requests queued but not answered yet - a cached result may only be sent right away
+			/// 			if there are none, to keep the responses in the order of the requests. </summary>
+			std::atomic<size_t> pendingCount;
+			std::thread thread;
+		};
+
+		struct PendingFit
+		{
+			std::shared_ptr<Connection> connection;
+			uint32_t id;
+			std::vector<double> xy;
+			Clock::time_point arrival;
+
+			/// <summary>	The content hash of xy, if there is a cache. </summary>
+			Hash128 key;
+
+			/// <summary>	Set if the result was found in the cache, but had to wait for earlier requests. </summary>
+			bool isCached;
+			CachedFit cached;
+		};
+
+		std::string path;
+		FitServerOptions options;
+		LocalSocket listener;
+		std::atomic<bool> isStopping;
+
+		std::mutex mutex;
+		std::condition_variable requestQueued;
+		std::deque<PendingFit> pending;
+		size_t pendingPointCount;
+		WorkStealingThreadPool pool;
+		std::unique_ptr<ResultLruCache> cache;
+		uint64_t cacheSeed;
+
+		/// <summary>	The fit time per point and per batch, as moving averages. </summary>
+		double secondsPerPoint;
+		double secondsPerBatch;
+
+		mutable std::mutex statisticsMutex;
+		uint64_t requestCount;
+		uint64_t batchCount;
+		uint64_t batchSizeSum;
+		uint64_t maxBatchSize;
+		std::vector<float> latencies;
+		size_t nextLatency;
+
+	public:
+		/// <summary>	Creates the socket, throws std::runtime_error. </summary>
+		FitServer(const char* szPath, const FitServerOptions& options = FitServerOptions());
+
+		/// <summary>	Removes the socket file. Run must have returned. </summary>
+		~FitServer();
+
+		FitServer(const FitServer&) = delete;
+		FitServer& operator=(const FitServer&) = delete;
+
+		/// <summary>	Accepts connections and serves them until Stop is called. </summary>
+		void Run();
+
+		/// <summary>	Makes Run return after closing the connections, may be called from any thread. </summary>
+		void Stop();
+
+		FitServerStatistics GetStatistics() const;
+
+		/// <summary>	Gets the statistics of the result cache, all zero without a cache. </summary>
+		ResultCacheStatistics GetCacheStatistics() const;
+
+	private:
+		void ServeConnection(const std::shared_ptr<Connection>& connection);
+
+		void RunBatcher();
+
+		void FitBatch(std::vector<PendingFit>& batch);
+
+		void AddLatency(double microseconds);
+	};
+
+	/// <summary>	A connection to a FitServer. Requests may be pipelined: the responses to the fit requests of one
+	/// 			client arrive in the order of the requests. Methods throw std::runtime_error if the connection
+	/// 			fails. </summary>
+	class FitClient
+	{
+	private:
+		LocalSocket socket;
+		uint32_t nextId;
+
+	public:
+		explicit FitClient(const char* szPath);
+
+		/// <summary>	Sends a fit request without waiting for the response, returns its id. </summary>
+		uint32_t SendFit(const double* x, const double* y, size_t count);
+
+		FitResponse ReceiveFit();
+
+		/// <summary>	Sends a fit request and waits for the response. </summary>
+		FitResponse Fit(const double* x, const double* y, size_t count);
+
+		/// <summary>	Gets the statistics of the server - there must be no fit responses outstanding. </summary>
+		FitServerStatistics GetStatistics();
+
+		static EllipseParameters<double> GetEllipse(const FitResponse& response);
+	};
+}
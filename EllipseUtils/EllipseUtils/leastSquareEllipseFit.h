@@ -1,7 +1,10 @@
 #pragma once
 
+#include <algorithm>
+#include <limits>
 #include "ellipseParameters.h"
 #include "inc_eigen.h"
+#include "momentAccumulator.h"
 
 namespace EllipseUtils
 {
@@ -63,34 +66,62 @@ namespace EllipseUtils
 			}
 		};
 
+		/// <summary>	Like PointAccessorFromTwoArrays, for arrays of another element type (e.g. float or int32_t). </summary>
+		template <typename tValue>
+		class PointAccessorFromTwoTypedArrays
+		{
+		private:
+			const tValue* ptrX;
+			const tValue* ptrY;
+			size_t count;
+		public:
+			PointAccessorFromTwoTypedArrays(const tValue* ptrX, const tValue* ptrY, size_t count)
+				: ptrX(ptrX), ptrY(ptrY), count(count)
+			{}
+
+			size_t GetLength() const
+			{
+				return this->count;
+			}
+
+			tFloat GetX(size_t index) const
+			{
+				return tFloat(this->ptrX[index]);
+			}
+
+			tFloat GetY(size_t index) const
+			{
+				return tFloat(this->ptrY[index]);
+			}
+		};
+
+		/// <summary>	Points in an array of records, see PointRecordAccessor. </summary>
+		template <typename tValue>
+		using PointAccessorFromRecords = PointRecordAccessor<tFloat, tValue>;
+
+		/// <summary>	The number of points needed to determine a conic. </summary>
+		static const size_t MinPointCount = 5;
+
 		template <typename PointAccessor>
 		static EllipseAlgebraicParameters<tFloat> Fit(const PointAccessor& ptAccessor)
 		{
-			auto numOfPoints = ptAccessor.GetLength();
-			tFloat mx, my; tFloat minX, minY, maxX, maxY;
-			CalcMeanMinMax([&](int index)->tFloat {return ptAccessor.GetX(index); }, ptAccessor.GetLength(), mx, minX, maxX);
-			CalcMeanMinMax([&](int index)->tFloat {return ptAccessor.GetY(index); }, ptAccessor.GetLength(), my, minY, maxY);
-			tFloat sx = (maxX - minX) / 2;
-			tFloat sy = (maxY - minY) / 2;
+			NormalizedMomentAccumulator<tFloat> moments(PointNormalization<tFloat>::FromPoints(ptAccessor));
+			moments.AddPoints(ptAccessor);
+			return Fit(moments);
+		}
 
+		static EllipseAlgebraicParameters<tFloat> Fit(const NormalizedMomentAccumulator<tFloat>& moments)
+		{
 			tFloat scatterM[6 * 6];
-			for (int r = 0; r < 6; ++r)
+			moments.GetScatterMatrix(scatterM);
+
+			// the reduction below needs the scatter matrix of the linear terms (x, y, 1) to be regular, which it is not
+			// for collinear points - and those do not determine an ellipse anyway (the result is NaN, see below)
+			if (IsCollinear(scatterM + (3 * 6) + 3, 6))
 			{
-				for (int c = 0; c < 6; ++c)
-				{
-					tFloat v = 0;
-					for (size_t k = 0; k < numOfPoints; ++k)
-					{
-						tFloat x = ptAccessor.GetX(k); tFloat y = ptAccessor.GetY(k);
-						x = (x - mx) / sx;
-						y = (y - my) / sy;
-						tFloat v1 = CalcDesignMatrixValue(r, x, y);
-						tFloat v2 = CalcDesignMatrixValue(c, x, y);
-						v += v1*v2;
-					}
-
-					scatterM[r * 6 + c] = v;
-				}
+				tFloat nanA[6];
+				std::fill(nanA, nanA + 6, std::numeric_limits<tFloat>::quiet_NaN());
+				return Denormalize(nanA, moments.GetNormalization());
 			}
 
 			tFloat tmpBtimestmpE[3 * 3];
@@ -114,25 +145,44 @@ namespace EllipseUtils
 
 			eigenSolver.compute(m, true);
 
-			int indexPositiveEigenValue = -1;
+			// the solution is the eigenvector which satisfies the ellipse constraint 4*a*c - b^2 > 0 (Halir and Flusser) -
+			// choosing by the sign of the eigenvalue fails for points exactly on an ellipse, where the eigenvalue of the
+			// exact conic is zero up to round-off; should more than one qualify, the one with the smallest residual wins
+			int indexEllipseEigenVector = -1;
 			auto eigenval = eigenSolver.eigenvalues();
+			auto eigenVecs = eigenSolver.eigenvectors();
 			for (int i = 0; i < 3; ++i)
 			{
-				if (eigenval[i].real() < 0)
+				const tFloat constraint = 4 * eigenVecs(0, i).real() * eigenVecs(2, i).real() - eigenVecs(1, i).real() * eigenVecs(1, i).real();
+				if (constraint > 0 && (indexEllipseEigenVector < 0 || std::abs(eigenval[i].real()) < std::abs(eigenval[indexEllipseEigenVector].real())))
 				{
-					indexPositiveEigenValue = i;
-					break;
+					indexEllipseEigenVector = i;
 				}
 			}
 
+			// no ellipse-specific solution - the result is NaN, which FromAlgebraicParameters
+			// reports as not an ellipse
 			tFloat A[6];
-			auto eigenVecs = eigenSolver.eigenvectors();
-			A[0] = eigenVecs(0, indexPositiveEigenValue).real();
-			A[1] = eigenVecs(1, indexPositiveEigenValue).real();
-			A[2] = eigenVecs(2, indexPositiveEigenValue).real();
+			if (indexEllipseEigenVector < 0)
+			{
+				std::fill(A, A + 6, std::numeric_limits<tFloat>::quiet_NaN());
+				return Denormalize(A, moments.GetNormalization());
+			}
+
+			A[0] = eigenVecs(0, indexEllipseEigenVector).real();
+			A[1] = eigenVecs(1, indexEllipseEigenVector).real();
+			A[2] = eigenVecs(2, indexEllipseEigenVector).real();
 
 			CalcLowerHalf(scatterM + 3, 6 * sizeof(tFloat), scatterM + (3 * 6) + 3, 6 * sizeof(tFloat), A, A + 3);
 
+			return Denormalize(A, moments.GetNormalization());
+		}
+
+		/// <summary>	Converts the coefficients A[0..5] of the conic in normalized coordinates (x'=(x-mx)/sx, y'=(y-my)/sy)
+		/// 			into the coefficients of the conic in the original coordinates. </summary>
+		static EllipseAlgebraicParameters<tFloat> Denormalize(const tFloat* A, const PointNormalization<tFloat>& normalization)
+		{
+			const tFloat mx = normalization.mx, my = normalization.my, sx = normalization.sx, sy = normalization.sy;
 			EllipseAlgebraicParameters<tFloat> params;
 			params.a = A[0] * sy*sy;
 			params.b = A[1] * sx*sy;
@@ -145,93 +195,33 @@ namespace EllipseUtils
 			return params;
 		}
 
-	private:
-		static tFloat CalcDesignMatrixValue(int col,tFloat x, tFloat y)
+		/// <summary>	The inverse of Denormalize - converts the conic into normalized coordinates. </summary>
+		static void Normalize(const EllipseAlgebraicParameters<tFloat>& params, const PointNormalization<tFloat>& normalization, tFloat* A)
 		{
-			switch (col)
-			{
-			case 0:return x*x;
-			case 1:return x*y;
-			case 2:return y*y;
-			case 3:return x;
-			case 4:return y;
-			case 5:return 1;
-			}
-
-			throw std::logic_error("Only expecting col to be in the range 0 to 5.");
+			const tFloat mx = normalization.mx, my = normalization.my, sx = normalization.sx, sy = normalization.sy;
+			A[0] = params.a * sx*sx;
+			A[1] = params.b * sx*sy;
+			A[2] = params.c * sy*sy;
+			A[3] = (2 * params.a*mx + params.b*my + params.d) * sx;
+			A[4] = (params.b*mx + 2 * params.c*my + params.e) * sy;
+			A[5] = params.a*mx*mx + params.b*mx*my + params.c*my*my + params.d*mx + params.e*my + params.f;
 		}
 
-		/*template <typename PointAccessor>
-		static tFloat CalcDesignMatrixValue(size_t col, size_t row, tFloat mx, tFloat my, tFloat sx, tFloat sy, const PointAccessor& ptAccessor)
-		{
-			switch (col)
-			{
-			case 0:
-			{
-				tFloat x = ptAccessor.GetX(row);
-				x = (x - mx) / sx;
-				return x*x;
-			}
-			case 1:
-			{
-				tFloat x = ptAccessor.GetX(row); tFloat y = ptAccessor.GetY(row);
-				x = (x - mx) / sx;
-				y = (y - my) / sy;
-				return x*y;
-			}
-			case 2:
-			{
-				tFloat y = ptAccessor.GetY(row);
-				y = (y - my) / sy;
-				return y*y;
-			}
-			case 3:
-			{
-				tFloat x = ptAccessor.GetX(row);
-				x = (x - mx) / sx;
-				return x;
-			}
-			case 4:
-			{
-				tFloat y = ptAccessor.GetY(row);
-				y = (y - my) / sy;
-				return y;
-			}
-			case 5:
-				return 1;
-			}
-
-			throw std::logic_error("Only expecting col to be in the range 0 to 5.");
-		}*/
-
-		static void CalcMeanMinMax(const std::function<tFloat(int)> getVal, size_t count, tFloat& mean, tFloat& min, tFloat& max)
+	private:
+		static tFloat squared(tFloat f)
 		{
-			min = (std::numeric_limits<tFloat>::max)();
-			max = (std::numeric_limits<tFloat>::min)();
-			mean = 0;
-
-			for (size_t i = 0; i < count; ++i)
-			{
-				tFloat value = getVal(i);
-				if (value < min)
-				{
-					min = value;
-				}
-
-				if (value > max)
-				{
-					max = value;
-				}
-
-				mean += value;
-			}
-
-			mean = mean / count;
+			return f*f;
 		}
 
-		static tFloat squared(tFloat f)
+		/// <summary>	Checks whether the scatter matrix of the linear terms (x, y, 1) is that of points on a line, i.e.
+		/// 			whether the covariance of x and y is singular up to round-off. </summary>
+		static bool IsCollinear(const tFloat* pC, int stride)
 		{
-			return f*f;
+			const tFloat n = pC[2 * stride + 2];
+			const tFloat covXX = pC[0] - pC[2] * pC[2] / n;
+			const tFloat covYY = pC[stride + 1] - pC[stride + 2] * pC[stride + 2] / n;
+			const tFloat covXY = pC[1] - pC[2] * pC[stride + 2] / n;
+			return !(covXX * covYY - covXY * covXY > 64 * std::numeric_limits<tFloat>::epsilon() * covXX * covYY);
 		}
 
 		static void CalcTmpBtimesTmpE(const tFloat* pB, int strideB, const tFloat* pC, int strideC, tFloat* pDest)
@@ -341,4 +331,29 @@ namespace EllipseUtils
 #undef c
 		}
 	};
+
+	/// <summary>	Fits an ellipse to the points of the accessor. The result is invalid for fewer than
+	/// 			LeastSquareEllipseFitter::MinPointCount points, and for points which determine no ellipse. </summary>
+	template <typename tFloat, typename PointAccessor>
+	EllipseParameters<tFloat> FitEllipse(const PointAccessor& ptAccessor)
+	{
+		if (ptAccessor.GetLength() < LeastSquareEllipseFitter<tFloat>::MinPointCount)
+		{
+			return EllipseParameters<tFloat>::Invalid();
+		}
+
+		return EllipseParameters<tFloat>::FromAlgebraicParameters(LeastSquareEllipseFitter<tFloat>::Fit(ptAccessor));
+	}
+
+	/// <summary>	Fits an ellipse to accumulated moments of points of weight one, so the weight sum is their number. </summary>
+	template <typename tFloat>
+	EllipseParameters<tFloat> FitEllipse(const NormalizedMomentAccumulator<tFloat>& moments)
+	{
+		if (!(moments.GetWeightSum() >= LeastSquareEllipseFitter<tFloat>::MinPointCount))
+		{
+			return EllipseParameters<tFloat>::Invalid();
+		}
+
+		return EllipseParameters<tFloat>::FromAlgebraicParameters(LeastSquareEllipseFitter<tFloat>::Fit(moments));
+	}
 }
\ No newline at end of file
@@ -0,0 +1,228 @@
+#include "stdafx.h"
+#include "localSocket.h"
+#include <cstring>
+#include <stdexcept>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <winsock2.h>
+#include <windows.h>
+#pragma comment(lib, "ws2_32.lib")
+
+// afunix.h is missing from SDKs before Windows 10 1803, the structure is the same as on POSIX systems
+struct sockaddr_un
+{
+	ADDRESS_FAMILY sun_family;
+	char sun_path[108];
+};
+
+typedef int socklen_t;
+static const uintptr_t InvalidHandle = INVALID_SOCKET;
+#else
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static const int InvalidHandle = -1;
+#endif
+
+using namespace EllipseUtils;
+
+#if defined(_WIN32)
+/// <summary>	Initializes Winsock once per process. </summary>
+static void InitializeSockets()
+{
+	struct Initializer
+	{
+		Initializer()
+		{
+			WSADATA data;
+			WSAStartup(MAKEWORD(2, 2), &data);
+		}
+	};
+
+	static Initializer initializer;
+}
+#endif
+
+static sockaddr_un GetAddress(const char* szPath)
+{
+	sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	const size_t length = strlen(szPath);
+	if (length >= sizeof(address.sun_path))
+	{
+		throw std::runtime_error("The socket path is too long.");
+	}
+
+	memcpy(address.sun_path, szPath, length);
+	return address;
+}
+
+LocalSocket::LocalSocket()
+	: handle(InvalidHandle)
+{
+}
+
+LocalSocket::~LocalSocket()
+{
+	this->Close();
+}
+
+LocalSocket::LocalSocket(LocalSocket&& other)
+	: handle(other.handle)
+{
+	other.handle = InvalidHandle;
+}
+
+LocalSocket& LocalSocket::operator=(LocalSocket&& other)
+{
+	if (this != &other)
+	{
+		this->Close();
+		this->handle = other.handle;
+		other.handle = InvalidHandle;
+	}
+
+	return *this;
+}
+
+/*static*/LocalSocket LocalSocket::Listen(const char* szPath, int backlog)
+{
+#if defined(_WIN32)
+	InitializeSockets();
+#endif
+	const sockaddr_un address = GetAddress(szPath);
+	RemovePath(szPath);
+	LocalSocket socket;
+	socket.handle = ::socket(AF_UNIX, SOCK_STREAM, 0);
+	if (socket.handle == InvalidHandle || bind(socket.handle, (const sockaddr*)&address, (socklen_t)sizeof(address)) != 0 || listen(socket.handle, backlog) != 0)
+	{
+		throw std::runtime_error("Couldn't listen on the socket.");
+	}
+
+	return socket;
+}
+
+/*static*/LocalSocket LocalSocket::Connect(const char* szPath)
+{
+#if defined(_WIN32)
+	InitializeSockets();
+#endif
+	const sockaddr_un address = GetAddress(szPath);
+	LocalSocket socket;
+	socket.handle = ::socket(AF_UNIX, SOCK_STREAM, 0);
+	if (socket.handle == InvalidHandle || connect(socket.handle, (const sockaddr*)&address, (socklen_t)sizeof(address)) != 0)
+	{
+		throw std::runtime_error("Couldn't connect to the socket.");
+	}
+
+	return socket;
+}
+
+LocalSocket LocalSocket::Accept()
+{
+	LocalSocket socket;
+	for (;;)
+	{
+		socket.handle = accept(this->handle, nullptr, nullptr);
+#if !defined(_WIN32)
+		if (socket.handle == InvalidHandle && errno == EINTR)
+		{
+			continue;
+		}
+#endif
+		return socket;
+	}
+}
+
+bool LocalSocket::IsOpen() const
+{
+	return this->handle != InvalidHandle;
+}
+
+bool LocalSocket::SendAll(const void* data, size_t size)
+{
+	const char* p = (const char*)data;
+	while (size > 0)
+	{
+		// a chunk of at most 1 GB, the length is an int on Windows
+#if defined(_WIN32)
+		const int n = send(this->handle, p, (int)(std::min)(size, (size_t)1 << 30), 0);
+#else
+		const ssize_t n = send(this->handle, p, (std::min)(size, (size_t)1 << 30), MSG_NOSIGNAL);
+		if (n < 0 && errno == EINTR)
+		{
+			continue;
+		}
+#endif
+		if (n <= 0)
+		{
+			return false;
+		}
+
+		p += n;
+		size -= (size_t)n;
+	}
+
+	return true;
+}
+
+bool LocalSocket::ReceiveAll(void* data, size_t size)
+{
+	char* p = (char*)data;
+	while (size > 0)
+	{
+#if defined(_WIN32)
+		const int n = recv(this->handle, p, (int)(std::min)(size, (size_t)1 << 30), 0);
+#else
+		const ssize_t n = recv(this->handle, p, (std::min)(size, (size_t)1 << 30), 0);
+		if (n < 0 && errno == EINTR)
+		{
+			continue;
+		}
+#endif
+		if (n <= 0)
+		{
+			return false;
+		}
+
+		p += n;
+		size -= (size_t)n;
+	}
+
+	return true;
+}
+
+void LocalSocket::Shutdown()
+{
+	if (this->handle != InvalidHandle)
+	{
+#if defined(_WIN32)
+		shutdown(this->handle, SD_BOTH);
+#else
+		shutdown(this->handle, SHUT_RDWR);
+#endif
+	}
+}
+
+void LocalSocket::Close()
+{
+	if (this->handle != InvalidHandle)
+	{
+#if defined(_WIN32)
+		closesocket(this->handle);
+#else
+		close(this->handle);
+#endif
+		this->handle = InvalidHandle;
+	}
+}
+
+/*static*/void LocalSocket::RemovePath(const char* szPath)
+{
+	remove(szPath);
+}
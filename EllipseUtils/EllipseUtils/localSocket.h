@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace EllipseUtils
+{
+	/// <summary>	A stream socket in the Unix domain (AF_UNIX, which Windows supports since Windows 10 1803), addressed
+	/// 			by a path in the file system. The socket is closed in the destructor. </summary>
+	class LocalSocket
+	{
+	private:
+#if defined(_WIN32)
+		uintptr_t handle;
+#else
+		int handle;
+#endif
+
+	public:
+		/// <summary>	Creates a socket which is not open. </summary>
+		LocalSocket();
+		~LocalSocket();
+
+		LocalSocket(LocalSocket&& other);
+		LocalSocket& operator=(LocalSocket&& other);
+
+		LocalSocket(const LocalSocket&) = delete;
+		LocalSocket& operator=(const LocalSocket&) = delete;
+
+		/// <summary>	Creates a socket listening at the path, a file left over at the path is removed first. Throws
+		/// 			std::runtime_error. </summary>
+		static LocalSocket Listen(const char* szPath, int backlog = 64);
+
+		/// <summary>	Connects to a listening socket, throws std::runtime_error. </summary>
+		static LocalSocket Connect(const char* szPath);
+
+		/// <summary>	Waits for a connection, returns a socket which is not open if accepting failed. </summary>
+		LocalSocket Accept();
+
+		bool IsOpen() const;
+
+		/// <summary>	Sends all bytes, returns false if the connection failed. </summary>
+		bool SendAll(const void* data, size_t size);
+
+		/// <summary>	Receives exactly size bytes, returns false if the connection was closed or failed before. </summary>
+		bool ReceiveAll(void* data, size_t size);
+
+		/// <summary>	Shuts down both directions, which makes blocking calls on the socket in other threads return. </summary>
+		void Shutdown();
+
+		void Close();
+
+		/// <summary>	Removes the file of a listening socket. </summary>
+		static void RemovePath(const char* szPath);
+	};
+}
@@ -0,0 +1,225 @@
+#include "stdafx.h"
+#include "mappedFile.h"
+#include <stdexcept>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace EllipseUtils;
+
+MappedFile::MappedFile(const char* szFilename, AccessPattern accessPattern)
+	: data(nullptr), size(0)
+{
+#if defined(_WIN32)
+	this->mappingHandle = nullptr;
+	DWORD flags = FILE_ATTRIBUTE_NORMAL;
+	if (accessPattern == AccessPattern::Sequential) { flags |= FILE_FLAG_SEQUENTIAL_SCAN; }
+	if (accessPattern == AccessPattern::Random) { flags |= FILE_FLAG_RANDOM_ACCESS; }
+	this->fileHandle = CreateFileA(szFilename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, flags, nullptr);
+	if (this->fileHandle == INVALID_HANDLE_VALUE)
+	{
+		this->fileHandle = nullptr;
+		throw std::runtime_error("Couldn't open file.");
+	}
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(this->fileHandle, &fileSize))
+	{
+		this->Close();
+		throw std::runtime_error("Couldn't determine the size of the file.");
+	}
+
+	this->size = (size_t)fileSize.QuadPart;
+	if (this->size == 0)
+	{
+		return;
+	}
+
+	this->mappingHandle = CreateFileMappingA(this->fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (this->mappingHandle != nullptr)
+	{
+		this->data = static_cast<const char*>(MapViewOfFile(this->mappingHandle, FILE_MAP_READ, 0, 0, 0));
+	}
+#else
+	this->fileDescriptor = open(szFilename, O_RDONLY);
+	if (this->fileDescriptor < 0)
+	{
+		throw std::runtime_error("Couldn't open file.");
+	}
+
+	struct stat fileStatus;
+	if (fstat(this->fileDescriptor, &fileStatus) != 0)
+	{
+		this->Close();
+		throw std::runtime_error("Couldn't determine the size of the file.");
+	}
+
+	this->size = (size_t)fileStatus.st_size;
+	if (this->size == 0)
+	{
+		return;
+	}
+
+	void* p = mmap(nullptr, this->size, PROT_READ, MAP_PRIVATE, this->fileDescriptor, 0);
+	if (p != MAP_FAILED)
+	{
+		this->data = static_cast<const char*>(p);
+		this->Advise(0, this->size, accessPattern);
+	}
+#endif
+
+	if (this->data == nullptr)
+	{
+		this->Close();
+		throw std::runtime_error("Couldn't map file.");
+	}
+}
+
+MappedFile::~MappedFile()
+{
+	this->Close();
+}
+
+MappedFile::MappedFile(MappedFile&& other)
+	: data(other.data), size(other.size)
+{
+#if defined(_WIN32)
+	this->fileHandle = other.fileHandle;
+	this->mappingHandle = other.mappingHandle;
+	other.fileHandle = other.mappingHandle = nullptr;
+#else
+	this->fileDescriptor = other.fileDescriptor;
+	other.fileDescriptor = -1;
+#endif
+	other.data = nullptr;
+	other.size = 0;
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other)
+{
+	if (this != &other)
+	{
+		this->Close();
+		this->data = other.data;
+		this->size = other.size;
+#if defined(_WIN32)
+		this->fileHandle = other.fileHandle;
+		this->mappingHandle = other.mappingHandle;
+		other.fileHandle = other.mappingHandle = nullptr;
+#else
+		this->fileDescriptor = other.fileDescriptor;
+		other.fileDescriptor = -1;
+#endif
+		other.data = nullptr;
+		other.size = 0;
+	}
+
+	return *this;
+}
+
+void MappedFile::Advise(size_t offset, size_t length, AccessPattern accessPattern) const
+{
+#if defined(_WIN32)
+	// on Windows the access pattern can only be given to CreateFile
+	(void)offset; (void)length; (void)accessPattern;
+#else
+	if (this->data == nullptr || offset >= this->size)
+	{
+		return;
+	}
+
+	// madvise requires a page-aligned address
+	size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+	size_t alignedOffset = offset - offset % pageSize;
+	length = (std::min)(length, this->size - offset) + (offset - alignedOffset);
+	int advice = accessPattern == AccessPattern::Sequential ? MADV_SEQUENTIAL : accessPattern == AccessPattern::Random ? MADV_RANDOM : MADV_NORMAL;
+	madvise(const_cast<char*>(this->data) + alignedOffset, length, advice);
+#endif
+}
+
+void MappedFile::Prefetch(size_t offset, size_t length) const
+{
+	if (this->data == nullptr || offset >= this->size)
+	{
+		return;
+	}
+
+	length = (std::min)(length, this->size - offset);
+#if defined(_WIN32)
+#if _WIN32_WINNT >= _WIN32_WINNT_WIN8
+	WIN32_MEMORY_RANGE_ENTRY range;
+	range.VirtualAddress = const_cast<char*>(this->data) + offset;
+	range.NumberOfBytes = length;
+	PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#endif
+#else
+	size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+	size_t alignedOffset = offset - offset % pageSize;
+	madvise(const_cast<char*>(this->data) + alignedOffset, length + (offset - alignedOffset), MADV_WILLNEED);
+#endif
+}
+
+void MappedFile::Release(size_t offset, size_t length) const
+{
+	if (this->data == nullptr || offset >= this->size)
+	{
+		return;
+	}
+
+	length = (std::min)(length, this->size - offset);
+#if defined(_WIN32)
+	// removes the pages from the working set, they stay in the file cache
+	VirtualUnlock(const_cast<char*>(this->data) + offset, length);
+#else
+	size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+	size_t alignedOffset = (offset + pageSize - 1) / pageSize * pageSize;
+	if (alignedOffset < offset + length)
+	{
+		madvise(const_cast<char*>(this->data) + alignedOffset, offset + length - alignedOffset, MADV_DONTNEED);
+	}
+#endif
+}
+
+void MappedFile::Close()
+{
+#if defined(_WIN32)
+	if (this->data != nullptr)
+	{
+		UnmapViewOfFile(this->data);
+	}
+
+	if (this->mappingHandle != nullptr)
+	{
+		CloseHandle(this->mappingHandle);
+	}
+
+	if (this->fileHandle != nullptr)
+	{
+		CloseHandle(this->fileHandle);
+	}
+
+	this->fileHandle = this->mappingHandle = nullptr;
+#else
+	if (this->data != nullptr)
+	{
+		munmap(const_cast<char*>(this->data), this->size);
+	}
+
+	if (this->fileDescriptor >= 0)
+	{
+		close(this->fileDescriptor);
+	}
+
+	this->fileDescriptor = -1;
+#endif
+	this->data = nullptr;
+	this->size = 0;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+
+namespace EllipseUtils
+{
+	/// <summary>	A file which is mapped read-only into memory (MapViewOfFile on Windows, mmap elsewhere). The mapping
+	/// 			is released in the destructor. An empty file results in a null data pointer and a size of zero. </summary>
+	class MappedFile
+	{
+	public:
+		enum class AccessPattern
+		{
+			Normal,
+			Sequential,
+			Random
+		};
+
+	private:
+		const char* data;
+		size_t size;
+#if defined(_WIN32)
+		void* fileHandle;
+		void* mappingHandle;
+#else
+		int fileDescriptor;
+#endif
+
+	public:
+		/// <summary>	Maps the file, throws std::runtime_error if it cannot be opened or mapped. </summary>
+		explicit MappedFile(const char* szFilename, AccessPattern accessPattern = AccessPattern::Normal);
+		~MappedFile();
+
+		MappedFile(MappedFile&& other);
+		MappedFile& operator=(MappedFile&& other);
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		const char* GetData() const
+		{
+			return this->data;
+		}
+
+		size_t GetSize() const
+		{
+			return this->size;
+		}
+
+		/// <summary>	Tells the operating system how the range [offset, offset+length) is going to be accessed (a hint,
+		/// 			which is ignored where it is not supported). </summary>
+		void Advise(size_t offset, size_t length, AccessPattern accessPattern) const;
+
+		/// <summary>	Asks the operating system to read the range [offset, offset+length) ahead, asynchronously where
+		/// 			possible. </summary>
+		void Prefetch(size_t offset, size_t length) const;
+
+		/// <summary>	Tells the operating system that the range [offset, offset+length) is no longer needed, so the
+		/// 			pages can be dropped from the working set. </summary>
+		void Release(size_t offset, size_t length) const;
+
+	private:
+		void Close();
+	};
+}
@@ -0,0 +1,334 @@
+#pragma once
+
+#include <limits>
+#include <stdexcept>
+#include "pointRecordAccessor.h"
+
+namespace EllipseUtils
+{
+	/// <summary>	The translation and scaling which is applied to the points before the moments are accumulated,
+	/// 			i.e. x' = (x - mx) / sx and y' = (y - my) / sy. </summary>
+	template<typename tFloat>
+	struct PointNormalization
+	{
+	public:
+		tFloat mx, my;
+		tFloat sx, sy;
+
+		/// <summary>	Determine the normalization from the mean and half the extent of the points. </summary>
+		template <typename PointAccessor>
+		static PointNormalization FromPoints(const PointAccessor& ptAccessor)
+		{
+			size_t numOfPoints = ptAccessor.GetLength();
+			tFloat minX = (std::numeric_limits<tFloat>::max)(), minY = (std::numeric_limits<tFloat>::max)();
+			tFloat maxX = std::numeric_limits<tFloat>::lowest(), maxY = std::numeric_limits<tFloat>::lowest();
+			tFloat sumX = 0, sumY = 0;
+			for (size_t i = 0; i < numOfPoints; ++i)
+			{
+				tFloat x = ptAccessor.GetX(i); tFloat y = ptAccessor.GetY(i);
+				minX = (std::min)(minX, x); maxX = (std::max)(maxX, x);
+				minY = (std::min)(minY, y); maxY = (std::max)(maxY, y);
+				sumX += x; sumY += y;
+			}
+
+			return FromMeanMinMax(sumX / numOfPoints, sumY / numOfPoints, minX, minY, maxX, maxY);
+		}
+
+		/// <summary>	Same as above, reading the records in blocks (see PointRecordAccessor::GetPoints). </summary>
+		template <typename tValue>
+		static PointNormalization FromPoints(const PointRecordAccessor<tFloat, tValue>& ptAccessor)
+		{
+			const size_t BlockSize = 256;
+			tFloat x[BlockSize], y[BlockSize];
+			size_t numOfPoints = ptAccessor.GetLength();
+			tFloat minX = (std::numeric_limits<tFloat>::max)(), minY = (std::numeric_limits<tFloat>::max)();
+			tFloat maxX = std::numeric_limits<tFloat>::lowest(), maxY = std::numeric_limits<tFloat>::lowest();
+			tFloat sumX = 0, sumY = 0;
+			for (size_t blockStart = 0; blockStart < numOfPoints; blockStart += BlockSize)
+			{
+				size_t n = (std::min)(BlockSize, numOfPoints - blockStart);
+				ptAccessor.GetPoints(blockStart, n, x, y);
+				for (size_t i = 0; i < n; ++i)
+				{
+					minX = (std::min)(minX, x[i]); maxX = (std::max)(maxX, x[i]);
+					minY = (std::min)(minY, y[i]); maxY = (std::max)(maxY, y[i]);
+					sumX += x[i]; sumY += y[i];
+				}
+			}
+
+			return FromMeanMinMax(sumX / numOfPoints, sumY / numOfPoints, minX, minY, maxX, maxY);
+		}
+
+		static PointNormalization FromMeanMinMax(tFloat mx, tFloat my, tFloat minX, tFloat minY, tFloat maxX, tFloat maxY)
+		{
+			PointNormalization n;
+			n.mx = mx;
+			n.my = my;
+			n.sx = (maxX - minX) / 2;
+			n.sy = (maxY - minY) / 2;
+
+			// guard against degenerate point sets (all points on a horizontal or vertical line)
+			if (!(n.sx > 0)) { n.sx = 1; }
+			if (!(n.sy > 0)) { n.sy = 1; }
+			return n;
+		}
+
+		/// <summary>	Returns a normalization with the same translation, but with the same scale in x and y. </summary>
+		PointNormalization Isotropic() const
+		{
+			PointNormalization n = *this;
+			n.sx = n.sy = (std::max)(this->sx, this->sy);
+			return n;
+		}
+
+		bool operator==(const PointNormalization& other) const
+		{
+			return this->mx == other.mx && this->my == other.my && this->sx == other.sx && this->sy == other.sy;
+		}
+	};
+
+	/// <summary>	Accumulates the (weighted) moments sum(w * x'^i * y'^j) with i+j <= 4 of the normalized points.
+	/// 			Those 15 sums are all that is needed in order to construct the scatter matrix of the
+	/// 			algebraic fit, so the points have to be visited only once. Accumulators with the same
+	/// 			normalization can be merged. </summary>
+	template<typename tFloat>
+	class NormalizedMomentAccumulator
+	{
+	public:
+		static const int MaxDegree = 4;
+		static const int MomentCount = 15;
+
+	private:
+		PointNormalization<tFloat> normalization;
+		tFloat invSx, invSy;
+		tFloat moments[MomentCount];
+
+	public:
+		explicit NormalizedMomentAccumulator(const PointNormalization<tFloat>& normalization)
+			: normalization(normalization), invSx(1 / normalization.sx), invSy(1 / normalization.sy)
+		{
+			this->Clear();
+		}
+
+		void Clear()
+		{
+			for (int i = 0; i < MomentCount; ++i)
+			{
+				this->moments[i] = 0;
+			}
+		}
+
+		const PointNormalization<tFloat>& GetNormalization() const
+		{
+			return this->normalization;
+		}
+
+		/// <summary>	Gets the moment sum(w * x'^i * y'^j). </summary>
+		tFloat GetMoment(int i, int j) const
+		{
+			return this->moments[MomentIndex(i, j)];
+		}
+
+		/// <summary>	Sets the moment sum(w * x'^i * y'^j), e.g. when restoring moments which were stored. </summary>
+		void SetMoment(int i, int j, tFloat value)
+		{
+			this->moments[MomentIndex(i, j)] = value;
+		}
+
+		/// <summary>	Gets the sum of the weights (or the number of points for unweighted accumulation). </summary>
+		tFloat GetWeightSum() const
+		{
+			return this->moments[0];
+		}
+
+		void Add(tFloat x, tFloat y)
+		{
+			this->AddNormalized((x - this->normalization.mx) * this->invSx, (y - this->normalization.my) * this->invSy, 1);
+		}
+
+		void Add(tFloat x, tFloat y, tFloat weight)
+		{
+			this->AddNormalized((x - this->normalization.mx) * this->invSx, (y - this->normalization.my) * this->invSy, weight);
+		}
+
+		template <typename PointAccessor>
+		void AddPoints(const PointAccessor& ptAccessor)
+		{
+			this->AddPoints(ptAccessor, 0, ptAccessor.GetLength());
+		}
+
+		/// <summary>	Adds the points with index in the range [start, end). </summary>
+		template <typename PointAccessor>
+		void AddPoints(const PointAccessor& ptAccessor, size_t start, size_t end)
+		{
+			tFloat s[MomentCount] = {};
+			const tFloat mx = this->normalization.mx, my = this->normalization.my;
+			for (size_t k = start; k < end; ++k)
+			{
+				tFloat x = (ptAccessor.GetX(k) - mx) * this->invSx;
+				tFloat y = (ptAccessor.GetY(k) - my) * this->invSy;
+				AccumulateMonomials(s, x, y, 1);
+			}
+
+			for (int i = 0; i < MomentCount; ++i)
+			{
+				this->moments[i] += s[i];
+			}
+		}
+
+		/// <summary>	Adds the points with index in the range [start, end) from an array of records. The points are
+		/// 			deinterleaved block-wise into two arrays first, so the accumulation runs on contiguous data. </summary>
+		template <typename tValue>
+		void AddPoints(const PointRecordAccessor<tFloat, tValue>& ptAccessor, size_t start, size_t end)
+		{
+			const size_t BlockSize = 256;
+			tFloat x[BlockSize], y[BlockSize];
+			tFloat s[MomentCount] = {};
+			const tFloat mx = this->normalization.mx, my = this->normalization.my;
+			for (size_t blockStart = start; blockStart < end; blockStart += BlockSize)
+			{
+				size_t n = (std::min)(BlockSize, end - blockStart);
+				ptAccessor.GetPoints(blockStart, n, x, y);
+				for (size_t k = 0; k < n; ++k)
+				{
+					AccumulateMonomials(s, (x[k] - mx) * this->invSx, (y[k] - my) * this->invSy, 1);
+				}
+			}
+
+			for (int i = 0; i < MomentCount; ++i)
+			{
+				this->moments[i] += s[i];
+			}
+		}
+
+		/// <summary>	Adds the points (x[k], y[k]) with k in [0, count). </summary>
+		void AddPointBlock(const tFloat* x, const tFloat* y, size_t count)
+		{
+			tFloat s[MomentCount] = {};
+			const tFloat mx = this->normalization.mx, my = this->normalization.my;
+			for (size_t k = 0; k < count; ++k)
+			{
+				AccumulateMonomials(s, (x[k] - mx) * this->invSx, (y[k] - my) * this->invSy, 1);
+			}
+
+			for (int i = 0; i < MomentCount; ++i)
+			{
+				this->moments[i] += s[i];
+			}
+		}
+
+		/// <summary>	Adds points which are already normalized, with the weights w. The loop is written such that it can
+		/// 			be vectorized. </summary>
+		void AddNormalizedPoints(const tFloat* x, const tFloat* y, const tFloat* w, size_t count)
+		{
+			tFloat s[MomentCount] = {};
+			for (size_t k = 0; k < count; ++k)
+			{
+				AccumulateMonomials(s, x[k], y[k], w[k]);
+			}
+
+			for (int i = 0; i < MomentCount; ++i)
+			{
+				this->moments[i] += s[i];
+			}
+		}
+
+		/// <summary>	Adds the moments of the other accumulator, which must use the same normalization. </summary>
+		void Merge(const NormalizedMomentAccumulator& other)
+		{
+			if (!(this->normalization == other.normalization))
+			{
+				throw std::logic_error("Only accumulators with the same normalization can be merged.");
+			}
+
+			for (int i = 0; i < MomentCount; ++i)
+			{
+				this->moments[i] += other.moments[i];
+			}
+		}
+
+		/// <summary>	Returns the moments expressed with respect to another normalization. Since the moments are
+		/// 			polynomial in the coordinates, this is an exact (binomial) transformation and does not
+		/// 			require the points. </summary>
+		NormalizedMomentAccumulator Renormalized(const PointNormalization<tFloat>& target) const
+		{
+			static const int binomial[MaxDegree + 1][MaxDegree + 1] =
+			{
+				{ 1, 0, 0, 0, 0 },
+				{ 1, 1, 0, 0, 0 },
+				{ 1, 2, 1, 0, 0 },
+				{ 1, 3, 3, 1, 0 },
+				{ 1, 4, 6, 4, 1 }
+			};
+
+			// x_target = alphaX * x_this + betaX
+			tFloat alphaX = this->normalization.sx / target.sx, betaX = (this->normalization.mx - target.mx) / target.sx;
+			tFloat alphaY = this->normalization.sy / target.sy, betaY = (this->normalization.my - target.my) / target.sy;
+			tFloat powAlphaX[MaxDegree + 1], powBetaX[MaxDegree + 1], powAlphaY[MaxDegree + 1], powBetaY[MaxDegree + 1];
+			powAlphaX[0] = powBetaX[0] = powAlphaY[0] = powBetaY[0] = 1;
+			for (int i = 1; i <= MaxDegree; ++i)
+			{
+				powAlphaX[i] = powAlphaX[i - 1] * alphaX; powBetaX[i] = powBetaX[i - 1] * betaX;
+				powAlphaY[i] = powAlphaY[i - 1] * alphaY; powBetaY[i] = powBetaY[i - 1] * betaY;
+			}
+
+			NormalizedMomentAccumulator result(target);
+			for (int i = 0; i <= MaxDegree; ++i)
+			{
+				for (int j = 0; i + j <= MaxDegree; ++j)
+				{
+					tFloat v = 0;
+					for (int a = 0; a <= i; ++a)
+					{
+						tFloat fx = binomial[i][a] * powAlphaX[a] * powBetaX[i - a];
+						for (int b = 0; b <= j; ++b)
+						{
+							v += fx * binomial[j][b] * powAlphaY[b] * powBetaY[j - b] * this->GetMoment(a, b);
+						}
+					}
+
+					result.moments[MomentIndex(i, j)] = v;
+				}
+			}
+
+			return result;
+		}
+
+		/// <summary>	Calculates the 6x6 scatter matrix D^T*D (row-major), where the rows of the design matrix D
+		/// 			are (x'^2, x'y', y'^2, x', y', 1). </summary>
+		void GetScatterMatrix(tFloat* scatterM) const
+		{
+			static const int exponentX[6] = { 2, 1, 0, 1, 0, 0 };
+			static const int exponentY[6] = { 0, 1, 2, 0, 1, 0 };
+			for (int r = 0; r < 6; ++r)
+			{
+				for (int c = 0; c < 6; ++c)
+				{
+					scatterM[r * 6 + c] = this->GetMoment(exponentX[r] + exponentX[c], exponentY[r] + exponentY[c]);
+				}
+			}
+		}
+
+	private:
+		static int MomentIndex(int i, int j)
+		{
+			int degree = i + j;
+			return degree * (degree + 1) / 2 + j;
+		}
+
+		void AddNormalized(tFloat x, tFloat y, tFloat w)
+		{
+			AccumulateMonomials(this->moments, x, y, w);
+		}
+
+		static void AccumulateMonomials(tFloat* s, tFloat x, tFloat y, tFloat w)
+		{
+			tFloat xx = x*x, xy = x*y, yy = y*y;
+			s[0] += w;
+			s[1] += w*x; s[2] += w*y;
+			s[3] += w*xx; s[4] += w*xy; s[5] += w*yy;
+			s[6] += w*xx*x; s[7] += w*xx*y; s[8] += w*x*yy; s[9] += w*yy*y;
+			s[10] += w*xx*xx; s[11] += w*xx*xy; s[12] += w*xx*yy; s[13] += w*xy*yy; s[14] += w*yy*yy;
+		}
+	};
+}
@@ -0,0 +1,168 @@
+#include "stdafx.h"
+#include "momentSummary.h"
+#include "leastSquareEllipseFit.h"
+#include <cstring>
+#include <stdexcept>
+
+using namespace EllipseUtils;
+
+/*static*/const size_t MomentSummary::SerializedSize;
+/*static*/const uint32_t MomentSummary::Version;
+
+static const char SummaryMagic[8] = { 'E', 'L', 'L', 'M', 'O', 'M', '\r', '\n' };
+
+/// <summary>	The identity normalization, used by empty summaries. </summary>
+static PointNormalization<double> GetIdentityNormalization()
+{
+	PointNormalization<double> normalization;
+	normalization.mx = normalization.my = 0;
+	normalization.sx = normalization.sy = 1;
+	return normalization;
+}
+
+MomentSummary::MomentSummary()
+	: moments(GetIdentityNormalization()), pointCount(0), minX(0), minY(0), maxX(0), maxY(0)
+{
+}
+
+void MomentSummary::Merge(const MomentSummary& other)
+{
+	if (other.pointCount == 0)
+	{
+		return;
+	}
+
+	if (this->pointCount == 0)
+	{
+		*this = other;
+		return;
+	}
+
+	// the mean of the union from the first moments, sum(x) = n * mx + sx * sum(x')
+	const PointNormalization<double>& a = this->moments.GetNormalization();
+	const PointNormalization<double>& b = other.moments.GetNormalization();
+	const double weightSum = this->moments.GetWeightSum() + other.moments.GetWeightSum();
+	const double meanX = (a.mx * this->moments.GetWeightSum() + a.sx * this->moments.GetMoment(1, 0) + b.mx * other.moments.GetWeightSum() + b.sx * other.moments.GetMoment(1, 0)) / weightSum;
+	const double meanY = (a.my * this->moments.GetWeightSum() + a.sy * this->moments.GetMoment(0, 1) + b.my * other.moments.GetWeightSum() + b.sy * other.moments.GetMoment(0, 1)) / weightSum;
+	this->minX = (std::min)(this->minX, other.minX);
+	this->minY = (std::min)(this->minY, other.minY);
+	this->maxX = (std::max)(this->maxX, other.maxX);
+	this->maxY = (std::max)(this->maxY, other.maxY);
+
+	const PointNormalization<double> target = PointNormalization<double>::FromMeanMinMax(meanX, meanY, this->minX, this->minY, this->maxX, this->maxY);
+	NormalizedMomentAccumulator<double> merged = this->moments.Renormalized(target);
+	merged.Merge(other.moments.Renormalized(target));
+	this->moments = merged;
+	this->pointCount += other.pointCount;
+}
+
+EllipseAlgebraicParameters<double> MomentSummary::Solve() const
+{
+	if (this->pointCount == 0)
+	{
+		throw std::logic_error("The summary contains no points.");
+	}
+
+	return LeastSquareEllipseFitter<double>::Fit(this->moments);
+}
+
+void MomentSummary::Serialize(void* dest) const
+{
+	char* p = static_cast<char*>(dest);
+	const uint32_t header[2] = { Version, 0 };
+	const PointNormalization<double>& normalization = this->moments.GetNormalization();
+	const double values[8] = { normalization.mx, normalization.my, normalization.sx, normalization.sy, this->minX, this->minY, this->maxX, this->maxY };
+	memcpy(p, SummaryMagic, 8);
+	memcpy(p + 8, header, 8);
+	memcpy(p + 16, &this->pointCount, 8);
+	memcpy(p + 24, values, sizeof(values));
+	p += 24 + sizeof(values);
+	for (int degree = 0; degree <= NormalizedMomentAccumulator<double>::MaxDegree; ++degree)
+	{
+		for (int j = 0; j <= degree; ++j, p += 8)
+		{
+			const double moment = this->moments.GetMoment(degree - j, j);
+			memcpy(p, &moment, 8);
+		}
+	}
+}
+
+/*static*/MomentSummary MomentSummary::Deserialize(const void* data, size_t size)
+{
+	const char* p = static_cast<const char*>(data);
+	if (size < SerializedSize || memcmp(p, SummaryMagic, 8) != 0)
+	{
+		throw std::runtime_error("Not a moment summary.");
+	}
+
+	uint32_t header[2];
+	memcpy(header, p + 8, 8);
+	if (header[0] != Version)
+	{
+		throw std::runtime_error("Unsupported version of moment summary.");
+	}
+
+	MomentSummary summary;
+	double values[8];
+	memcpy(&summary.pointCount, p + 16, 8);
+	memcpy(values, p + 24, sizeof(values));
+	if (!(values[2] > 0) || !(values[3] > 0))
+	{
+		throw std::runtime_error("Invalid normalization in moment summary.");
+	}
+
+	PointNormalization<double> normalization;
+	normalization.mx = values[0];
+	normalization.my = values[1];
+	normalization.sx = values[2];
+	normalization.sy = values[3];
+	summary.minX = values[4];
+	summary.minY = values[5];
+	summary.maxX = values[6];
+	summary.maxY = values[7];
+	summary.moments = NormalizedMomentAccumulator<double>(normalization);
+	p += 24 + sizeof(values);
+	for (int degree = 0; degree <= NormalizedMomentAccumulator<double>::MaxDegree; ++degree)
+	{
+		for (int j = 0; j <= degree; ++j, p += 8)
+		{
+			double moment;
+			memcpy(&moment, p, 8);
+			summary.moments.SetMoment(degree - j, j, moment);
+		}
+	}
+
+	return summary;
+}
+
+/*static*/MomentSummary MomentSummary::ReadFile(const char* szFilename)
+{
+	FILE* fp;
+	if (fopen_s(&fp, szFilename, "rb") != 0)
+	{
+		throw std::runtime_error("Couldn't open file.");
+	}
+
+	char buffer[SerializedSize];
+	const size_t size = fread(buffer, 1, sizeof(buffer), fp);
+	fclose(fp);
+	return Deserialize(buffer, size);
+}
+
+void MomentSummary::WriteFile(const char* szFilename) const
+{
+	char buffer[SerializedSize];
+	this->Serialize(buffer);
+	FILE* fp;
+	if (fopen_s(&fp, szFilename, "wb") != 0)
+	{
+		throw std::runtime_error("Couldn't create file.");
+	}
+
+	bool ok = fwrite(buffer, 1, sizeof(buffer), fp) == sizeof(buffer);
+	ok = fclose(fp) == 0 && ok;
+	if (!ok)
+	{
+		throw std::runtime_error("Couldn't write file.");
+	}
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "ellipseParameters.h"
+#include "momentAccumulator.h"
+
+namespace EllipseUtils
+{
+	/// <summary>	The state of an ellipse fit over a set of points: the normalization, the number of points, their
+	/// 			bounding box and the 15 moments of the normalized points. Since the fit depends only on the
+	/// 			moments, summaries of parts of a point set (e.g. shards on different machines) can be merged
+	/// 			into the summary of the whole set and solved there.
+	/// 			The serialized form has a fixed layout of SerializedSize bytes, all little-endian:
+	/// 				magic "ELLMOM\r\n", version (uint32), reserved (uint32), point count (uint64),
+	/// 				mx, my, sx, sy, minX, minY, maxX, maxY, then the moments sum(x'^i * y'^j) by degree
+	/// 				i + j = 0..4 and, within a degree, by increasing j (all double). </summary>
+	class MomentSummary
+	{
+	public:
+		static const size_t SerializedSize = 208;
+		static const uint32_t Version = 1;
+
+	private:
+		NormalizedMomentAccumulator<double> moments;
+		uint64_t pointCount;
+		double minX, minY, maxX, maxY;
+
+	public:
+		/// <summary>	Creates the summary of no points. </summary>
+		MomentSummary();
+
+		/// <summary>	Summarizes the points, normalized like LeastSquareEllipseFitter::Fit does. </summary>
+		template <typename PointAccessor>
+		static MomentSummary FromPoints(const PointAccessor& accessor)
+		{
+			MomentSummary summary;
+			const size_t count = accessor.GetLength();
+			if (count == 0)
+			{
+				return summary;
+			}
+
+			double sumX = 0, sumY = 0;
+			summary.minX = summary.minY = (std::numeric_limits<double>::max)();
+			summary.maxX = summary.maxY = std::numeric_limits<double>::lowest();
+			for (size_t i = 0; i < count; ++i)
+			{
+				const double x = accessor.GetX(i), y = accessor.GetY(i);
+				summary.minX = (std::min)(summary.minX, x); summary.maxX = (std::max)(summary.maxX, x);
+				summary.minY = (std::min)(summary.minY, y); summary.maxY = (std::max)(summary.maxY, y);
+				sumX += x; sumY += y;
+			}
+
+			summary.moments = NormalizedMomentAccumulator<double>(PointNormalization<double>::FromMeanMinMax(sumX / count, sumY / count, summary.minX, summary.minY, summary.maxX, summary.maxY));
+			summary.moments.AddPoints(accessor);
+			summary.pointCount = count;
+			return summary;
+		}
+
+		uint64_t GetPointCount() const
+		{
+			return this->pointCount;
+		}
+
+		const NormalizedMomentAccumulator<double>& GetMoments() const
+		{
+			return this->moments;
+		}
+
+		/// <summary>	Adds the points of the other summary. Both are re-expressed exactly (see
+		/// 			NormalizedMomentAccumulator::Renormalized) in the normalization the union of the points would
+		/// 			get: its mean and half its extent. Merging is commutative and associative up to rounding. </summary>
+		void Merge(const MomentSummary& other);
+
+		/// <summary>	Fits the ellipse to the summarized points. Throws std::logic_error for an empty summary. </summary>
+		EllipseAlgebraicParameters<double> Solve() const;
+
+		/// <summary>	Writes SerializedSize bytes to dest. </summary>
+		void Serialize(void* dest) const;
+
+		/// <summary>	Reads a serialized summary, throws std::runtime_error if it is not one of this version. </summary>
+		static MomentSummary Deserialize(const void* data, size_t size);
+
+		/// <summary>	Reads and writes a file holding one summary, throws std::runtime_error. </summary>
+		static MomentSummary ReadFile(const char* szFilename);
+		void WriteFile(const char* szFilename) const;
+	};
+}
@@ -0,0 +1,252 @@
+#include "stdafx.h"
+#include "npyFile.h"
+
+using namespace EllipseUtils;
+
+static const char Magic[6] = { '\x93', 'N', 'U', 'M', 'P', 'Y' };
+
+/// <summary>	Finds the value of the key in the header dictionary, returns the position after the colon. </summary>
+static size_t FindValue(const std::string& header, const char* key)
+{
+	size_t position = header.find(std::string("'") + key + "'");
+	if (position == std::string::npos)
+	{
+		position = header.find(std::string("\"") + key + "\"");
+	}
+
+	if (position == std::string::npos || (position = header.find(':', position)) == std::string::npos)
+	{
+		throw std::runtime_error(std::string("The .npy header has no \"") + key + "\".");
+	}
+
+	position = header.find_first_not_of(" \t", position + 1);
+	if (position == std::string::npos)
+	{
+		throw std::runtime_error("The .npy header is truncated.");
+	}
+
+	return position;
+}
+
+NpyFile::NpyFile(const char* szFilename)
+	: file(szFilename)
+{
+	ParseHeader(this->file.GetData(), this->file.GetSize(), this->dataType, this->shape, this->fortranOrder, this->dataOffset);
+}
+
+PointArrayView NpyFile::GetPoints() const
+{
+	if (this->shape.size() != 2 || (this->shape[0] != 2 && this->shape[1] != 2))
+	{
+		throw std::runtime_error("Expected an array with the shape (N,2) or (2,N).");
+	}
+
+	const size_t elementSize = BinaryPointFile::GetElementSize(this->dataType);
+	const char* data = static_cast<const char*>(this->GetData());
+
+	// (N,2) in C order and (2,N) in Fortran order are interleaved, the other two are planar
+	bool isPointsInRows = this->shape[1] == 2;
+	size_t count = (size_t)(isPointsInRows ? this->shape[0] : this->shape[1]);
+	if (isPointsInRows != this->fortranOrder)
+	{
+		return PointArrayView{ this->dataType, data, data + elementSize, count, 2 };
+	}
+
+	return PointArrayView{ this->dataType, data, data + count * elementSize, count, 1 };
+}
+
+/*static*/PointArrayView NpyFile::GetPoints(const NpyFile& x, const NpyFile& y)
+{
+	if (x.shape.size() != 1 || y.shape.size() != 1 || x.shape[0] != y.shape[0] || x.dataType != y.dataType)
+	{
+		throw std::runtime_error("Expected two 1-D arrays with the same length and type.");
+	}
+
+	return PointArrayView{ x.dataType, x.GetData(), y.GetData(), (size_t)x.shape[0], 1 };
+}
+
+/*static*/bool NpyFile::IsNpyFile(const char* szFilename)
+{
+	FILE* fp;
+	if (fopen_s(&fp, szFilename, "rb") != 0)
+	{
+		return false;
+	}
+
+	char magic[sizeof(Magic)];
+	bool isNpy = fread(magic, 1, sizeof(magic), fp) == sizeof(magic) && memcmp(magic, Magic, sizeof(Magic)) == 0;
+	fclose(fp);
+	return isNpy;
+}
+
+/*static*/void NpyFile::ParseHeader(const char* data, size_t size, PointDataType& dataType, std::vector<uint64_t>& shape, bool& fortranOrder, size_t& dataOffset)
+{
+	if (size < 10 || memcmp(data, Magic, sizeof(Magic)) != 0)
+	{
+		throw std::runtime_error("Not an .npy file.");
+	}
+
+	const unsigned char major = static_cast<unsigned char>(data[6]);
+	size_t headerOffset, headerLength;
+	if (major == 1)
+	{
+		headerOffset = 10;
+		headerLength = static_cast<unsigned char>(data[8]) | (static_cast<unsigned char>(data[9]) << 8);
+	}
+	else if (major == 2 || major == 3)
+	{
+		if (size < 12)
+		{
+			throw std::runtime_error("The .npy header is truncated.");
+		}
+
+		headerOffset = 12;
+		headerLength = 0;
+		for (int i = 3; i >= 0; --i)
+		{
+			headerLength = (headerLength << 8) | static_cast<unsigned char>(data[8 + i]);
+		}
+	}
+	else
+	{
+		throw std::runtime_error("Unsupported version of the .npy format.");
+	}
+
+	if (headerLength > size - headerOffset)
+	{
+		throw std::runtime_error("The .npy header is truncated.");
+	}
+
+	const std::string header(data + headerOffset, headerLength);
+	dataOffset = headerOffset + headerLength;
+
+	// 'descr': '<f8'
+	size_t position = FindValue(header, "descr");
+	char quote = header[position];
+	size_t end = header.find(quote, position + 1);
+	if ((quote != '\'' && quote != '"') || end == std::string::npos)
+	{
+		throw std::runtime_error("Unsupported \"descr\" in the .npy header.");
+	}
+
+	std::string descr = header.substr(position + 1, end - position - 1);
+	if (descr == "<f4" || descr == "=f4")
+	{
+		dataType = PointDataType::Float32;
+	}
+	else if (descr == "<f8" || descr == "=f8")
+	{
+		dataType = PointDataType::Float64;
+	}
+	else if (descr == "<i4" || descr == "=i4")
+	{
+		dataType = PointDataType::Int32;
+	}
+	else
+	{
+		throw std::runtime_error("Unsupported data type \"" + descr + "\" in the .npy file (supported: <f4, <f8, <i4).");
+	}
+
+	// 'fortran_order': False
+	position = FindValue(header, "fortran_order");
+	if (header.compare(position, 4, "True") == 0)
+	{
+		fortranOrder = true;
+	}
+	else if (header.compare(position, 5, "False") == 0)
+	{
+		fortranOrder = false;
+	}
+	else
+	{
+		throw std::runtime_error("Invalid \"fortran_order\" in the .npy header.");
+	}
+
+	// 'shape': (1000, 2)
+	position = FindValue(header, "shape");
+	end = header.find(')', position);
+	if (header[position] != '(' || end == std::string::npos)
+	{
+		throw std::runtime_error("Invalid \"shape\" in the .npy header.");
+	}
+
+	shape.clear();
+	uint64_t elementCount = 1;
+	const char* p = header.c_str() + position + 1;
+	const char* shapeEnd = header.c_str() + end;
+	while (p < shapeEnd)
+	{
+		while (p < shapeEnd && (*p == ' ' || *p == ','))
+		{
+			++p;
+		}
+
+		if (p == shapeEnd)
+		{
+			break;
+		}
+
+		char* next;
+		unsigned long long dimension = strtoull(p, &next, 10);
+		if (next == p || dimension > (uint64_t)size)
+		{
+			throw std::runtime_error("Invalid \"shape\" in the .npy header.");
+		}
+
+		shape.push_back(dimension);
+		elementCount *= dimension;
+		if (elementCount > (uint64_t)size)
+		{
+			throw std::runtime_error("The .npy file is smaller than its shape.");
+		}
+
+		p = next;
+	}
+
+	const size_t elementSize = BinaryPointFile::GetElementSize(dataType);
+	if (elementCount * elementSize > size - dataOffset)
+	{
+		throw std::runtime_error("The .npy file is smaller than its shape.");
+	}
+
+	if (dataOffset % elementSize != 0)
+	{
+		throw std::runtime_error("The data in the .npy file is not aligned.");
+	}
+}
+
+/*static*/void NpyFile::Write(const char* szFilename, PointDataType dataType, const std::vector<uint64_t>& shape, bool fortranOrder, const void* data)
+{
+	static const char* descrs[] = { "<f4", "<f8", "<i4" };
+	std::string header = std::string("{'descr': '") + descrs[(int)dataType] + "', 'fortran_order': " + (fortranOrder ? "True" : "False") + ", 'shape': (";
+	uint64_t elementCount = 1;
+	for (size_t i = 0; i < shape.size(); ++i)
+	{
+		header += std::to_string(shape[i]) + (shape.size() == 1 || i + 1 < shape.size() ? "," : "");
+		elementCount *= shape[i];
+	}
+
+	header += "), }";
+
+	// the data starts at a multiple of 64 bytes, the header ends with a newline
+	size_t totalLength = (10 + header.size() + 1 + 63) / 64 * 64;
+	header.append(totalLength - 10 - header.size() - 1, ' ');
+	header += '\n';
+
+	FILE* fp;
+	if (fopen_s(&fp, szFilename, "wb") != 0)
+	{
+		throw std::runtime_error("Couldn't create file.");
+	}
+
+	const unsigned char preamble[10] = { 0x93, 'N', 'U', 'M', 'P', 'Y', 1, 0, (unsigned char)(header.size() & 0xff), (unsigned char)(header.size() >> 8) };
+	const size_t dataSize = (size_t)elementCount * BinaryPointFile::GetElementSize(dataType);
+	bool ok = fwrite(preamble, 1, sizeof(preamble), fp) == sizeof(preamble) &&
+		fwrite(header.data(), 1, header.size(), fp) == header.size() &&
+		(dataSize == 0 || fwrite(data, 1, dataSize, fp) == dataSize);
+	ok = fclose(fp) == 0 && ok;
+	if (!ok)
+	{
+		throw std::runtime_error("Couldn't write file.");
+	}
+}
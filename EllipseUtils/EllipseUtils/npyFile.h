@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "mappedFile.h"
+#include "pointArrayView.h"
+
+namespace EllipseUtils
+{
+	/// <summary>	A memory-mapped NumPy .npy file (format versions 1 to 3, little-endian float32, float64 or int32).
+	/// 			The points are used in place, see GetPoints. </summary>
+	class NpyFile
+	{
+	private:
+		MappedFile file;
+		PointDataType dataType;
+		std::vector<uint64_t> shape;
+		bool fortranOrder;
+		size_t dataOffset;
+
+	public:
+		/// <summary>	Maps the file and parses the header, throws std::runtime_error if the file is not a supported
+		/// 			.npy file or is too small for the shape given in the header. </summary>
+		explicit NpyFile(const char* szFilename);
+
+		PointDataType GetDataType() const
+		{
+			return this->dataType;
+		}
+
+		const std::vector<uint64_t>& GetShape() const
+		{
+			return this->shape;
+		}
+
+		bool IsFortranOrder() const
+		{
+			return this->fortranOrder;
+		}
+
+		const void* GetData() const
+		{
+			return this->file.GetData() + this->dataOffset;
+		}
+
+		/// <summary>	The offset of the array data from the start of the file. </summary>
+		size_t GetDataOffset() const
+		{
+			return this->dataOffset;
+		}
+
+		/// <summary>	Gets the points of an array with shape (N,2) or (2,N), in C or Fortran order. Throws
+		/// 			std::runtime_error for other shapes. </summary>
+		PointArrayView GetPoints() const;
+
+		/// <summary>	Gets the points from two 1-D arrays of the same type and length. </summary>
+		static PointArrayView GetPoints(const NpyFile& x, const NpyFile& y);
+
+		static bool IsNpyFile(const char* szFilename);
+
+		/// <summary>	Parses the header of an .npy file in memory, throws std::runtime_error. </summary>
+		static void ParseHeader(const char* data, size_t size, PointDataType& dataType, std::vector<uint64_t>& shape, bool& fortranOrder, size_t& dataOffset);
+
+		/// <summary>	Writes an .npy file (version 1.0), mainly for tests and tools. </summary>
+		static void Write(const char* szFilename, PointDataType dataType, const std::vector<uint64_t>& shape, bool fortranOrder, const void* data);
+	};
+}
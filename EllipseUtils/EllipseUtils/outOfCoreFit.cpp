@@ -0,0 +1,233 @@
+#include "stdafx.h"
+#include "outOfCoreFit.h"
+#include <stdexcept>
+
+using namespace EllipseUtils;
+
+/// <summary>	Where the coordinates are in the file(s). </summary>
+struct FilePointLayout
+{
+	PointDataType dataType;
+	uint64_t count;
+	const char* xFilename;
+	const char* yFilename;
+	uint64_t xOffset, yOffset;
+
+	/// <summary>	x0 y0 x1 y1 ... starting at xOffset, otherwise two arrays. </summary>
+	bool isInterleaved;
+
+	/// <summary>	Set if the bounding box is known without reading the points. </summary>
+	bool hasBounds;
+	double minX, minY, maxX, maxY;
+};
+
+/// <summary>	The bounding box and the sums of the coordinates of the points seen so far. </summary>
+struct PointBounds
+{
+	double minX = (std::numeric_limits<double>::max)(), minY = (std::numeric_limits<double>::max)();
+	double maxX = std::numeric_limits<double>::lowest(), maxY = std::numeric_limits<double>::lowest();
+	double sumX = 0, sumY = 0;
+	uint64_t count = 0;
+
+	template <typename PointAccessor>
+	void Add(const PointAccessor& accessor)
+	{
+		// the sums of a chunk are added to the totals, which keeps the rounding error of the mean small
+		double chunkSumX = 0, chunkSumY = 0;
+		const size_t n = accessor.GetLength();
+		for (size_t i = 0; i < n; ++i)
+		{
+			const double x = accessor.GetX(i), y = accessor.GetY(i);
+			this->minX = (std::min)(this->minX, x); this->maxX = (std::max)(this->maxX, x);
+			this->minY = (std::min)(this->minY, y); this->maxY = (std::max)(this->maxY, y);
+			chunkSumX += x; chunkSumY += y;
+		}
+
+		this->sumX += chunkSumX;
+		this->sumY += chunkSumY;
+		this->count += n;
+	}
+
+	PointNormalization<double> GetNormalization() const
+	{
+		return PointNormalization<double>::FromMeanMinMax(this->sumX / this->count, this->sumY / this->count, this->minX, this->minY, this->maxX, this->maxY);
+	}
+};
+
+static FilePointLayout GetLayout(const char* szFilename, const PointFileOptions& options)
+{
+	// the files are mapped only to parse the headers, which does not read the points
+	FilePointLayout layout = {};
+	layout.xFilename = layout.yFilename = szFilename;
+	if (options.yFilename != nullptr)
+	{
+		NpyFile x(szFilename), y(options.yFilename);
+		const PointArrayView view = NpyFile::GetPoints(x, y);
+		layout.dataType = view.dataType;
+		layout.count = view.count;
+		layout.yFilename = options.yFilename;
+		layout.xOffset = x.GetDataOffset();
+		layout.yOffset = y.GetDataOffset();
+	}
+	else if (options.isRaw)
+	{
+		uint64_t fileSize;
+		{
+			ChunkedFileReader file(szFilename, ChunkedFileReader::Method::Read, 1);
+			fileSize = file.GetFileSize();
+		}
+
+		const size_t elementSize = BinaryPointFile::GetElementSize(options.rawDataType);
+		if (fileSize % (2 * elementSize) != 0)
+		{
+			throw std::runtime_error("The size of the raw array is not a multiple of the size of a point.");
+		}
+
+		layout.dataType = options.rawDataType;
+		layout.count = fileSize / (2 * elementSize);
+		layout.isInterleaved = options.rawLayout == PointLayout::Interleaved;
+		layout.yOffset = layout.isInterleaved ? elementSize : layout.count * elementSize;
+	}
+	else if (NpyFile::IsNpyFile(szFilename))
+	{
+		NpyFile file(szFilename);
+		const PointArrayView view = file.GetPoints();
+		const char* base = static_cast<const char*>(file.GetData()) - file.GetDataOffset();
+		layout.dataType = view.dataType;
+		layout.count = view.count;
+		layout.xOffset = static_cast<const char*>(view.x) - base;
+		layout.yOffset = static_cast<const char*>(view.y) - base;
+		layout.isInterleaved = view.stride == 2;
+	}
+	else if (BinaryPointFile::IsBinaryPointFile(szFilename))
+	{
+		BinaryPointFile file(szFilename);
+		const BinaryPointFileHeader& header = file.GetHeader();
+		layout.dataType = header.dataType;
+		layout.count = header.count;
+		layout.xOffset = header.xOffset;
+		layout.yOffset = header.yOffset;
+		layout.hasBounds = true;
+		layout.minX = header.minX; layout.minY = header.minY;
+		layout.maxX = header.maxX; layout.maxY = header.maxY;
+	}
+	else
+	{
+		throw std::invalid_argument("Only binary point files, compressed point files, .npy files and raw arrays can be read out-of-core.");
+	}
+
+	if (layout.count == 0)
+	{
+		throw std::runtime_error("The file contains no points.");
+	}
+
+	return layout;
+}
+
+/// <summary>	Reads the points chunk by chunk and calls func with an accessor for each chunk. </summary>
+template <typename tFunc>
+static void ForEachChunk(const FilePointLayout& layout, const OutOfCoreOptions& options, OutOfCoreStatistics& statistics, tFunc func)
+{
+	const size_t elementSize = BinaryPointFile::GetElementSize(layout.dataType);
+	const size_t pointsPerChunk = (std::max)(options.bufferSize / (2 * elementSize), (size_t)1);
+	++statistics.passes;
+	if (layout.isInterleaved)
+	{
+		ChunkedFileReader reader(layout.xFilename, options.method, pointsPerChunk * 2 * elementSize);
+		for (uint64_t start = 0; start < layout.count; start += pointsPerChunk)
+		{
+			const size_t n = (size_t)(std::min)((uint64_t)pointsPerChunk, layout.count - start);
+			const char* p = reader.Read(layout.xOffset + start * 2 * elementSize, n * 2 * elementSize);
+			PointArrayView{ layout.dataType, p, p + elementSize, n, 2 }.Visit<double>(func);
+			statistics.bytesRead += n * 2 * elementSize;
+		}
+
+		return;
+	}
+
+	ChunkedFileReader xReader(layout.xFilename, options.method, pointsPerChunk * elementSize);
+	ChunkedFileReader yReader(layout.yFilename, options.method, pointsPerChunk * elementSize);
+	for (uint64_t start = 0; start < layout.count; start += pointsPerChunk)
+	{
+		const size_t n = (size_t)(std::min)((uint64_t)pointsPerChunk, layout.count - start);
+		const char* x = xReader.Read(layout.xOffset + start * elementSize, n * elementSize);
+		const char* y = yReader.Read(layout.yOffset + start * elementSize, n * elementSize);
+		PointArrayView{ layout.dataType, x, y, n, 1 }.Visit<double>(func);
+		statistics.bytesRead += n * 2 * elementSize;
+	}
+}
+
+/// <summary>	Checks whether the points seen so far have moved so far from the normalization that the moments
+/// 			should be re-expressed - the normalized coordinates of new points then stay within a few units. </summary>
+static bool NeedsRecentering(const PointNormalization<double>& current, const PointNormalization<double>& target)
+{
+	return std::abs(target.mx - current.mx) > current.sx || std::abs(target.my - current.my) > current.sy ||
+		target.sx > 2 * current.sx || target.sy > 2 * current.sy;
+}
+
+/*static*/NormalizedMomentAccumulator<double> OutOfCoreEllipseFitter::AccumulateMoments(const char* szFilename, const PointFileOptions& fileOptions, const OutOfCoreOptions& options, OutOfCoreStatistics* statistics)
+{
+	OutOfCoreStatistics ownStatistics;
+	OutOfCoreStatistics& stats = statistics != nullptr ? *statistics : ownStatistics;
+	stats = OutOfCoreStatistics();
+
+	// a compressed file has the normalization in its header and is decoded block by block, a single pass in either mode
+	if (!fileOptions.isRaw && fileOptions.yFilename == nullptr && CompressedPointFile::IsCompressedPointFile(szFilename))
+	{
+		CompressedPointFile file(szFilename);
+		if (file.GetCount() == 0)
+		{
+			throw std::runtime_error("The file contains no points.");
+		}
+
+		stats.pointCount = file.GetCount();
+		stats.passes = 1;
+		stats.bytesRead = ChunkedFileReader(szFilename, ChunkedFileReader::Method::Read, 1).GetFileSize();
+		NormalizedMomentAccumulator<double> moments(file.GetNormalization<double>());
+		file.AddToMoments(moments);
+		return moments;
+	}
+
+	const FilePointLayout layout = GetLayout(szFilename, fileOptions);
+	stats.pointCount = layout.count;
+	if (options.normalization == OutOfCoreNormalization::TwoPass)
+	{
+		PointNormalization<double> normalization;
+		if (layout.hasBounds)
+		{
+			normalization = PointNormalization<double>::FromMeanMinMax((layout.minX + layout.maxX) / 2, (layout.minY + layout.maxY) / 2,
+				layout.minX, layout.minY, layout.maxX, layout.maxY);
+		}
+		else
+		{
+			PointBounds bounds;
+			ForEachChunk(layout, options, stats, [&](const auto& accessor) { bounds.Add(accessor); });
+			normalization = bounds.GetNormalization();
+		}
+
+		NormalizedMomentAccumulator<double> moments(normalization);
+		ForEachChunk(layout, options, stats, [&](const auto& accessor) { moments.AddPoints(accessor); });
+		return moments;
+	}
+
+	PointBounds bounds;
+	std::unique_ptr<NormalizedMomentAccumulator<double>> moments;
+	ForEachChunk(layout, options, stats, [&](const auto& accessor)
+	{
+		bounds.Add(accessor);
+		const PointNormalization<double> target = bounds.GetNormalization();
+		if (!moments)
+		{
+			moments.reset(new NormalizedMomentAccumulator<double>(target));
+		}
+		else if (NeedsRecentering(moments->GetNormalization(), target))
+		{
+			*moments = moments->Renormalized(target);
+			++stats.recenterings;
+		}
+
+		moments->AddPoints(accessor);
+	});
+
+	return moments->Renormalized(bounds.GetNormalization());
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include "chunkedFileReader.h"
+#include "momentAccumulator.h"
+#include "pointFileReader.h"
+
+namespace EllipseUtils
+{
+	enum class OutOfCoreNormalization
+	{
+		/// <summary>	A first pass determines the mean and the bounding box, the second one accumulates the moments.
+		/// 			For binary point files the bounding box is taken from the header and the center of the box is
+		/// 			used instead of the mean, so a single pass suffices. </summary>
+		TwoPass,
+
+		/// <summary>	A single pass: the moments are accumulated with the normalization of the points read so far,
+		/// 			and are re-expressed with an updated normalization (NormalizedMomentAccumulator::Renormalized,
+		/// 			which is exact) whenever the mean or the extent have moved too far from it. </summary>
+		Online
+	};
+
+	struct OutOfCoreOptions
+	{
+		ChunkedFileReader::Method method = ChunkedFileReader::Method::Mapping;
+		OutOfCoreNormalization normalization = OutOfCoreNormalization::TwoPass;
+
+		/// <summary>	The memory used for reading, split between the x- and the y-array for planar layouts. </summary>
+		size_t bufferSize = 64 << 20;
+	};
+
+	struct OutOfCoreStatistics
+	{
+		uint64_t pointCount = 0;
+		uint64_t bytesRead = 0;
+		unsigned int passes = 0;
+		unsigned int recenterings = 0;
+	};
+
+	/// <summary>	Fits a single ellipse to the points of a file which need not fit into memory. Since the fit only
+	/// 			needs the moments of the points, the file is read sequentially in chunks of a bounded size (see
+	/// 			ChunkedFileReader) and each chunk is added to a NormalizedMomentAccumulator. Supported are binary
+	/// 			point files, .npy files (also pairs of 1-D arrays, see PointFileOptions::yFilename) and raw arrays,
+	/// 			as well as compressed point files, which are mapped and decoded block by block in a single pass. </summary>
+	class OutOfCoreEllipseFitter
+	{
+	public:
+		/// <summary>	Accumulates the moments of the points in the file. Throws std::invalid_argument for files in
+		/// 			other formats, std::runtime_error if the file cannot be read or has no points. </summary>
+		static NormalizedMomentAccumulator<double> AccumulateMoments(const char* szFilename, const PointFileOptions& fileOptions, const OutOfCoreOptions& options, OutOfCoreStatistics* statistics = nullptr);
+
+		static EllipseAlgebraicParameters<double> Fit(const char* szFilename, const PointFileOptions& fileOptions, const OutOfCoreOptions& options, OutOfCoreStatistics* statistics = nullptr)
+		{
+			return LeastSquareEllipseFitter<double>::Fit(AccumulateMoments(szFilename, fileOptions, options, statistics));
+		}
+	};
+}
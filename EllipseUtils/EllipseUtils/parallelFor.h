@@ -0,0 +1,83 @@
+#pragma once
+
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <exception>
+
+namespace EllipseUtils
+{
+	/// <summary>	Gets the number of threads to use if "maxThreads" is zero (meaning "one per core"). </summary>
+	inline unsigned int GetDefaultThreadCount()
+	{
+		unsigned int n = std::thread::hardware_concurrency();
+		return n > 0 ? n : 1;
+	}
+
+	/// <summary>	Calls func(i) for all i in [0, count), distributed over up to maxThreads threads (with
+	/// 			maxThreads = 0 one thread per core is used). The indices are handed out dynamically, so
+	/// 			tasks of different cost are balanced. The first exception thrown by func is re-thrown. </summary>
+	template <typename tFunc>
+	void ParallelFor(size_t count, tFunc func, unsigned int maxThreads = 0)
+	{
+		unsigned int threadCount = maxThreads > 0 ? maxThreads : GetDefaultThreadCount();
+		if (threadCount > count)
+		{
+			threadCount = (unsigned int)count;
+		}
+
+		if (threadCount <= 1)
+		{
+			for (size_t i = 0; i < count; ++i)
+			{
+				func(i);
+			}
+
+			return;
+		}
+
+		std::atomic<size_t> next(0);
+		std::atomic<bool> failed(false);
+		std::exception_ptr exception;
+		auto worker = [&]()
+		{
+			for (;;)
+			{
+				size_t i = next.fetch_add(1);
+				if (i >= count || failed.load())
+				{
+					break;
+				}
+
+				try
+				{
+					func(i);
+				}
+				catch (...)
+				{
+					if (!failed.exchange(true))
+					{
+						exception = std::current_exception();
+					}
+				}
+			}
+		};
+
+		std::vector<std::thread> threads;
+		for (unsigned int t = 1; t < threadCount; ++t)
+		{
+			threads.emplace_back(worker);
+		}
+
+		worker();
+		for (auto& t : threads)
+		{
+			t.join();
+		}
+
+		if (exception)
+		{
+			std::rethrow_exception(exception);
+		}
+	}
+}
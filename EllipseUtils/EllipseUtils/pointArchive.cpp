@@ -0,0 +1,212 @@
+#include "stdafx.h"
+#include "pointArchive.h"
+
+using namespace EllipseUtils;
+
+static const char Magic[8] = { 'E', 'L', 'L', 'P', 'A', 'R', '\r', '\n' };
+
+static_assert(sizeof(PointArchiveHeader) == 48, "The header must not contain padding.");
+static_assert(sizeof(PointArchiveEntry) == 72, "The entries must not contain padding.");
+
+PointArchive::PointArchive(const char* szFilename)
+	: file(szFilename, MappedFile::AccessPattern::Random), entries(nullptr), names(nullptr)
+{
+	const size_t fileSize = this->file.GetSize();
+	if (fileSize < sizeof(PointArchiveHeader))
+	{
+		throw std::runtime_error("The file is too small for a point archive.");
+	}
+
+	memcpy(&this->header, this->file.GetData(), sizeof(PointArchiveHeader));
+	if (memcmp(this->header.magic, Magic, sizeof(Magic)) != 0)
+	{
+		throw std::runtime_error("Not a point archive.");
+	}
+
+	if (this->header.version != CurrentVersion)
+	{
+		throw std::runtime_error("Unsupported version of the point archive.");
+	}
+
+	if (this->header.tocOffset % BinaryPointFile::BlockAlignment != 0 || this->header.tocOffset > fileSize ||
+		this->header.entryCount > (fileSize - this->header.tocOffset) / sizeof(PointArchiveEntry) ||
+		this->header.namesOffset > fileSize || this->header.namesSize > fileSize - this->header.namesOffset)
+	{
+		throw std::runtime_error("Invalid table of contents in the point archive.");
+	}
+
+	this->entries = reinterpret_cast<const PointArchiveEntry*>(this->file.GetData() + this->header.tocOffset);
+	this->names = this->file.GetData() + this->header.namesOffset;
+	for (size_t i = 0; i < this->GetEntryCount(); ++i)
+	{
+		const PointArchiveEntry& entry = this->entries[i];
+		if (entry.nameOffset > this->header.namesSize || entry.nameLength > this->header.namesSize - entry.nameOffset ||
+			(entry.dataType != PointDataType::Float32 && entry.dataType != PointDataType::Float64 && entry.dataType != PointDataType::Int32) ||
+			!BinaryPointFile::AreBlocksValid(entry.dataType, entry.count, entry.xOffset, entry.yOffset, sizeof(PointArchiveHeader), (size_t)this->header.tocOffset))
+		{
+			throw std::runtime_error("Invalid entry in the point archive.");
+		}
+	}
+
+	this->sortedIndices.resize(this->GetEntryCount());
+	for (size_t i = 0; i < this->sortedIndices.size(); ++i)
+	{
+		this->sortedIndices[i] = i;
+	}
+
+	std::sort(this->sortedIndices.begin(), this->sortedIndices.end(), [this](size_t a, size_t b) { return this->GetName(a) < this->GetName(b); });
+}
+
+size_t PointArchive::Find(const std::string& name) const
+{
+	auto it = std::lower_bound(this->sortedIndices.begin(), this->sortedIndices.end(), name, [this](size_t index, const std::string& n) { return this->GetName(index) < n; });
+	if (it != this->sortedIndices.end() && this->GetName(*it) == name)
+	{
+		return *it;
+	}
+
+	return NotFound;
+}
+
+void PointArchive::Prefetch(size_t index) const
+{
+	const PointArchiveEntry& entry = this->entries[index];
+	size_t blockSize = (size_t)entry.count * BinaryPointFile::GetElementSize(entry.dataType);
+	this->file.Prefetch((size_t)entry.xOffset, blockSize);
+	this->file.Prefetch((size_t)entry.yOffset, blockSize);
+}
+
+void PointArchive::Release(size_t index) const
+{
+	const PointArchiveEntry& entry = this->entries[index];
+	size_t blockSize = (size_t)entry.count * BinaryPointFile::GetElementSize(entry.dataType);
+	this->file.Release((size_t)entry.xOffset, blockSize);
+	this->file.Release((size_t)entry.yOffset, blockSize);
+}
+
+/*static*/bool PointArchive::IsPointArchive(const char* szFilename)
+{
+	FILE* fp;
+	if (fopen_s(&fp, szFilename, "rb") != 0)
+	{
+		return false;
+	}
+
+	char magic[sizeof(Magic)];
+	bool isArchive = fread(magic, 1, sizeof(magic), fp) == sizeof(magic) && memcmp(magic, Magic, sizeof(Magic)) == 0;
+	fclose(fp);
+	return isArchive;
+}
+
+PointArchive::SequentialReader::SequentialReader(const PointArchive& archive, size_t prefetchCount)
+	: archive(archive), prefetchCount((std::max)(prefetchCount, (size_t)1)), index(NotFound)
+{
+}
+
+bool PointArchive::SequentialReader::Next()
+{
+	const size_t count = this->archive.GetEntryCount();
+	if (this->index == NotFound)
+	{
+		this->index = 0;
+		for (size_t i = 0; i < this->prefetchCount && i < count; ++i)
+		{
+			this->archive.Prefetch(i);
+		}
+	}
+	else if (this->index < count)
+	{
+		this->archive.Release(this->index);
+		++this->index;
+
+		// keep the window [index, index + prefetchCount) prefetched
+		if (this->index + this->prefetchCount - 1 < count)
+		{
+			this->archive.Prefetch(this->index + this->prefetchCount - 1);
+		}
+	}
+
+	return this->index < count;
+}
+
+PointArchiveWriter::PointArchiveWriter(const char* szFilename)
+	: position(0)
+{
+	if (fopen_s(&this->fp, szFilename, "wb") != 0)
+	{
+		this->fp = nullptr;
+		throw std::runtime_error("Couldn't create file.");
+	}
+
+	// a header without a table of contents, which is rewritten by Finish
+	PointArchiveHeader header = {};
+	this->WriteAligned(&header, sizeof(header));
+}
+
+PointArchiveWriter::~PointArchiveWriter()
+{
+	if (this->fp != nullptr)
+	{
+		fclose(this->fp);
+	}
+}
+
+void PointArchiveWriter::Add(const std::string& name, PointDataType dataType, const double* x, const double* y, size_t count)
+{
+	if (!this->usedNames.insert(name).second)
+	{
+		throw std::invalid_argument("The names in a point archive must be unique.");
+	}
+
+	PointArchiveEntry entry = {};
+	entry.nameOffset = this->names.size();
+	entry.nameLength = (uint32_t)name.size();
+	entry.dataType = dataType;
+	entry.count = count;
+
+	std::vector<char> block;
+	BinaryPointFile::EncodeBlock(dataType, x, count, block, entry.minX, entry.maxX);
+	entry.xOffset = this->position;
+	this->WriteAligned(block.data(), block.size());
+
+	block.clear();
+	BinaryPointFile::EncodeBlock(dataType, y, count, block, entry.minY, entry.maxY);
+	entry.yOffset = this->position;
+	this->WriteAligned(block.data(), block.size());
+
+	this->names += name;
+	this->entries.push_back(entry);
+}
+
+void PointArchiveWriter::Finish()
+{
+	PointArchiveHeader header = {};
+	memcpy(header.magic, Magic, sizeof(Magic));
+	header.version = PointArchive::CurrentVersion;
+	header.entryCount = this->entries.size();
+	header.tocOffset = this->position;
+	this->WriteAligned(this->entries.data(), this->entries.size() * sizeof(PointArchiveEntry));
+	header.namesOffset = this->position;
+	header.namesSize = this->names.size();
+	this->WriteAligned(this->names.data(), this->names.size());
+
+	bool ok = fseek(this->fp, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, this->fp) == 1;
+	ok = fclose(this->fp) == 0 && ok;
+	this->fp = nullptr;
+	if (!ok)
+	{
+		throw std::runtime_error("Couldn't write file.");
+	}
+}
+
+void PointArchiveWriter::WriteAligned(const void* data, size_t size)
+{
+	static const char padding[BinaryPointFile::BlockAlignment] = {};
+	size_t paddingSize = (BinaryPointFile::BlockAlignment - size % BinaryPointFile::BlockAlignment) % BinaryPointFile::BlockAlignment;
+	if ((size > 0 && fwrite(data, 1, size, this->fp) != size) || fwrite(padding, 1, paddingSize, this->fp) != paddingSize)
+	{
+		throw std::runtime_error("Couldn't write file.");
+	}
+
+	this->position += size + paddingSize;
+}
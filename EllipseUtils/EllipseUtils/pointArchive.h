@@ -0,0 +1,147 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <set>
+#include <string>
+#include <vector>
+#include "mappedFile.h"
+#include "binaryPointFile.h"
+
+namespace EllipseUtils
+{
+	/// <summary>	The header of a point archive (little-endian). The archive consists of the header, the point blocks
+	/// 			(x[] and y[] of every entry, aligned like in the binary point file), the table of contents and the
+	/// 			names, which are referenced from the table of contents. </summary>
+	struct PointArchiveHeader
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t reserved;
+		uint64_t entryCount;
+		uint64_t tocOffset;
+		uint64_t namesOffset;
+		uint64_t namesSize;
+	};
+
+	/// <summary>	An entry in the table of contents of a point archive. </summary>
+	struct PointArchiveEntry
+	{
+		uint64_t nameOffset;
+		uint32_t nameLength;
+		PointDataType dataType;
+		uint64_t count;
+		uint64_t xOffset;
+		uint64_t yOffset;
+		double minX, minY, maxX, maxY;
+	};
+
+	/// <summary>	Many point sets in one memory-mapped file, with random access by index or by name. The table of
+	/// 			contents is validated completely when the archive is opened. </summary>
+	class PointArchive
+	{
+	public:
+		static const uint32_t CurrentVersion = 1;
+		static const size_t NotFound = (size_t)-1;
+
+		/// <summary>	Iterates over the entries in order. The blocks of the next entries are prefetched, the blocks
+		/// 			of the entries which were visited already are released. </summary>
+		class SequentialReader
+		{
+		private:
+			const PointArchive& archive;
+			size_t prefetchCount;
+			size_t index;
+
+		public:
+			explicit SequentialReader(const PointArchive& archive, size_t prefetchCount = 4);
+
+			/// <summary>	Advances to the next entry (the first call advances to the first one), returns false at
+			/// 			the end. </summary>
+			bool Next();
+
+			size_t GetIndex() const
+			{
+				return this->index;
+			}
+
+			template <typename tFloat, typename tFunc>
+			void Visit(tFunc func) const
+			{
+				this->archive.Visit<tFloat>(this->index, func);
+			}
+		};
+
+	private:
+		MappedFile file;
+		PointArchiveHeader header;
+		const PointArchiveEntry* entries;
+		const char* names;
+
+		/// <summary>	The indices of the entries sorted by name, for the lookup by name. </summary>
+		std::vector<size_t> sortedIndices;
+
+	public:
+		/// <summary>	Maps the archive and validates it, throws std::runtime_error. </summary>
+		explicit PointArchive(const char* szFilename);
+
+		size_t GetEntryCount() const
+		{
+			return (size_t)this->header.entryCount;
+		}
+
+		const PointArchiveEntry& GetEntry(size_t index) const
+		{
+			return this->entries[index];
+		}
+
+		std::string GetName(size_t index) const
+		{
+			return std::string(this->names + this->entries[index].nameOffset, this->entries[index].nameLength);
+		}
+
+		/// <summary>	Gets the index of the entry with the name, or NotFound. </summary>
+		size_t Find(const std::string& name) const;
+
+		/// <summary>	Calls func with an accessor for the points of the entry. </summary>
+		template <typename tFloat, typename tFunc>
+		void Visit(size_t index, tFunc func) const
+		{
+			const PointArchiveEntry& entry = this->entries[index];
+			VisitPointArrays<tFloat>(entry.dataType, this->file.GetData() + entry.xOffset, this->file.GetData() + entry.yOffset, (size_t)entry.count, func);
+		}
+
+		void Prefetch(size_t index) const;
+		void Release(size_t index) const;
+
+		static bool IsPointArchive(const char* szFilename);
+	};
+
+	/// <summary>	Writes a point archive. The blocks are written when they are added, the table of contents is written
+	/// 			by Finish - an archive which was not finished is invalid. </summary>
+	class PointArchiveWriter
+	{
+	private:
+		FILE* fp;
+		uint64_t position;
+		std::vector<PointArchiveEntry> entries;
+		std::string names;
+		std::set<std::string> usedNames;
+
+	public:
+		/// <summary>	Creates the file, throws std::runtime_error. </summary>
+		explicit PointArchiveWriter(const char* szFilename);
+		~PointArchiveWriter();
+
+		PointArchiveWriter(const PointArchiveWriter&) = delete;
+		PointArchiveWriter& operator=(const PointArchiveWriter&) = delete;
+
+		/// <summary>	Adds an entry, the names must be unique (std::invalid_argument otherwise). </summary>
+		void Add(const std::string& name, PointDataType dataType, const double* x, const double* y, size_t count);
+
+		void Finish();
+
+	private:
+		void WriteAligned(const void* data, size_t size);
+	};
+}
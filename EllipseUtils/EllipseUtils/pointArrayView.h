@@ -0,0 +1,85 @@
+#pragma once
+
+#include <algorithm>
+#include <stdexcept>
+#include "binaryPointFile.h"
+
+namespace EllipseUtils
+{
+	enum class PointLayout
+	{
+		/// <summary>	x0 y0 x1 y1 ... (an (N,2) array in C order) </summary>
+		Interleaved,
+
+		/// <summary>	x0 x1 ... followed by y0 y1 ... (a (2,N) array in C order) </summary>
+		Planar
+	};
+
+	/// <summary>	Describes points in memory which is owned elsewhere (usually a mapped file): the coordinates of
+	/// 			point i are x[i*stride] and y[i*stride], with elements of the given data type. </summary>
+	struct PointArrayView
+	{
+		PointDataType dataType;
+		const void* x;
+		const void* y;
+		size_t count;
+
+		/// <summary>	The distance between consecutive points in elements. </summary>
+		size_t stride;
+
+		/// <summary>	Calls func with an accessor for the points - PointAccessorFromTwoTypedArrays for a stride of 1,
+		/// 			otherwise PointAccessorFromRecords. </summary>
+		template <typename tFloat, typename tFunc>
+		void Visit(tFunc func) const
+		{
+			if (this->stride == 1)
+			{
+				VisitPointArrays<tFloat>(this->dataType, this->x, this->y, this->count, func);
+				return;
+			}
+
+			switch (this->dataType)
+			{
+			case PointDataType::Float32:
+				this->VisitStrided<tFloat, float>(func);
+				break;
+			case PointDataType::Float64:
+				this->VisitStrided<tFloat, double>(func);
+				break;
+			case PointDataType::Int32:
+				this->VisitStrided<tFloat, int32_t>(func);
+				break;
+			}
+		}
+
+		/// <summary>	A view of a raw array without header, throws std::runtime_error if the size does not match. </summary>
+		static PointArrayView FromRaw(const void* data, size_t byteCount, PointDataType dataType, PointLayout layout)
+		{
+			const size_t elementSize = BinaryPointFile::GetElementSize(dataType);
+			if (byteCount % (2 * elementSize) != 0)
+			{
+				throw std::runtime_error("The size of the raw array is not a multiple of the size of a point.");
+			}
+
+			const size_t count = byteCount / (2 * elementSize);
+			const char* p = static_cast<const char*>(data);
+			if (layout == PointLayout::Interleaved)
+			{
+				return PointArrayView{ dataType, p, p + elementSize, count, 2 };
+			}
+
+			return PointArrayView{ dataType, p, p + count * elementSize, count, 1 };
+		}
+
+	private:
+		template <typename tFloat, typename tValue, typename tFunc>
+		void VisitStrided(tFunc func) const
+		{
+			const char* x = static_cast<const char*>(this->x);
+			const char* y = static_cast<const char*>(this->y);
+			const char* base = (std::min)(x, y);
+			func(typename LeastSquareEllipseFitter<tFloat>::template PointAccessorFromRecords<tValue>(
+				base, this->count, this->stride * sizeof(tValue), x - base, y - base));
+		}
+	};
+}
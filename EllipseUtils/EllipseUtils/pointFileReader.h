@@ -0,0 +1,127 @@
+#pragma once
+
+#include <vector>
+#include "leastSquareEllipseFit.h"
+#include "mappedFile.h"
+#include "textPointReader.h"
+#include "binaryPointFile.h"
+#include "compressedPointFile.h"
+#include "npyFile.h"
+#include "pointArrayView.h"
+
+namespace EllipseUtils
+{
+	struct PointFileOptions
+	{
+		/// <summary>	If set, the file is a 1-D .npy array with the x-coordinates and this one has the y-coordinates. </summary>
+		const char* yFilename = nullptr;
+
+		/// <summary>	Read the file as raw array without header. </summary>
+		bool isRaw = false;
+		PointDataType rawDataType = PointDataType::Float64;
+		PointLayout rawLayout = PointLayout::Interleaved;
+	};
+
+	/// <summary>	Reads points from any of the supported formats - binary point files, compressed point files and .npy
+	/// 			files are recognized by their magic number, raw arrays and pairs of .npy files have to be given in the
+	/// 			options, anything else is read as text. Except for text and compressed files, the accessor points into
+	/// 			the mapped file. </summary>
+	class PointFileReader
+	{
+	public:
+		/// <summary>	Calls func with an accessor for the points in the file. The accessor is only valid during the call.
+		/// 			A compressed file is decoded completely for this, AccumulateMoments does without. </summary>
+		template <typename tFloat, typename tFunc>
+		static void Visit(const char* szFilename, tFunc func, const PointFileOptions& options = PointFileOptions())
+		{
+			if (options.yFilename != nullptr)
+			{
+				NpyFile x(szFilename), y(options.yFilename);
+				NpyFile::GetPoints(x, y).template Visit<tFloat>(func);
+			}
+			else if (options.isRaw)
+			{
+				MappedFile file(szFilename, MappedFile::AccessPattern::Sequential);
+				PointArrayView::FromRaw(file.GetData(), file.GetSize(), options.rawDataType, options.rawLayout).template Visit<tFloat>(func);
+			}
+			else if (NpyFile::IsNpyFile(szFilename))
+			{
+				NpyFile file(szFilename);
+				file.GetPoints().template Visit<tFloat>(func);
+			}
+			else if (BinaryPointFile::IsBinaryPointFile(szFilename))
+			{
+				BinaryPointFile file(szFilename, MappedFile::AccessPattern::Sequential);
+				file.template Visit<tFloat>(func);
+			}
+			else
+			{
+				std::vector<double> xPoints, yPoints;
+				if (CompressedPointFile::IsCompressedPointFile(szFilename))
+				{
+					CompressedPointFile(szFilename).Read(xPoints, yPoints);
+				}
+				else
+				{
+					TextPointReader::ReadFile(szFilename, xPoints, yPoints);
+				}
+
+				func(typename LeastSquareEllipseFitter<tFloat>::template PointAccessorFromTwoTypedArrays<double>(xPoints.data(), yPoints.data(), xPoints.size()));
+			}
+		}
+
+		/// <summary>	Gets the moments of the points in the file. A compressed file is decoded block by block with the
+		/// 			normalization from its header (see CompressedPointFile::AddToMoments), the other formats through
+		/// 			Visit. </summary>
+		template <typename tFloat>
+		static NormalizedMomentAccumulator<tFloat> AccumulateMoments(const char* szFilename, const PointFileOptions& options = PointFileOptions())
+		{
+			if (!options.isRaw && options.yFilename == nullptr && CompressedPointFile::IsCompressedPointFile(szFilename))
+			{
+				CompressedPointFile file(szFilename);
+				NormalizedMomentAccumulator<tFloat> moments(file.GetNormalization<tFloat>());
+				file.AddToMoments(moments);
+				return moments;
+			}
+
+			// the accumulator has no default constructor, it is replaced in the callback
+			NormalizedMomentAccumulator<tFloat> moments(PointNormalization<tFloat>::FromMeanMinMax(0, 0, 0, 0, 0, 0));
+			Visit<tFloat>(szFilename, [&](const auto& accessor)
+			{
+				moments = NormalizedMomentAccumulator<tFloat>(PointNormalization<tFloat>::FromPoints(accessor));
+				moments.AddPoints(accessor);
+			}, options);
+			return moments;
+		}
+
+		/// <summary>	Reads the points into the vectors (appending). </summary>
+		static void Read(const char* szFilename, std::vector<double>& xPoints, std::vector<double>& yPoints, const PointFileOptions& options = PointFileOptions())
+		{
+			if (!options.isRaw && options.yFilename == nullptr && !NpyFile::IsNpyFile(szFilename) && !BinaryPointFile::IsBinaryPointFile(szFilename))
+			{
+				if (CompressedPointFile::IsCompressedPointFile(szFilename))
+				{
+					CompressedPointFile(szFilename).Read(xPoints, yPoints);
+				}
+				else
+				{
+					TextPointReader::ReadFile(szFilename, xPoints, yPoints);
+				}
+
+				return;
+			}
+
+			Visit<double>(szFilename, [&](const auto& accessor)
+			{
+				const size_t count = accessor.GetLength();
+				xPoints.reserve(xPoints.size() + count);
+				yPoints.reserve(yPoints.size() + count);
+				for (size_t i = 0; i < count; ++i)
+				{
+					xPoints.push_back(accessor.GetX(i));
+					yPoints.push_back(accessor.GetY(i));
+				}
+			}, options);
+		}
+	};
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#if !defined(ELLIPSEUTILS_SSE2) && (defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__))
+#define ELLIPSEUTILS_SSE2
+#endif
+
+#if defined(ELLIPSEUTILS_SSE2)
+#include <emmintrin.h>
+#endif
+
+namespace EllipseUtils
+{
+	/// <summary>	Accesses points stored in an array of records (array of structures): the coordinates of point i are the
+	/// 			tValue's at base + i * byteStride + offsetX and base + i * byteStride + offsetY. This covers interleaved
+	/// 			{x, y} structs, arrays of Eigen::Vector2d or Vector2f, (N,2) arrays and records with further fields,
+	/// 			without copying the points into separate arrays.
+	/// 			Besides GetX/GetY, the accessor can copy a block of points into two arrays (see GetPoints) - for
+	/// 			tightly packed {x, y} pairs of float or double this deinterleaves with SSE2 shuffles. The moment
+	/// 			accumulator uses this, so fitting from interleaved points costs about the same as from two arrays. </summary>
+	template<typename tFloat, typename tValue>
+	class PointRecordAccessor
+	{
+	private:
+		const char* base;
+		size_t count;
+		size_t byteStride;
+		size_t offsetX;
+		size_t offsetY;
+	public:
+		PointRecordAccessor(const void* base, size_t count, size_t byteStride, size_t offsetX, size_t offsetY)
+			: base(static_cast<const char*>(base)), count(count), byteStride(byteStride), offsetX(offsetX), offsetY(offsetY)
+		{}
+
+		/// <summary>	Points stored as x0 y0 x1 y1 ... (e.g. an (N,2) array in C order). </summary>
+		static PointRecordAccessor FromInterleaved(const tValue* xy, size_t count)
+		{
+			return PointRecordAccessor(xy, count, 2 * sizeof(tValue), 0, sizeof(tValue));
+		}
+
+		/// <summary>	Points stored in an array of records, e.g. FromRecords(points, count, offsetof(Point, x), offsetof(Point, y)). </summary>
+		template<typename tRecord>
+		static PointRecordAccessor FromRecords(const tRecord* records, size_t count, size_t offsetX, size_t offsetY)
+		{
+			return PointRecordAccessor(records, count, sizeof(tRecord), offsetX, offsetY);
+		}
+
+		size_t GetLength() const
+		{
+			return this->count;
+		}
+
+		tFloat GetX(size_t index) const
+		{
+			return tFloat(*reinterpret_cast<const tValue*>(this->base + index * this->byteStride + this->offsetX));
+		}
+
+		tFloat GetY(size_t index) const
+		{
+			return tFloat(*reinterpret_cast<const tValue*>(this->base + index * this->byteStride + this->offsetY));
+		}
+
+		/// <summary>	True if the points are packed as x0 y0 x1 y1 ... without gaps, which is where GetPoints can use
+		/// 			SIMD shuffles. </summary>
+		bool IsInterleaved() const
+		{
+			return this->byteStride == 2 * sizeof(tValue) && this->offsetY == this->offsetX + sizeof(tValue);
+		}
+
+		/// <summary>	Copies the coordinates of the points [start, start + n) to x[0..n) and y[0..n). </summary>
+		void GetPoints(size_t start, size_t n, tFloat* x, tFloat* y) const
+		{
+			size_t i = 0;
+			if (this->IsInterleaved())
+			{
+				i = Deinterleave(reinterpret_cast<const tValue*>(this->base + start * this->byteStride + this->offsetX), n, x, y);
+			}
+
+			for (; i < n; ++i)
+			{
+				x[i] = this->GetX(start + i);
+				y[i] = this->GetY(start + i);
+			}
+		}
+
+	private:
+		/// <summary>	Deinterleaves as many points as the SIMD path handles, returns that number. The generic version
+		/// 			handles none and leaves everything to the scalar loop. </summary>
+		template<typename tSrc, typename tDest>
+		static size_t Deinterleave(const tSrc* /*xy*/, size_t /*n*/, tDest* /*x*/, tDest* /*y*/)
+		{
+			return 0;
+		}
+
+#if defined(ELLIPSEUTILS_SSE2)
+		static size_t Deinterleave(const double* xy, size_t n, double* x, double* y)
+		{
+			size_t i = 0;
+			for (; i + 2 <= n; i += 2)
+			{
+				__m128d p0 = _mm_loadu_pd(xy + 2 * i);		// x0 y0
+				__m128d p1 = _mm_loadu_pd(xy + 2 * i + 2);	// x1 y1
+				_mm_storeu_pd(x + i, _mm_unpacklo_pd(p0, p1));
+				_mm_storeu_pd(y + i, _mm_unpackhi_pd(p0, p1));
+			}
+
+			return i;
+		}
+
+		static size_t Deinterleave(const float* xy, size_t n, float* x, float* y)
+		{
+			size_t i = 0;
+			for (; i + 4 <= n; i += 4)
+			{
+				__m128 p01 = _mm_loadu_ps(xy + 2 * i);		// x0 y0 x1 y1
+				__m128 p23 = _mm_loadu_ps(xy + 2 * i + 4);	// x2 y2 x3 y3
+				_mm_storeu_ps(x + i, _mm_shuffle_ps(p01, p23, _MM_SHUFFLE(2, 0, 2, 0)));
+				_mm_storeu_ps(y + i, _mm_shuffle_ps(p01, p23, _MM_SHUFFLE(3, 1, 3, 1)));
+			}
+
+			return i;
+		}
+
+		static size_t Deinterleave(const float* xy, size_t n, double* x, double* y)
+		{
+			size_t i = 0;
+			for (; i + 4 <= n; i += 4)
+			{
+				__m128 p01 = _mm_loadu_ps(xy + 2 * i);
+				__m128 p23 = _mm_loadu_ps(xy + 2 * i + 4);
+				__m128 xs = _mm_shuffle_ps(p01, p23, _MM_SHUFFLE(2, 0, 2, 0));
+				__m128 ys = _mm_shuffle_ps(p01, p23, _MM_SHUFFLE(3, 1, 3, 1));
+				_mm_storeu_pd(x + i, _mm_cvtps_pd(xs));
+				_mm_storeu_pd(x + i + 2, _mm_cvtps_pd(_mm_movehl_ps(xs, xs)));
+				_mm_storeu_pd(y + i, _mm_cvtps_pd(ys));
+				_mm_storeu_pd(y + i + 2, _mm_cvtps_pd(_mm_movehl_ps(ys, ys)));
+			}
+
+			return i;
+		}
+#endif
+	};
+}
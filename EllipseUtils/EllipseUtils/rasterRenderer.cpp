@@ -0,0 +1,275 @@
+#include "stdafx.h"
+#include "rasterRenderer.h"
+#include "parallelFor.h"
+#include <stdexcept>
+
+using namespace EllipseUtils;
+
+RasterImage::RasterImage(int width, int height, int channels)
+	: width(width), height(height), channels(channels)
+{
+	if (width <= 0 || height <= 0 || (channels != 1 && channels != 3))
+	{
+		throw std::invalid_argument("Invalid image size or channel count.");
+	}
+
+	this->pixels.resize((size_t)width * height * channels, 0);
+}
+
+void RasterImage::Fill(const RasterColor& color)
+{
+	if (this->channels == 1)
+	{
+		std::fill(this->pixels.begin(), this->pixels.end(), color.GetGray());
+		return;
+	}
+
+	for (size_t i = 0; i < this->pixels.size(); i += 3)
+	{
+		this->pixels[i] = color.r;
+		this->pixels[i + 1] = color.g;
+		this->pixels[i + 2] = color.b;
+	}
+}
+
+void RasterImage::WritePnm(const char* szFilename) const
+{
+	FILE* fp;
+	if (fopen_s(&fp, szFilename, "wb") != 0)
+	{
+		throw std::runtime_error("Couldn't create file.");
+	}
+
+	bool ok = fprintf(fp, "%s\n%d %d\n255\n", this->channels == 1 ? "P5" : "P6", this->width, this->height) > 0;
+	ok = ok && fwrite(this->pixels.data(), 1, this->pixels.size(), fp) == this->pixels.size();
+	ok = fclose(fp) == 0 && ok;
+	if (!ok)
+	{
+		throw std::runtime_error("Couldn't write file.");
+	}
+}
+
+RasterRenderer::RasterRenderer(RasterImage& image, double viewX, double viewY, double scale, const RasterOptions& options)
+	: image(image), viewX(viewX), viewY(viewY), scale(scale), options(options)
+{
+}
+
+/*static*/void RasterRenderer::FitView(double minX, double minY, double maxX, double maxY, int width, int height, int marginPixels, double& viewX, double& viewY, double& scale)
+{
+	const double availableWidth = (std::max)(width - 2 * marginPixels, 1), availableHeight = (std::max)(height - 2 * marginPixels, 1);
+	const double w = (std::max)(maxX - minX, 1e-9), h = (std::max)(maxY - minY, 1e-9);
+	scale = (std::min)(availableWidth / w, availableHeight / h);
+
+	// center the rectangle
+	viewX = (minX + maxX) / 2 - width / (2 * scale);
+	viewY = (minY + maxY) / 2 - height / (2 * scale);
+}
+
+void RasterRenderer::Render(const float* x, const float* y, size_t count, const EllipseParameters<double>* ellipses, size_t ellipseCount)
+{
+	this->image.Fill(this->options.background);
+	const int width = this->image.GetWidth(), height = this->image.GetHeight();
+	const int tileHeight = (std::max)(this->options.tileHeight, 1);
+	const size_t tileCount = (size_t)((height + tileHeight - 1) / tileHeight);
+
+	// bin the points by tile (a point near the border of a tile goes to both tiles), in two passes: count, then fill
+	const double extent = this->options.pointRadius + 0.5;
+	std::vector<uint32_t> tileStart(tileCount + 1, 0), indices;
+	for (int pass = 0; pass < 2; ++pass)
+	{
+		std::vector<uint32_t> position(tileStart.begin(), tileStart.end() - 1);
+		for (size_t i = 0; i < count; ++i)
+		{
+			if (!(x[i] > -extent && x[i] < width + extent && y[i] > -extent && y[i] < height + extent))
+			{
+				continue;
+			}
+
+			const int firstRow = (std::max)((int)floor(y[i] - extent), 0);
+			const int lastRow = (std::min)((int)floor(y[i] + extent), height - 1);
+			for (int tile = firstRow / tileHeight; tile <= lastRow / tileHeight; ++tile)
+			{
+				if (pass == 0)
+				{
+					++tileStart[tile + 1];
+				}
+				else
+				{
+					indices[position[tile]++] = (uint32_t)i;
+				}
+			}
+		}
+
+		if (pass == 0)
+		{
+			for (size_t t = 0; t < tileCount; ++t)
+			{
+				tileStart[t + 1] += tileStart[t];
+			}
+
+			indices.resize(tileStart[tileCount]);
+		}
+	}
+
+	std::vector<PixelEllipse> pixelEllipses;
+	for (size_t i = 0; i < ellipseCount; ++i)
+	{
+		const EllipseParameters<double>& e = ellipses[i];
+		if (std::isfinite(e.x0) && std::isfinite(e.y0) && std::isfinite(e.a) && std::isfinite(e.b) && std::isfinite(e.theta))
+		{
+			pixelEllipses.push_back(this->ToPixelEllipse(e));
+		}
+	}
+
+	ParallelFor(tileCount, [&](size_t tile)
+	{
+		const int rowStart = (int)tile * tileHeight;
+		const int rowEnd = (std::min)(rowStart + tileHeight, height);
+		this->DrawPoints(x, y, indices.data() + tileStart[tile], tileStart[tile + 1] - tileStart[tile], rowStart, rowEnd);
+		for (const PixelEllipse& e : pixelEllipses)
+		{
+			for (int row = rowStart; row < rowEnd; ++row)
+			{
+				this->DrawEllipseRow(e, row);
+			}
+		}
+	}, this->options.maxThreads);
+}
+
+RasterRenderer::PixelEllipse RasterRenderer::ToPixelEllipse(const EllipseParameters<double>& e) const
+{
+	// axes below half a pixel would make the implicit function too steep for the distance estimate
+	const double a = (std::max)(std::abs(e.a) * this->scale, 0.5), b = (std::max)(std::abs(e.b) * this->scale, 0.5);
+	const double c = cos(e.theta), s = sin(e.theta);
+	PixelEllipse p;
+	p.cx = (e.x0 - this->viewX) * this->scale;
+	p.cy = (e.y0 - this->viewY) * this->scale;
+	p.A = c * c / (a * a) + s * s / (b * b);
+	p.B = 2 * c * s * (1 / (a * a) - 1 / (b * b));
+	p.C = s * s / (a * a) + c * c / (b * b);
+	p.halfHeight = sqrt(a * a * s * s + b * b * c * c);
+
+	const double t = atan2(-b * s, a * c);
+	p.rightX = a * cos(t) * c - b * sin(t) * s;
+	p.rightY = a * cos(t) * s + b * sin(t) * c;
+	if (p.rightX < 0)
+	{
+		p.rightX = -p.rightX;
+		p.rightY = -p.rightY;
+	}
+
+	return p;
+}
+
+void RasterRenderer::DrawPoints(const float* x, const float* y, const uint32_t* indices, size_t count, int rowStart, int rowEnd)
+{
+	const double radius = this->options.pointRadius, extent = radius + 0.5;
+	const int width = this->image.GetWidth(), channels = this->image.GetChannels();
+	for (size_t k = 0; k < count; ++k)
+	{
+		const double px = x[indices[k]], py = y[indices[k]];
+		const int x0 = (std::max)((int)floor(px - extent), 0), x1 = (std::min)((int)floor(px + extent), width - 1);
+		const int y0 = (std::max)((int)floor(py - extent), rowStart), y1 = (std::min)((int)floor(py + extent), rowEnd - 1);
+		for (int row = y0; row <= y1; ++row)
+		{
+			uint8_t* pixel = this->image.GetRow(row) + x0 * channels;
+			const double dy = row + 0.5 - py;
+			for (int column = x0; column <= x1; ++column, pixel += channels)
+			{
+				const double dx = column + 0.5 - px;
+				const double coverage = (std::min)(extent - sqrt(dx * dx + dy * dy), 1.0);
+				if (coverage > 0)
+				{
+					this->Blend(pixel, this->options.pointColor, coverage * this->options.pointOpacity);
+				}
+			}
+		}
+	}
+}
+
+void RasterRenderer::DrawEllipseRow(const PixelEllipse& e, int row)
+{
+	// the outline can touch the row if it passes through the band of rows [yc - reach, yc + reach]
+	const double halfWidth = this->options.lineWidth / 2, reach = halfWidth + 1;
+	const double dy = row + 0.5 - e.cy;
+	const double y1 = (std::max)(dy - reach, -e.halfHeight), y2 = (std::min)(dy + reach, e.halfHeight);
+	if (y1 > y2)
+	{
+		return;
+	}
+
+	// the x-range of the left and the right arc within the band - the left arc has its minimum at the leftmost
+	// point, the right one its maximum at the rightmost point, otherwise the extremes are at the ends of the band
+	auto roots = [&](double v, double& left, double& right)
+	{
+		const double p = e.B * v, q = e.C * v * v - 1;
+		const double root = sqrt((std::max)(p * p - 4 * e.A * q, 0.0));
+		left = (-p - root) / (2 * e.A);
+		right = (-p + root) / (2 * e.A);
+	};
+
+	double left1, right1, left2, right2;
+	roots(y1, left1, right1);
+	roots(y2, left2, right2);
+	double ranges[2][2] =
+	{
+		{ (-e.rightY >= y1 && -e.rightY <= y2) ? -e.rightX : (std::min)(left1, left2), (std::max)(left1, left2) },
+		{ (std::min)(right1, right2), (e.rightY >= y1 && e.rightY <= y2) ? e.rightX : (std::max)(right1, right2) }
+	};
+
+	const int width = this->image.GetWidth(), channels = this->image.GetChannels();
+	int columns[2][2];
+	for (int i = 0; i < 2; ++i)
+	{
+		columns[i][0] = (int)(std::min)((std::max)(floor(e.cx + ranges[i][0] - reach), 0.0), (double)width);
+		columns[i][1] = (int)(std::max)((std::min)(ceil(e.cx + ranges[i][1] + reach), width - 1.0), -1.0);
+	}
+
+	// visit each pixel once, so that it is blended only once
+	int rangeCount = 2;
+	if (columns[0][1] >= columns[1][0])
+	{
+		columns[0][1] = (std::max)(columns[0][1], columns[1][1]);
+		rangeCount = 1;
+	}
+
+	uint8_t* rowPixels = this->image.GetRow(row);
+	for (int i = 0; i < rangeCount; ++i)
+	{
+		// F and its gradient are evaluated incrementally along the row
+		const double dx = columns[i][0] + 0.5 - e.cx;
+		double f = e.A * dx * dx + e.B * dx * dy + e.C * dy * dy - 1;
+		double gx = 2 * e.A * dx + e.B * dy;
+		double gy = e.B * dx + 2 * e.C * dy;
+		uint8_t* pixel = rowPixels + columns[i][0] * channels;
+		for (int column = columns[i][0]; column <= columns[i][1]; ++column, pixel += channels)
+		{
+			const double gradient = gx * gx + gy * gy;
+			if (gradient > 0)
+			{
+				const double coverage = (std::min)(halfWidth + 0.5 - std::abs(f) / sqrt(gradient), 1.0);
+				if (coverage > 0)
+				{
+					this->Blend(pixel, this->options.ellipseColor, coverage);
+				}
+			}
+
+			f += gx + e.A;
+			gx += 2 * e.A;
+			gy += e.B;
+		}
+	}
+}
+
+void RasterRenderer::Blend(uint8_t* pixel, const RasterColor& color, double coverage)
+{
+	if (this->image.GetChannels() == 1)
+	{
+		pixel[0] = (uint8_t)(pixel[0] + (color.GetGray() - pixel[0]) * coverage + 0.5);
+		return;
+	}
+
+	pixel[0] = (uint8_t)(pixel[0] + (color.r - pixel[0]) * coverage + 0.5);
+	pixel[1] = (uint8_t)(pixel[1] + (color.g - pixel[1]) * coverage + 0.5);
+	pixel[2] = (uint8_t)(pixel[2] + (color.b - pixel[2]) * coverage + 0.5);
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "ellipseParameters.h"
+
+namespace EllipseUtils
+{
+	struct RasterColor
+	{
+		uint8_t r, g, b;
+
+		/// <summary>	The value used for grayscale images. </summary>
+		uint8_t GetGray() const
+		{
+			return (uint8_t)((77 * this->r + 150 * this->g + 29 * this->b + 128) >> 8);
+		}
+	};
+
+	/// <summary>	An 8-bit grayscale (1 channel) or RGB (3 channels) image, rows from top to bottom. </summary>
+	class RasterImage
+	{
+	private:
+		int width, height, channels;
+		std::vector<uint8_t> pixels;
+
+	public:
+		/// <summary>	Creates a black image, throws std::invalid_argument for an invalid size or channel count. </summary>
+		RasterImage(int width, int height, int channels);
+
+		int GetWidth() const
+		{
+			return this->width;
+		}
+
+		int GetHeight() const
+		{
+			return this->height;
+		}
+
+		int GetChannels() const
+		{
+			return this->channels;
+		}
+
+		uint8_t* GetRow(int y)
+		{
+			return this->pixels.data() + (size_t)y * this->width * this->channels;
+		}
+
+		const uint8_t* GetRow(int y) const
+		{
+			return this->pixels.data() + (size_t)y * this->width * this->channels;
+		}
+
+		void Fill(const RasterColor& color);
+
+		/// <summary>	Writes a binary PGM (P5, grayscale) or PPM (P6, RGB) file, throws std::runtime_error. </summary>
+		void WritePnm(const char* szFilename) const;
+	};
+
+	struct RasterOptions
+	{
+		RasterColor background = RasterColor{ 255, 255, 255 };
+		RasterColor pointColor = RasterColor{ 0, 0, 0 };
+		RasterColor ellipseColor = RasterColor{ 128, 0, 128 };
+
+		/// <summary>	The radius of a point in pixels. Points are splatted with anti-aliased edges. </summary>
+		double pointRadius = 1;
+
+		/// <summary>	The opacity of a single point - with values below 1, dense regions become darker than sparse ones. </summary>
+		double pointOpacity = 1;
+
+		/// <summary>	The width of the ellipse outline in pixels. </summary>
+		double lineWidth = 2;
+
+		/// <summary>	The image is split into horizontal tiles of this height, which are rendered in parallel. </summary>
+		int tileHeight = 32;
+
+		/// <summary>	The maximal number of threads, 0 means one per core. </summary>
+		unsigned int maxThreads = 0;
+	};
+
+	/// <summary>	Draws points and ellipses into a RasterImage. The image is split into horizontal tiles; the points
+	/// 			are binned by tile first, then each tile (its points, then the ellipses) is drawn by one thread,
+	/// 			so no synchronization is needed and the result does not depend on the number of threads.
+	/// 			The ellipse outline is drawn with an incremental evaluation of the implicit equation along each row
+	/// 			(like the midpoint algorithm, but with the distance to the curve for anti-aliasing). </summary>
+	class RasterRenderer
+	{
+	private:
+		RasterImage& image;
+		double viewX, viewY, scale;
+		RasterOptions options;
+
+	public:
+		/// <summary>	Maps the point (x, y) to the pixel position ((x - viewX) * scale, (y - viewY) * scale). </summary>
+		RasterRenderer(RasterImage& image, double viewX, double viewY, double scale, const RasterOptions& options = RasterOptions());
+
+		/// <summary>	Gets a view which fits the rectangle into the image with a margin of marginPixels. </summary>
+		static void FitView(double minX, double minY, double maxX, double maxY, int width, int height, int marginPixels, double& viewX, double& viewY, double& scale);
+
+		/// <summary>	Fills the image with the background, then draws the points and the ellipses. </summary>
+		template <typename PointAccessor>
+		void Render(const PointAccessor& accessor, const EllipseParameters<double>* ellipses, size_t ellipseCount)
+		{
+			const size_t count = accessor.GetLength();
+			std::vector<float> x(count), y(count);
+			for (size_t i = 0; i < count; ++i)
+			{
+				x[i] = (float)((accessor.GetX(i) - this->viewX) * this->scale);
+				y[i] = (float)((accessor.GetY(i) - this->viewY) * this->scale);
+			}
+
+			this->Render(x.data(), y.data(), count, ellipses, ellipseCount);
+		}
+
+		/// <summary>	Same as above, with the points already in pixel coordinates. </summary>
+		void Render(const float* x, const float* y, size_t count, const EllipseParameters<double>* ellipses, size_t ellipseCount);
+
+	private:
+		/// <summary>	An ellipse in pixel coordinates, prepared for drawing rows. </summary>
+		struct PixelEllipse
+		{
+			double cx, cy;
+
+			/// <summary>	F(dx, dy) = A*dx^2 + B*dx*dy + C*dy^2 - 1 with dx = x - cx, dy = y - cy </summary>
+			double A, B, C;
+			double halfHeight;
+
+			/// <summary>	The rightmost point relative to the center, the leftmost one is the negation. </summary>
+			double rightX, rightY;
+		};
+
+		PixelEllipse ToPixelEllipse(const EllipseParameters<double>& e) const;
+
+		void DrawPoints(const float* x, const float* y, const uint32_t* indices, size_t count, int rowStart, int rowEnd);
+
+		void DrawEllipseRow(const PixelEllipse& e, int row);
+
+		void Blend(uint8_t* pixel, const RasterColor& color, double coverage);
+	};
+}
@@ -0,0 +1,553 @@
+#include "stdafx.h"
+#include "resultCache.h"
+#include "pointFileReader.h"
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace EllipseUtils;
+
+/*static*/const uint32_t ContentHash::FitVersion;
+/*static*/const int64_t ResultCacheFile::MinimumFileAgeNanoseconds;
+
+static const char CacheFileMagic[8] = { 'E', 'L', 'L', 'C', 'A', 'C', 'H', 'E' };
+static const uint32_t CacheFileVersion = 1;
+
+static inline uint64_t RotateLeft(uint64_t x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t FinalMix(uint64_t k)
+{
+	k ^= k >> 33;
+	k *= 0xff51afd7ed558ccdULL;
+	k ^= k >> 33;
+	k *= 0xc4ceb9fe1a85ec53ULL;
+	k ^= k >> 33;
+	return k;
+}
+
+/*static*/Hash128 ContentHash::Compute(const void* data, size_t size, uint64_t seed)
+{
+	const uint64_t c1 = 0x87c37b91114253d5ULL, c2 = 0x4cf5ad432745937fULL;
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	const size_t blockCount = size / 16;
+	uint64_t h1 = seed, h2 = seed;
+	for (size_t i = 0; i < blockCount; ++i)
+	{
+		uint64_t k1, k2;
+		memcpy(&k1, bytes + i * 16, 8);
+		memcpy(&k2, bytes + i * 16 + 8, 8);
+
+		k1 *= c1; k1 = RotateLeft(k1, 31); k1 *= c2; h1 ^= k1;
+		h1 = RotateLeft(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+		k2 *= c2; k2 = RotateLeft(k2, 33); k2 *= c1; h2 ^= k2;
+		h2 = RotateLeft(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+	}
+
+	// the remaining 0 to 15 bytes
+	const uint8_t* tail = bytes + blockCount * 16;
+	const size_t tailSize = size & 15;
+	uint64_t k1 = 0, k2 = 0;
+	for (size_t i = tailSize; i > 8; --i)
+	{
+		k2 ^= (uint64_t)tail[i - 1] << ((i - 9) * 8);
+	}
+
+	for (size_t i = (std::min)(tailSize, (size_t)8); i > 0; --i)
+	{
+		k1 ^= (uint64_t)tail[i - 1] << ((i - 1) * 8);
+	}
+
+	if (tailSize > 8)
+	{
+		k2 *= c2; k2 = RotateLeft(k2, 33); k2 *= c1; h2 ^= k2;
+	}
+
+	if (tailSize > 0)
+	{
+		k1 *= c1; k1 = RotateLeft(k1, 31); k1 *= c2; h1 ^= k1;
+	}
+
+	h1 ^= (uint64_t)size;
+	h2 ^= (uint64_t)size;
+	h1 += h2;
+	h2 += h1;
+	h1 = FinalMix(h1);
+	h2 = FinalMix(h2);
+	h1 += h2;
+	h2 += h1;
+	return Hash128{ h1, h2 };
+}
+
+/*static*/uint64_t ContentHash::GetOptionsSeed(const PointFileOptions& options)
+{
+	// the raw data type and layout only matter for raw files
+	const uint32_t key[5] =
+	{
+		FitVersion,
+		options.isRaw ? 1u : 0u,
+		options.yFilename != nullptr ? 1u : 0u,
+		options.isRaw ? (uint32_t)options.rawDataType : 0u,
+		options.isRaw ? (uint32_t)options.rawLayout : 0u
+	};
+
+	uint64_t seed = Compute(key, sizeof(key)).low;
+
+	// the y-coordinates are part of every point set read with these options, so their content goes into the seed
+	if (options.yFilename != nullptr)
+	{
+		MappedFile yFile(options.yFilename, MappedFile::AccessPattern::Sequential);
+		seed = Compute(yFile.GetData(), yFile.GetSize(), seed).low;
+	}
+
+	return seed;
+}
+
+ResultLruCache::ResultLruCache(size_t capacity, size_t shardCount)
+{
+	shardCount = (std::max)(shardCount, (size_t)1);
+	this->shardCapacity = (std::max)((capacity + shardCount - 1) / shardCount, (size_t)1);
+	for (size_t i = 0; i < shardCount; ++i)
+	{
+		this->shards.emplace_back(new Shard());
+		this->shards.back()->hitCount = this->shards.back()->missCount = this->shards.back()->evictionCount = 0;
+	}
+}
+
+bool ResultLruCache::TryGet(const Hash128& key, CachedFit& fit)
+{
+	Shard& shard = this->GetShard(key);
+	std::lock_guard<std::mutex> lock(shard.mutex);
+	auto found = shard.index.find(key);
+	if (found == shard.index.end())
+	{
+		++shard.missCount;
+		return false;
+	}
+
+	shard.entries.splice(shard.entries.begin(), shard.entries, found->second);
+	fit = found->second->fit;
+	++shard.hitCount;
+	return true;
+}
+
+void ResultLruCache::Put(const Hash128& key, const CachedFit& fit)
+{
+	Shard& shard = this->GetShard(key);
+	std::lock_guard<std::mutex> lock(shard.mutex);
+	auto found = shard.index.find(key);
+	if (found != shard.index.end())
+	{
+		found->second->fit = fit;
+		shard.entries.splice(shard.entries.begin(), shard.entries, found->second);
+		return;
+	}
+
+	shard.entries.push_front(Entry{ key, fit });
+	shard.index.emplace(key, shard.entries.begin());
+	if (shard.entries.size() > this->shardCapacity)
+	{
+		shard.index.erase(shard.entries.back().key);
+		shard.entries.pop_back();
+		++shard.evictionCount;
+	}
+}
+
+ResultCacheStatistics ResultLruCache::GetStatistics() const
+{
+	ResultCacheStatistics statistics = {};
+	for (const auto& shard : this->shards)
+	{
+		std::lock_guard<std::mutex> lock(shard->mutex);
+		statistics.hitCount += shard->hitCount;
+		statistics.missCount += shard->missCount;
+		statistics.evictionCount += shard->evictionCount;
+		statistics.entryCount += shard->entries.size();
+	}
+
+	return statistics;
+}
+
+/// <summary>	An empty slot has the key 0, so a hash of 0 is stored as 1. </summary>
+static Hash128 ToStoredKey(const Hash128& key)
+{
+	return key.low == 0 && key.high == 0 ? Hash128{ 1, 0 } : key;
+}
+
+static bool IsEmpty(const Hash128& key)
+{
+	return key.low == 0 && key.high == 0;
+}
+
+ResultCacheFile::ResultCacheFile(const char* szFilename, size_t initialCapacity)
+	: filename(szFilename), data(nullptr), size(0), hitCount(0), missCount(0), fileHitCount(0)
+{
+	uint64_t capacity = 16;
+	while (capacity < initialCapacity)
+	{
+		capacity *= 2;
+	}
+
+	size_t fileSize;
+#if defined(_WIN32)
+	this->mappingHandle = nullptr;
+
+	// without sharing, the open fails while another process has the file open
+	this->fileHandle = CreateFileA(szFilename, GENERIC_READ | GENERIC_WRITE, 0, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (this->fileHandle == INVALID_HANDLE_VALUE)
+	{
+		this->fileHandle = nullptr;
+		throw std::runtime_error("Couldn't open the cache file, it may be in use by another process.");
+	}
+
+	LARGE_INTEGER length;
+	if (!GetFileSizeEx(this->fileHandle, &length))
+	{
+		this->Close();
+		throw std::runtime_error("Couldn't determine the size of the cache file.");
+	}
+
+	fileSize = (size_t)length.QuadPart;
+#else
+	this->fileDescriptor = open(szFilename, O_RDWR | O_CREAT, 0666);
+	if (this->fileDescriptor < 0)
+	{
+		throw std::runtime_error("Couldn't open the cache file.");
+	}
+
+	if (flock(this->fileDescriptor, LOCK_EX | LOCK_NB) != 0)
+	{
+		this->Close();
+		throw std::runtime_error("The cache file is in use by another process.");
+	}
+
+	struct stat status;
+	if (fstat(this->fileDescriptor, &status) != 0)
+	{
+		this->Close();
+		throw std::runtime_error("Couldn't determine the size of the cache file.");
+	}
+
+	fileSize = (size_t)status.st_size;
+#endif
+
+	try
+	{
+		bool isValid = false;
+		if (fileSize >= sizeof(Header))
+		{
+			this->Map(fileSize);
+			const Header& header = this->GetHeader();
+			isValid = memcmp(header.magic, CacheFileMagic, sizeof(CacheFileMagic)) == 0 && header.version == CacheFileVersion && header.isOpen == 0 &&
+				header.capacity >= 16 && (header.capacity & (header.capacity - 1)) == 0 && fileSize == GetFileSize(header.capacity) &&
+				header.contentCount < header.capacity && header.fileCount < header.capacity;
+		}
+
+		if (!isValid)
+		{
+			this->Initialize(capacity);
+		}
+
+		// the flag has to be on the disk before any record is changed
+		this->GetHeader().isOpen = 1;
+		this->Flush();
+	}
+	catch (...)
+	{
+		this->Close();
+		throw;
+	}
+}
+
+ResultCacheFile::~ResultCacheFile()
+{
+	try
+	{
+		// the records first, then the header which says they are complete
+		this->Flush();
+		this->GetHeader().isOpen = 0;
+		this->Flush();
+	}
+	catch (const std::exception&)
+	{
+	}
+
+	this->Close();
+}
+
+bool ResultCacheFile::TryGetByFile(const std::string& path, uint64_t optionsSeed, uint64_t size, int64_t modificationTime, CachedFit& fit)
+{
+	const Hash128 pathKey = ToStoredKey(ContentHash::Compute(path.data(), path.size(), optionsSeed));
+	std::lock_guard<std::mutex> lock(this->mutex);
+	const FileRecord* file = this->FindFile(pathKey);
+	if (IsEmpty(file->pathKey) || file->size != size || file->modificationTime != modificationTime)
+	{
+		return false;
+	}
+
+	const ContentRecord* content = this->FindContent(file->contentKey);
+	if (IsEmpty(content->key))
+	{
+		return false;
+	}
+
+	fit.pointCount = content->pointCount;
+	fit.ellipse = EllipseParameters<double>{ content->x0, content->y0, content->a, content->b, content->theta };
+	++this->fileHitCount;
+	return true;
+}
+
+bool ResultCacheFile::TryGet(const Hash128& key, CachedFit& fit)
+{
+	std::lock_guard<std::mutex> lock(this->mutex);
+	const ContentRecord* content = this->FindContent(ToStoredKey(key));
+	if (IsEmpty(content->key))
+	{
+		++this->missCount;
+		return false;
+	}
+
+	fit.pointCount = content->pointCount;
+	fit.ellipse = EllipseParameters<double>{ content->x0, content->y0, content->a, content->b, content->theta };
+	++this->hitCount;
+	return true;
+}
+
+void ResultCacheFile::Put(const Hash128& key, const CachedFit& fit)
+{
+	const Hash128 storedKey = ToStoredKey(key);
+	std::lock_guard<std::mutex> lock(this->mutex);
+	this->Reserve();
+	ContentRecord* content = this->FindContent(storedKey);
+	if (IsEmpty(content->key))
+	{
+		++this->GetHeader().contentCount;
+	}
+
+	content->pointCount = fit.pointCount;
+	content->x0 = fit.ellipse.x0;
+	content->y0 = fit.ellipse.y0;
+	content->a = fit.ellipse.a;
+	content->b = fit.ellipse.b;
+	content->theta = fit.ellipse.theta;
+	content->key = storedKey;
+}
+
+void ResultCacheFile::PutFile(const std::string& path, uint64_t optionsSeed, uint64_t size, int64_t modificationTime, const Hash128& contentKey)
+{
+	const int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+	if (now - modificationTime < MinimumFileAgeNanoseconds)
+	{
+		return;
+	}
+
+	const Hash128 pathKey = ToStoredKey(ContentHash::Compute(path.data(), path.size(), optionsSeed));
+	std::lock_guard<std::mutex> lock(this->mutex);
+	this->Reserve();
+	FileRecord* file = this->FindFile(pathKey);
+	if (IsEmpty(file->pathKey))
+	{
+		++this->GetHeader().fileCount;
+	}
+
+	file->size = size;
+	file->modificationTime = modificationTime;
+	file->contentKey = ToStoredKey(contentKey);
+	file->pathKey = pathKey;
+}
+
+ResultCacheStatistics ResultCacheFile::GetStatistics() const
+{
+	std::lock_guard<std::mutex> lock(this->mutex);
+	ResultCacheStatistics statistics = {};
+	statistics.hitCount = this->hitCount;
+	statistics.missCount = this->missCount;
+	statistics.fileHitCount = this->fileHitCount;
+	statistics.entryCount = this->GetHeader().contentCount;
+	return statistics;
+}
+
+ResultCacheFile::ContentRecord* ResultCacheFile::FindContent(const Hash128& key) const
+{
+	ContentRecord* table = this->GetContentTable();
+	const uint64_t mask = this->GetHeader().capacity - 1;
+
+	// linear probing - the table is never full, so there is an empty slot at the end of each run
+	for (uint64_t i = key.low & mask;; i = (i + 1) & mask)
+	{
+		if (table[i].key == key || IsEmpty(table[i].key))
+		{
+			return &table[i];
+		}
+	}
+}
+
+ResultCacheFile::FileRecord* ResultCacheFile::FindFile(const Hash128& pathKey) const
+{
+	FileRecord* table = this->GetFileTable();
+	const uint64_t mask = this->GetHeader().capacity - 1;
+	for (uint64_t i = pathKey.low & mask;; i = (i + 1) & mask)
+	{
+		if (table[i].pathKey == pathKey || IsEmpty(table[i].pathKey))
+		{
+			return &table[i];
+		}
+	}
+}
+
+void ResultCacheFile::Reserve()
+{
+	const Header& header = this->GetHeader();
+	if (((std::max)(header.contentCount, header.fileCount) + 1) * 4 <= header.capacity * 3)
+	{
+		return;
+	}
+
+	// the positions depend on the capacity, so all records are inserted again
+	std::vector<ContentRecord> contents;
+	std::vector<FileRecord> files;
+	for (uint64_t i = 0; i < header.capacity; ++i)
+	{
+		if (!IsEmpty(this->GetContentTable()[i].key))
+		{
+			contents.push_back(this->GetContentTable()[i]);
+		}
+
+		if (!IsEmpty(this->GetFileTable()[i].pathKey))
+		{
+			files.push_back(this->GetFileTable()[i]);
+		}
+	}
+
+	this->Initialize(header.capacity * 2);
+	this->GetHeader().isOpen = 1;
+	for (const ContentRecord& content : contents)
+	{
+		*this->FindContent(content.key) = content;
+	}
+
+	for (const FileRecord& file : files)
+	{
+		*this->FindFile(file.pathKey) = file;
+	}
+
+	this->GetHeader().contentCount = contents.size();
+	this->GetHeader().fileCount = files.size();
+}
+
+void ResultCacheFile::Map(size_t size)
+{
+	this->Unmap();
+#if defined(_WIN32)
+	LARGE_INTEGER length;
+	length.QuadPart = (LONGLONG)size;
+	if (!SetFilePointerEx(this->fileHandle, length, nullptr, FILE_BEGIN) || !SetEndOfFile(this->fileHandle))
+	{
+		throw std::runtime_error("Couldn't resize the cache file.");
+	}
+
+	this->mappingHandle = CreateFileMappingA(this->fileHandle, nullptr, PAGE_READWRITE, 0, 0, nullptr);
+	if (this->mappingHandle != nullptr)
+	{
+		this->data = static_cast<char*>(MapViewOfFile(this->mappingHandle, FILE_MAP_WRITE, 0, 0, 0));
+	}
+#else
+	if (ftruncate(this->fileDescriptor, (off_t)size) != 0)
+	{
+		throw std::runtime_error("Couldn't resize the cache file.");
+	}
+
+	void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, this->fileDescriptor, 0);
+	if (p != MAP_FAILED)
+	{
+		this->data = static_cast<char*>(p);
+	}
+#endif
+
+	if (this->data == nullptr)
+	{
+		throw std::runtime_error("Couldn't map the cache file.");
+	}
+
+	this->size = size;
+}
+
+void ResultCacheFile::Unmap()
+{
+#if defined(_WIN32)
+	if (this->data != nullptr)
+	{
+		UnmapViewOfFile(this->data);
+	}
+
+	if (this->mappingHandle != nullptr)
+	{
+		CloseHandle(this->mappingHandle);
+	}
+
+	this->mappingHandle = nullptr;
+#else
+	if (this->data != nullptr)
+	{
+		munmap(this->data, this->size);
+	}
+#endif
+	this->data = nullptr;
+	this->size = 0;
+}
+
+void ResultCacheFile::Initialize(uint64_t capacity)
+{
+	this->Map(GetFileSize(capacity));
+	memset(this->data, 0, this->size);
+	Header& header = this->GetHeader();
+	memcpy(header.magic, CacheFileMagic, sizeof(CacheFileMagic));
+	header.version = CacheFileVersion;
+	header.capacity = capacity;
+}
+
+void ResultCacheFile::Flush()
+{
+#if defined(_WIN32)
+	if (!FlushViewOfFile(this->data, 0) || !FlushFileBuffers(this->fileHandle))
+#else
+	if (msync(this->data, this->size, MS_SYNC) != 0)
+#endif
+	{
+		throw std::runtime_error("Couldn't write the cache file.");
+	}
+}
+
+void ResultCacheFile::Close()
+{
+	this->Unmap();
+#if defined(_WIN32)
+	if (this->fileHandle != nullptr)
+	{
+		CloseHandle(this->fileHandle);
+	}
+
+	this->fileHandle = nullptr;
+#else
+	if (this->fileDescriptor >= 0)
+	{
+		close(this->fileDescriptor);
+	}
+
+	this->fileDescriptor = -1;
+#endif
+}
@@ -0,0 +1,253 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "ellipseParameters.h"
+
+namespace EllipseUtils
+{
+	struct PointFileOptions;
+
+	struct Hash128
+	{
+		uint64_t low, high;
+
+		bool operator==(const Hash128& other) const
+		{
+			return this->low == other.low && this->high == other.high;
+		}
+
+		bool operator!=(const Hash128& other) const
+		{
+			return !(*this == other);
+		}
+	};
+
+	/// <summary>	For hash tables keyed by a Hash128, which is already uniformly distributed. </summary>
+	struct Hash128Hasher
+	{
+		size_t operator()(const Hash128& key) const
+		{
+			return (size_t)key.low;
+		}
+	};
+
+	/// <summary>	Hashes the raw bytes of point sets - two point sets with the same bytes, read with the same options,
+	/// 			give the same fit, so the hash identifies the result. </summary>
+	class ContentHash
+	{
+	public:
+		/// <summary>	Changes whenever a change of the fitter changes its results, so cached results of an earlier
+		/// 			version are not used. </summary>
+		static const uint32_t FitVersion = 1;
+
+		/// <summary>	MurmurHash3 (x64, 128 bit) of the bytes - it processes 16 bytes per step with a few multiplications,
+		/// 			so hashing a file costs a fraction of parsing it. </summary>
+		static Hash128 Compute(const void* data, size_t size, uint64_t seed = 0);
+
+		/// <summary>	Gets the seed which mixes the options the bytes are read with (and FitVersion) into the hash. With
+		/// 			PointFileOptions::yFilename, the content of that file is mixed in as well, so the seed has to be
+		/// 			taken again when it changes. Throws std::runtime_error if it cannot be read. </summary>
+		static uint64_t GetOptionsSeed(const PointFileOptions& options);
+	};
+
+	/// <summary>	A cached fit. A point set with fewer than five points, or one which does not determine an ellipse,
+	/// 			is cached with an invalid ellipse. </summary>
+	struct CachedFit
+	{
+		uint64_t pointCount;
+		EllipseParameters<double> ellipse;
+	};
+
+	struct ResultCacheStatistics
+	{
+		uint64_t hitCount;
+		uint64_t missCount;
+
+		/// <summary>	The hits by file metadata (ResultCacheFile::TryGetByFile), which did not need to read the file. </summary>
+		uint64_t fileHitCount;
+		uint64_t evictionCount;
+		uint64_t entryCount;
+	};
+
+	/// <summary>	An in-memory cache of fits with a capacity, evicting the least recently used entries. The entries
+	/// 			are split into shards by their hash, each with its own mutex and LRU list, so that threads looking
+	/// 			up different point sets rarely contend for a lock. </summary>
+	class ResultLruCache
+	{
+	private:
+		struct Entry
+		{
+			Hash128 key;
+			CachedFit fit;
+		};
+
+		struct Shard
+		{
+			std::mutex mutex;
+
+			/// <summary>	The most recently used entry first. </summary>
+			std::list<Entry> entries;
+			std::unordered_map<Hash128, std::list<Entry>::iterator, Hash128Hasher> index;
+			uint64_t hitCount;
+			uint64_t missCount;
+			uint64_t evictionCount;
+		};
+
+		std::vector<std::unique_ptr<Shard>> shards;
+		size_t shardCapacity;
+
+	public:
+		/// <summary>	Creates a cache for up to capacity entries (at least one per shard). </summary>
+		explicit ResultLruCache(size_t capacity, size_t shardCount = 16);
+
+		ResultLruCache(const ResultLruCache&) = delete;
+		ResultLruCache& operator=(const ResultLruCache&) = delete;
+
+		bool TryGet(const Hash128& key, CachedFit& fit);
+
+		void Put(const Hash128& key, const CachedFit& fit);
+
+		ResultCacheStatistics GetStatistics() const;
+
+	private:
+		Shard& GetShard(const Hash128& key) const
+		{
+			// the shard is chosen by the high half, the hash table within the shard uses the low half
+			return *this->shards[(size_t)(key.high % this->shards.size())];
+		}
+	};
+
+	/// <summary>	A persistent cache of fits in a memory-mapped file, for batch mode. The file has two hash tables
+	/// 			with open addressing: the fits by content hash, and the content hash by file (the hash of the path
+	/// 			and the options seed, with the size and the modification time of the file when it was fitted). An unchanged file is found
+	/// 			by its metadata without reading it; a changed (or new) file is hashed, and only fitted if its content
+	/// 			is not known. The tables double when they are three quarters full.
+	/// 			The file is locked while it is open, so one process uses it at a time. It is flushed on destruction;
+	/// 			a file which was not closed properly is discarded on open, as its content may be incomplete. The
+	/// 			methods may be called from any thread. </summary>
+	class ResultCacheFile
+	{
+	public:
+		/// <summary>	Files modified less than this long before they are recorded are not recorded by metadata -
+		/// 			a modification in the same tick of the file system clock would go unnoticed. </summary>
+		static const int64_t MinimumFileAgeNanoseconds = 2000000000;
+
+	private:
+		struct Header
+		{
+			char magic[8];
+			uint32_t version;
+
+			/// <summary>	Set while the file is open, see the class summary. </summary>
+			uint32_t isOpen;
+			uint64_t capacity;
+			uint64_t contentCount;
+			uint64_t fileCount;
+			uint64_t reserved[3];
+		};
+
+		struct ContentRecord
+		{
+			Hash128 key;
+			uint64_t pointCount;
+			double x0, y0, a, b, theta;
+		};
+
+		struct FileRecord
+		{
+			Hash128 pathKey;
+			uint64_t size;
+			int64_t modificationTime;
+			Hash128 contentKey;
+			uint64_t reserved[2];
+		};
+
+		static_assert(sizeof(Header) == 64 && sizeof(ContentRecord) == 64 && sizeof(FileRecord) == 64, "The records must not contain padding.");
+
+		std::string filename;
+		mutable std::mutex mutex;
+		char* data;
+		size_t size;
+#if defined(_WIN32)
+		void* fileHandle;
+		void* mappingHandle;
+#else
+		int fileDescriptor;
+#endif
+		uint64_t hitCount;
+		uint64_t missCount;
+		uint64_t fileHitCount;
+
+	public:
+		/// <summary>	Opens or creates the cache file, throws std::runtime_error (also if another process has it open). </summary>
+		explicit ResultCacheFile(const char* szFilename, size_t initialCapacity = 4096);
+
+		~ResultCacheFile();
+
+		ResultCacheFile(const ResultCacheFile&) = delete;
+		ResultCacheFile& operator=(const ResultCacheFile&) = delete;
+
+		/// <summary>	Looks the file up by its path (as given), size and modification time. A file recorded with another
+		/// 			options seed (see ContentHash::GetOptionsSeed) is not found, its fit is that of other options. </summary>
+		bool TryGetByFile(const std::string& path, uint64_t optionsSeed, uint64_t size, int64_t modificationTime, CachedFit& fit);
+
+		bool TryGet(const Hash128& key, CachedFit& fit);
+
+		void Put(const Hash128& key, const CachedFit& fit);
+
+		/// <summary>	Records the content of the file with its metadata, unless it was modified less than
+		/// 			MinimumFileAgeNanoseconds ago. </summary>
+		void PutFile(const std::string& path, uint64_t optionsSeed, uint64_t size, int64_t modificationTime, const Hash128& contentKey);
+
+		ResultCacheStatistics GetStatistics() const;
+
+	private:
+		Header& GetHeader() const
+		{
+			return *reinterpret_cast<Header*>(this->data);
+		}
+
+		ContentRecord* GetContentTable() const
+		{
+			return reinterpret_cast<ContentRecord*>(this->data + sizeof(Header));
+		}
+
+		FileRecord* GetFileTable() const
+		{
+			return reinterpret_cast<FileRecord*>(this->data + sizeof(Header) + this->GetHeader().capacity * sizeof(ContentRecord));
+		}
+
+		static size_t GetFileSize(uint64_t capacity)
+		{
+			return sizeof(Header) + (size_t)capacity * (sizeof(ContentRecord) + sizeof(FileRecord));
+		}
+
+		/// <summary>	Gets the slot of the key in the table: the one holding it, or the empty one where it belongs. </summary>
+		ContentRecord* FindContent(const Hash128& key) const;
+
+		FileRecord* FindFile(const Hash128& pathKey) const;
+
+		/// <summary>	Makes room for one more record in each table, doubling the capacity if needed. </summary>
+		void Reserve();
+
+		/// <summary>	Resizes the file and maps it. </summary>
+		void Map(size_t size);
+
+		void Unmap();
+
+		/// <summary>	Empties the file and gives it the capacity. </summary>
+		void Initialize(uint64_t capacity);
+
+		/// <summary>	Writes the mapped pages to the file, throws std::runtime_error. </summary>
+		void Flush();
+
+		void Close();
+	};
+}
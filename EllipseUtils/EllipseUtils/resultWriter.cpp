@@ -0,0 +1,441 @@
+#include "stdafx.h"
+#include "resultWriter.h"
+#include <cmath>
+#include <stdexcept>
+
+using namespace EllipseUtils;
+
+static const char BinaryMagic[8] = { 'E', 'L', 'L', 'R', 'E', 'S', '\r', '\n' };
+static const uint32_t BinaryVersion = 1;
+
+struct BinaryResultRecord
+{
+	uint64_t index;
+	uint64_t pointCount;
+	double x0, y0, a, b, theta;
+};
+
+static_assert(sizeof(BinaryResultRecord) == 56, "The record must not contain padding.");
+
+static const int MaxDecimals = 9;
+
+static const char DigitPairs[] =
+	"00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+	"40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+	"8081828384858687888990919293949596979899";
+
+/// <summary>	Writes the decimal digits of n, returns the number of characters. </summary>
+static size_t FormatUnsigned(char* dest, uint64_t n)
+{
+	char digits[20];
+	char* p = digits + sizeof(digits);
+	while (n >= 100)
+	{
+		unsigned int pair = (unsigned int)(n % 100);
+		n /= 100;
+		*--p = DigitPairs[2 * pair + 1];
+		*--p = DigitPairs[2 * pair];
+	}
+
+	if (n >= 10)
+	{
+		*--p = DigitPairs[2 * n + 1];
+		*--p = DigitPairs[2 * n];
+	}
+	else
+	{
+		*--p = (char)('0' + n);
+	}
+
+	size_t length = digits + sizeof(digits) - p;
+	memcpy(dest, p, length);
+	return length;
+}
+
+/// <summary>	Returns the rounding error of the product p = a * b, i.e. a * b - p exactly (Dekker's algorithm). </summary>
+static double ProductError(double a, double b, double p)
+{
+	const double split = 134217729.0;	// 2^27 + 1
+	double t = split * a;
+	const double aHigh = t - (t - a), aLow = a - aHigh;
+	t = split * b;
+	const double bHigh = t - (t - b), bLow = b - bHigh;
+	return ((aHigh * bHigh - p) + aHigh * bLow + aLow * bHigh) + aLow * bLow;
+}
+
+/// <summary>	Appends the string, quoted if it contains a separator, a quote or a line break. </summary>
+static void AppendCsvString(std::vector<char>& buffer, const char* sz)
+{
+	if (strpbrk(sz, ",\"\r\n") == nullptr)
+	{
+		buffer.insert(buffer.end(), sz, sz + strlen(sz));
+		return;
+	}
+
+	buffer.push_back('"');
+	for (; *sz != '\0'; ++sz)
+	{
+		if (*sz == '"')
+		{
+			buffer.push_back('"');
+		}
+
+		buffer.push_back(*sz);
+	}
+
+	buffer.push_back('"');
+}
+
+static void AppendJsonString(std::vector<char>& buffer, const char* sz)
+{
+	static const char hex[] = "0123456789abcdef";
+	buffer.push_back('"');
+	for (; *sz != '\0'; ++sz)
+	{
+		unsigned char c = (unsigned char)*sz;
+		if (c == '"' || c == '\\')
+		{
+			buffer.push_back('\\');
+			buffer.push_back((char)c);
+		}
+		else if (c < 0x20)
+		{
+			const char escape[6] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 15] };
+			buffer.insert(buffer.end(), escape, escape + sizeof(escape));
+		}
+		else
+		{
+			buffer.push_back((char)c);
+		}
+	}
+
+	buffer.push_back('"');
+}
+
+static void AppendLiteral(std::vector<char>& buffer, const char* sz)
+{
+	buffer.insert(buffer.end(), sz, sz + strlen(sz));
+}
+
+static void AppendUnsigned(std::vector<char>& buffer, uint64_t n)
+{
+	char text[20];
+	buffer.insert(buffer.end(), text, text + FormatUnsigned(text, n));
+}
+
+ResultWriter::LocalBuffer::LocalBuffer(ResultWriter& writer)
+	: writer(writer)
+{
+	this->buffer.reserve(BufferSize);
+}
+
+ResultWriter::LocalBuffer::~LocalBuffer()
+{
+	try
+	{
+		this->Flush();
+	}
+	catch (...)
+	{
+	}
+}
+
+void ResultWriter::LocalBuffer::Write(const FitResult& result)
+{
+	this->writer.Format(result, this->buffer);
+	if (this->buffer.size() >= BufferSize)
+	{
+		this->writer.Submit(this->buffer);
+	}
+}
+
+void ResultWriter::LocalBuffer::Flush()
+{
+	if (!this->buffer.empty())
+	{
+		this->writer.Submit(this->buffer);
+	}
+}
+
+ResultWriter::ResultWriter(const char* szFilename, ResultFormat format, int decimals)
+	: fp(nullptr), format(format), decimals((std::min)((std::max)(decimals, 0), MaxDecimals)), isClosing(false), hasFailed(false)
+{
+	if (fopen_s(&this->fp, szFilename, "wb") != 0)
+	{
+		throw std::runtime_error("Couldn't create file.");
+	}
+
+	std::vector<char> header;
+	FormatHeader(format, header);
+	if (fwrite(header.data(), 1, header.size(), this->fp) != header.size())
+	{
+		fclose(this->fp);
+		throw std::runtime_error("Couldn't write file.");
+	}
+
+	this->thread = std::thread([this]() { this->WriteQueuedBuffers(); });
+}
+
+ResultWriter::~ResultWriter()
+{
+	try
+	{
+		this->Close();
+	}
+	catch (...)
+	{
+	}
+}
+
+void ResultWriter::Write(const FitResult& result)
+{
+	if (!this->ownBuffer)
+	{
+		this->ownBuffer.reset(new LocalBuffer(*this));
+	}
+
+	this->ownBuffer->Write(result);
+}
+
+void ResultWriter::Flush()
+{
+	if (this->ownBuffer)
+	{
+		this->ownBuffer->Flush();
+	}
+}
+
+void ResultWriter::Close()
+{
+	if (this->fp == nullptr)
+	{
+		return;
+	}
+
+	if (this->ownBuffer)
+	{
+		this->ownBuffer->Flush();
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->isClosing = true;
+	}
+
+	this->queueChanged.notify_all();
+	this->thread.join();
+
+	bool ok = fclose(this->fp) == 0 && !this->hasFailed;
+	this->fp = nullptr;
+	if (!ok)
+	{
+		throw std::runtime_error("Couldn't write the results.");
+	}
+}
+
+/*static*/bool ResultWriter::TryParseFormat(const char* sz, ResultFormat& format)
+{
+	if (_stricmp(sz, "csv") == 0)
+	{
+		format = ResultFormat::Csv;
+	}
+	else if (_stricmp(sz, "jsonl") == 0)
+	{
+		format = ResultFormat::JsonLines;
+	}
+	else if (_stricmp(sz, "bin") == 0)
+	{
+		format = ResultFormat::Binary;
+	}
+	else
+	{
+		return false;
+	}
+
+	return true;
+}
+
+/*static*/size_t ResultWriter::FormatDouble(char* dest, double value, int decimals)
+{
+	static const uint64_t powersOf10[MaxDecimals + 1] = { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000 };
+	if (!std::isfinite(value))
+	{
+		const char* text = value != value ? "nan" : (value > 0 ? "inf" : "-inf");
+		size_t length = strlen(text);
+		memcpy(dest, text, length);
+		return length;
+	}
+
+	decimals = (std::min)((std::max)(decimals, 0), MaxDecimals);
+	const uint64_t scale = powersOf10[decimals];
+	const double scaled = std::abs(value) * scale;
+	if (!(scaled < 9e15))
+	{
+		return (size_t)snprintf(dest, 32, "%.17g", value);
+	}
+
+	// round the exact product, not the rounded one - otherwise values just below a tie (like 0.0000005,
+	// which is 4.99999999999999977e-07) would be rounded up, unlike printf does
+	double n = floor(scaled);
+	const double fraction = (scaled - n) + ProductError(std::abs(value), (double)scale, scaled);
+	if (fraction > 0.5 || (fraction == 0.5 && fmod(n, 2) != 0))
+	{
+		n += 1;
+	}
+
+	char* p = dest;
+	if (value < 0)
+	{
+		*p++ = '-';
+	}
+
+	const uint64_t digits = (uint64_t)n;
+	p += FormatUnsigned(p, digits / scale);
+	if (decimals > 0)
+	{
+		*p++ = '.';
+		char fractionDigits[20];
+		size_t length = FormatUnsigned(fractionDigits, digits % scale);
+		memset(p, '0', decimals - length);
+		memcpy(p + decimals - length, fractionDigits, length);
+		p += decimals;
+	}
+
+	return p - dest;
+}
+
+/*static*/void ResultWriter::FormatHeader(ResultFormat format, std::vector<char>& buffer)
+{
+	if (format == ResultFormat::Csv)
+	{
+		AppendLiteral(buffer, "index,name,points,x0,y0,a,b,theta\n");
+	}
+	else if (format == ResultFormat::Binary)
+	{
+		const uint32_t versionAndSize[2] = { BinaryVersion, (uint32_t)sizeof(BinaryResultRecord) };
+		const char* p = reinterpret_cast<const char*>(versionAndSize);
+		buffer.insert(buffer.end(), BinaryMagic, BinaryMagic + sizeof(BinaryMagic));
+		buffer.insert(buffer.end(), p, p + sizeof(versionAndSize));
+	}
+}
+
+void ResultWriter::Format(const FitResult& result, std::vector<char>& buffer) const
+{
+	FormatResult(this->format, this->decimals, result, buffer);
+}
+
+/*static*/void ResultWriter::FormatResult(ResultFormat format, int decimals, const FitResult& result, std::vector<char>& buffer)
+{
+	decimals = (std::min)((std::max)(decimals, 0), MaxDecimals);
+	const double values[5] = { result.ellipse.x0, result.ellipse.y0, result.ellipse.a, result.ellipse.b, result.ellipse.theta };
+	if (format == ResultFormat::Binary)
+	{
+		BinaryResultRecord record = { result.index, result.pointCount, values[0], values[1], values[2], values[3], values[4] };
+		const char* p = reinterpret_cast<const char*>(&record);
+		buffer.insert(buffer.end(), p, p + sizeof(record));
+		return;
+	}
+
+	static const char* jsonKeys[5] = { ",\"x0\":", ",\"y0\":", ",\"a\":", ",\"b\":", ",\"theta\":" };
+	const char* name = result.name != nullptr ? result.name : "";
+	const bool isCsv = format == ResultFormat::Csv;
+	if (isCsv)
+	{
+		AppendUnsigned(buffer, result.index);
+		buffer.push_back(',');
+		AppendCsvString(buffer, name);
+		buffer.push_back(',');
+		AppendUnsigned(buffer, result.pointCount);
+	}
+	else
+	{
+		AppendLiteral(buffer, "{\"index\":");
+		AppendUnsigned(buffer, result.index);
+		AppendLiteral(buffer, ",\"name\":");
+		AppendJsonString(buffer, name);
+		AppendLiteral(buffer, ",\"points\":");
+		AppendUnsigned(buffer, result.pointCount);
+	}
+
+	for (int i = 0; i < 5; ++i)
+	{
+		char text[32];
+		if (isCsv)
+		{
+			buffer.push_back(',');
+			buffer.insert(buffer.end(), text, text + FormatDouble(text, values[i], decimals));
+		}
+		else
+		{
+			// JSON has no representation for nan and inf
+			AppendLiteral(buffer, jsonKeys[i]);
+			if (std::isfinite(values[i]))
+			{
+				buffer.insert(buffer.end(), text, text + FormatDouble(text, values[i], decimals));
+			}
+			else
+			{
+				AppendLiteral(buffer, "null");
+			}
+		}
+	}
+
+	if (!isCsv)
+	{
+		buffer.push_back('}');
+	}
+
+	buffer.push_back('\n');
+}
+
+void ResultWriter::Submit(std::vector<char>& buffer)
+{
+	std::unique_lock<std::mutex> lock(this->mutex);
+	this->queueChanged.wait(lock, [this]() { return this->queue.size() < MaxPendingBuffers; });
+	this->queue.push_back(std::move(buffer));
+	if (!this->freeBuffers.empty())
+	{
+		buffer = std::move(this->freeBuffers.back());
+		this->freeBuffers.pop_back();
+	}
+	else
+	{
+		buffer = std::vector<char>();
+		buffer.reserve(BufferSize);
+	}
+
+	lock.unlock();
+	this->queueChanged.notify_all();
+}
+
+void ResultWriter::WriteQueuedBuffers()
+{
+	std::unique_lock<std::mutex> lock(this->mutex);
+	for (;;)
+	{
+		this->queueChanged.wait(lock, [this]() { return !this->queue.empty() || this->isClosing; });
+		if (this->queue.empty())
+		{
+			break;
+		}
+
+		std::vector<char> buffer = std::move(this->queue.front());
+		this->queue.pop_front();
+		lock.unlock();
+		this->queueChanged.notify_all();
+
+		if (fwrite(buffer.data(), 1, buffer.size(), this->fp) != buffer.size())
+		{
+			this->hasFailed = true;
+		}
+
+		buffer.clear();
+		lock.lock();
+		if (this->queue.empty() && fflush(this->fp) != 0)
+		{
+			this->hasFailed = true;
+		}
+
+		this->freeBuffers.push_back(std::move(buffer));
+	}
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "ellipseParameters.h"
+
+namespace EllipseUtils
+{
+	enum class ResultFormat
+	{
+		/// <summary>	One line per result with a header line. </summary>
+		Csv,
+
+		/// <summary>	One JSON object per line. </summary>
+		JsonLines,
+
+		/// <summary>	A header (magic "ELLRES\r\n", version, record size) followed by fixed-size records
+		/// 			(index, point count, x0, y0, a, b, theta - all 8 bytes, little-endian), without the names. </summary>
+		Binary
+	};
+
+	/// <summary>	The result of one fit, as written by ResultWriter. </summary>
+	struct FitResult
+	{
+		/// <summary>	The position of the input in the batch, which allows to restore the order of the results. </summary>
+		uint64_t index;
+
+		/// <summary>	The name of the input (may be nullptr). </summary>
+		const char* name;
+		uint64_t pointCount;
+		EllipseParameters<double> ellipse;
+	};
+
+	/// <summary>	Writes fit results to a file. The results are formatted into large buffers, which a background
+	/// 			thread writes to the file, so the fitting threads neither wait for formatting with printf nor
+	/// 			for the I/O. Each thread which writes results uses its own LocalBuffer, the writer itself
+	/// 			only receives full buffers; results within a buffer stay in order, buffers of different threads
+	/// 			are interleaved (use FitResult::index to restore the order). Whenever the background thread
+	/// 			has written all queued buffers, it flushes the file, so readers see the results without delay. </summary>
+	class ResultWriter
+	{
+	public:
+		static const size_t BufferSize = 1 << 20;
+
+		/// <summary>	The number of full buffers which may wait for the background thread before writers block. </summary>
+		static const size_t MaxPendingBuffers = 4;
+
+		/// <summary>	A buffer for the results of one thread, which is handed to the writer when it is full, on
+		/// 			Flush and on destruction. </summary>
+		class LocalBuffer
+		{
+		private:
+			ResultWriter& writer;
+			std::vector<char> buffer;
+		public:
+			explicit LocalBuffer(ResultWriter& writer);
+			~LocalBuffer();
+
+			LocalBuffer(const LocalBuffer&) = delete;
+			LocalBuffer& operator=(const LocalBuffer&) = delete;
+
+			void Write(const FitResult& result);
+
+			void Flush();
+		};
+
+	private:
+		FILE* fp;
+		ResultFormat format;
+		int decimals;
+
+		std::mutex mutex;
+		std::condition_variable queueChanged;
+		std::deque<std::vector<char>> queue;
+		std::vector<std::vector<char>> freeBuffers;
+		bool isClosing;
+		bool hasFailed;
+		std::thread thread;
+
+		std::unique_ptr<LocalBuffer> ownBuffer;
+
+	public:
+		/// <summary>	Creates the file and writes the header (CSV and binary), throws std::runtime_error. Numbers are
+		/// 			written with the given number of decimals (CSV and JSON Lines). </summary>
+		ResultWriter(const char* szFilename, ResultFormat format, int decimals = 6);
+
+		/// <summary>	Closes the writer, errors are ignored - call Close to get them. </summary>
+		~ResultWriter();
+
+		ResultWriter(const ResultWriter&) = delete;
+		ResultWriter& operator=(const ResultWriter&) = delete;
+
+		/// <summary>	Writes a result through a buffer owned by the writer - for use from a single thread only. </summary>
+		void Write(const FitResult& result);
+
+		/// <summary>	Hands the results written with Write so far to the background thread. </summary>
+		void Flush();
+
+		/// <summary>	Writes all buffers (LocalBuffers must have been flushed or destroyed before) and closes the
+		/// 			file. Throws std::runtime_error if writing failed. </summary>
+		void Close();
+
+		/// <summary>	Parses "csv", "jsonl" or "bin". </summary>
+		static bool TryParseFormat(const char* sz, ResultFormat& format);
+
+		/// <summary>	Formats the value with a fixed number of decimals like printf("%.*f") (up to 9 decimals), but
+		/// 			without going through the locale and format string machinery. Values too large for the fast
+		/// 			path are formatted with "%.17g", non-finite values as "nan", "inf" or "-inf". Returns the number
+		/// 			of characters written to dest, which needs room for 32 characters. </summary>
+		static size_t FormatDouble(char* dest, double value, int decimals);
+
+		/// <summary>	Appends the header of the format (CSV and binary, nothing for JSON Lines) to the buffer. </summary>
+		static void FormatHeader(ResultFormat format, std::vector<char>& buffer);
+
+		/// <summary>	Appends the formatted result to the buffer, for writing results elsewhere than to a file. </summary>
+		static void FormatResult(ResultFormat format, int decimals, const FitResult& result, std::vector<char>& buffer);
+
+	private:
+		/// <summary>	Appends the formatted result to the buffer. </summary>
+		void Format(const FitResult& result, std::vector<char>& buffer) const;
+
+		/// <summary>	Queues the content of the buffer for writing, and replaces it with an empty buffer. Blocks if
+		/// 			MaxPendingBuffers buffers are waiting already. </summary>
+		void Submit(std::vector<char>& buffer);
+
+		void WriteQueuedBuffers();
+	};
+}
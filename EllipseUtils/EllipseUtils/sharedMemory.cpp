@@ -0,0 +1,179 @@
+#include "stdafx.h"
+#include "sharedMemory.h"
+#include <stdexcept>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace EllipseUtils;
+
+/// <summary>	Gets the name in the namespace of the operating system. </summary>
+static std::string GetSystemName(const char* szName)
+{
+#if defined(_WIN32)
+	return std::string("Local\\") + szName;
+#else
+	return std::string("/") + szName;
+#endif
+}
+
+SharedMemoryRegion::SharedMemoryRegion()
+	: data(nullptr), size(0), isOwner(false)
+{
+#if defined(_WIN32)
+	this->mappingHandle = nullptr;
+#endif
+}
+
+/*static*/SharedMemoryRegion SharedMemoryRegion::Create(const char* szName, size_t size)
+{
+	SharedMemoryRegion region;
+	region.name = GetSystemName(szName);
+	region.size = size;
+	region.isOwner = true;
+#if defined(_WIN32)
+	region.mappingHandle = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, (DWORD)((uint64_t)size >> 32), (DWORD)size, region.name.c_str());
+	if (region.mappingHandle == nullptr || GetLastError() == ERROR_ALREADY_EXISTS)
+	{
+		throw std::runtime_error("Couldn't create the shared memory.");
+	}
+
+	region.data = static_cast<char*>(MapViewOfFile(region.mappingHandle, FILE_MAP_ALL_ACCESS, 0, 0, size));
+#else
+	shm_unlink(region.name.c_str());
+	const int descriptor = shm_open(region.name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (descriptor < 0)
+	{
+		throw std::runtime_error("Couldn't create the shared memory.");
+	}
+
+	void* p = ftruncate(descriptor, (off_t)size) == 0 ? mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0) : MAP_FAILED;
+	close(descriptor);
+	region.data = p != MAP_FAILED ? static_cast<char*>(p) : nullptr;
+#endif
+	if (region.data == nullptr)
+	{
+		throw std::runtime_error("Couldn't map the shared memory.");
+	}
+
+	return region;
+}
+
+/*static*/SharedMemoryRegion SharedMemoryRegion::Open(const char* szName)
+{
+	SharedMemoryRegion region;
+	region.name = GetSystemName(szName);
+#if defined(_WIN32)
+	region.mappingHandle = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, region.name.c_str());
+	if (region.mappingHandle == nullptr)
+	{
+		throw std::runtime_error("Couldn't open the shared memory.");
+	}
+
+	region.data = static_cast<char*>(MapViewOfFile(region.mappingHandle, FILE_MAP_ALL_ACCESS, 0, 0, 0));
+	MEMORY_BASIC_INFORMATION info;
+	if (region.data != nullptr && VirtualQuery(region.data, &info, sizeof(info)) != 0)
+	{
+		region.size = info.RegionSize;
+	}
+#else
+	const int descriptor = shm_open(region.name.c_str(), O_RDWR, 0);
+	if (descriptor < 0)
+	{
+		throw std::runtime_error("Couldn't open the shared memory.");
+	}
+
+	struct stat status;
+	void* p = MAP_FAILED;
+	if (fstat(descriptor, &status) == 0 && status.st_size > 0)
+	{
+		region.size = (size_t)status.st_size;
+		p = mmap(nullptr, region.size, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+	}
+
+	close(descriptor);
+	region.data = p != MAP_FAILED ? static_cast<char*>(p) : nullptr;
+#endif
+	if (region.data == nullptr)
+	{
+		throw std::runtime_error("Couldn't map the shared memory.");
+	}
+
+	return region;
+}
+
+SharedMemoryRegion::~SharedMemoryRegion()
+{
+	this->Close();
+}
+
+SharedMemoryRegion::SharedMemoryRegion(SharedMemoryRegion&& other)
+	: name(std::move(other.name)), data(other.data), size(other.size), isOwner(other.isOwner)
+{
+#if defined(_WIN32)
+	this->mappingHandle = other.mappingHandle;
+	other.mappingHandle = nullptr;
+#endif
+	other.data = nullptr;
+	other.size = 0;
+	other.isOwner = false;
+}
+
+SharedMemoryRegion& SharedMemoryRegion::operator=(SharedMemoryRegion&& other)
+{
+	if (this != &other)
+	{
+		this->Close();
+		this->name = std::move(other.name);
+		this->data = other.data;
+		this->size = other.size;
+		this->isOwner = other.isOwner;
+#if defined(_WIN32)
+		this->mappingHandle = other.mappingHandle;
+		other.mappingHandle = nullptr;
+#endif
+		other.data = nullptr;
+		other.size = 0;
+		other.isOwner = false;
+	}
+
+	return *this;
+}
+
+void SharedMemoryRegion::Close()
+{
+#if defined(_WIN32)
+	// the mapping disappears with the last handle, there is no name to remove
+	if (this->data != nullptr)
+	{
+		UnmapViewOfFile(this->data);
+	}
+
+	if (this->mappingHandle != nullptr)
+	{
+		CloseHandle(this->mappingHandle);
+		this->mappingHandle = nullptr;
+	}
+#else
+	if (this->data != nullptr)
+	{
+		munmap(this->data, this->size);
+	}
+
+	if (this->isOwner)
+	{
+		shm_unlink(this->name.c_str());
+	}
+#endif
+	this->data = nullptr;
+	this->size = 0;
+	this->isOwner = false;
+}
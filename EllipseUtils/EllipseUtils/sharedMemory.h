@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace EllipseUtils
+{
+	/// <summary>	A named region of memory shared between processes (shm_open on POSIX systems, a named file mapping
+	/// 			backed by the paging file on Windows), mapped read-write. The region is unmapped in the destructor;
+	/// 			the process which created it also removes the name. </summary>
+	class SharedMemoryRegion
+	{
+	private:
+		std::string name;
+		char* data;
+		size_t size;
+		bool isOwner;
+#if defined(_WIN32)
+		void* mappingHandle;
+#endif
+
+	public:
+		/// <summary>	Creates a zero-filled region, replacing a region left over with the same name. The name is a
+		/// 			plain identifier without slashes. Throws std::runtime_error. </summary>
+		static SharedMemoryRegion Create(const char* szName, size_t size);
+
+		/// <summary>	Maps an existing region, throws std::runtime_error. </summary>
+		static SharedMemoryRegion Open(const char* szName);
+
+		~SharedMemoryRegion();
+
+		SharedMemoryRegion(SharedMemoryRegion&& other);
+		SharedMemoryRegion& operator=(SharedMemoryRegion&& other);
+
+		SharedMemoryRegion(const SharedMemoryRegion&) = delete;
+		SharedMemoryRegion& operator=(const SharedMemoryRegion&) = delete;
+
+		char* GetData() const
+		{
+			return this->data;
+		}
+
+		size_t GetSize() const
+		{
+			return this->size;
+		}
+
+	private:
+		SharedMemoryRegion();
+
+		void Close();
+	};
+}
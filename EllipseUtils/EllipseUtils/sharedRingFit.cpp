@@ -0,0 +1,202 @@
+#include "stdafx.h"
+#include "sharedRingFit.h"
+#include "leastSquareEllipseFit.h"
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+
+using namespace EllipseUtils;
+
+/// <summary>	The points of a slot start after the FitResponse, at the next cache line. </summary>
+static const size_t SlotPointsOffset = 64;
+
+/// <summary>	Waits by spinning first (the answer is often a few microseconds away), then by yielding, then by
+/// 			sleeping, so a side which waits long does not burn a core. </summary>
+class RingBackoff
+{
+private:
+	int count = 0;
+public:
+	void Pause()
+	{
+		++this->count;
+		if (this->count < 256)
+		{
+			std::atomic_signal_fence(std::memory_order_seq_cst);
+		}
+		else if (this->count < 1024)
+		{
+			std::this_thread::yield();
+		}
+		else
+		{
+			std::this_thread::sleep_for(std::chrono::microseconds(50));
+		}
+	}
+};
+
+static uint64_t GetSlotSize(uint32_t slotCapacity)
+{
+	return (SlotPointsOffset + 2 * sizeof(double) * (uint64_t)slotCapacity + 63) / 64 * 64;
+}
+
+static char* GetSlotAddress(SharedRingHeader* header, uint64_t sequence)
+{
+	return reinterpret_cast<char*>(header) + sizeof(SharedRingHeader) + (sequence % header->slotCount) * header->slotSize;
+}
+
+SharedRingFitServer::SharedRingFitServer(const char* szName, uint32_t slotCount, uint32_t slotCapacity)
+	: region(SharedMemoryRegion::Create(szName, (size_t)(sizeof(SharedRingHeader) + (std::max)(slotCount, 1u) * GetSlotSize(slotCapacity))))
+{
+	if (!std::atomic<uint64_t>().is_lock_free())
+	{
+		throw std::runtime_error("The ring needs lock-free 64-bit atomics.");
+	}
+
+	// the region is zero-filled, so the indices start at 0
+	this->header = reinterpret_cast<SharedRingHeader*>(this->region.GetData());
+	this->header->slotCount = (std::max)(slotCount, 1u);
+	this->header->slotCapacity = slotCapacity;
+	this->header->slotSize = GetSlotSize(slotCapacity);
+	std::atomic_thread_fence(std::memory_order_release);
+	this->header->magic = SharedRingHeader::Magic;
+}
+
+void SharedRingFitServer::Run()
+{
+	uint64_t next = this->header->completed.load(std::memory_order_relaxed);
+	while (this->header->isClosing.load(std::memory_order_relaxed) == 0)
+	{
+		RingBackoff backoff;
+		while (this->header->submitted.load(std::memory_order_acquire) == next)
+		{
+			if (this->header->isClosing.load(std::memory_order_relaxed) != 0)
+			{
+				return;
+			}
+
+			backoff.Pause();
+		}
+
+		char* slot = GetSlotAddress(this->header, next);
+		FitResponse* response = reinterpret_cast<FitResponse*>(slot);
+		const uint32_t count = (std::min)(response->pointCount, this->header->slotCapacity);
+		const double* x = reinterpret_cast<const double*>(slot + SlotPointsOffset);
+		const double* y = x + this->header->slotCapacity;
+		const EllipseParameters<double> ellipse = FitEllipse<double>(LeastSquareEllipseFitter<double>::PointAccessorFromTwoArrays(x, y, count));
+		response->status = count < LeastSquareEllipseFitter<double>::MinPointCount ? FitStatus::TooFewPoints : ellipse.IsValid() ? FitStatus::Ok : FitStatus::NoEllipse;
+
+		response->type = FitMessageType::Fit;
+		response->id = (uint32_t)next;
+		response->x0 = ellipse.x0;
+		response->y0 = ellipse.y0;
+		response->a = ellipse.a;
+		response->b = ellipse.b;
+		response->theta = ellipse.theta;
+		this->header->completed.store(++next, std::memory_order_release);
+	}
+}
+
+void SharedRingFitServer::Stop()
+{
+	this->header->isClosing.store(1);
+}
+
+uint64_t SharedRingFitServer::GetCompletedCount() const
+{
+	return this->header->completed.load();
+}
+
+SharedRingFitClient::SharedRingFitClient(const char* szName)
+	: region(SharedMemoryRegion::Open(szName))
+{
+	this->header = reinterpret_cast<SharedRingHeader*>(this->region.GetData());
+	if (this->region.GetSize() < sizeof(SharedRingHeader) || this->header->magic != SharedRingHeader::Magic ||
+		this->region.GetSize() < sizeof(SharedRingHeader) + (size_t)this->header->slotCount * this->header->slotSize)
+	{
+		throw std::runtime_error("The shared memory is not a fit ring.");
+	}
+
+	std::atomic_thread_fence(std::memory_order_acquire);
+	this->submitted = this->header->submitted.load();
+	this->collected = this->submitted;
+	if (this->header->completed.load() != this->submitted)
+	{
+		throw std::runtime_error("The ring still holds sets of another client.");
+	}
+}
+
+SharedRingFitClient::Slot SharedRingFitClient::AcquireSlot()
+{
+	if (this->submitted - this->collected >= this->header->slotCount)
+	{
+		throw std::logic_error("All slots hold results which have not been received.");
+	}
+
+	char* slot = this->GetSlot(this->submitted);
+	Slot result;
+	result.sequence = this->submitted;
+	result.x = reinterpret_cast<double*>(slot + SlotPointsOffset);
+	result.y = result.x + this->header->slotCapacity;
+	result.capacity = this->header->slotCapacity;
+	return result;
+}
+
+void SharedRingFitClient::Submit(const Slot& slot, uint32_t pointCount)
+{
+	if (slot.sequence != this->submitted || pointCount > this->header->slotCapacity)
+	{
+		throw std::logic_error("Invalid slot or point count.");
+	}
+
+	reinterpret_cast<FitResponse*>(this->GetSlot(slot.sequence))->pointCount = pointCount;
+	this->header->submitted.store(++this->submitted, std::memory_order_release);
+}
+
+FitResponse SharedRingFitClient::ReceiveResult()
+{
+	if (this->collected == this->submitted)
+	{
+		throw std::logic_error("There is no set to receive the result of.");
+	}
+
+	RingBackoff backoff;
+	while (this->header->completed.load(std::memory_order_acquire) <= this->collected)
+	{
+		if (this->header->isClosing.load(std::memory_order_relaxed) != 0)
+		{
+			throw std::runtime_error("The server has stopped.");
+		}
+
+		backoff.Pause();
+	}
+
+	FitResponse response;
+	memcpy(&response, this->GetSlot(this->collected++), sizeof(response));
+	return response;
+}
+
+FitResponse SharedRingFitClient::Fit(const double* x, const double* y, size_t count)
+{
+	if (count > this->header->slotCapacity)
+	{
+		throw std::invalid_argument("Too many points for a slot.");
+	}
+
+	// the result received would be that of the oldest set in flight, not of this one
+	if (this->collected != this->submitted)
+	{
+		throw std::logic_error("Sets submitted with Submit are still in flight.");
+	}
+
+	Slot slot = this->AcquireSlot();
+	std::copy(x, x + count, slot.x);
+	std::copy(y, y + count, slot.y);
+	this->Submit(slot, (uint32_t)count);
+	return this->ReceiveResult();
+}
+
+char* SharedRingFitClient::GetSlot(uint64_t sequence) const
+{
+	return GetSlotAddress(this->header, sequence);
+}
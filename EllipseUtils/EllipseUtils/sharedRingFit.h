@@ -0,0 +1,118 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include "fitServer.h"
+#include "sharedMemory.h"
+
+namespace EllipseUtils
+{
+	/// <summary>	The layout of a fit ring in shared memory: this header (three cache lines, so the indices written
+	/// 			by the two sides do not share a line), followed by slotCount slots of slotSize bytes. A slot holds a
+	/// 			FitResponse (the client sets pointCount, the server the rest), padded to 64 bytes, then the x and
+	/// 			then the y coordinates, slotCapacity doubles each. </summary>
+	struct SharedRingHeader
+	{
+		static const uint64_t Magic = 0x474e495254494645ull;	// "EFITRING"
+
+		uint64_t magic;
+		uint32_t slotCount;
+		uint32_t slotCapacity;
+		uint64_t slotSize;
+		uint64_t reserved[5];
+
+		/// <summary>	The number of sets submitted by the client (written by the client only). </summary>
+		std::atomic<uint64_t> submitted;
+		char padding1[56];
+
+		/// <summary>	The number of sets fitted by the server (written by the server only). </summary>
+		std::atomic<uint64_t> completed;
+		char padding2[56];
+
+		std::atomic<uint32_t> isClosing;
+		char padding3[60];
+	};
+
+	static_assert(sizeof(SharedRingHeader) == 256, "The header must keep its layout.");
+
+	/// <summary>	A single-producer/single-consumer ring of point set slots in shared memory. The client writes the
+	/// 			points of a set directly into a free slot and publishes it by advancing "submitted"; the server
+	/// 			fits the points in place (no copy on either side beyond the client filling the slot) and writes
+	/// 			the result into the slot before advancing "completed". Slot k is reused for set k + slotCount,
+	/// 			once the client has collected the result of set k. Both sides wait by spinning briefly, then
+	/// 			yielding, then sleeping. </summary>
+	class SharedRingFitServer
+	{
+	private:
+		SharedMemoryRegion region;
+		SharedRingHeader* header;
+
+	public:
+		/// <summary>	Creates the shared memory for slotCount slots of up to slotCapacity points each, throws
+		/// 			std::runtime_error. </summary>
+		SharedRingFitServer(const char* szName, uint32_t slotCount, uint32_t slotCapacity);
+
+		/// <summary>	Fits the submitted sets until Stop is called. </summary>
+		void Run();
+
+		/// <summary>	Makes Run return, may be called from any thread. </summary>
+		void Stop();
+
+		/// <summary>	The number of sets fitted so far. </summary>
+		uint64_t GetCompletedCount() const;
+	};
+
+	/// <summary>	The client side of the ring - there must be only one client at a time. Results are collected in
+	/// 			the order of submission. </summary>
+	class SharedRingFitClient
+	{
+	public:
+		/// <summary>	A free slot to fill before submitting it. </summary>
+		struct Slot
+		{
+			uint64_t sequence;
+			double* x;
+			double* y;
+			uint32_t capacity;
+		};
+
+	private:
+		SharedMemoryRegion region;
+		SharedRingHeader* header;
+
+		/// <summary>	The number of results collected, all slots before it may be reused. </summary>
+		uint64_t collected;
+		uint64_t submitted;
+
+	public:
+		/// <summary>	Opens the ring of a server, throws std::runtime_error if it is not a ring or if another client
+		/// 			left sets in it. </summary>
+		explicit SharedRingFitClient(const char* szName);
+
+		uint32_t GetSlotCapacity() const
+		{
+			return this->header->slotCapacity;
+		}
+
+		/// <summary>	Gets the next slot. The result of the set which used the slot before must have been received, so
+		/// 			a client submitting more sets than there are slots must call ReceiveResult in between; throws
+		/// 			std::logic_error if all slots hold results which have not been received. </summary>
+		Slot AcquireSlot();
+
+		/// <summary>	Publishes the first pointCount points of the slot (at most its capacity). </summary>
+		void Submit(const Slot& slot, uint32_t pointCount);
+
+		/// <summary>	Waits for the result of the oldest set which has not been collected yet. The id of the response
+		/// 			is the lower 32 bits of the sequence number of the set. Throws std::logic_error if there is no
+		/// 			such set and std::runtime_error if the server stops. </summary>
+		FitResponse ReceiveResult();
+
+		/// <summary>	Copies the points into a slot, submits it and waits for the result; the number of points must
+		/// 			not exceed GetSlotCapacity. Throws std::logic_error if results of sets submitted with Submit
+		/// 			have not been received yet. </summary>
+		FitResponse Fit(const double* x, const double* y, size_t count);
+
+	private:
+		char* GetSlot(uint64_t sequence) const;
+	};
+}
@@ -20,6 +20,8 @@
 #include <string>
 #include <sstream>  
 #include <fstream>
+#include <chrono>
+#include <random>
 
 
 // TODO: reference additional headers your program requires here
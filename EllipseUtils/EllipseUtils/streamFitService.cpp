@@ -0,0 +1,297 @@
+#include "stdafx.h"
+#include "streamFitService.h"
+#include "leastSquareEllipseFit.h"
+#include "textPointReader.h"
+#include "workStealingThreadPool.h"
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+
+#if defined(_WIN32)
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+using namespace EllipseUtils;
+
+StreamFrameParser::StreamFrameParser(StreamFraming framing)
+	: framing(framing), prefixLength(0), payloadSize(0)
+{
+}
+
+/// <summary>	Checks whether the line consists of white space only. </summary>
+static bool IsBlankLine(const char* begin, const char* end)
+{
+	for (const char* p = begin; p < end; ++p)
+	{
+		if (*p != ' ' && *p != '\t' && *p != '\r')
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void StreamFrameParser::Feed(const char* data, size_t size, const FrameFunction& onFrame)
+{
+	const char* end = data + size;
+	if (this->framing == StreamFraming::BlankLine)
+	{
+		const char* p = data;
+		for (;;)
+		{
+			const char* newline = TextPointReader::FindNewline(p, end);
+			if (newline == end)
+			{
+				this->partialLine.insert(this->partialLine.end(), p, end);
+				return;
+			}
+
+			if (!this->partialLine.empty())
+			{
+				this->partialLine.insert(this->partialLine.end(), p, newline);
+				this->AddLine(this->partialLine.data(), this->partialLine.data() + this->partialLine.size(), onFrame);
+				this->partialLine.clear();
+			}
+			else
+			{
+				this->AddLine(p, newline, onFrame);
+			}
+
+			p = newline + 1;
+		}
+	}
+
+	while (data < end)
+	{
+		if (this->prefixLength < sizeof(this->prefix))
+		{
+			const size_t n = (std::min)(sizeof(this->prefix) - this->prefixLength, (size_t)(end - data));
+			memcpy(this->prefix + this->prefixLength, data, n);
+			this->prefixLength += n;
+			data += n;
+			if (this->prefixLength < sizeof(this->prefix))
+			{
+				return;
+			}
+
+			const uint32_t count = (uint32_t)(unsigned char)this->prefix[0] | ((uint32_t)(unsigned char)this->prefix[1] << 8) |
+				((uint32_t)(unsigned char)this->prefix[2] << 16) | ((uint32_t)(unsigned char)this->prefix[3] << 24);
+			if (count > MaxFramePoints)
+			{
+				throw std::runtime_error("The frame is too large.");
+			}
+
+			this->payloadSize = (size_t)count * 2 * sizeof(double);
+			this->frame.reserve(this->payloadSize);
+		}
+
+		// a frame without points is complete with its prefix, so it is emitted below even if the prefix ends the data
+
+		const size_t n = (std::min)(this->payloadSize - this->frame.size(), (size_t)(end - data));
+		this->frame.insert(this->frame.end(), data, data + n);
+		data += n;
+		if (this->frame.size() == this->payloadSize)
+		{
+			onFrame(this->frame);
+			this->frame.clear();
+			this->prefixLength = 0;
+		}
+	}
+}
+
+void StreamFrameParser::Finish(const FrameFunction& onFrame)
+{
+	if (this->framing == StreamFraming::BlankLine)
+	{
+		if (!this->partialLine.empty())
+		{
+			this->AddLine(this->partialLine.data(), this->partialLine.data() + this->partialLine.size(), onFrame);
+			this->partialLine.clear();
+		}
+
+		if (!this->frame.empty())
+		{
+			onFrame(this->frame);
+			this->frame.clear();
+		}
+
+		return;
+	}
+
+	if (this->prefixLength > 0)
+	{
+		throw std::runtime_error("The stream ends within a frame.");
+	}
+}
+
+void StreamFrameParser::AddLine(const char* begin, const char* end, const FrameFunction& onFrame)
+{
+	if (!IsBlankLine(begin, end))
+	{
+		this->frame.insert(this->frame.end(), begin, end);
+		this->frame.push_back('\n');
+	}
+	else if (!this->frame.empty())
+	{
+		onFrame(this->frame);
+		this->frame.clear();
+	}
+}
+
+/*static*/void StreamFrameParser::GetPoints(StreamFraming framing, const std::vector<char>& frame, std::vector<double>& xPoints, std::vector<double>& yPoints)
+{
+	if (framing == StreamFraming::BlankLine)
+	{
+		TextPointReader::Parse(frame.data(), frame.data() + frame.size(), xPoints, yPoints);
+		return;
+	}
+
+	const size_t count = frame.size() / (2 * sizeof(double));
+	xPoints.reserve(xPoints.size() + count);
+	yPoints.reserve(yPoints.size() + count);
+	for (size_t i = 0; i < count; ++i)
+	{
+		double xy[2];
+		memcpy(xy, frame.data() + i * sizeof(xy), sizeof(xy));
+		xPoints.push_back(xy[0]);
+		yPoints.push_back(xy[1]);
+	}
+}
+
+/*static*/bool StreamFrameParser::TryParseFraming(const char* sz, StreamFraming& framing)
+{
+	if (_stricmp(sz, "text") == 0)
+	{
+		framing = StreamFraming::BlankLine;
+	}
+	else if (_stricmp(sz, "binary") == 0)
+	{
+		framing = StreamFraming::LengthPrefixed;
+	}
+	else
+	{
+		return false;
+	}
+
+	return true;
+}
+
+/// <summary>	Reads what is available (at most size bytes) without waiting for the buffer to fill, unlike fread.
+/// 			Returns 0 at the end of the stream. </summary>
+static size_t ReadAvailable(FILE* input, char* buffer, size_t size)
+{
+#if defined(_WIN32)
+	const int n = _read(_fileno(input), buffer, (unsigned int)size);
+#else
+	const ssize_t n = read(fileno(input), buffer, size);
+#endif
+	if (n < 0)
+	{
+		throw std::runtime_error("Couldn't read the input.");
+	}
+
+	return (size_t)n;
+}
+
+/*static*/StreamFitStatistics StreamFitService::Run(FILE* input, FILE* output, const StreamFitOptions& options)
+{
+#if defined(_WIN32)
+	// binary frames and results must not go through the text mode translation
+	_setmode(_fileno(input), _O_BINARY);
+	_setmode(_fileno(output), _O_BINARY);
+#endif
+	StreamFitStatistics statistics;
+	auto start = std::chrono::steady_clock::now();
+	std::mutex mutex;
+	std::condition_variable setFinished;
+	size_t pendingCount = 0;
+	bool hasFailed = false;
+	uint64_t nextIndexToWrite = 0;
+	std::map<uint64_t, std::vector<char>> reorderBuffer;
+
+	auto writeLocked = [&](const std::vector<char>& text)
+	{
+		hasFailed = hasFailed || fwrite(text.data(), 1, text.size(), output) != text.size();
+	};
+
+	std::vector<char> header;
+	ResultWriter::FormatHeader(options.format, header);
+	writeLocked(header);
+
+	// declared last, so it is destroyed (waiting for the tasks) before the state the tasks use
+	WorkStealingThreadPool pool(options.threadCount);
+	auto onFrame = [&](std::vector<char>& frame)
+	{
+		const uint64_t index = statistics.setCount++;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			setFinished.wait(lock, [&]() { return pendingCount < (std::max)(options.maxPendingSets, (size_t)1); });
+			++pendingCount;
+		}
+
+		std::shared_ptr<std::vector<char>> content = std::make_shared<std::vector<char>>(std::move(frame));
+		pool.Submit([&, index, content]()
+		{
+			std::vector<double> x, y;
+			StreamFrameParser::GetPoints(options.framing, *content, x, y);
+			content->clear();
+			content->shrink_to_fit();
+
+			const EllipseParameters<double> ellParams = FitEllipse<double>(LeastSquareEllipseFitter<double>::PointAccessorFromTwoArrays(x.data(), y.data(), x.size()));
+
+			std::vector<char> text;
+			ResultWriter::FormatResult(options.format, options.decimals, FitResult{ index, nullptr, x.size(), ellParams }, text);
+
+			std::lock_guard<std::mutex> lock(mutex);
+			statistics.pointCount += x.size();
+			statistics.failedCount += ellParams.IsValid() ? 0 : 1;
+			if (!options.isOrdered)
+			{
+				writeLocked(text);
+			}
+			else
+			{
+				reorderBuffer[index] = std::move(text);
+				for (auto it = reorderBuffer.begin(); it != reorderBuffer.end() && it->first == nextIndexToWrite; it = reorderBuffer.erase(it))
+				{
+					writeLocked(it->second);
+					++nextIndexToWrite;
+				}
+			}
+
+			fflush(output);
+			--pendingCount;
+			setFinished.notify_all();
+		});
+	};
+
+	StreamFrameParser parser(options.framing);
+	std::vector<char> buffer(1 << 16);
+	for (;;)
+	{
+		const size_t n = ReadAvailable(input, buffer.data(), buffer.size());
+		if (n == 0)
+		{
+			break;
+		}
+
+		parser.Feed(buffer.data(), n, onFrame);
+	}
+
+	parser.Finish(onFrame);
+	pool.Wait();
+	if (hasFailed || fflush(output) != 0)
+	{
+		throw std::runtime_error("Couldn't write the results.");
+	}
+
+	statistics.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return statistics;
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <vector>
+#include "resultWriter.h"
+
+namespace EllipseUtils
+{
+	enum class StreamFraming
+	{
+		/// <summary>	Text with one point "x y" per line, the sets are separated by one or more blank lines. </summary>
+		BlankLine,
+
+		/// <summary>	Binary frames: the number of points (uint32_t) followed by x0 y0 x1 y1 ... as doubles, all
+		/// 			little-endian. </summary>
+		LengthPrefixed
+	};
+
+	/// <summary>	Splits a byte stream into the frames of the point sets. The parser keeps its state between the
+	/// 			calls of Feed, so the stream can be fed in pieces of any size as they arrive. </summary>
+	class StreamFrameParser
+	{
+	public:
+		/// <summary>	Receives a frame - the text of a set or the payload of a binary frame, see GetPoints. The
+		/// 			function may take the content of the vector. </summary>
+		typedef std::function<void(std::vector<char>& frame)> FrameFunction;
+
+		/// <summary>	Binary frames with more points are rejected, so a corrupt length cannot exhaust the memory. </summary>
+		static const uint32_t MaxFramePoints = 1 << 26;
+
+	private:
+		StreamFraming framing;
+		std::vector<char> frame;
+
+		/// <summary>	Text: the start of a line which is not complete yet. </summary>
+		std::vector<char> partialLine;
+
+		/// <summary>	Binary: the bytes of the length prefix read so far, and the size of the payload. </summary>
+		char prefix[4];
+		size_t prefixLength;
+		size_t payloadSize;
+
+	public:
+		explicit StreamFrameParser(StreamFraming framing);
+
+		void Feed(const char* data, size_t size, const FrameFunction& onFrame);
+
+		/// <summary>	Ends the stream, which emits the last set of a text stream. Throws std::runtime_error if a
+		/// 			binary frame is incomplete. </summary>
+		void Finish(const FrameFunction& onFrame);
+
+		/// <summary>	Gets the points of a frame (appending). </summary>
+		static void GetPoints(StreamFraming framing, const std::vector<char>& frame, std::vector<double>& xPoints, std::vector<double>& yPoints);
+
+		/// <summary>	Parses "text" or "binary". </summary>
+		static bool TryParseFraming(const char* sz, StreamFraming& framing);
+
+	private:
+		void AddLine(const char* begin, const char* end, const FrameFunction& onFrame);
+	};
+
+	struct StreamFitOptions
+	{
+		StreamFraming framing = StreamFraming::BlankLine;
+		ResultFormat format = ResultFormat::JsonLines;
+		int decimals = 6;
+
+		/// <summary>	If set, the results are written in the order of the sets, otherwise as soon as they are ready. </summary>
+		bool isOrdered = true;
+
+		/// <summary>	The number of fitting threads, 0 means one per core. </summary>
+		unsigned int threadCount = 0;
+
+		/// <summary>	The number of sets which may be parsed or fitted at the same time (or wait for an earlier set in
+		/// 			ordered mode) before reading from the input pauses. </summary>
+		size_t maxPendingSets = 256;
+	};
+
+	struct StreamFitStatistics
+	{
+		uint64_t setCount = 0;
+		uint64_t pointCount = 0;
+
+		/// <summary>	The sets for which no ellipse was found (written with NaN parameters). </summary>
+		uint64_t failedCount = 0;
+		double seconds = 0;
+	};
+
+	/// <summary>	Reads framed point sets from an input stream and writes one fit result per set (FitResult::index is
+	/// 			the position of the set in the stream) to an output stream. The calling thread reads whatever
+	/// 			input is available and splits it into frames; parsing the points and fitting are tasks of a
+	/// 			WorkStealingThreadPool, and each task writes its result (or hands it to the reorder buffer) when
+	/// 			it is done, so reading, parsing, fitting and writing overlap. </summary>
+	class StreamFitService
+	{
+	public:
+		/// <summary>	Runs until the end of the input. Throws std::runtime_error if reading or writing fails or the
+		/// 			stream ends within a binary frame; the sets before are written. </summary>
+		static StreamFitStatistics Run(FILE* input, FILE* output, const StreamFitOptions& options);
+	};
+}
@@ -0,0 +1,257 @@
+#include "stdafx.h"
+#include "textPointReader.h"
+#include "mappedFile.h"
+#include <cstdint>
+#include <cstdlib>
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define ELLIPSEUTILS_SSE2
+#include <emmintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+using namespace EllipseUtils;
+
+static inline bool IsBlank(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+static inline bool IsDigit(char c)
+{
+	return static_cast<unsigned char>(c - '0') < 10;
+}
+
+#if defined(ELLIPSEUTILS_SSE2)
+static inline int CountTrailingZeros(unsigned int mask)
+{
+#if defined(_MSC_VER)
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return (int)index;
+#else
+	return __builtin_ctz(mask);
+#endif
+}
+#endif
+
+/*static*/void TextPointReader::ReadFile(const char* szFilename, std::vector<double>& xPoints, std::vector<double>& yPoints)
+{
+	MappedFile file(szFilename, MappedFile::AccessPattern::Sequential);
+	const char* begin = file.GetData();
+	const char* end = begin + file.GetSize();
+
+	size_t lineCount = EstimateLineCount(begin, end);
+	xPoints.reserve(xPoints.size() + lineCount + lineCount / 16);
+	yPoints.reserve(yPoints.size() + lineCount + lineCount / 16);
+	Parse(begin, end, xPoints, yPoints);
+}
+
+/*static*/void TextPointReader::Parse(const char* begin, const char* end, std::vector<double>& xPoints, std::vector<double>& yPoints)
+{
+	const char* p = begin;
+	while (p < end)
+	{
+		while (p < end && IsBlank(*p))
+		{
+			++p;
+		}
+
+		double x, y;
+		const char* q = ParseDouble(p, end, x);
+		if (q != nullptr)
+		{
+			while (q < end && IsBlank(*q))
+			{
+				++q;
+			}
+
+			q = ParseDouble(q, end, y);
+			if (q != nullptr)
+			{
+				xPoints.push_back(x);
+				yPoints.push_back(y);
+				p = q;
+			}
+		}
+
+		// usually we are at the newline already
+		if (p < end && *p != '\n')
+		{
+			p = FindNewline(p, end);
+		}
+
+		++p;
+	}
+}
+
+/*static*/size_t TextPointReader::EstimateLineCount(const char* begin, const char* end)
+{
+	const size_t SampleSize = 1024 * 1024;
+	const size_t size = end - begin;
+	if (size <= SampleSize)
+	{
+		return CountNewlines(begin, end) + 1;
+	}
+
+	size_t count = CountNewlines(begin, begin + SampleSize);
+	return (size_t)((double)count * size / SampleSize) + 1;
+}
+
+/*static*/const char* TextPointReader::FindNewline(const char* p, const char* end)
+{
+#if defined(ELLIPSEUTILS_SSE2)
+	const __m128i newline = _mm_set1_epi8('\n');
+	for (; end - p >= 16; p += 16)
+	{
+		int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), newline));
+		if (mask != 0)
+		{
+			return p + CountTrailingZeros(mask);
+		}
+	}
+#endif
+
+	while (p < end && *p != '\n')
+	{
+		++p;
+	}
+
+	return p;
+}
+
+/*static*/size_t TextPointReader::CountNewlines(const char* p, const char* end)
+{
+	size_t count = 0;
+#if defined(ELLIPSEUTILS_SSE2)
+	const __m128i newline = _mm_set1_epi8('\n');
+	while (end - p >= 16)
+	{
+		// the byte-wise counters (0 or -1 per match) can take at most 255 blocks before they overflow
+		__m128i counters = _mm_setzero_si128();
+		for (int block = 0; block < 255 && end - p >= 16; ++block, p += 16)
+		{
+			counters = _mm_sub_epi8(counters, _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), newline));
+		}
+
+		__m128i sums = _mm_sad_epu8(counters, _mm_setzero_si128());
+		count += (size_t)_mm_cvtsi128_si32(sums) + (size_t)_mm_cvtsi128_si32(_mm_srli_si128(sums, 8));
+	}
+#endif
+
+	for (; p < end; ++p)
+	{
+		count += *p == '\n';
+	}
+
+	return count;
+}
+
+/*static*/const char* TextPointReader::ParseDouble(const char* p, const char* end, double& value)
+{
+	static const double powersOf10[] =
+	{
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+
+	const char* start = p;
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+'))
+	{
+		negative = *p == '-';
+		++p;
+	}
+
+	uint64_t mantissa = 0;
+	int significantDigits = 0, exponent = 0;
+	bool anyDigit = false, truncated = false;
+	for (; p < end && IsDigit(*p); ++p)
+	{
+		anyDigit = true;
+		if (significantDigits < 19)
+		{
+			mantissa = mantissa * 10 + (*p - '0');
+			significantDigits += mantissa != 0;
+		}
+		else
+		{
+			truncated |= *p != '0';
+			++exponent;
+		}
+	}
+
+	if (p < end && *p == '.')
+	{
+		for (++p; p < end && IsDigit(*p); ++p)
+		{
+			anyDigit = true;
+			if (significantDigits < 19)
+			{
+				mantissa = mantissa * 10 + (*p - '0');
+				significantDigits += mantissa != 0;
+				--exponent;
+			}
+			else
+			{
+				truncated |= *p != '0';
+			}
+		}
+	}
+
+	if (anyDigit && p < end && (*p == 'e' || *p == 'E'))
+	{
+		// the exponent only belongs to the number if there is at least one digit
+		const char* q = p + 1;
+		bool negativeExponent = false;
+		if (q < end && (*q == '-' || *q == '+'))
+		{
+			negativeExponent = *q == '-';
+			++q;
+		}
+
+		if (q < end && IsDigit(*q))
+		{
+			int e = 0;
+			for (; q < end && IsDigit(*q); ++q)
+			{
+				e = e < 100000 ? e * 10 + (*q - '0') : e;
+			}
+
+			exponent += negativeExponent ? -e : e;
+			p = q;
+		}
+	}
+
+	// Clinger's fast path: both the mantissa and the power of ten are exact doubles, so the result is correctly rounded
+	if (anyDigit && !truncated && mantissa <= (uint64_t(1) << 53) && exponent >= -22 && exponent <= 22)
+	{
+		double v = (double)mantissa;
+		v = exponent < 0 ? v / powersOf10[-exponent] : v * powersOf10[exponent];
+		value = negative ? -v : v;
+		return p;
+	}
+
+	// strtod needs a terminated string - copy the token (which may also be something like "inf" or "nan")
+	if (!anyDigit)
+	{
+		p = start;
+		while (p < end && !IsBlank(*p) && *p != '\n')
+		{
+			++p;
+		}
+	}
+
+	std::string token(start, p);
+	char* tokenEnd;
+	double v = strtod(token.c_str(), &tokenEnd);
+	if (tokenEnd == token.c_str())
+	{
+		return nullptr;
+	}
+
+	value = v;
+	return start + (tokenEnd - token.c_str());
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <vector>
+
+namespace EllipseUtils
+{
+	/// <summary>	Reads text files with one point "x y" per line (lines which do not start with two numbers are
+	/// 			skipped, like sscanf("%lf %lf") would). The file is memory-mapped and parsed in place: newlines are
+	/// 			searched with SSE2 and the numbers are converted with a fast path which is exact for up to 15
+	/// 			significant digits, everything else goes through strtod. </summary>
+	class TextPointReader
+	{
+	public:
+		/// <summary>	Appends the points of the file to the vectors, which are reserved from an estimate of the line
+		/// 			count first. Throws std::runtime_error if the file cannot be read. </summary>
+		static void ReadFile(const char* szFilename, std::vector<double>& xPoints, std::vector<double>& yPoints);
+
+		/// <summary>	Appends the points in the text [begin, end) to the vectors. </summary>
+		static void Parse(const char* begin, const char* end, std::vector<double>& xPoints, std::vector<double>& yPoints);
+
+		/// <summary>	Estimates the number of lines from the newlines in the first megabyte. </summary>
+		static size_t EstimateLineCount(const char* begin, const char* end);
+
+		/// <summary>	Parses a number starting exactly at p. Returns the position after the number, or nullptr if
+		/// 			there is no number. </summary>
+		static const char* ParseDouble(const char* p, const char* end, double& value);
+
+		/// <summary>	Returns the position of the next '\n' in [p, end), or end. </summary>
+		static const char* FindNewline(const char* p, const char* end);
+
+		/// <summary>	Counts the '\n' in [p, end). </summary>
+		static size_t CountNewlines(const char* p, const char* end);
+	};
+}
@@ -0,0 +1,167 @@
+#include "stdafx.h"
+#include "workStealingThreadPool.h"
+#include "parallelFor.h"
+
+using namespace EllipseUtils;
+
+static thread_local const WorkStealingThreadPool* currentPool = nullptr;
+static thread_local int currentWorkerIndex = -1;
+
+WorkStealingThreadPool::WorkStealingThreadPool(unsigned int threadCount)
+	: pendingCount(0), queuedCount(0), nextQueue(0), isStopping(false)
+{
+	threadCount = threadCount > 0 ? threadCount : GetDefaultThreadCount();
+	for (unsigned int i = 0; i < threadCount; ++i)
+	{
+		this->workers.emplace_back(new Worker());
+	}
+
+	// the workers are started when all queues exist, since they look into each other's queues
+	for (unsigned int i = 0; i < threadCount; ++i)
+	{
+		this->workers[i]->thread = std::thread([this, i]() { this->Run(i); });
+	}
+}
+
+WorkStealingThreadPool::~WorkStealingThreadPool()
+{
+	{
+		std::unique_lock<std::mutex> lock(this->mutex);
+		this->allDone.wait(lock, [this]() { return this->pendingCount == 0; });
+		this->isStopping = true;
+	}
+
+	this->workAvailable.notify_all();
+	for (auto& worker : this->workers)
+	{
+		worker->thread.join();
+	}
+}
+
+void WorkStealingThreadPool::Submit(std::function<void()> task)
+{
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		++this->pendingCount;
+	}
+
+	const size_t index = currentPool == this ? (size_t)currentWorkerIndex : this->nextQueue.fetch_add(1) % this->workers.size();
+	{
+		Worker& worker = *this->workers[index];
+		std::lock_guard<std::mutex> lock(worker.mutex);
+		worker.tasks.push_back(std::move(task));
+	}
+
+	{
+		// incremented under the lock, so a worker cannot miss the task between checking and going to sleep
+		std::lock_guard<std::mutex> lock(this->mutex);
+		++this->queuedCount;
+	}
+
+	this->workAvailable.notify_one();
+}
+
+void WorkStealingThreadPool::Wait()
+{
+	std::unique_lock<std::mutex> lock(this->mutex);
+	this->allDone.wait(lock, [this]() { return this->pendingCount == 0; });
+	if (this->exception)
+	{
+		std::exception_ptr e = this->exception;
+		this->exception = nullptr;
+		std::rethrow_exception(e);
+	}
+}
+
+std::vector<WorkStealingThreadPool::WorkerStatistics> WorkStealingThreadPool::GetStatistics() const
+{
+	std::vector<WorkerStatistics> statistics;
+	for (const auto& worker : this->workers)
+	{
+		statistics.push_back(worker->statistics);
+	}
+
+	return statistics;
+}
+
+/*static*/int WorkStealingThreadPool::GetWorkerIndex()
+{
+	return currentWorkerIndex;
+}
+
+void WorkStealingThreadPool::Run(unsigned int index)
+{
+	currentPool = this;
+	currentWorkerIndex = (int)index;
+	for (;;)
+	{
+		std::function<void()> task;
+		if (this->TryTakeTask(index, task))
+		{
+			try
+			{
+				task();
+			}
+			catch (...)
+			{
+				std::lock_guard<std::mutex> lock(this->mutex);
+				if (!this->exception)
+				{
+					this->exception = std::current_exception();
+				}
+			}
+
+			task = nullptr;
+			++this->workers[index]->statistics.executed;
+			std::lock_guard<std::mutex> lock(this->mutex);
+			if (--this->pendingCount == 0)
+			{
+				this->allDone.notify_all();
+			}
+
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(this->mutex);
+		this->workAvailable.wait(lock, [this]() { return this->isStopping || this->queuedCount.load() > 0; });
+		if (this->isStopping && this->queuedCount.load() == 0)
+		{
+			break;
+		}
+	}
+
+	currentPool = nullptr;
+	currentWorkerIndex = -1;
+}
+
+bool WorkStealingThreadPool::TryTakeTask(unsigned int index, std::function<void()>& task)
+{
+	{
+		Worker& own = *this->workers[index];
+		std::lock_guard<std::mutex> lock(own.mutex);
+		if (!own.tasks.empty())
+		{
+			task = std::move(own.tasks.back());
+			own.tasks.pop_back();
+			--this->queuedCount;
+			return true;
+		}
+	}
+
+	const size_t count = this->workers.size();
+	for (size_t i = 1; i < count; ++i)
+	{
+		Worker& victim = *this->workers[(index + i) % count];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if (!victim.tasks.empty())
+		{
+			task = std::move(victim.tasks.front());
+			victim.tasks.pop_front();
+			--this->queuedCount;
+			++this->workers[index]->statistics.stolen;
+			return true;
+		}
+	}
+
+	return false;
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace EllipseUtils
+{
+	/// <summary>	A thread pool where each worker has its own queue of tasks. A worker runs the most recently queued
+	/// 			task of its own queue first (its data is likely to be in the cache still); when its queue is
+	/// 			empty, it steals the oldest task from the queue of another worker. Tasks submitted by a task go
+	/// 			to the queue of the worker running it, tasks submitted from other threads are distributed
+	/// 			round-robin. </summary>
+	class WorkStealingThreadPool
+	{
+	public:
+		struct WorkerStatistics
+		{
+			/// <summary>	The number of tasks the worker has run. </summary>
+			uint64_t executed;
+
+			/// <summary>	The number of those tasks which it took from the queue of another worker. </summary>
+			uint64_t stolen;
+		};
+
+	private:
+		struct Worker
+		{
+			std::mutex mutex;
+			std::deque<std::function<void()>> tasks;
+			WorkerStatistics statistics = WorkerStatistics{ 0, 0 };
+			std::thread thread;
+		};
+
+		std::vector<std::unique_ptr<Worker>> workers;
+		std::mutex mutex;
+		std::condition_variable workAvailable;
+		std::condition_variable allDone;
+
+		/// <summary>	The tasks which have been submitted and are not finished yet (guarded by mutex). </summary>
+		size_t pendingCount;
+
+		/// <summary>	The tasks which are in one of the queues. </summary>
+		std::atomic<size_t> queuedCount;
+		std::atomic<size_t> nextQueue;
+		bool isStopping;
+		std::exception_ptr exception;
+
+	public:
+		/// <summary>	Starts threadCount workers, 0 means one per core. </summary>
+		explicit WorkStealingThreadPool(unsigned int threadCount = 0);
+
+		/// <summary>	Waits for all tasks and stops the workers, exceptions of tasks are ignored. </summary>
+		~WorkStealingThreadPool();
+
+		WorkStealingThreadPool(const WorkStealingThreadPool&) = delete;
+		WorkStealingThreadPool& operator=(const WorkStealingThreadPool&) = delete;
+
+		unsigned int GetThreadCount() const
+		{
+			return (unsigned int)this->workers.size();
+		}
+
+		void Submit(std::function<void()> task);
+
+		/// <summary>	Waits until all submitted tasks (including the ones submitted by tasks) are finished, then
+		/// 			re-throws the first exception thrown by a task, if any. Must not be called from a task. </summary>
+		void Wait();
+
+		/// <summary>	Gets the statistics of the workers - only meaningful after Wait. </summary>
+		std::vector<WorkerStatistics> GetStatistics() const;
+
+		/// <summary>	Gets the index of the worker which runs the calling task, or -1 if the caller is not a worker of
+		/// 			any pool. This allows tasks to use per-worker state without synchronization. </summary>
+		static int GetWorkerIndex();
+
+	private:
+		void Run(unsigned int index);
+
+		bool TryTakeTask(unsigned int index, std::function<void()>& task);
+	};
+}
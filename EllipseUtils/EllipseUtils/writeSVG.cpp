@@ -1,114 +1,178 @@
 #include "stdafx.h"
 #include "writeSVG.h"
+#include "ellipseGeometry.h"
+#include "resultWriter.h"
 
-void write_svg_five_points_and_ellipse(const char* szFilename, std::function<bool(double&, double&, bool&)> getPoints, double x0, double y0, double a, double b, double theta)
+/// <summary>	The decimals for coordinates of points - a thousandth of a unit of the view box is plenty. </summary>
+static const int PointDecimals = 3;
+
+void get_svg_size_for_ellipse(double x0, double y0, double a, double b, double theta, int& xsize, int& ysize)
 {
-	int xsize = (int)(abs(x0) + (std::max)(abs(a), abs(b)) + 0.5);
-	int ysize = (int)(abs(y0) + (std::max)(abs(a), abs(b)) + 0.5);
-	write_svg_five_points_and_ellipse(szFilename, xsize, ysize, getPoints, x0, y0, a, b, theta);
+	double minX, minY, maxX, maxY;
+	EllipseUtils::EllipseGeometry<double>::BoundingBox(EllipseUtils::EllipseParameters<double>{ x0, y0, a, b, theta }, minX, minY, maxX, maxY);
+
+	// the canvas starts at the origin, so the side of the box farther from it decides (also for negative coordinates)
+	xsize = (int)ceil((std::max)(fabs(minX), fabs(maxX)));
+	ysize = (int)ceil((std::max)(fabs(minY), fabs(maxY)));
 }
 
-void write_svg_five_points_and_ellipse(const char* szFilename, int xsize, int ysize, std::function<bool(double&, double&, bool&)> getPoints, double x0, double y0, double a, double b, double theta)
+SvgWriter::SvgWriter(const char* szFilename)
+	: svg(nullptr), pointRadius(0), pointColor(nullptr), hasPoints(false)
 {
-	FILE * svg;
-
-	if (xsize <= 0 || ysize <= 0)
-		throw std::logic_error("Error: invalid image size in write_svg.");
-
-	/* open file */
-	/*if (wcscmp(szwFilename, L"-") == 0) svg = stdout;
-	else svg = _wfopen(szwFilename, L"w");*/
-	fopen_s(&svg, szFilename, "w");
-	if (svg == NULL) throw std::logic_error("Error: unable to open SVG output file.");
-
-	/* write SVG header */
-	fprintf(svg, "<?xml version=\"1.0\" standalone=\"no\"?>\n");
-	fprintf(svg, "<!DOCTYPE svg PUBLIC \"-//W3C//DTD SVG 1.1//EN\"\n");
-	fprintf(svg, " \"http://www.w3.org/Graphics/SVG/1.1/DTD/svg11.dtd\">\n");
-	fprintf(svg, "<svg width=\"%dpx\" height=\"%dpx\" ", xsize, ysize);
-	fprintf(svg, "version=\"1.1\"\n xmlns=\"http://www.w3.org/2000/svg\" ");
-	fprintf(svg, "xmlns:xlink=\"http://www.w3.org/1999/xlink\">\n");
-
-	/* write line segments */
-	//for (i = 0; i<n; i++)
-	const double radiusPoint = 2;
-	for (;;)
+	if (fopen_s(&this->svg, szFilename, "w") != 0 || this->svg == nullptr)
 	{
-		double x, y; bool isSpecial;
-		bool b = getPoints(x, y, isSpecial);
-		if (b == false)
-		{
-			break;
-		}
-
-		if (isSpecial == false)
-		{
-			fprintf(svg, "<circle cx=\"%f\" cy=\"%f\" r=\"%f\" fill=\"black\" />\n", x, y, radiusPoint);
-		}
-		else
-		{
-			fprintf(svg, "<circle cx=\"%f\" cy=\"%f\" r=\"%f\" fill=\"red\" />\n", x, y, radiusPoint * 2);
-		}
+		throw std::logic_error("Error: unable to open SVG output file.");
 	}
 
-	fprintf(svg,
-		"<g transform=\"translate(%lf %lf)  rotate(%lf)\">\n"
-		"<ellipse cx=\"%lf\" cy= \"%lf\" rx=\"%lf\" ry=\"%lf\" fill=\"none\" stroke=\"purple\" stroke-width=\"3\" />\n"
-		"</g>\n",
-		x0, y0,
-		180 * theta / M_PI,
-		0.0, 0.0, a, b);
+	this->buffer.reserve(BufferSize + 256);
+}
 
+SvgWriter::~SvgWriter()
+{
+	if (this->svg != nullptr)
+	{
+		fclose(this->svg);
+	}
+}
 
-	/* close SVG file */
-	fprintf(svg, "</svg>\n");
-	if (svg != stdout && fclose(svg) == EOF)
-		throw std::logic_error("Error: unable to close file while writing SVG file.");
+void SvgWriter::WriteHeader(const char* szSizeAttributes)
+{
+	this->Append(
+		"<?xml version=\"1.0\" standalone=\"no\"?>\n"
+		"<!DOCTYPE svg PUBLIC \"-//W3C//DTD SVG 1.1//EN\"\n"
+		" \"http://www.w3.org/Graphics/SVG/1.1/DTD/svg11.dtd\">\n"
+		"<svg ");
+	this->Append(szSizeAttributes);
+	this->Append(
+		" version=\"1.1\"\n xmlns=\"http://www.w3.org/2000/svg\" "
+		"xmlns:xlink=\"http://www.w3.org/1999/xlink\">\n");
 }
 
-void write_svg_points_and_ellipse(const char* szFilename, int viewBoxX, int viewBoxY, int viewBoxW, int viewBoxH, std::function<bool(double&, double&)> getPoints, double x0, double y0, double a, double b, double theta)
+void SvgWriter::BeginPoints(double radius, const char* color)
 {
-	FILE * svg;
+	this->pointRadius = radius;
+	this->pointColor = color;
+	this->hasPoints = false;
+}
 
-	/* open file */
-	if (fopen_s(&svg, szFilename, "w") != 0)
+void SvgWriter::AddPoint(double x, double y)
+{
+	if (!this->hasPoints)
 	{
-		throw std::logic_error("Error: unable to open SVG output file.");
+		this->Append("<path fill=\"none\" stroke=\"");
+		this->Append(this->pointColor);
+		this->Append("\" stroke-width=\"");
+		this->Append(2 * this->pointRadius, PointDecimals);
+		this->Append("\" stroke-linecap=\"round\" d=\"");
+		this->hasPoints = true;
+	}
+
+	this->Append("M");
+	this->Append(x, PointDecimals);
+	this->Append(" ");
+	this->Append(y, PointDecimals);
+	this->Append("h0\n");
+}
+
+void SvgWriter::EndPoints()
+{
+	if (this->hasPoints)
+	{
+		this->Append("\" />\n");
+		this->hasPoints = false;
+	}
+}
+
+void SvgWriter::WriteCircle(double x, double y, double radius, const char* color)
+{
+	this->Append("<circle cx=\"");
+	this->Append(x, 6);
+	this->Append("\" cy=\"");
+	this->Append(y, 6);
+	this->Append("\" r=\"");
+	this->Append(radius, 6);
+	this->Append("\" fill=\"");
+	this->Append(color);
+	this->Append("\" />\n");
+}
+
+void SvgWriter::WriteEllipse(double x0, double y0, double a, double b, double theta)
+{
+	this->Append("<g transform=\"translate(");
+	this->Append(x0, 6);
+	this->Append(" ");
+	this->Append(y0, 6);
+	this->Append(")  rotate(");
+	this->Append(180 * theta / M_PI, 6);
+	this->Append(")\">\n<ellipse cx=\"0\" cy= \"0\" rx=\"");
+	this->Append(a, 6);
+	this->Append("\" ry=\"");
+	this->Append(b, 6);
+	this->Append("\" fill=\"none\" stroke=\"purple\" stroke-width=\"3\" />\n</g>\n");
+}
+
+void SvgWriter::Close()
+{
+	this->Append("</svg>\n");
+	this->Flush();
+	FILE* svg = this->svg;
+	this->svg = nullptr;
+	if (fclose(svg) == EOF)
+	{
+		throw std::logic_error("Error: unable to close file while writing SVG file.");
 	}
+}
+
+void SvgWriter::Append(const char* sz)
+{
+	this->buffer.insert(this->buffer.end(), sz, sz + strlen(sz));
+	if (this->buffer.size() >= BufferSize)
+	{
+		this->Flush();
+	}
+}
+
+void SvgWriter::Append(double value, int decimals)
+{
+	char text[32];
+	size_t length = EllipseUtils::ResultWriter::FormatDouble(text, value, decimals);
+	this->buffer.insert(this->buffer.end(), text, text + length);
+}
 
-	/* write SVG header */
-	fprintf(svg, "<?xml version=\"1.0\" standalone=\"no\"?>\n");
-	fprintf(svg, "<!DOCTYPE svg PUBLIC \"-//W3C//DTD SVG 1.1//EN\"\n");
-	fprintf(svg, " \"http://www.w3.org/Graphics/SVG/1.1/DTD/svg11.dtd\">\n");
-	fprintf(svg, "<svg  viewBox=\"%i %i %i %i\" ", viewBoxX, viewBoxY, viewBoxW, viewBoxH);
-	fprintf(svg, "version=\"1.1\"\n xmlns=\"http://www.w3.org/2000/svg\" ");
-	fprintf(svg, "xmlns:xlink=\"http://www.w3.org/1999/xlink\">\n");
-
-	/* write line segments */
-	const double radiusPoint = 2;
-	for (;;)
+void SvgWriter::Flush()
+{
+	if (!this->buffer.empty() && fwrite(this->buffer.data(), 1, this->buffer.size(), this->svg) != this->buffer.size())
 	{
-		double x, y;
-		bool b = getPoints(x, y);
-		if (b == false)
-		{
-			break;
-		}
-
-		fprintf(svg, "<circle cx=\"%f\" cy=\"%f\" r=\"%f\" fill=\"black\" />\n", x, y, radiusPoint);
+		throw std::logic_error("Error: unable to write SVG file.");
 	}
 
-	fprintf(svg,
-		"<g transform=\"translate(%lf %lf)  rotate(%lf)\">\n"
-		"<ellipse cx=\"%lf\" cy= \"%lf\" rx=\"%lf\" ry=\"%lf\" fill=\"none\" stroke=\"purple\" stroke-width=\"3\" />\n"
-		"</g>\n",
-		x0, y0,
-		180 * theta / M_PI,
-		0.0, 0.0, a, b);
+	this->buffer.clear();
+}
 
+PointOccupancyGrid::PointOccupancyGrid(double x, double y, double width, double height, double cellSize)
+	: x(x), y(y), invCellSize(1 / cellSize)
+{
+	this->columns = (size_t)(std::max)(ceil(width * this->invCellSize), 1.0);
+	this->rows = (size_t)(std::max)(ceil(height * this->invCellSize), 1.0);
+	this->occupied.resize((this->columns * this->rows + 63) / 64, 0);
+}
 
-		/* close SVG file */
-		fprintf(svg, "</svg>\n");
-		if (svg != stdout && fclose(svg) == EOF)
-			throw std::logic_error("Error: unable to close file while writing SVG file.");
-}
\ No newline at end of file
+bool PointOccupancyGrid::TryOccupy(double px, double py)
+{
+	const double column = floor((px - this->x) * this->invCellSize);
+	const double row = floor((py - this->y) * this->invCellSize);
+	if (!(column >= 0 && column < this->columns && row >= 0 && row < this->rows))
+	{
+		return false;
+	}
+
+	const size_t cell = (size_t)row * this->columns + (size_t)column;
+	const uint64_t bit = uint64_t(1) << (cell % 64);
+	if ((this->occupied[cell / 64] & bit) != 0)
+	{
+		return false;
+	}
+
+	this->occupied[cell / 64] |= bit;
+	return true;
+}
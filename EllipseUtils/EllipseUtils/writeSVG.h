@@ -1,6 +1,157 @@
 #pragma once
 
-void write_svg_five_points_and_ellipse(const char* szFilename, int xsize, int ysize, std::function<bool(double&, double&, bool&)> getPoints, double x0, double y0, double a, double b, double theta);
-void write_svg_five_points_and_ellipse(const char* szFilename, std::function<bool(double&, double&, bool&)> getPoints, double x0, double y0, double a, double b, double theta);
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <stdexcept>
+#include <vector>
 
-void write_svg_points_and_ellipse(const char* szwFilename, int viewBoxX, int viewBoxY, int viewBoxW, int viewBoxH, std::function<bool(double&, double&)> getPoints, double x0, double y0, double a, double b, double theta);
\ No newline at end of file
+/// <summary>	Options for write_svg_points_and_ellipse. </summary>
+struct SvgOptions
+{
+	/// <summary>	If set, only the first point in each cell of a grid over the view box is written and points outside
+	/// 			of the view box are left out, so the size of the output is bounded by the number of cells regardless
+	/// 			of the number of points. </summary>
+	bool decimate = false;
+
+	/// <summary>	The number of grid cells along the longer side of the view box (the resolution the SVG is meant
+	/// 			to be looked at). The cells are never smaller than a point. </summary>
+	int decimationResolution = 2048;
+};
+
+/// <summary>	Writes an SVG file through a large buffer. Numbers are formatted with a fixed number of decimals
+/// 			without going through printf. </summary>
+class SvgWriter
+{
+public:
+	static const size_t BufferSize = 1 << 20;
+
+private:
+	FILE* svg;
+	std::vector<char> buffer;
+	double pointRadius;
+	const char* pointColor;
+	bool hasPoints;
+
+public:
+	/// <summary>	Creates the file, throws std::logic_error if that fails. </summary>
+	explicit SvgWriter(const char* szFilename);
+	~SvgWriter();
+
+	SvgWriter(const SvgWriter&) = delete;
+	SvgWriter& operator=(const SvgWriter&) = delete;
+
+	void WriteHeader(const char* szSizeAttributes);
+
+	/// <summary>	Points are written as zero-length segments with round caps in a single path, which renders like
+	/// 			circles of the given radius but takes a fraction of the space of a circle element per point. </summary>
+	void BeginPoints(double radius, const char* color);
+	void AddPoint(double x, double y);
+	void EndPoints();
+
+	void WriteCircle(double x, double y, double radius, const char* color);
+	void WriteEllipse(double x0, double y0, double a, double b, double theta);
+
+	/// <summary>	Writes the closing tag and closes the file, throws std::logic_error on failure. </summary>
+	void Close();
+
+	void Append(const char* sz);
+	void Append(double value, int decimals);
+
+private:
+	void Flush();
+};
+
+/// <summary>	The cells of a grid over a rectangle which already contain a point. </summary>
+class PointOccupancyGrid
+{
+private:
+	double x, y;
+	double invCellSize;
+	size_t columns, rows;
+	std::vector<uint64_t> occupied;
+
+public:
+	PointOccupancyGrid(double x, double y, double width, double height, double cellSize);
+
+	/// <summary>	Marks the cell of the point as occupied; returns false if it was occupied already. Points outside
+	/// 			of the rectangle are never accepted, they would not be visible anyway. </summary>
+	bool TryOccupy(double px, double py);
+};
+
+/// <summary>	Gets an image size which contains the ellipse. </summary>
+void get_svg_size_for_ellipse(double x0, double y0, double a, double b, double theta, int& xsize, int& ysize);
+
+template <typename tGetPoints>
+void write_svg_five_points_and_ellipse(const char* szFilename, int xsize, int ysize, tGetPoints getPoints, double x0, double y0, double a, double b, double theta)
+{
+	if (xsize <= 0 || ysize <= 0)
+		throw std::logic_error("Error: invalid image size in write_svg.");
+
+	SvgWriter svg(szFilename);
+	char size[64];
+	snprintf(size, sizeof(size), "width=\"%dpx\" height=\"%dpx\"", xsize, ysize);
+	svg.WriteHeader(size);
+
+	const double radiusPoint = 2;
+	for (;;)
+	{
+		double x, y; bool isSpecial;
+		if (!getPoints(x, y, isSpecial))
+		{
+			break;
+		}
+
+		svg.WriteCircle(x, y, isSpecial ? radiusPoint * 2 : radiusPoint, isSpecial ? "red" : "black");
+	}
+
+	svg.WriteEllipse(x0, y0, a, b, theta);
+	svg.Close();
+}
+
+/// <summary>	Writes the points and the ellipse, with the size of the image determined from the bounding box of the ellipse. </summary>
+template <typename tGetPoints>
+void write_svg_five_points_and_ellipse(const char* szFilename, tGetPoints getPoints, double x0, double y0, double a, double b, double theta)
+{
+	int xsize, ysize;
+	get_svg_size_for_ellipse(x0, y0, a, b, theta, xsize, ysize);
+	write_svg_five_points_and_ellipse(szFilename, xsize, ysize, getPoints, x0, y0, a, b, theta);
+}
+
+/// <summary>	Writes the points returned by getPoints(x, y) (until it returns false) and the ellipse. </summary>
+template <typename tGetPoints>
+void write_svg_points_and_ellipse(const char* szFilename, int viewBoxX, int viewBoxY, int viewBoxW, int viewBoxH, tGetPoints getPoints, double x0, double y0, double a, double b, double theta, const SvgOptions& options = SvgOptions())
+{
+	SvgWriter svg(szFilename);
+	char viewBox[96];
+	snprintf(viewBox, sizeof(viewBox), "viewBox=\"%i %i %i %i\"", viewBoxX, viewBoxY, viewBoxW, viewBoxH);
+	svg.WriteHeader(viewBox);
+
+	const double radiusPoint = 2;
+	std::unique_ptr<PointOccupancyGrid> grid;
+	if (options.decimate)
+	{
+		double cellSize = (std::max)((double)(std::max)(viewBoxW, viewBoxH) / (std::max)(options.decimationResolution, 1), radiusPoint);
+		grid.reset(new PointOccupancyGrid(viewBoxX, viewBoxY, viewBoxW, viewBoxH, cellSize));
+	}
+
+	svg.BeginPoints(radiusPoint, "black");
+	for (;;)
+	{
+		double x, y;
+		if (!getPoints(x, y))
+		{
+			break;
+		}
+
+		if (!grid || grid->TryOccupy(x, y))
+		{
+			svg.AddPoint(x, y);
+		}
+	}
+
+	svg.EndPoints();
+	svg.WriteEllipse(x0, y0, a, b, theta);
+	svg.Close();
+}